@@ -47,7 +47,7 @@ public:
     {
         for( size_t Stream = 0; Stream < D3D11_SO_STREAM_COUNT; ++Stream )
         {
-            SAFE_DELETE_ARRAY( m_SemanticString[Stream] );
+            FreeEffectMemory( m_SemanticString[Stream] );
         }
     }
 
@@ -122,8 +122,8 @@ protected:
         if( len == 0 )
             return S_OK;
 
-        SAFE_DELETE_ARRAY( m_SemanticString[Stream] );
-        VN( m_SemanticString[Stream] = new char[len + 1] );
+        FreeEffectMemory( m_SemanticString[Stream] );
+        VN( m_SemanticString[Stream] = (char*) AllocateEffectMemory(len + 1) );
         strcpy_s( m_SemanticString[Stream], len + 1, pString );
 
         LPSTR pSemantic = m_SemanticString[Stream];
@@ -43,6 +43,7 @@ namespace D3DX11Effects
 struct SBaseBlock;
 struct SShaderBlock;
 struct SPassBlock;
+struct SPassRuntime;
 struct SClassInstance;
 struct SInterface;
 struct SShaderResource;
@@ -56,15 +57,18 @@ struct SRasterizerBlock;
 struct SString;
 struct SD3DShaderVTable;
 struct SClassInstanceGlobalVariable;
+class CConstantBufferRing;
 
 struct SAssignment;
 struct SVariable;
 struct SGlobalVariable;
 struct SAnnotation;
 struct SConstantBuffer;
+struct SConstantBufferRuntime;
 
 class CEffect;
 class CEffectLoader;
+class CEffectSnapshot;
 
 enum ELhsType;
 
@@ -280,7 +284,7 @@ struct SType : public ID3DX11EffectType
 // Represents a type structure for a single element.
 // It seems pretty trivial, but it has a different virtual table which enables
 // us to accurately represent a type that consists of a single element
-struct SSingleElementType : public ID3DX11EffectType
+struct SSingleElementType : public ID3DX11EffectType, public CEffectAllocated
 {
     SType *pType;
 
@@ -310,9 +314,14 @@ struct SBaseBlock
     uint32_t        AssignmentCount;
     SAssignment     *pAssignments;
 
+    // Hash of the state desc of render state and sampler blocks, computed in BindToDevice and
+    // whenever the state object is recreated. Equal hashes mean equal descs, across effects.
+    uint64_t        IdentityHash;
+
     SBaseBlock();
 
     bool ApplyAssignments(CEffect *pEffect);
+    void UpdateIdentityHash();
 
     inline SSamplerBlock *AsSampler() const
     {
@@ -338,10 +347,10 @@ struct SBaseBlock
         return (SRasterizerBlock*) this;
     }
 
-    inline SPassBlock *AsPass() const
+    inline SPassRuntime *AsPass() const
     {
         assert( BlockType == EBT_Pass );
-        return (SPassBlock*) this;
+        return (SPassRuntime*) this;
     }
 };
 
@@ -401,8 +410,15 @@ struct SGroup : public ID3DX11EffectGroup
     IUNKNOWN_IMP(SGroup, ID3DX11EffectGroup, IUnknown);
 };
 
-struct SPassBlock : SBaseBlock, public ID3DX11EffectPass
+// The part of a pass that Apply reads. The records of a technique are allocated together in
+// the runtime heap, where PackRuntimeData gathers the records of the whole effect into one array.
+struct SPassRuntime : SBaseBlock
 {
+    CEffect     *pEffect;
+
+    bool        InitiallyValid;         // validity of all state objects and shaders in pass upon BindToDevice
+    bool        HasDependencies;        // if pass expressions or pass state blocks have dependencies on variables (if true, IsValid != InitiallyValid possibly)
+
     struct
     {
         ID3D11BlendState*       pBlendState;
@@ -431,21 +447,25 @@ struct SPassBlock : SBaseBlock, public ID3DX11EffectPass
         SShaderBlock            *pHullShaderBlock;
     }           BackingStore;
 
-    char        *pName;
+    SPassRuntime();
 
-    uint32_t    AnnotationCount;
-    SAnnotation *pAnnotations;
+    void ApplyPassAssignments();
+    bool CheckShaderDependencies( _In_ const SShaderBlock* pBlock );
+    bool CheckDependencies();
+};
 
-    CEffect     *pEffect;
+struct SPassBlock : public ID3DX11EffectPass
+{
+    SPassRuntime    *pRuntime;
 
-    bool        InitiallyValid;         // validity of all state objects and shaders in pass upon BindToDevice
-    bool        HasDependencies;        // if pass expressions or pass state blocks have dependencies on variables (if true, IsValid != InitiallyValid possibly)
+    char            *pName;
+
+    uint32_t        AnnotationCount;
+    SAnnotation     *pAnnotations;
 
     SPassBlock();
 
-    void ApplyPassAssignments();
-    bool CheckShaderDependencies( _In_ const SShaderBlock* pBlock );
-    bool CheckDependencies();
+    void GetIdentity(_Out_ D3DX11_EFFECT_PASS_IDENTITY *pIdentity);
 
     template<EObjectType EShaderType>
     HRESULT GetShaderDescHelper(_Out_ D3DX11_PASS_SHADER_DESC *pDesc);
@@ -520,13 +540,34 @@ struct SInterface
     }
 };
 
+// Stores pObject in *ppSlot. A reference is taken on pObject unless Weak is set, and the reference
+// held on the previous object is dropped unless *pIsWeak says that none was taken.
+template<class T>
+inline void BindObject(_Inout_ T **ppSlot, _Inout_ bool *pIsWeak, _In_opt_ T *pObject, _In_ bool Weak)
+{
+    if (!Weak)
+    {
+        SAFE_ADDREF(pObject);
+    }
+    if (!*pIsWeak)
+    {
+        SAFE_RELEASE(*ppSlot);
+    }
+    *ppSlot = pObject;
+    *pIsWeak = Weak;
+}
+
 struct SShaderResource
 {
     ID3D11ShaderResourceView *pShaderResource;
+    Timer                    LastModifiedTime;  // effect time at which pShaderResource was last changed
+    bool                     IsWeakReference;   // pShaderResource was set without a reference (D3DX11_EFFECT_BINDING_WEAK_REFERENCES)
 
     SShaderResource() 
     {
         pShaderResource = nullptr;
+        LastModifiedTime = 0;
+        IsWeakReference = false;
     }
 
 };
@@ -534,10 +575,14 @@ struct SShaderResource
 struct SUnorderedAccessView
 {
     ID3D11UnorderedAccessView *pUnorderedAccessView;
+    Timer                     LastModifiedTime; // effect time at which pUnorderedAccessView was last changed
+    bool                      IsWeakReference;  // pUnorderedAccessView was set without a reference (D3DX11_EFFECT_BINDING_WEAK_REFERENCES)
 
     SUnorderedAccessView() 
     {
         pUnorderedAccessView = nullptr;
+        LastModifiedTime = 0;
+        IsWeakReference = false;
     }
 
 };
@@ -565,21 +610,36 @@ template<class T, class D3DTYPE> struct SShaderDependency
     T       *ppFXPointers;              // Array of ptrs to FX objects (CBs, SShaderResources, etc)
     D3DTYPE *ppD3DObjects;              // Array of ptrs to matching D3D objects
 
+    Timer   LastAppliedTime;            // effect time at which the range was last set on the context; 0 forces the next set
+
     SShaderDependency()
     {
         StartIndex = Count = 0;
+        LastAppliedTime = 0;
 
         ppD3DObjects = nullptr;
         ppFXPointers = nullptr;
     }
 };
 
-typedef SShaderDependency<SConstantBuffer*, ID3D11Buffer*> SShaderCBDependency;
+typedef SShaderDependency<SConstantBufferRuntime*, ID3D11Buffer*> SShaderCBDependency;
 typedef SShaderDependency<SSamplerBlock*, ID3D11SamplerState*> SShaderSamplerDependency;
 typedef SShaderDependency<SShaderResource*, ID3D11ShaderResourceView*> SShaderResourceDependency;
 typedef SShaderDependency<SUnorderedAccessView*, ID3D11UnorderedAccessView*> SUnorderedAccessViewDependency;
 typedef SShaderDependency<SInterface*, ID3D11ClassInstance*> SInterfaceDependency;
 
+// Index of the pipeline stage a shader block is applied to
+enum EShaderStage
+{
+    ESS_Vertex,
+    ESS_Hull,
+    ESS_Domain,
+    ESS_Geometry,
+    ESS_Pixel,
+    ESS_Compute,
+    ESS_Count,
+};
+
 // Shader VTables are used to eliminate branching in ApplyShaderBlock.
 // The effect owns three D3DShaderVTables, one for PS, one for VS, and one for GS.
 struct SD3DShaderVTable
@@ -589,6 +649,8 @@ struct SD3DShaderVTable
     void ( __stdcall ID3D11DeviceContext::*pSetSamplers)(uint32_t Offset, uint32_t NumSamplers, ID3D11SamplerState*const* pSamplers);
     void ( __stdcall ID3D11DeviceContext::*pSetShaderResources)(uint32_t Offset, uint32_t NumResources, ID3D11ShaderResourceView *const *pResources);
     HRESULT ( __stdcall ID3D11Device::*pCreateShader)(const void *pShaderBlob, size_t ShaderBlobSize, ID3D11ClassLinkage* pClassLinkage, ID3D11DeviceChild **ppShader);
+    void ( __stdcall ID3D11DeviceContext1::*pSetConstantBuffers1)(uint32_t StartConstantSlot, uint32_t NumBuffers, ID3D11Buffer *const *pBuffers, const uint32_t *pFirstConstant, const uint32_t *pNumConstants);
+    EShaderStage Stage;
 };
 
 
@@ -620,39 +682,54 @@ struct SShaderBlock
         SInterfaceParameter         *pInterfaceParameters;      // set with BindInterfaces (used for function interface parameters)
     };
 
-    bool                            IsValid;
-    SD3DShaderVTable                *pVT;                
+    // Data for the desc and identity queries. Unlike the reflection data, it is kept after Optimize();
+    // the effect keeps these in one array (CEffect::m_pShaderDescs), in the order of its shader blocks.
+    struct SDescData
+    {
+        // Hash of the bytecode and stream out declarations, computed in BindToDevice
+        uint64_t                    IdentityHash;
 
-    // This value is nullptr if the shader is nullptr or was never initialized
-    SReflectionData                 *pReflectionData;
+        ID3DBlob                    *pInputSignatureBlob;   // The input signature is separated from the bytecode because it 
+                                                            // is always available, even after Optimize() has been called.
 
-    ID3D11DeviceChild               *pD3DObject;
+        SDescData()
+        {
+            IdentityHash = 0;
+            pInputSignatureBlob = nullptr;
+        }
+    };
 
+    // Only the fields that Apply reads are kept in the block itself; the dependency counts are
+    // packed together so that the whole set fits in two cache lines
+    bool                            IsValid;
     uint32_t                        CBDepCount;
-    SShaderCBDependency             *pCBDeps;
+    SD3DShaderVTable                *pVT;                
+    ID3D11DeviceChild               *pD3DObject;
 
     uint32_t                        SampDepCount;
-    SShaderSamplerDependency        *pSampDeps;
-
     uint32_t                        InterfaceDepCount;
-    SInterfaceDependency            *pInterfaceDeps;
-
     uint32_t                        ResourceDepCount;
-    SShaderResourceDependency       *pResourceDeps;
-
     uint32_t                        UAVDepCount;
+    uint32_t                        TBufferDepCount;
+
+    SShaderCBDependency             *pCBDeps;
+    SShaderSamplerDependency        *pSampDeps;
+    SInterfaceDependency            *pInterfaceDeps;
+    SShaderResourceDependency       *pResourceDeps;
     SUnorderedAccessViewDependency  *pUAVDeps;
+    SConstantBufferRuntime          **ppTbufDeps;
 
-    uint32_t                        TBufferDepCount;
-    SConstantBuffer                 **ppTbufDeps;
+    // This value is nullptr if the shader is nullptr or was never initialized
+    SReflectionData                 *pReflectionData;
 
-    ID3DBlob                        *pInputSignatureBlob;   // The input signature is separated from the bytecode because it 
-                                                            // is always available, even after Optimize() has been called.
+    // This value is nullptr for the nullptr shaders, which are not part of any effect
+    SDescData                       *pDescData;
 
     SShaderBlock(SD3DShaderVTable *pVirtualTable = nullptr);
 
     EObjectType GetShaderType();
 
+    void UpdateIdentityHash();
     HRESULT OnDeviceBind();
 
     // Public API helpers
@@ -702,11 +779,7 @@ struct SVariable
     // For structure members:
     //    Offset of this member (in bytes) from parent structure (structure members must be numeric/struct)
     UDataPointer            Data;
-    union
-    {
-        uint32_t            MemberDataOffsetPlus4;  // 4 added so that 0 == nullptr can represent "unused"
-        SMemberDataPointer  *pMemberData;
-    };
+    SMemberDataPointer      *pMemberData;
 
     SType                   *pType;
     char                    *pName;
@@ -781,65 +854,235 @@ struct SAnonymousShader : public TUncastableVariable<ID3DX11EffectShaderVariable
     IUNKNOWN_IMP(SAnonymousShader, ID3DX11EffectShaderVariable, ID3DX11EffectVariable);
 };
 
+// Contents of a cbuffer shared by every effect bound to it through a CConstantBufferRegistry.
+// Owned by the registry; effects point the runtime part of their SConstantBuffer at pBackingStore and pD3DObject.
+struct SSharedConstantBuffer
+{
+    char                            *pName;
+    CEffectVector<uint8_t>          Layout;         // see ComputeConstantBufferLayout
+    uint8_t                         *pBackingStore;
+    uint32_t                        Size;           // in bytes
+    ID3D11Buffer                    *pD3DObject;
+    bool                            IsDirty;        // Set when any effect updates the contents; cleared on upload
+    ID3DX11ConstantBufferRegistry   *pRegistry;     // not AddRef'ed; each effect sharing this cbuffer holds a reference
+
+    SSharedConstantBuffer()
+    {
+        pName = nullptr;
+        pBackingStore = nullptr;
+        Size = 0;
+        pD3DObject = nullptr;
+        IsDirty = false;
+        pRegistry = nullptr;
+    }
+
+    ~SSharedConstantBuffer()
+    {
+        SAFE_DELETE_ARRAY(pName);
+        SAFE_DELETE_ARRAY(pBackingStore);
+        SAFE_RELEASE(pD3DObject);
+    }
+};
+
+// Global variables of an effect that have the same semantic (compared case-insensitively).
+// Built when the effect is loaded, since Optimize discards variable semantics.
+struct SSemanticBinding : public CEffectAllocated
+{
+    char                            *pSemantic;
+    CEffectVector<SGlobalVariable*> Variables;
+
+    SSemanticBinding()
+    {
+        pSemantic = nullptr;
+    }
+
+    ~SSemanticBinding()
+    {
+        FreeEffectMemory(pSemantic);
+    }
+};
+
+// How the value of a variable handle is stored in its cbuffer
+enum EVariableHandleLayout
+{
+    EVHL_Vector,                // scalars and vectors: Columns components, stored as is
+    EVHL_RowMajorMatrix,        // one register per row
+    EVHL_ColumnMajorMatrix,     // one register per column
+};
+
+// Decoded D3DX11_EFFECT_VARIABLE_HANDLE. Handles only hold indices and offsets, which Optimize
+// and CloneEffect preserve; from the least significant bit, a handle is made of:
+//   16 bits  Offset, 12 bits ConstantBuffer, 20 bits Variable, 2 bits Rows - 1,
+//   2 bits Columns - 1, 2 bits Layout, 3 bits ScalarType, and the top bit, which is set in
+//   every valid handle
+struct SVariableHandle
+{
+    uint32_t                Offset;             // in bytes, from the start of the cbuffer
+    uint32_t                ConstantBuffer;     // index into CEffect::m_pCBs
+    uint32_t                Variable;           // index into CEffect::m_pVariables
+    uint32_t                Rows;
+    uint32_t                Columns;
+    EVariableHandleLayout   Layout;
+    EScalarType             ScalarType;
+
+    static const uint32_t c_MaxOffset = (1 << 16) - 1;
+    static const uint32_t c_MaxConstantBuffer = (1 << 12) - 1;
+    static const uint32_t c_MaxVariable = (1 << 20) - 1;
+    static const uint64_t c_ValidBit = 1ULL << 63;
+
+    D3DX11_EFFECT_VARIABLE_HANDLE Encode() const
+    {
+        return c_ValidBit | (uint64_t)Offset | ((uint64_t)ConstantBuffer << 16) | ((uint64_t)Variable << 28) |
+            ((uint64_t)(Rows - 1) << 48) | ((uint64_t)(Columns - 1) << 50) | ((uint64_t)Layout << 52) |
+            ((uint64_t)ScalarType << 54);
+    }
+
+    bool Decode(_In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle)
+    {
+        Offset = (uint32_t)Handle & c_MaxOffset;
+        ConstantBuffer = (uint32_t)(Handle >> 16) & c_MaxConstantBuffer;
+        Variable = (uint32_t)(Handle >> 28) & c_MaxVariable;
+        Rows = ((uint32_t)(Handle >> 48) & 3) + 1;
+        Columns = ((uint32_t)(Handle >> 50) & 3) + 1;
+        Layout = (EVariableHandleLayout)((Handle >> 52) & 3);
+        ScalarType = (EScalarType)((Handle >> 54) & 7);
+        return 0 != (Handle & c_ValidBit) && Layout <= EVHL_ColumnMajorMatrix &&
+            ScalarType > EST_Invalid && ScalarType < EST_Count;
+    }
+
+    // True if values of Type can be stored through the handle; no conversion is made
+    bool AcceptsType(_In_ D3D_SHADER_VARIABLE_TYPE Type) const
+    {
+        switch (Type)
+        {
+        case D3D_SVT_FLOAT:
+            return EST_Float == ScalarType;
+        case D3D_SVT_INT:
+            return EST_Int == ScalarType;
+        case D3D_SVT_UINT:
+            return EST_UInt == ScalarType;
+        case D3D_SVT_BOOL:
+            return EST_Bool == ScalarType;
+        default:
+            return false;
+        }
+    }
+
+    // Number of bytes of the cbuffer that a set writes, from Offset
+    uint32_t GetStoreSize() const
+    {
+        switch (Layout)
+        {
+        case EVHL_RowMajorMatrix:
+            return (Rows - 1) * SType::c_RegisterSize + Columns * SType::c_ScalarSize;
+        case EVHL_ColumnMajorMatrix:
+            return (Columns - 1) * SType::c_RegisterSize + Rows * SType::c_ScalarSize;
+        default:
+            return Columns * SType::c_ScalarSize;
+        }
+    }
+
+    // Minimum size of the values a set reads: matrices are always read as 4x4 float matrices
+    uint32_t GetValueSize() const
+    {
+        return (EVHL_Vector == Layout) ? Columns * SType::c_ScalarSize : sizeof(CEffectMatrix);
+    }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // ID3DX11EffectConstantBuffer (SConstantBuffer implementation)
 ////////////////////////////////////////////////////////////////////////////////
 
-struct SConstantBuffer : public TUncastableVariable<ID3DX11EffectConstantBuffer>, public ID3DX11EffectType
+// The part of a cbuffer that Apply reads and writes. The effect keeps these in one array
+// (CEffect::m_pCBRuntimes), in the order of its cbuffers; the shader dependencies point here.
+struct SConstantBufferRuntime
 {
     ID3D11Buffer            *pD3DObject;
-    SShaderResource         TBuffer;            // nullptr iff IsTbuffer == false
 
     uint8_t                 *pBackingStore;
     uint32_t                Size;               // in bytes
 
-    char                    *pName;
+    bool                    IsDirty:1;          // Set when any member is updated; cleared on CB apply    
+    bool                    IsTBuffer:1;        // true iff TBuffer.pShaderResource != nullptr
+    bool                    IsNonUpdatable:1;   // Set to true if you want to share this CB with cloned Effects
+    bool                    IsBufferStale:1;    // Set when the latest contents were uploaded to the CB ring instead of pD3DObject
 
-    uint32_t                AnnotationCount;
-    SAnnotation             *pAnnotations;
+    uint32_t                RingGeneration;     // CB ring generation of the last upload to the ring; 0 if it holds no valid copy
+    uint32_t                RingFirstConstant;  // Location of the last upload to the ring, in 16-byte constants
 
-    uint32_t                VariableCount;      // # of variables contained in this cbuffer
-    SGlobalVariable         *pVariables;        // array of size [VariableCount], points into effect's contiguous variable list
-    uint32_t                ExplicitBindPoint;  // Used when a CB has been explicitly bound (register(bXX)). -1 if not
+    SSharedConstantBuffer   *pSharedCB;         // Set if pBackingStore and pD3DObject are shared with other effects
+
+    SConstantBufferRuntime()
+    {
+        pD3DObject = nullptr;
+        pBackingStore = nullptr;
+        Size = 0;
+        IsDirty = false;
+        IsTBuffer = false;
+        IsNonUpdatable = false;
+        IsBufferStale = false;
+        RingGeneration = 0;
+        RingFirstConstant = 0;
+        pSharedCB = nullptr;
+    }
+
+    void SetDirty()
+    {
+        IsDirty = true;
+        if (nullptr != pSharedCB)
+        {
+            pSharedCB->IsDirty = true;
+        }
+    }
+
+    // *SetConstantBuffers1 offsets and sizes must be multiples of 16 constants
+    static const uint32_t c_RingAlignment = 256;
+    uint32_t GetRingSize() const { return (Size + c_RingAlignment - 1) & ~(c_RingAlignment - 1); }
+};
+
+struct SConstantBuffer : public TUncastableVariable<ID3DX11EffectConstantBuffer>, public ID3DX11EffectType
+{
+    SConstantBufferRuntime  *pRuntime;
 
-    bool                    IsDirty:1;          // Set when any member is updated; cleared on CB apply    
-    bool                    IsTBuffer:1;        // true iff TBuffer.pShaderResource != nullptr
     bool                    IsUserManaged:1;    // Set if you don't want effects to update this buffer
     bool                    IsEffectOptimized:1;// Set if the effect has been optimized
     bool                    IsUsedByExpression:1;// Set if used by any expressions
     bool                    IsUserPacked:1;     // Set if the elements have user-specified offsets
     bool                    IsSingle:1;         // Set to true if you want to share this CB with cloned Effects
-    bool                    IsNonUpdatable:1;   // Set to true if you want to share this CB with cloned Effects
-
-    union
-    {
-        // These are used to store the original ID3D11Buffer* for use in UndoSetConstantBuffer
-        uint32_t            MemberDataOffsetPlus4;  // 4 added so that 0 == nullptr can represent "unused"
-        SMemberDataPointer  *pMemberData;
-    };
+    bool                    IsWeakReference;    // Set when the user's pD3DObject was set without a reference (see BindObject)
 
     CEffect                 *pEffect;
 
+    SShaderResource         TBuffer;            // nullptr iff IsTbuffer == false
+
+    char                    *pName;
+
+    uint32_t                AnnotationCount;
+    SAnnotation             *pAnnotations;
+
+    uint32_t                VariableCount;      // # of variables contained in this cbuffer
+    SGlobalVariable         *pVariables;        // array of size [VariableCount], points into effect's contiguous variable list
+    uint32_t                ExplicitBindPoint;  // Used when a CB has been explicitly bound (register(bXX)). -1 if not
+
+    // These are used to store the original ID3D11Buffer* for use in UndoSetConstantBuffer
+    SMemberDataPointer      *pMemberData;
+
     SConstantBuffer()
     {
-        pD3DObject = nullptr;
+        pRuntime = nullptr;
         ZeroMemory(&TBuffer, sizeof(TBuffer));
         ExplicitBindPoint = uint32_t(-1);
-        pBackingStore = nullptr;
-        Size = 0;
         pName = nullptr;
         VariableCount = 0;
         pVariables = nullptr;
         AnnotationCount = 0;
         pAnnotations = nullptr;
-        IsDirty = false;
-        IsTBuffer = false;
         IsUserManaged = false;
         IsEffectOptimized = false;
         IsUsedByExpression = false;
         IsUserPacked = false;
         IsSingle = false;
-        IsNonUpdatable = false;
+        IsWeakReference = false;
         pEffect = nullptr;
     }
 
@@ -926,10 +1169,12 @@ struct SAssignment
     struct SDependency
     {
         SGlobalVariable *pVariable;
+        Timer           *pLastModifiedTime;     // the variable's entry in CEffect::m_pVariableTimes
 
         SDependency()
         {
             pVariable = nullptr;
+            pLastModifiedTime = nullptr;
         }
     };
 
@@ -1003,21 +1248,55 @@ struct SPointerMapping
 
 typedef CEffectHashTableWithPrivateHeap<SPointerMapping, SPointerMapping::AreMappingsEqual> CPointerMappingTable;
 
-// Assist adding data to a block of memory
-class CEffectHeap
+// Assist adding data to a chain of memory blocks
+//
+// Blocks are never moved or reallocated, so pointers into the heap stay valid while it grows
+// and the loader can place the effect data where it will stay. The heap also has a logical
+// layout, in which the used part of each block follows the used part of the previous one;
+// GetOffset and GetPointer translate between the two, so that a copy of the heap (see CopyFrom)
+// can be laid out in a single block with the same offsets.
+class CEffectHeap : public CEffectAllocated
 {
 protected:
-    uint8_t    *m_pData;
-    uint32_t    m_dwBufferSize;
-    uint32_t    m_dwSize;
+    struct SBlock
+    {
+        SBlock      *pNext;
+        uint8_t     *pData;
+        uint32_t    Offset;         // logical offset of pData
+        uint32_t    BufferSize;
+    };
+
+    SBlock      *m_pFirst;
+    SBlock      *m_pLast;
+    uint32_t    m_dwBufferSize;     // sum of the sizes of all blocks
+    uint32_t    m_dwSize;           // logical size; the used part of m_pLast ends here
+    uint32_t    m_dwGrowSize;       // size of the next block added on demand, 0 if the heap can't grow
+
+    HRESULT AddBlock(_In_ uint32_t dwSize);
+    uint32_t GetBlockSize(_In_ const SBlock *pBlock) const { return (pBlock->pNext ? pBlock->pNext->Offset : m_dwSize) - pBlock->Offset; }
 
     template <bool bCopyData>
     HRESULT AddDataInternal(_In_reads_bytes_(dwSize) const void *pData, _In_ uint32_t dwSize, _Outptr_ void **ppPointer);
 
 public:
+    // Adds a block of exactly dwSize bytes; the heap can't grow past it unless EnableGrowth is called
     HRESULT ReserveMemory(uint32_t dwSize);
+    // Lets the heap add blocks as needed, once the reserved memory (if any) is used up
+    void EnableGrowth();
+    void FreeMemory();
     uint32_t GetSize();
-    uint8_t* GetDataStart() { return m_pData; }
+    uint32_t GetBufferSize() const { return m_dwBufferSize; }
+
+    // Only valid for heaps made of a single block
+    uint8_t* GetDataStart()
+    {
+        assert(m_pFirst == m_pLast);
+        return (nullptr != m_pFirst) ? m_pFirst->pData : nullptr;
+    }
+
+    // Translate between pointers into the used part of the heap and logical offsets
+    bool GetOffset(_In_ const void *pData, _Out_ uint32_t *pOffset) const;
+    uint8_t* GetPointer(_In_ uint32_t Offset) const;
 
     // AddData and AddString append existing data to the buffer - they change m_dwSize. Users are 
     //   not expected to modify the data pointed to by the return pointer
@@ -1030,31 +1309,182 @@ public:
 
     // Move data from the general heap and optional free memory
     HRESULT MoveData(_Inout_updates_bytes_(size) void **ppData, _In_ uint32_t size);
-    HRESULT MoveString(_Inout_updates_z_(1)  char **ppStringData);
-    HRESULT MoveInterfaceParameters(_In_ uint32_t InterfaceCount, _Inout_updates_(1) SShaderBlock::SInterfaceParameter **ppInterfaces);
-    HRESULT MoveEmptyDataBlock(_Inout_updates_(1) void **ppData, _In_ uint32_t size);
+
+    // Copies the used part of another heap into a single block of this (empty) heap, keeping its logical layout
+    HRESULT CopyFrom(_In_ CEffectHeap &Heap);
+    void Swap(_Inout_ CEffectHeap &Heap);
 
     bool IsInHeap(_In_ void *pData) const
     {
-        return (pData >= m_pData && pData < (m_pData + m_dwBufferSize));
+        for (const SBlock *pBlock = m_pFirst; nullptr != pBlock; pBlock = pBlock->pNext)
+        {
+            if (pData >= pBlock->pData && pData < (pBlock->pData + pBlock->BufferSize))
+                return true;
+        }
+        return false;
     }
 
     CEffectHeap();
     ~CEffectHeap();
 };
 
-class CEffectReflection
+class CEffectReflection : public CEffectAllocated
 {
 public:
     // Single memory block support
     CEffectHeap m_Heap;
+
+    // Shader bytecode, kept apart so that D3DX11EffectDiscardShaderData can free it alone
+    CEffectHeap m_BytecodeHeap;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Runtime state object cache
+//////////////////////////////////////////////////////////////////////////
+
+// State blocks with variable-driven assignments are recreated on the apply path whenever
+// one of their dependencies changes. This cache remembers the objects created for the most
+// recently used descriptions (keyed by the full bytes of the D3D11_*_DESC), so toggling a
+// state back and forth does not call into the device every time.
+// Each entry holds one reference on its object; the least recently used entry is released
+// when a new description arrives and the cache is full.
+template<class DESC, class D3DTYPE, uint32_t MaxEntries = 16>
+class CStateObjectCache
+{
+public:
+    typedef HRESULT ( __stdcall ID3D11Device::*PFNCreateState)(const DESC *pDesc, D3DTYPE **ppState);
+
+protected:
+    struct SEntry
+    {
+        uint32_t    Hash;
+        uint32_t    LastUsed;
+        DESC        Desc;
+        D3DTYPE     *pObject;
+    };
+
+    CEffectVector<SEntry>   m_Entries;
+    uint32_t                m_UseCount;
+
+    void AddEntry(_In_ const DESC *pDesc, _In_ uint32_t Hash, _In_ D3DTYPE *pObject)
+    {
+        SEntry *pEntry = nullptr;
+
+        if (m_Entries.GetSize() < MaxEntries)
+        {
+            pEntry = m_Entries.Add();
+            if (nullptr == pEntry)
+            {
+                // Out of memory; the object is still valid, it just won't be cached
+                return;
+            }
+        }
+        else
+        {
+            // Evict the least recently used description
+            pEntry = &m_Entries[0];
+            for (uint32_t i = 1; i < m_Entries.GetSize(); ++ i)
+            {
+                if (m_Entries[i].LastUsed < pEntry->LastUsed)
+                {
+                    pEntry = &m_Entries[i];
+                }
+            }
+            SAFE_RELEASE(pEntry->pObject);
+        }
+
+        pEntry->Hash = Hash;
+        pEntry->LastUsed = ++ m_UseCount;
+        memcpy(&pEntry->Desc, pDesc, sizeof(DESC));
+        pEntry->pObject = pObject;
+        pObject->AddRef();
+    }
+
+public:
+    CStateObjectCache() : m_UseCount(0)
+    {
+    }
+
+    ~CStateObjectCache()
+    {
+        Clear();
+    }
+
+    // Seeds the cache with an object created elsewhere (e.g. in BindToDevice)
+    void Add(_In_ const DESC *pDesc, _In_ D3DTYPE *pObject)
+    {
+        AddEntry(pDesc, ComputeHash((const uint8_t*)pDesc, sizeof(DESC)), pObject);
+    }
+
+    // Returns (AddRef'ed) the cached object matching *pDesc, creating and caching it on a miss
+    HRESULT FindOrCreate(_In_ ID3D11Device *pDevice, _In_ PFNCreateState pfnCreate, _In_ const DESC *pDesc, _Outptr_ D3DTYPE **ppObject)
+    {
+        HRESULT hr = S_OK;
+        uint32_t hash = ComputeHash((const uint8_t*)pDesc, sizeof(DESC));
+
+        *ppObject = nullptr;
+
+        for (uint32_t i = 0; i < m_Entries.GetSize(); ++ i)
+        {
+            SEntry *pEntry = &m_Entries[i];
+            if (pEntry->Hash == hash && 0 == memcmp(&pEntry->Desc, pDesc, sizeof(DESC)))
+            {
+                pEntry->LastUsed = ++ m_UseCount;
+                pEntry->pObject->AddRef();
+                *ppObject = pEntry->pObject;
+                goto lExit;
+            }
+        }
+
+        VH( (pDevice->*pfnCreate)(pDesc, ppObject) );
+        SetDebugObjectName(*ppObject, "D3DX11Effect");
+        AddEntry(pDesc, hash, *ppObject);
+
+lExit:
+        return hr;
+    }
+
+    void Clear()
+    {
+        for (uint32_t i = 0; i < m_Entries.GetSize(); ++ i)
+        {
+            SAFE_RELEASE(m_Entries[i].pObject);
+        }
+        m_Entries.Clear();
+        m_UseCount = 0;
+    }
 };
 
+// Identifies a pooled type interface (by pType alone) or member interface; Index is the position of the
+// interface in CEffect::m_pTypeInterfaces or CEffect::m_pMemberInterfaces and is not part of the key
+struct SInterfacePoolKey
+{
+    void        *pTopLevelEntity;
+    void        *pData;
+    SType       *pType;
+    char        *pName;
+    char        *pSemantic;
+    uint32_t    IsSingleElement;
+    uint32_t    Index;
+
+    uint32_t ComputeHash() const
+    {
+        return ::ComputeHash((const uint8_t*)this, offsetof(SInterfacePoolKey, Index));
+    }
+
+    static bool AreKeysEqual(const SInterfacePoolKey &Key1, const SInterfacePoolKey &Key2)
+    {
+        return 0 == memcmp(&Key1, &Key2, offsetof(SInterfacePoolKey, Index));
+    }
+};
+
+typedef CEffectHashTable<SInterfacePoolKey, SInterfacePoolKey::AreKeysEqual> CInterfacePoolTable;
 
-class CEffect : public ID3DX11Effect
+class CEffect : public ID3DX11Effect, public CEffectAllocated
 {
     friend struct SBaseBlock;
     friend struct SPassBlock;
+    friend struct SPassRuntime;
     friend class CEffectLoader;
     friend struct SConstantBuffer;
     friend struct TSamplerVariable<TGlobalVariable<ID3DX11EffectSamplerVariable>>;
@@ -1062,18 +1492,38 @@ class CEffect : public ID3DX11Effect
     
 protected:
 
-    uint32_t                m_RefCount;
+    volatile LONG           m_RefCount;         // atomic, so that interfaces can be AddRef'ed and released on any thread
     uint32_t                m_Flags;
 
+    // Provides all of the memory of this effect and its clones (nullptr: the CRT heap); see CEffectAllocatorScope
+    ID3DX11EffectAllocator  *m_pAllocator;
+
     // Private heap - all pointers should point into here
     CEffectHeap             m_Heap;
 
+    // Holds only the pass records and the assignment and shader dependency arrays; nothing points
+    // into it except the passes, the blocks that own the arrays and the pass assignments, so
+    // PackRuntimeData can lay it out again
+    CEffectHeap             m_RuntimeHeap;
+
+    // Logical offsets (see CEffectHeap::GetOffset) of the pointer slots of m_Heap, m_RuntimeHeap and of
+    // the reflection heap, recorded once the effect is loaded (see RecordRelocations), so that
+    // CloneEffect can copy the heaps whole and rebase the slots. The slots of the variable tables
+    // hold variable pointers, which may also be member interfaces.
+    CEffectVector<uint32_t> m_HeapRelocations;
+    CEffectVector<uint32_t> m_RuntimeRelocations;
+    CEffectVector<uint32_t> m_ReflectionRelocations;
+    CEffectVector<uint32_t> m_VariableRelocations;
+    CEffectVector<uint32_t> m_RuntimeVariableRelocations;
+    bool                    m_RelocationsRecorded;
+
     // Reflection object
     CEffectReflection       *m_pReflection;
 
     // global variables in the effect (aka parameters)
     uint32_t                m_VariableCount;
     SGlobalVariable         *m_pVariables;
+    Timer                   *m_pVariableTimes;      // when each of m_pVariables was last modified, in the same order
 
     // anonymous shader variables (one for every inline shader assignment)
     uint32_t                m_AnonymousShaderCount;
@@ -1089,6 +1539,7 @@ protected:
 
     uint32_t                m_ShaderBlockCount;
     SShaderBlock            *m_pShaderBlocks;
+    SShaderBlock::SDescData *m_pShaderDescs;        // in the same order as m_pShaderBlocks
 
     uint32_t                m_DepthStencilBlockCount;
     SDepthStencilBlock      *m_pDepthStencilBlocks;
@@ -1108,8 +1559,13 @@ protected:
     uint32_t                m_InterfaceCount;
     SInterface              *m_pInterfaces;
 
+    // Interfaces created in m_Heap for the class instances that shaders are bound to; only
+    // the shader interface dependencies point to them
+    uint32_t                m_BackgroundInterfaceCount;
+
     uint32_t                m_CBCount;
     SConstantBuffer         *m_pCBs;
+    SConstantBufferRuntime  *m_pCBRuntimes;         // in the same order as m_pCBs
 
     uint32_t                m_StringCount;
     SString                 *m_pStrings;
@@ -1135,10 +1591,40 @@ protected:
     ID3D11DeviceContext     *m_pContext;
     ID3D11ClassLinkage      *m_pClassLinkage;
 
+    // Objects created for state blocks that are modified at runtime, keyed by description
+    CStateObjectCache<D3D11_SAMPLER_DESC, ID3D11SamplerState>             m_SamplerStateCache;
+    CStateObjectCache<D3D11_BLEND_DESC, ID3D11BlendState>                 m_BlendStateCache;
+    CStateObjectCache<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>  m_DepthStencilStateCache;
+    CStateObjectCache<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>       m_RasterizerStateCache;
+
+    // Ring buffer, possibly shared with other effects, that cbuffer contents are sub-allocated from
+    // (see SetConstantBufferRing); nullptr unless enabled
+    CConstantBufferRing     *m_pCBRing;
+    bool                    m_CBRingActive;         // the pass being applied binds its cbuffers from the ring
+
+    // D3DX11_EFFECT_BINDING_* flags (see SetBindingFlags), and the shader block last applied to each stage of
+    // m_pBindingContext; a range of that block whose objects have not changed since it was set is still bound
+    uint32_t                m_BindingFlags;
+    ID3D11DeviceContext     *m_pBindingContext;     // not AddRef'ed; only compared against m_pContext
+    SShaderBlock            *m_pLastAppliedShaderBlocks[ESS_Count];
+
     // Master lists of reflection interfaces
     CEffectVectorOwner<SSingleElementType> m_pTypeInterfaces;
     CEffectVectorOwner<SMember>            m_pMemberInterfaces;
 
+    // Indices of the master lists, so that repeated GetMemberBy*, GetElement and GetType calls find their
+    // interface without a scan. Interfaces past the m_Indexed* counts are indexed on the next lookup.
+    CInterfacePoolTable     m_TypeInterfaceIndex;
+    CInterfacePoolTable     m_MemberInterfaceIndex;
+    uint32_t                m_IndexedTypeInterfaces;
+    uint32_t                m_IndexedMemberInterfaces;
+
+    // Serializes the reflection calls that create pooled interfaces, which may run on several threads at once
+    SRWLOCK                 m_InterfacePoolLock;
+
+    // Global variables grouped by semantic, for ID3DX11ParameterTable
+    CEffectVectorOwner<SSemanticBinding>   m_SemanticBindings;
+
     //////////////////////////////////////////////////////////////////////////    
     // String & Type pooling
 
@@ -1157,24 +1643,33 @@ protected:
     // After Optimize() is called, the type/string pools should be deleted and all
     // remaining data should be migrated into the optimized type heap
     CEffectHeap             *m_pOptimizedTypeHeap;
+    // Entries of the pointer mapping tables built by CloneEffect; reset after each clone, so
+    // that cloning the effect again reuses its blocks
+    CDataBlockStore         *m_pCloneHeap;
 
     // Pools a string or type and modifies the pointer
     void AddStringToPool(const char **ppString);
     void AddTypeToPool(SType **ppType);
 
     HRESULT OptimizeTypes(_Inout_ CPointerMappingTable *pMappingTable, _In_ bool Cloning = false);
+    HRESULT PackRuntimeData();
+    HRESULT RecordRelocations();
 
 
     //////////////////////////////////////////////////////////////////////////    
     // Runtime (performance critical)
     
     void ApplyShaderBlock(_In_ SShaderBlock *pBlock);
+    void ReserveCBRing(_In_ SPassRuntime *pBlock);
+    bool UploadCBToRing(_Inout_ SConstantBufferRuntime *pCB);
+    void ApplyCBDependencyFromRing(_In_ SD3DShaderVTable *pVT, _In_ SShaderCBDependency *pCBDep);
     bool ApplyRenderStateBlock(_In_ SBaseBlock *pBlock);
     bool ApplySamplerBlock(_In_ SSamplerBlock *pBlock);
-    void ApplyPassBlock(_Inout_ SPassBlock *pBlock);
+    void ApplyOutputMergerViews(_In_ SPassRuntime *pBlock);
+    void ApplyPassBlock(_Inout_ SPassRuntime *pBlock);
     bool EvaluateAssignment(_Inout_  SAssignment *pAssignment);
     bool ValidateShaderBlock(_Inout_ SShaderBlock* pBlock );
-    bool ValidatePassBlock(_Inout_ SPassBlock* pBlock );
+    bool ValidatePassBlock(_Inout_ SPassRuntime* pBlock );
     
     //////////////////////////////////////////////////////////////////////////    
     // Non-runtime functions (not performance critical)    
@@ -1187,6 +1682,7 @@ protected:
     void ReplaceSamplerReference(_In_ SSamplerBlock *pOldSamplerBlock, _In_ ID3D11SamplerState *pNewSampler);
     void AddRefAllForCloning( _In_ CEffect* pEffectSource );
     HRESULT CopyMemberInterfaces( _In_ CEffect* pEffectSource );
+    HRESULT CopyHeapsForCloning( _In_ CEffect* pEffectSource );
     HRESULT CopyStringPool( _In_ CEffect* pEffectSource, _Inout_ CPointerMappingTable& mappingTable );
     HRESULT CopyTypePool( _In_ CEffect* pEffectSource, _Inout_ CPointerMappingTable& mappingTableTypes, _Inout_ CPointerMappingTable& mappingTableStrings );
     HRESULT CopyOptimizedTypePool( _In_ CEffect* pEffectSource, _Inout_ CPointerMappingTable& mappingTableTypes );
@@ -1194,6 +1690,12 @@ protected:
     HRESULT FixupMemberInterface( _Inout_ SMember* pMember, _In_ CEffect* pEffectSource, _Inout_ CPointerMappingTable& mappingTableStrings );
 
     void ValidateIndex(_In_ uint32_t Elements);
+    void ReleaseCBRing();
+    void InvalidateAppliedBindings();
+    bool IsCBUsedByAssignments(_In_ SConstantBuffer *pCB);
+    HRESULT BuildSemanticBindings();
+    HRESULT CopySemanticBindings(_In_ CEffect *pEffectSource);
+    void RebaseCBBackingStore(_Inout_ SConstantBuffer *pCB, _In_ uint8_t *pNewBackingStore);
 
     void IncrementTimer();    
     void HandleLocalTimerRollover();
@@ -1201,7 +1703,7 @@ protected:
     friend struct SConstantBuffer;
 
 public:
-    CEffect( uint32_t Flags = 0 );
+    CEffect( uint32_t Flags = 0, _In_opt_ ID3DX11EffectAllocator *pAllocator = nullptr );
     virtual ~CEffect();
     void ReleaseShaderRefection();
 
@@ -1211,6 +1713,41 @@ public:
     // Once the effect is fully loaded, call BindToDevice to attach it to a device
     HRESULT BindToDevice(_In_ ID3D11Device *pDevice, _In_z_ LPCSTR srcName );
 
+    // Sub-allocates cbuffer contents from a ring buffer (nullptr disables); see D3DX11EffectSetConstantBufferRing
+    HRESULT SetConstantBufferRing(_In_opt_ ID3DX11ConstantBufferRing *pRing);
+
+    // Sets the D3DX11_EFFECT_BINDING_* flags; see D3DX11EffectSetBindingFlags
+    HRESULT SetBindingFlags(_In_ uint32_t Flags);
+
+    // Adds up the memory held by the effect, by category; see D3DX11EffectGetMemoryUsage
+    void GetMemoryUsage(_Out_ D3DX11_EFFECT_MEMORY_USAGE *pUsage);
+
+    // Frees shader bytecode and reflection objects, keeping input signatures; see D3DX11EffectDiscardShaderData
+    HRESULT DiscardShaderData();
+
+    // Set if resources and user cbuffers are stored without taking references on them
+    bool UsesWeakReferences() const { return 0 != (m_BindingFlags & D3DX11_EFFECT_BINDING_WEAK_REFERENCES); }
+
+    // Binds the named cbuffer to the registry's shared copy; see D3DX11EffectShareConstantBuffer
+    HRESULT ShareConstantBuffer(_In_z_ LPCSTR Name, _In_ ID3DX11ConstantBufferRegistry *pRegistry);
+
+    // Resolves the path of a scalar, vector or matrix in a cbuffer; see D3DX11EffectGetVariableHandle
+    HRESULT GetVariableHandle(_In_z_ LPCSTR pPath, _Out_ D3DX11_EFFECT_VARIABLE_HANDLE *pHandle);
+
+    // Stores a value through a handle and marks its cbuffer dirty; see D3DX11EffectSetVariableByHandle
+    HRESULT SetVariableByHandle(_In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle, _In_ D3D_SHADER_VARIABLE_TYPE Type,
+                                _In_reads_bytes_(ByteCount) const void *pData, _In_ uint32_t ByteCount);
+
+    // Creates a snapshot of cbuffer contents and object bindings; see D3DX11EffectCreateSnapshot
+    HRESULT CreateSnapshot(_In_reads_opt_(ConstantBufferCount) ID3DX11EffectConstantBuffer *const *ppConstantBuffers,
+                           _In_ uint32_t ConstantBufferCount, _In_ uint32_t Flags, _Outptr_ ID3DX11EffectSnapshot **ppSnapshot);
+    bool IsSnapshotCompatible(_In_ CEffectSnapshot *pSnapshot);
+    HRESULT CaptureSnapshot(_Inout_ CEffectSnapshot *pSnapshot);
+    HRESULT RestoreSnapshot(_In_ CEffectSnapshot *pSnapshot);
+
+    uint32_t GetSemanticBindingCount() const { return m_SemanticBindings.GetSize(); }
+    SSemanticBinding *GetSemanticBinding(_In_ uint32_t Index) { return m_SemanticBindings[Index]; }
+
     Timer GetCurrentTime() const { return m_LocalTimer; }
     
     bool IsReflectionData(void *pData) const { return m_pReflection->m_Heap.IsInHeap(pData); }
@@ -1253,11 +1790,22 @@ public:
     //////////////////////////////////////////////////////////////////////////    
     // New reflection helpers
 
+    // Must be called whenever pooled interfaces are moved or their data pointers are changed
+    void InvalidateInterfacePoolIndices();
+    HRESULT IndexInterfacePools();
+
+    // Thread-safe; they find or create the interface with m_InterfacePoolLock held
     ID3DX11EffectType * CreatePooledSingleElementTypeInterface(_In_ SType *pType);
     ID3DX11EffectVariable * CreatePooledVariableMemberInterface(_In_ TTopLevelVariable<ID3DX11EffectVariable> *pTopLevelEntity,
                                                                 _In_ const SVariable *pMember,
                                                                 _In_ const UDataPointer Data, _In_ bool IsSingleElement, _In_ uint32_t Index);
 
+protected:
+    ID3DX11EffectType * FindOrCreateTypeInterface(_In_ SType *pType);
+    ID3DX11EffectVariable * FindOrCreateMemberInterface(_In_ TTopLevelVariable<ID3DX11EffectVariable> *pTopLevelEntity,
+                                                        _In_ const SVariable *pMember,
+                                                        _In_ const UDataPointer Data, _In_ bool IsSingleElement, _In_ uint32_t Index);
+
 };
 
 }
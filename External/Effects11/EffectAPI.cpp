@@ -107,6 +107,16 @@ static HRESULT LoadBinaryFromFile( _In_z_ LPCWSTR pFileName, _Inout_ std::unique
 _Use_decl_annotations_
 HRESULT WINAPI D3DX11CreateEffectFromMemory(LPCVOID pData, SIZE_T DataLength, UINT FXFlags,
                                             ID3D11Device *pDevice, ID3DX11Effect **ppEffect, LPCSTR srcName )
+{
+    return D3DX11CreateEffectFromMemoryWithAllocator( pData, DataLength, FXFlags, pDevice, nullptr, ppEffect, srcName );
+}
+
+//--------------------------------------------------------------------------------------
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11CreateEffectFromMemoryWithAllocator(LPCVOID pData, SIZE_T DataLength, UINT FXFlags,
+                                                         ID3D11Device *pDevice, ID3DX11EffectAllocator *pAllocator,
+                                                         ID3DX11Effect **ppEffect, LPCSTR srcName )
 {
     if ( !pData || !DataLength || !pDevice || !ppEffect )
         return E_INVALIDARG;
@@ -118,8 +128,11 @@ HRESULT WINAPI D3DX11CreateEffectFromMemory(LPCVOID pData, SIZE_T DataLength, UI
 
     HRESULT hr = S_OK;
 
+    // The effect object itself comes from the allocator too
+    CEffectAllocatorScope allocatorScope(pAllocator);
+
     // Note that pData must point to a compiled effect, not HLSL
-    VN( *ppEffect = new CEffect( FXFlags & D3DX11_EFFECT_RUNTIME_VALID_FLAGS) );
+    VN( *ppEffect = new CEffect( FXFlags & D3DX11_EFFECT_RUNTIME_VALID_FLAGS, pAllocator ) );
     VH( ((CEffect*)(*ppEffect))->LoadEffect(pData, static_cast<uint32_t>(DataLength) ) );
     VH( ((CEffect*)(*ppEffect))->BindToDevice(pDevice, (srcName) ? srcName : "D3DX11Effect" ) );
 
@@ -333,3 +346,68 @@ lExit:
     }
     return hr;
 }
+
+//--------------------------------------------------------------------------------------
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectSetBindingFlags( ID3DX11Effect *pEffect, UINT Flags )
+{
+    if ( !pEffect )
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*)pEffect)->SetBindingFlags(Flags);
+}
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectPassGetIdentity( ID3DX11EffectPass *pPass, D3DX11_EFFECT_PASS_IDENTITY *pIdentity )
+{
+    if ( !pPass || !pIdentity || !pPass->IsValid() )
+        return E_INVALIDARG;
+
+    // SPassBlock is the only valid implementation of ID3DX11EffectPass
+    ((SPassBlock*)pPass)->GetIdentity(pIdentity);
+    return S_OK;
+}
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectGetVariableHandle( ID3DX11Effect *pEffect, LPCSTR Path, D3DX11_EFFECT_VARIABLE_HANDLE *pHandle )
+{
+    if ( !pEffect )
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*)pEffect)->GetVariableHandle(Path, pHandle);
+}
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectSetVariableByHandle( ID3DX11Effect *pEffect, D3DX11_EFFECT_VARIABLE_HANDLE Handle,
+                                                D3D_SHADER_VARIABLE_TYPE Type, const void *pData, UINT ByteCount )
+{
+    if ( !pEffect )
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*)pEffect)->SetVariableByHandle(Handle, Type, pData, ByteCount);
+}
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectGetMemoryUsage( ID3DX11Effect *pEffect, D3DX11_EFFECT_MEMORY_USAGE *pUsage )
+{
+    if ( !pEffect || !pUsage )
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    ((CEffect*)pEffect)->GetMemoryUsage(pUsage);
+    return S_OK;
+}
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectDiscardShaderData( ID3DX11Effect *pEffect )
+{
+    if ( !pEffect )
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*)pEffect)->DiscardShaderData();
+}
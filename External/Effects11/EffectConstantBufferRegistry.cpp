@@ -0,0 +1,446 @@
+//--------------------------------------------------------------------------------------
+// File: EffectConstantBufferRegistry.cpp
+//
+// Direct3D 11 Effects registry of cbuffers shared across effects
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#include "pchfx.h"
+
+#include "EffectConstantBufferRegistry.h"
+
+namespace D3DX11Effects
+{
+
+//--------------------------------------------------------------------------------------
+// Layout signatures
+//--------------------------------------------------------------------------------------
+
+static HRESULT AppendLayoutData(_Inout_ CEffectVector<uint8_t> *pLayout, _In_reads_bytes_(Size) const void *pData, _In_ uint32_t Size)
+{
+    return pLayout->AddRange((const uint8_t*) pData, Size);
+}
+
+static HRESULT AppendLayoutString(_Inout_ CEffectVector<uint8_t> *pLayout, _In_opt_z_ LPCSTR pString)
+{
+    if (nullptr == pString)
+    {
+        pString = "";
+    }
+    return AppendLayoutData(pLayout, pString, (uint32_t) strlen(pString) + 1);
+}
+
+static HRESULT AppendTypeLayout(_Inout_ CEffectVector<uint8_t> *pLayout, _In_ const SType *pType)
+{
+    HRESULT hr = S_OK;
+    uint32_t header[] = { (uint32_t) pType->VarType, pType->Elements, pType->TotalSize, pType->Stride, pType->PackedSize };
+
+    VH( AppendLayoutData(pLayout, header, sizeof(header)) );
+    VH( AppendLayoutString(pLayout, pType->pTypeName) );
+
+    switch (pType->VarType)
+    {
+    case EVT_Numeric:
+        {
+            uint32_t numeric[] = { (uint32_t) pType->NumericType.NumericLayout, (uint32_t) pType->NumericType.ScalarType,
+                                   pType->NumericType.Rows, pType->NumericType.Columns,
+                                   pType->NumericType.IsColumnMajor, pType->NumericType.IsPackedArray };
+
+            VH( AppendLayoutData(pLayout, numeric, sizeof(numeric)) );
+        }
+        break;
+
+    case EVT_Struct:
+        {
+            uint32_t members[] = { pType->StructType.Members, (uint32_t) pType->StructType.ImplementsInterface, (uint32_t) pType->StructType.HasSuperClass };
+
+            VH( AppendLayoutData(pLayout, members, sizeof(members)) );
+            for (uint32_t i = 0; i < pType->StructType.Members; ++ i)
+            {
+                const SVariable *pMember = &pType->StructType.pMembers[i];
+                uint32_t offset = (uint32_t) pMember->Data.Offset;
+
+                VH( AppendLayoutString(pLayout, pMember->pName) );
+                VH( AppendLayoutData(pLayout, &offset, sizeof(offset)) );
+                VH( AppendTypeLayout(pLayout, pMember->pType) );
+            }
+        }
+        break;
+
+    default:
+        // Only numeric and structure types belong in constant buffers
+        VH( E_FAIL );
+    }
+
+lExit:
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT ComputeConstantBufferLayout(SConstantBuffer *pCB, CEffectVector<uint8_t> *pLayout)
+{
+    HRESULT hr = S_OK;
+    uint32_t header[] = { pCB->pRuntime->Size, pCB->VariableCount };
+
+    pLayout->Clear();
+    VH( AppendLayoutData(pLayout, header, sizeof(header)) );
+
+    for (uint32_t i = 0; i < pCB->VariableCount; ++ i)
+    {
+        SGlobalVariable *pVariable = &pCB->pVariables[i];
+        uint32_t offset = (uint32_t) (pVariable->Data.pNumeric - pCB->pRuntime->pBackingStore);
+
+        VH( AppendLayoutString(pLayout, pVariable->pName) );
+        VH( AppendLayoutData(pLayout, &offset, sizeof(offset)) );
+        VH( AppendTypeLayout(pLayout, pVariable->pType) );
+    }
+
+lExit:
+    return hr;
+}
+
+//--------------------------------------------------------------------------------------
+// CConstantBufferRegistry
+//--------------------------------------------------------------------------------------
+
+CConstantBufferRegistry::CConstantBufferRegistry()
+{
+    m_RefCount = 1;
+    m_pDevice = nullptr;
+}
+
+CConstantBufferRegistry::~CConstantBufferRegistry()
+{
+    m_SharedCBs.Clear();
+    SAFE_RELEASE(m_pDevice);
+}
+
+HRESULT CConstantBufferRegistry::Initialize(_In_ ID3D11Device *pDevice)
+{
+    assert(nullptr == m_pDevice);
+
+    m_pDevice = pDevice;
+    m_pDevice->AddRef();
+    return S_OK;
+}
+
+_Use_decl_annotations_
+HRESULT CConstantBufferRegistry::FindOrAdd(LPCSTR pName, const CEffectVector<uint8_t> &Layout, const uint8_t *pInitialData,
+                                           uint32_t Size, SSharedConstantBuffer **ppSharedCB)
+{
+    HRESULT hr = S_OK;
+    SSharedConstantBuffer *pSharedCB = nullptr;
+    D3D11_BUFFER_DESC bufDesc;
+    size_t nameLength;
+
+    for (uint32_t i = 0; i < m_SharedCBs.GetSize(); ++ i)
+    {
+        if (strcmp(m_SharedCBs[i]->pName, pName) != 0)
+            continue;
+
+        if (m_SharedCBs[i]->Size != Size || m_SharedCBs[i]->Layout.GetSize() != Layout.GetSize() ||
+            memcmp(m_SharedCBs[i]->Layout.GetData(), Layout.GetData(), Layout.GetSize()) != 0)
+        {
+            DPF(0, "ID3DX11ConstantBufferRegistry: cbuffer %s does not match the layout it was first registered with", pName);
+            VH( E_FAIL );
+        }
+
+        *ppSharedCB = m_SharedCBs[i];
+        goto lExit;
+    }
+
+    VN( pSharedCB = new SSharedConstantBuffer );
+
+    nameLength = strlen(pName) + 1;
+    VN( pSharedCB->pName = new char[nameLength] );
+    memcpy(pSharedCB->pName, pName, nameLength);
+
+    VH( pSharedCB->Layout.CopyFrom(Layout) );
+
+    // The first effect to register the cbuffer provides its initial contents
+    VN( pSharedCB->pBackingStore = new uint8_t[Size] );
+    memcpy(pSharedCB->pBackingStore, pInitialData, Size);
+    pSharedCB->Size = Size;
+
+    bufDesc.ByteWidth = Size;
+    bufDesc.Usage = D3D11_USAGE_DEFAULT;
+    bufDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    bufDesc.CPUAccessFlags = 0;
+    bufDesc.MiscFlags = 0;
+    bufDesc.StructureByteStride = 0;
+
+    VH( m_pDevice->CreateBuffer( &bufDesc, nullptr, &pSharedCB->pD3DObject ) );
+    SetDebugObjectName( pSharedCB->pD3DObject, pSharedCB->pName );
+
+    pSharedCB->IsDirty = true;
+    pSharedCB->pRegistry = this;
+
+    VH( m_SharedCBs.Add(pSharedCB) );
+    *ppSharedCB = pSharedCB;
+    pSharedCB = nullptr;
+
+lExit:
+    SAFE_DELETE(pSharedCB);
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT CConstantBufferRegistry::QueryInterface(REFIID iid, LPVOID *ppv)
+{
+    if (nullptr == ppv)
+    {
+        DPF(0, "ID3DX11ConstantBufferRegistry::QueryInterface: nullptr parameter");
+        return E_INVALIDARG;
+    }
+
+    *ppv = nullptr;
+    if (IsEqualIID(iid, IID_IUnknown))
+    {
+        *ppv = (IUnknown *) this;
+    }
+    else if (IsEqualIID(iid, IID_ID3DX11ConstantBufferRegistry))
+    {
+        *ppv = (ID3DX11ConstantBufferRegistry *) this;
+    }
+    else
+    {
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG CConstantBufferRegistry::AddRef()
+{
+    return (ULONG) InterlockedIncrement(&m_RefCount);
+}
+
+ULONG CConstantBufferRegistry::Release()
+{
+    LONG refCount = InterlockedDecrement(&m_RefCount);
+    if (refCount > 0)
+    {
+        return (ULONG) refCount;
+    }
+    else
+    {
+        delete this;
+    }
+
+    return 0;
+}
+
+HRESULT CConstantBufferRegistry::GetDevice(_Outptr_ ID3D11Device **ppDevice)
+{
+    if (nullptr == ppDevice)
+    {
+        DPF(0, "ID3DX11ConstantBufferRegistry::GetDevice: ppDevice cannot be nullptr");
+        return E_INVALIDARG;
+    }
+
+    *ppDevice = m_pDevice;
+    m_pDevice->AddRef();
+    return S_OK;
+}
+
+uint32_t CConstantBufferRegistry::GetConstantBufferCount()
+{
+    return m_SharedCBs.GetSize();
+}
+
+//--------------------------------------------------------------------------------------
+// CEffect support for shared cbuffers
+//--------------------------------------------------------------------------------------
+
+template<class T>
+static bool BlocksDependOnCB(_In_reads_(Count) T *pBlocks, _In_ uint32_t Count, _In_ SConstantBuffer *pCB)
+{
+    for (size_t i = 0; i < Count; ++ i)
+    {
+        for (size_t j = 0; j < pBlocks[i].AssignmentCount; ++ j)
+        {
+            SAssignment *pAssignment = &pBlocks[i].pAssignments[j];
+            for (size_t k = 0; k < pAssignment->DependencyCount; ++ k)
+            {
+                if (pAssignment->pDependencies[k].pVariable->pCB == pCB)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Returns true if a state or pass assignment reads a variable of pCB. Such assignments are only
+// recomputed when the variable is set through this effect, so the CB cannot be shared.
+bool CEffect::IsCBUsedByAssignments(_In_ SConstantBuffer *pCB)
+{
+    if (BlocksDependOnCB(m_pDepthStencilBlocks, m_DepthStencilBlockCount, pCB) ||
+        BlocksDependOnCB(m_pBlendBlocks, m_BlendBlockCount, pCB) ||
+        BlocksDependOnCB(m_pRasterizerBlocks, m_RasterizerBlockCount, pCB) ||
+        BlocksDependOnCB(m_pSamplerBlocks, m_SamplerBlockCount, pCB))
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < m_GroupCount; ++ i)
+    {
+        for (size_t j = 0; j < m_pGroups[i].TechniqueCount; ++ j)
+        {
+            STechnique *pTech = &m_pGroups[i].pTechniques[j];
+            for (size_t k = 0; k < pTech->PassCount; ++ k)
+            {
+                if (BlocksDependOnCB(pTech->pPasses[k].pRuntime, 1, pCB))
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Points the CB and every variable and member interface that references its data at pNewBackingStore
+_Use_decl_annotations_
+void CEffect::RebaseCBBackingStore(SConstantBuffer *pCB, uint8_t *pNewBackingStore)
+{
+    uint8_t *pOldBackingStore = pCB->pRuntime->pBackingStore;
+
+    for (size_t i = 0; i < pCB->VariableCount; ++ i)
+    {
+        SGlobalVariable *pVariable = &pCB->pVariables[i];
+        pVariable->Data.pNumeric = pNewBackingStore + (pVariable->Data.pNumeric - pOldBackingStore);
+    }
+
+    for (size_t i = 0; i < m_pMemberInterfaces.GetSize(); ++ i)
+    {
+        SMember *pMember = m_pMemberInterfaces[i];
+
+        // Members of annotations, which have no cbuffer, are dropped by Optimize()
+        if (nullptr == pMember || (nullptr != m_pReflection && IsReflectionData(pMember->pTopLevelEntity)))
+            continue;
+
+        if (pMember->pType->BelongsInConstantBuffer() && ((SGlobalVariable*)pMember->pTopLevelEntity)->pCB == pCB)
+        {
+            pMember->Data.pNumeric = pNewBackingStore + (pMember->Data.pNumeric - pOldBackingStore);
+        }
+    }
+
+    pCB->pRuntime->pBackingStore = pNewBackingStore;
+
+    // The data pointers of the member interfaces are part of their pool keys
+    InvalidateInterfacePoolIndices();
+}
+
+_Use_decl_annotations_
+HRESULT CEffect::ShareConstantBuffer(LPCSTR Name, ID3DX11ConstantBufferRegistry *pRegistry)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "D3DX11EffectShareConstantBuffer";
+    CConstantBufferRegistry *pCBRegistry = (CConstantBufferRegistry*) pRegistry;
+    CEffectVector<uint8_t> layout;
+    SConstantBuffer *pCB;
+    SSharedConstantBuffer *pSharedCB = nullptr;
+
+    if (IsOptimized())
+    {
+        DPF(0, "%s: Cannot share cbuffers of an optimized effect", pFuncName);
+        VH( D3DERR_INVALIDCALL );
+    }
+
+    if (!pCBRegistry->IsSameDevice(m_pDevice))
+    {
+        DPF(0, "%s: The registry was created for a different device", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    pCB = FindCB(Name);
+    if (nullptr == pCB)
+    {
+        DPF(0, "%s: Effect has no cbuffer named %s", pFuncName, Name);
+        VH( E_INVALIDARG );
+    }
+
+    if (nullptr != pCB->pRuntime->pSharedCB)
+    {
+        if (pCB->pRuntime->pSharedCB->pRegistry != pRegistry)
+        {
+            DPF(0, "%s: cbuffer %s is already shared through another registry", pFuncName, Name);
+            VH( D3DERR_INVALIDCALL );
+        }
+        goto lExit;
+    }
+
+    if (pCB->pRuntime->IsTBuffer || pCB->pRuntime->IsNonUpdatable || pCB->pRuntime->Size == 0)
+    {
+        DPF(0, "%s: cbuffer %s is a texture buffer, user-managed or shared with cloned effects", pFuncName, Name);
+        VH( D3DERR_INVALIDCALL );
+    }
+
+    if (pCB->IsUsedByExpression || IsCBUsedByAssignments(pCB))
+    {
+        DPF(0, "%s: cbuffer %s is referenced by state or pass assignments", pFuncName, Name);
+        VH( D3DERR_INVALIDCALL );
+    }
+
+    VH( ComputeConstantBufferLayout(pCB, &layout) );
+    VH( pCBRegistry->FindOrAdd(Name, layout, pCB->pRuntime->pBackingStore, pCB->pRuntime->Size, &pSharedCB) );
+
+    // From now on, values set through any of the sharing effects are seen (and uploaded once) by all of them
+    RebaseCBBackingStore(pCB, pSharedCB->pBackingStore);
+
+    ReplaceCBReference(pCB, pSharedCB->pD3DObject);
+    pSharedCB->pD3DObject->AddRef();
+    SAFE_RELEASE(pCB->pRuntime->pD3DObject);
+    pCB->pRuntime->pD3DObject = pSharedCB->pD3DObject;
+
+    pCB->pRuntime->pSharedCB = pSharedCB;
+    pCB->pRuntime->IsDirty = false;
+    pCB->pRuntime->IsBufferStale = false;
+    pRegistry->AddRef();
+
+lExit:
+    return hr;
+}
+
+}
+
+//--------------------------------------------------------------------------------------
+
+using namespace D3DX11Effects;
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11CreateConstantBufferRegistry(ID3D11Device *pDevice, ID3DX11ConstantBufferRegistry **ppRegistry)
+{
+    HRESULT hr = S_OK;
+    CConstantBufferRegistry *pRegistry = nullptr;
+
+    if (!pDevice || !ppRegistry)
+        return E_INVALIDARG;
+
+    *ppRegistry = nullptr;
+
+    VN( pRegistry = new CConstantBufferRegistry );
+    VH( pRegistry->Initialize(pDevice) );
+
+    *ppRegistry = pRegistry;
+    pRegistry = nullptr;
+
+lExit:
+    SAFE_RELEASE(pRegistry);
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectShareConstantBuffer(ID3DX11Effect *pEffect, LPCSTR Name, ID3DX11ConstantBufferRegistry *pRegistry)
+{
+    if (!pEffect || !Name || !pRegistry)
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*)pEffect)->ShareConstantBuffer(Name, pRegistry);
+}
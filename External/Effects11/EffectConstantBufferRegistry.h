@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// File: EffectConstantBufferRegistry.h
+//
+// Direct3D 11 Effects registry of cbuffers shared across effects
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace D3DX11Effects
+{
+
+// Builds a byte signature of the cbuffer's variables (names, offsets and types).
+// Two cbuffers can share a backing store iff their sizes and signatures are identical.
+HRESULT ComputeConstantBufferLayout(_In_ SConstantBuffer *pCB, _Inout_ CEffectVector<uint8_t> *pLayout);
+
+class CConstantBufferRegistry : public ID3DX11ConstantBufferRegistry
+{
+protected:
+    volatile LONG                               m_RefCount;
+    ID3D11Device                                *m_pDevice;
+
+    // Entries are never removed, so pointers to them stay valid for the lifetime of the registry
+    CEffectVectorOwner<SSharedConstantBuffer>   m_SharedCBs;
+
+public:
+    CConstantBufferRegistry();
+    virtual ~CConstantBufferRegistry();
+
+    HRESULT Initialize(_In_ ID3D11Device *pDevice);
+
+    bool IsSameDevice(_In_ ID3D11Device *pDevice) const { return pDevice == m_pDevice; }
+
+    // Returns the entry named pName, creating it from pInitialData if there is none.
+    // Fails if the existing entry has a different layout.
+    HRESULT FindOrAdd(_In_z_ LPCSTR pName, _In_ const CEffectVector<uint8_t> &Layout,
+                      _In_reads_bytes_(Size) const uint8_t *pInitialData, _In_ uint32_t Size,
+                      _Outptr_ SSharedConstantBuffer **ppSharedCB);
+
+    // IUnknown
+    STDMETHOD(QueryInterface)(REFIID iid, _COM_Outptr_ LPVOID *ppv) override;
+    STDMETHOD_(ULONG, AddRef)() override;
+    STDMETHOD_(ULONG, Release)() override;
+
+    // ID3DX11ConstantBufferRegistry
+    STDMETHOD(GetDevice)(_Outptr_ ID3D11Device **ppDevice) override;
+    STDMETHOD_(uint32_t, GetConstantBufferCount)() override;
+};
+
+}
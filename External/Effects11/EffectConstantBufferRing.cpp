@@ -0,0 +1,306 @@
+//--------------------------------------------------------------------------------------
+// File: EffectConstantBufferRing.cpp
+//
+// Direct3D 11 Effects ring buffer that cbuffer contents are sub-allocated from
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#include "pchfx.h"
+
+#include "EffectConstantBufferRing.h"
+
+namespace D3DX11Effects
+{
+
+//--------------------------------------------------------------------------------------
+// CConstantBufferRing
+//--------------------------------------------------------------------------------------
+
+CConstantBufferRing::CConstantBufferRing()
+{
+    m_RefCount = 1;
+    m_pDevice = nullptr;
+    m_pContext = nullptr;
+    m_pBuffer = nullptr;
+    m_Size = 0;
+    m_Offset = 0;
+    m_Generation = 0;
+    m_Discard = false;
+    m_pMappedData = nullptr;
+}
+
+CConstantBufferRing::~CConstantBufferRing()
+{
+    EndBatch();
+    SAFE_RELEASE(m_pBuffer);
+    SAFE_RELEASE(m_pContext);
+    SAFE_RELEASE(m_pDevice);
+}
+
+HRESULT CConstantBufferRing::Initialize(_In_ ID3D11Device *pDevice, _In_ uint32_t Size)
+{
+    HRESULT hr = S_OK;
+    ID3D11DeviceContext *pContext = nullptr;
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+    D3D11_BUFFER_DESC bufDesc;
+
+    assert(nullptr == m_pDevice);
+
+    m_pDevice = pDevice;
+    m_pDevice->AddRef();
+
+    if (FAILED(m_pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+        !options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+    {
+        DPF(0, "D3DX11CreateConstantBufferRing: Constant buffer offsetting is not supported");
+        hr = S_FALSE;
+        goto lExit;
+    }
+
+    m_pDevice->GetImmediateContext(&pContext);
+    if (FAILED(pContext->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**) &m_pContext)))
+    {
+        DPF(0, "D3DX11CreateConstantBufferRing: ID3D11DeviceContext1 is not available");
+        hr = S_FALSE;
+        goto lExit;
+    }
+
+    bufDesc.ByteWidth = Size;
+    bufDesc.Usage = D3D11_USAGE_DYNAMIC;
+    bufDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    bufDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    bufDesc.MiscFlags = 0;
+    bufDesc.StructureByteStride = 0;
+
+    VH( m_pDevice->CreateBuffer( &bufDesc, nullptr, &m_pBuffer ) );
+    SetDebugObjectName( m_pBuffer, "D3DX11Effect" );
+
+    // Start full, so that the first batch discards the ring
+    m_Size = Size;
+    m_Offset = Size;
+
+lExit:
+    SAFE_RELEASE( pContext );
+    return hr;
+}
+
+bool CConstantBufferRing::Reserve(_In_ uint32_t Size)
+{
+    // Batches are reserved before any of their cbuffers are appended
+    assert(nullptr == m_pMappedData);
+
+    if (Size > m_Size)
+    {
+        return false;
+    }
+
+    if (m_Offset + Size > m_Size)
+    {
+        m_Offset = 0;
+        m_Discard = true;
+        if (++ m_Generation == 0)
+            m_Generation = 1;
+    }
+    return true;
+}
+
+_Use_decl_annotations_
+bool CConstantBufferRing::Append(const void *pData, uint32_t DataSize, uint32_t AllocationSize, uint32_t *pFirstConstant)
+{
+    assert(DataSize <= AllocationSize && 0 == AllocationSize % SConstantBufferRuntime::c_RingAlignment);
+    assert(m_Offset + AllocationSize <= m_Size);
+
+    if (nullptr == m_pMappedData)
+    {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+
+        if (FAILED(m_pContext->Map(m_pBuffer, 0, m_Discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped)))
+        {
+            return false;
+        }
+        m_pMappedData = (uint8_t*) mapped.pData;
+        m_Discard = false;
+    }
+
+    memcpy(m_pMappedData + m_Offset, pData, DataSize);
+
+    *pFirstConstant = m_Offset / (4 * sizeof(uint32_t));
+    m_Offset += AllocationSize;
+    return true;
+}
+
+void CConstantBufferRing::EndBatch()
+{
+    if (nullptr != m_pMappedData)
+    {
+        m_pContext->Unmap(m_pBuffer, 0);
+        m_pMappedData = nullptr;
+    }
+}
+
+_Use_decl_annotations_
+HRESULT CConstantBufferRing::QueryInterface(REFIID iid, LPVOID *ppv)
+{
+    if (nullptr == ppv)
+    {
+        DPF(0, "ID3DX11ConstantBufferRing::QueryInterface: nullptr parameter");
+        return E_INVALIDARG;
+    }
+
+    *ppv = nullptr;
+    if (IsEqualIID(iid, IID_IUnknown))
+    {
+        *ppv = (IUnknown *) this;
+    }
+    else if (IsEqualIID(iid, IID_ID3DX11ConstantBufferRing))
+    {
+        *ppv = (ID3DX11ConstantBufferRing *) this;
+    }
+    else
+    {
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG CConstantBufferRing::AddRef()
+{
+    return (ULONG) InterlockedIncrement(&m_RefCount);
+}
+
+ULONG CConstantBufferRing::Release()
+{
+    LONG refCount = InterlockedDecrement(&m_RefCount);
+    if (refCount > 0)
+    {
+        return (ULONG) refCount;
+    }
+    else
+    {
+        delete this;
+    }
+
+    return 0;
+}
+
+HRESULT CConstantBufferRing::GetDevice(_Outptr_ ID3D11Device **ppDevice)
+{
+    if (nullptr == ppDevice)
+    {
+        DPF(0, "ID3DX11ConstantBufferRing::GetDevice: ppDevice cannot be nullptr");
+        return E_INVALIDARG;
+    }
+
+    *ppDevice = m_pDevice;
+    m_pDevice->AddRef();
+    return S_OK;
+}
+
+uint32_t CConstantBufferRing::GetSize()
+{
+    return m_Size;
+}
+
+//--------------------------------------------------------------------------------------
+// CEffect support for the cbuffer ring
+//--------------------------------------------------------------------------------------
+
+void CEffect::ReleaseCBRing()
+{
+    SAFE_RELEASE( m_pCBRing );
+    m_CBRingActive = false;
+}
+
+// Cbuffers that are not user-managed are appended to the ring with D3D11_MAP_WRITE_NO_OVERWRITE
+// and bound with *SetConstantBuffers1, rather than updating one buffer per cbuffer with
+// UpdateSubresource. The ring may be shared with other effects.
+HRESULT CEffect::SetConstantBufferRing(_In_opt_ ID3DX11ConstantBufferRing *pRing)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "D3DX11EffectSetConstantBufferRing";
+    CConstantBufferRing *pCBRing = (CConstantBufferRing*) pRing;
+
+    if (nullptr != pCBRing && !pCBRing->IsSameDevice(m_pDevice))
+    {
+        DPF(0, "%s: The ring was created for a different device", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    // Pending uploads to the ring are picked up by CheckAndUpdateCB_FX through IsBufferStale
+    ReleaseCBRing();
+
+    if (nullptr == pCBRing)
+    {
+        goto lExit;
+    }
+
+    // Copies left in an earlier ring (or by the effect a clone was made from) are not in this one
+    for (size_t i = 0; i < m_CBCount; ++ i)
+    {
+        m_pCBRuntimes[i].RingGeneration = 0;
+    }
+
+    m_pCBRing = pCBRing;
+    m_pCBRing->AddRef();
+
+lExit:
+    return hr;
+}
+
+}
+
+//--------------------------------------------------------------------------------------
+
+using namespace D3DX11Effects;
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11CreateConstantBufferRing(ID3D11Device *pDevice, UINT RingSize, ID3DX11ConstantBufferRing **ppRing)
+{
+    HRESULT hr = S_OK;
+    CConstantBufferRing *pRing = nullptr;
+
+    if (!pDevice || !ppRing || 0 == RingSize)
+        return E_INVALIDARG;
+
+    *ppRing = nullptr;
+
+    if (RingSize > D3D11_REQ_RESOURCE_SIZE_IN_MEGABYTES_EXPRESSION_A_TERM * 1024 * 1024)
+    {
+        DPF(0, "D3DX11CreateConstantBufferRing: RingSize is too large");
+        return E_INVALIDARG;
+    }
+    RingSize = (RingSize + SConstantBufferRuntime::c_RingAlignment - 1) & ~(SConstantBufferRuntime::c_RingAlignment - 1);
+
+    VN( pRing = new CConstantBufferRing );
+    VH( pRing->Initialize(pDevice, RingSize) );
+
+    if (S_FALSE == hr)
+    {
+        // Effects keep using one buffer per cbuffer
+        goto lExit;
+    }
+
+    *ppRing = pRing;
+    pRing = nullptr;
+
+lExit:
+    SAFE_RELEASE(pRing);
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectSetConstantBufferRing(ID3DX11Effect *pEffect, ID3DX11ConstantBufferRing *pRing)
+{
+    if (!pEffect)
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*)pEffect)->SetConstantBufferRing(pRing);
+}
@@ -0,0 +1,67 @@
+//--------------------------------------------------------------------------------------
+// File: EffectConstantBufferRing.h
+//
+// Direct3D 11 Effects ring buffer that cbuffer contents are sub-allocated from
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace D3DX11Effects
+{
+
+// Effects sharing the ring append to it in turn, all through the immediate context. A batch is
+// the cbuffers one pass uploads: Reserve makes room for all of them, the first Append of the
+// batch maps the ring and EndBatch unmaps it, since draws cannot read a mapped buffer.
+class CConstantBufferRing : public ID3DX11ConstantBufferRing
+{
+protected:
+    volatile LONG           m_RefCount;
+    ID3D11Device            *m_pDevice;
+    ID3D11DeviceContext1    *m_pContext;
+    ID3D11Buffer            *m_pBuffer;
+    uint32_t                m_Size;
+    uint32_t                m_Offset;               // next free byte
+    uint32_t                m_Generation;           // incremented each time the ring wraps around and is discarded
+    bool                    m_Discard;              // the next map must discard the ring
+    uint8_t                 *m_pMappedData;         // nullptr unless a batch has mapped the ring
+
+public:
+    CConstantBufferRing();
+    virtual ~CConstantBufferRing();
+
+    // Returns S_FALSE if the device does not support constant buffer offsetting
+    HRESULT Initialize(_In_ ID3D11Device *pDevice, _In_ uint32_t Size);
+
+    bool IsSameDevice(_In_ ID3D11Device *pDevice) const { return pDevice == m_pDevice; }
+    bool IsContext(_In_ ID3D11DeviceContext *pContext) const { return pContext == m_pContext; }
+    ID3D11DeviceContext1 *GetContext() const { return m_pContext; }
+    ID3D11Buffer *GetBuffer() const { return m_pBuffer; }
+    uint32_t GetGeneration() const { return m_Generation; }
+
+    // Makes Size bytes of room for a batch, wrapping around if needed; false if the ring is too small
+    bool Reserve(_In_ uint32_t Size);
+
+    // Copies DataSize bytes into the room reserved for the batch and consumes AllocationSize bytes of it,
+    // a multiple of SConstantBufferRuntime::c_RingAlignment; returns the location of the copy, in 16-byte constants
+    bool Append(_In_reads_bytes_(DataSize) const void *pData, _In_ uint32_t DataSize, _In_ uint32_t AllocationSize,
+                _Out_ uint32_t *pFirstConstant);
+
+    void EndBatch();
+
+    // IUnknown
+    STDMETHOD(QueryInterface)(REFIID iid, _COM_Outptr_ LPVOID *ppv) override;
+    STDMETHOD_(ULONG, AddRef)() override;
+    STDMETHOD_(ULONG, Release)() override;
+
+    // ID3DX11ConstantBufferRing
+    STDMETHOD(GetDevice)(_Outptr_ ID3D11Device **ppDevice) override;
+    STDMETHOD_(uint32_t, GetSize)() override;
+};
+
+}
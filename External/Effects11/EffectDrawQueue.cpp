@@ -0,0 +1,400 @@
+//--------------------------------------------------------------------------------------
+// File: EffectDrawQueue.cpp
+//
+// Direct3D 11 Effects queue of draws sorted by shaders and render states
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#include "pchfx.h"
+
+#include "EffectDrawQueue.h"
+
+#include <thread>
+
+namespace D3DX11Effects
+{
+
+// Queues smaller than this are sorted on the calling thread, where starting threads costs more than it saves
+static const uint32_t c_ParallelSortThreshold = 4096;
+static const uint32_t c_MaxSortThreads = 8;
+
+// Width of each field of the sort key, from the most significant one; the sum is 64
+static const uint32_t c_KeyFieldBits[] = { 16, 16, 6, 5, 5, 6, 5, 5 };
+
+// Ids are assigned in order of first appearance. Identities beyond the capacity of the field
+// all share its last id, which only makes the sort group them less well.
+uint32_t SDrawKeyField::GetId(_In_ uint64_t Identity, _In_ uint32_t BitCount)
+{
+    uint32_t maxId = (1 << BitCount) - 1;
+    CDrawKeyIdTable::CIterator iter;
+    SDrawKeyId key;
+
+    // 0 is the identity and the id of missing shaders and states
+    if (0 == Identity)
+        return 0;
+
+    key.Identity = Identity;
+    key.Id = 0;
+
+    if (IdCount > 0 && SUCCEEDED(Ids.FindValueWithHash(key, key.ComputeHash(), &iter)))
+        return iter.GetData().Id;
+
+    if (IdCount >= maxId)
+        return maxId;
+
+    key.Id = IdCount + 1;
+    if (FAILED(Ids.AutoGrow()) || FAILED(Ids.AddValueWithHash(key, key.ComputeHash())))
+        return maxId;
+
+    return ++ IdCount;
+}
+
+static void SortRange(_Inout_updates_(Count) SDrawSortRecord *pRecords, _In_ uint32_t Count)
+{
+    std::sort(pRecords, pRecords + Count);
+}
+
+// Sorts chunks of the records concurrently, then merges them on the calling thread
+static void ParallelSort(_Inout_updates_(Count) SDrawSortRecord *pRecords, _In_ uint32_t Count)
+{
+    uint32_t threadCount = std::min(std::thread::hardware_concurrency(), c_MaxSortThreads);
+
+    if (Count < c_ParallelSortThreshold || threadCount < 2)
+    {
+        SortRange(pRecords, Count);
+        return;
+    }
+
+    uint32_t chunkSize = (Count + threadCount - 1) / threadCount;
+    std::thread workers[c_MaxSortThreads];
+
+    for (uint32_t i = 1; i < threadCount; ++ i)
+    {
+        uint32_t start = std::min(i * chunkSize, Count);
+        uint32_t count = std::min(chunkSize, Count - start);
+
+        try
+        {
+            workers[i] = std::thread(SortRange, pRecords + start, count);
+        }
+        catch (...)
+        {
+            // Could not start a thread: sort the chunk here instead
+            SortRange(pRecords + start, count);
+        }
+    }
+
+    SortRange(pRecords, std::min(chunkSize, Count));
+
+    for (uint32_t i = 1; i < threadCount; ++ i)
+    {
+        if (workers[i].joinable())
+            workers[i].join();
+    }
+
+    for (uint32_t merged = chunkSize; merged < Count; merged += chunkSize)
+    {
+        std::inplace_merge(pRecords, pRecords + merged, pRecords + std::min(merged + chunkSize, Count));
+    }
+}
+
+CDrawQueue::CDrawQueue()
+{
+    m_RefCount = 1;
+    m_IsSorted = true;
+}
+
+CDrawQueue::~CDrawQueue()
+{
+}
+
+uint64_t CDrawQueue::ComputeSortKey(_In_ SPassBlock *pPass)
+{
+    D3DX11_EFFECT_PASS_IDENTITY identity;
+    uint64_t identities[EKF_Count];
+    uint64_t key = 0;
+
+    // Identity hashes compare equal for identical shaders and states of different effects
+    pPass->GetIdentity(&identity);
+
+    // Compute passes have no pixel shader, so they are ordered by their compute shader instead
+    identities[EKF_PixelShader] = (0 != identity.PixelShaderHash) ? identity.PixelShaderHash : identity.ComputeShaderHash;
+    identities[EKF_VertexShader] = identity.VertexShaderHash;
+    identities[EKF_GeometryShader] = identity.GeometryShaderHash;
+    identities[EKF_HullShader] = identity.HullShaderHash;
+    identities[EKF_DomainShader] = identity.DomainShaderHash;
+    identities[EKF_Blend] = identity.BlendStateHash;
+    identities[EKF_DepthStencil] = identity.DepthStencilStateHash;
+    identities[EKF_Rasterizer] = identity.RasterizerStateHash;
+
+    for (uint32_t i = 0; i < EKF_Count; ++ i)
+    {
+        key = (key << c_KeyFieldBits[i]) | m_KeyFields[i].GetId(identities[i], c_KeyFieldBits[i]);
+    }
+
+    return key;
+}
+
+// Looks up the entry of m_AppliedParameters for the variable, adding it on first use
+HRESULT CDrawQueue::GetAppliedIndex(_In_ ID3DX11EffectVariable *pVariable, _Out_ uint32_t *pIndex)
+{
+    HRESULT hr = S_OK;
+    CDrawVariableIndexTable::CIterator iter;
+    SDrawVariableIndex key;
+    SDrawParameter applied;
+
+    key.pVariable = pVariable;
+    key.Index = m_AppliedParameters.GetSize();
+
+    if (m_AppliedParameters.GetSize() > 0 && SUCCEEDED(m_AppliedParameterIndex.FindValueWithHash(key, key.ComputeHash(), &iter)))
+    {
+        *pIndex = iter.GetData().Index;
+        goto lExit;
+    }
+
+    applied.pVariable = pVariable;
+    applied.Offset = 0;
+    applied.ByteCount = 0;
+    applied.AppliedIndex = key.Index;
+
+    VH( m_AppliedParameterIndex.AutoGrow() );
+    VH( m_AppliedParameters.Add(applied) );
+    if (FAILED(m_AppliedParameterIndex.AddValueWithHash(key, key.ComputeHash())))
+    {
+        m_AppliedParameters.Delete(key.Index);
+        VH( E_OUTOFMEMORY );
+    }
+
+    *pIndex = key.Index;
+
+lExit:
+    return hr;
+}
+
+HRESULT CDrawQueue::ApplyParameter(_In_ const SDrawParameter *pParameter)
+{
+    HRESULT hr = S_OK;
+    SDrawParameter *pApplied = &m_AppliedParameters[pParameter->AppliedIndex];
+
+    if (pApplied->ByteCount == pParameter->ByteCount &&
+        0 == memcmp(&m_ParameterData[pApplied->Offset], &m_ParameterData[pParameter->Offset], pParameter->ByteCount))
+    {
+        // Same value as the previous draw
+        goto lExit;
+    }
+
+    VH( pParameter->pVariable->SetRawValue(&m_ParameterData[pParameter->Offset], 0, pParameter->ByteCount) );
+
+    *pApplied = *pParameter;
+
+lExit:
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT CDrawQueue::QueryInterface(REFIID iid, LPVOID *ppv)
+{
+    if (nullptr == ppv)
+    {
+        DPF(0, "ID3DX11DrawQueue::QueryInterface: nullptr parameter");
+        return E_INVALIDARG;
+    }
+
+    *ppv = nullptr;
+    if (IsEqualIID(iid, IID_IUnknown))
+    {
+        *ppv = (IUnknown *) this;
+    }
+    else if (IsEqualIID(iid, IID_ID3DX11DrawQueue))
+    {
+        *ppv = (ID3DX11DrawQueue *) this;
+    }
+    else
+    {
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG CDrawQueue::AddRef()
+{
+    return ++ m_RefCount;
+}
+
+ULONG CDrawQueue::Release()
+{
+    if (-- m_RefCount > 0)
+    {
+        return m_RefCount;
+    }
+    else
+    {
+        delete this;
+    }
+
+    return 0;
+}
+
+_Use_decl_annotations_
+HRESULT CDrawQueue::Submit(ID3DX11EffectPass *pPass, const D3DX11_EFFECT_DRAW_PARAMETER *pParameters, uint32_t ParameterCount,
+                           LPD3DX11EFFECTDRAWCALLBACK pfnDraw, void *pUserData)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11DrawQueue::Submit";
+    uint32_t firstParameter = m_Parameters.GetSize();
+    SPassBlock *pPassBlock;
+    SDrawItem item;
+    SDrawSortRecord record;
+
+    VERIFYPARAMETER(pPass != nullptr && pfnDraw != nullptr);
+    VERIFYPARAMETER(pParameters != nullptr || ParameterCount == 0);
+
+    if (!pPass->IsValid())
+    {
+        DPF(0, "%s: Invalid pass", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    pPassBlock = (SPassBlock *) pPass;
+
+    item.pPass = pPassBlock;
+    item.FirstParameter = firstParameter;
+    item.ParameterCount = ParameterCount;
+    item.pfnDraw = pfnDraw;
+    item.pUserData = pUserData;
+
+    for (uint32_t i = 0; i < ParameterCount; ++ i)
+    {
+        SDrawParameter parameter;
+
+        if (nullptr == pParameters[i].pVariable || !pParameters[i].pVariable->IsValid() ||
+            nullptr == pParameters[i].pData || 0 == pParameters[i].ByteCount)
+        {
+            DPF(0, "%s: Invalid parameter %u", pFuncName, i);
+            VH( E_INVALIDARG );
+        }
+
+        parameter.pVariable = pParameters[i].pVariable;
+        parameter.Offset = m_ParameterData.GetSize();
+        parameter.ByteCount = pParameters[i].ByteCount;
+
+        VH( GetAppliedIndex(parameter.pVariable, &parameter.AppliedIndex) );
+        VH( m_ParameterData.AddRange((const uint8_t*) pParameters[i].pData, pParameters[i].ByteCount) );
+        VH( m_Parameters.Add(parameter) );
+    }
+
+    // The key reflects the shaders and states the pass selected when it was last applied
+    record.Key = ComputeSortKey(pPassBlock);
+    record.Sequence = m_Items.GetSize();
+
+    VH( m_Items.Add(item) );
+    if (FAILED(m_SortRecords.Add(record)))
+    {
+        m_Items.Delete(record.Sequence);
+        VH( E_OUTOFMEMORY );
+    }
+
+    m_IsSorted = false;
+
+lExit:
+    if (FAILED(hr))
+    {
+        // Drop the parameters of the rejected draw; their data is left unused until Clear
+        while (m_Parameters.GetSize() > firstParameter)
+        {
+            m_Parameters.Delete(m_Parameters.GetSize() - 1);
+        }
+    }
+    return hr;
+}
+
+HRESULT CDrawQueue::Sort()
+{
+    if (!m_IsSorted)
+    {
+        ParallelSort(m_SortRecords.GetData(), m_SortRecords.GetSize());
+        m_IsSorted = true;
+    }
+
+    return S_OK;
+}
+
+_Use_decl_annotations_
+HRESULT CDrawQueue::Execute(ID3D11DeviceContext *pContext)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11DrawQueue::Execute";
+
+    VERIFYPARAMETER(pContext != nullptr);
+
+    VH( Sort() );
+
+    // Values may have been changed outside of the queue since the last Execute
+    for (uint32_t i = 0; i < m_AppliedParameters.GetSize(); ++ i)
+    {
+        m_AppliedParameters[i].ByteCount = 0;
+    }
+
+    for (uint32_t i = 0; i < m_SortRecords.GetSize(); ++ i)
+    {
+        SDrawItem *pItem = &m_Items[m_SortRecords[i].Sequence];
+
+        for (uint32_t j = 0; j < pItem->ParameterCount; ++ j)
+        {
+            VH( ApplyParameter(&m_Parameters[pItem->FirstParameter + j]) );
+        }
+
+        VH( pItem->pPass->Apply(0, pContext) );
+        pItem->pfnDraw(pContext, pItem->pUserData);
+    }
+
+lExit:
+    return hr;
+}
+
+HRESULT CDrawQueue::Clear()
+{
+    m_Items.Empty();
+    m_SortRecords.Empty();
+    m_Parameters.Empty();
+    m_ParameterData.Empty();
+    m_AppliedParameters.Empty();
+    m_AppliedParameterIndex.Cleanup();
+    m_IsSorted = true;
+
+    // Ids are kept, so the keys of recurring objects stay the same from frame to frame
+
+    return S_OK;
+}
+
+uint32_t CDrawQueue::GetCount()
+{
+    return m_Items.GetSize();
+}
+
+}
+
+//--------------------------------------------------------------------------------------
+
+using namespace D3DX11Effects;
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11CreateDrawQueue(ID3DX11DrawQueue **ppQueue)
+{
+    HRESULT hr = S_OK;
+
+    if (!ppQueue)
+        return E_INVALIDARG;
+
+    VN( *ppQueue = new CDrawQueue );
+
+lExit:
+    return hr;
+}
@@ -0,0 +1,146 @@
+//--------------------------------------------------------------------------------------
+// File: EffectDrawQueue.h
+//
+// Direct3D 11 Effects queue of draws sorted by shaders and render states
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace D3DX11Effects
+{
+
+struct SDrawItem
+{
+    SPassBlock                  *pPass;
+    uint32_t                    FirstParameter;     // into CDrawQueue::m_Parameters
+    uint32_t                    ParameterCount;
+    LPD3DX11EFFECTDRAWCALLBACK  pfnDraw;
+    void                        *pUserData;
+};
+
+// Items are sorted through these records, so that the sort only moves 16 bytes per item.
+// Sequence is the index of the item, which makes the order total and the sort stable.
+struct SDrawSortRecord
+{
+    uint64_t    Key;
+    uint32_t    Sequence;
+
+    bool operator<(_In_ const SDrawSortRecord &Other) const
+    {
+        return Key < Other.Key || (Key == Other.Key && Sequence < Other.Sequence);
+    }
+};
+
+struct SDrawParameter
+{
+    ID3DX11EffectVariable   *pVariable;
+    uint32_t                Offset;             // into CDrawQueue::m_ParameterData
+    uint32_t                ByteCount;
+    uint32_t                AppliedIndex;       // into CDrawQueue::m_AppliedParameters, shared by all parameters of pVariable
+};
+
+struct SDrawKeyId
+{
+    uint64_t    Identity;
+    uint32_t    Id;
+
+    uint32_t ComputeHash() const
+    {
+        return ::ComputeHash((const uint8_t*) &Identity, sizeof(Identity));
+    }
+
+    static bool AreIdentitiesEqual(const SDrawKeyId &Id1, const SDrawKeyId &Id2)
+    {
+        return Id1.Identity == Id2.Identity;
+    }
+};
+
+struct SDrawVariableIndex
+{
+    ID3DX11EffectVariable   *pVariable;
+    uint32_t                Index;
+
+    uint32_t ComputeHash() const
+    {
+        return ::ComputeHash((const uint8_t*) &pVariable, sizeof(pVariable));
+    }
+
+    static bool AreVariablesEqual(const SDrawVariableIndex &Index1, const SDrawVariableIndex &Index2)
+    {
+        return Index1.pVariable == Index2.pVariable;
+    }
+};
+
+typedef CEffectHashTable<SDrawKeyId, SDrawKeyId::AreIdentitiesEqual> CDrawKeyIdTable;
+typedef CEffectHashTable<SDrawVariableIndex, SDrawVariableIndex::AreVariablesEqual> CDrawVariableIndexTable;
+
+// Dense ids of the identity hashes seen by a queue, one table per field of the sort key
+struct SDrawKeyField
+{
+    CDrawKeyIdTable Ids;
+    uint32_t        IdCount;
+
+    SDrawKeyField() : IdCount(0) {}
+
+    uint32_t GetId(_In_ uint64_t Identity, _In_ uint32_t BitCount);
+};
+
+class CDrawQueue : public ID3DX11DrawQueue
+{
+protected:
+    enum EKeyField
+    {
+        EKF_PixelShader,
+        EKF_VertexShader,
+        EKF_GeometryShader,
+        EKF_HullShader,
+        EKF_DomainShader,
+        EKF_Blend,
+        EKF_DepthStencil,
+        EKF_Rasterizer,
+        EKF_Count
+    };
+
+    uint32_t                        m_RefCount;
+    CEffectVector<SDrawItem>        m_Items;
+    CEffectVector<SDrawSortRecord>  m_SortRecords;
+    CEffectVector<SDrawParameter>   m_Parameters;
+    CEffectVector<uint8_t>          m_ParameterData;
+    SDrawKeyField                   m_KeyFields[EKF_Count];
+    bool                            m_IsSorted;
+
+    // Last value set for each variable during Execute, one entry per variable submitted
+    // since the last Clear; ByteCount is 0 until a value is set
+    CEffectVector<SDrawParameter>   m_AppliedParameters;
+    CDrawVariableIndexTable         m_AppliedParameterIndex;
+
+    uint64_t ComputeSortKey(_In_ SPassBlock *pPass);
+    HRESULT GetAppliedIndex(_In_ ID3DX11EffectVariable *pVariable, _Out_ uint32_t *pIndex);
+    HRESULT ApplyParameter(_In_ const SDrawParameter *pParameter);
+
+public:
+    CDrawQueue();
+    virtual ~CDrawQueue();
+
+    // IUnknown
+    STDMETHOD(QueryInterface)(REFIID iid, _COM_Outptr_ LPVOID *ppv) override;
+    STDMETHOD_(ULONG, AddRef)() override;
+    STDMETHOD_(ULONG, Release)() override;
+
+    // ID3DX11DrawQueue
+    STDMETHOD(Submit)(_In_ ID3DX11EffectPass *pPass,
+                      _In_reads_opt_(ParameterCount) const D3DX11_EFFECT_DRAW_PARAMETER *pParameters, _In_ uint32_t ParameterCount,
+                      _In_ LPD3DX11EFFECTDRAWCALLBACK pfnDraw, _In_opt_ void *pUserData) override;
+    STDMETHOD(Sort)() override;
+    STDMETHOD(Execute)(_In_ ID3D11DeviceContext *pContext) override;
+    STDMETHOD(Clear)() override;
+    STDMETHOD_(uint32_t, GetCount)() override;
+};
+
+}
@@ -17,8 +17,6 @@
 
 #include "EffectStates11.h"
 
-#define PRIVATENEW new(m_BulkHeap)
-
 namespace D3DX11Effects
 {
 
@@ -28,6 +26,7 @@ SRasterizerBlock g_NullRasterizer;
 SDepthStencilBlock g_NullDepthStencil;
 SBlendBlock g_NullBlend;
 SShaderResource g_NullTexture;
+SSamplerBlock g_NullSampler;
 SInterface g_NullInterface;
 SUnorderedAccessView g_NullUnorderedAccessView;
 SRenderTargetView g_NullRenderTargetView;
@@ -39,12 +38,16 @@ SDepthStencilView g_NullDepthStencilView;
 // 3) SetSamplers
 // 4) SetShaderResources
 // 5) CreateShader
+// 6) SetConstantBuffers1
+// 7) Stage
 SD3DShaderVTable g_vtPS = {
     (void (__stdcall ID3D11DeviceContext::*)(ID3D11DeviceChild*, ID3D11ClassInstance*const*, uint32_t)) &ID3D11DeviceContext::PSSetShader,
     &ID3D11DeviceContext::PSSetConstantBuffers,
     &ID3D11DeviceContext::PSSetSamplers,
     &ID3D11DeviceContext::PSSetShaderResources,
-    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreatePixelShader
+    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreatePixelShader,
+    &ID3D11DeviceContext1::PSSetConstantBuffers1,
+    ESS_Pixel
 };
 
 SD3DShaderVTable g_vtVS = {
@@ -52,7 +55,9 @@ SD3DShaderVTable g_vtVS = {
     &ID3D11DeviceContext::VSSetConstantBuffers,
     &ID3D11DeviceContext::VSSetSamplers,
     &ID3D11DeviceContext::VSSetShaderResources,
-    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateVertexShader
+    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateVertexShader,
+    &ID3D11DeviceContext1::VSSetConstantBuffers1,
+    ESS_Vertex
 };
 
 SD3DShaderVTable g_vtGS = {
@@ -60,7 +65,9 @@ SD3DShaderVTable g_vtGS = {
     &ID3D11DeviceContext::GSSetConstantBuffers,
     &ID3D11DeviceContext::GSSetSamplers,
     &ID3D11DeviceContext::GSSetShaderResources,
-    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateGeometryShader
+    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateGeometryShader,
+    &ID3D11DeviceContext1::GSSetConstantBuffers1,
+    ESS_Geometry
 };
 
 SD3DShaderVTable g_vtHS = {
@@ -68,7 +75,9 @@ SD3DShaderVTable g_vtHS = {
     &ID3D11DeviceContext::HSSetConstantBuffers,
     &ID3D11DeviceContext::HSSetSamplers,
     &ID3D11DeviceContext::HSSetShaderResources,
-    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateHullShader
+    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateHullShader,
+    &ID3D11DeviceContext1::HSSetConstantBuffers1,
+    ESS_Hull
 };
 
 SD3DShaderVTable g_vtDS = {
@@ -76,7 +85,9 @@ SD3DShaderVTable g_vtDS = {
     &ID3D11DeviceContext::DSSetConstantBuffers,
     &ID3D11DeviceContext::DSSetSamplers,
     &ID3D11DeviceContext::DSSetShaderResources,
-    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateDomainShader
+    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateDomainShader,
+    &ID3D11DeviceContext1::DSSetConstantBuffers1,
+    ESS_Domain
 };
 
 SD3DShaderVTable g_vtCS = {
@@ -84,7 +95,9 @@ SD3DShaderVTable g_vtCS = {
     &ID3D11DeviceContext::CSSetConstantBuffers,
     &ID3D11DeviceContext::CSSetSamplers,
     &ID3D11DeviceContext::CSSetShaderResources,
-    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateComputeShader
+    (HRESULT (__stdcall ID3D11Device::*)(const void *, size_t, ID3D11ClassLinkage*, ID3D11DeviceChild **)) &ID3D11Device::CreateComputeShader,
+    &ID3D11DeviceContext1::CSSetConstantBuffers1,
+    ESS_Compute
 };
 
 SShaderBlock g_NullVS(&g_vtVS);
@@ -183,16 +196,21 @@ inline HRESULT VerifyPointer(uint32_t oBase, uint32_t dwSize, uint32_t dwMaxSize
 
 //////////////////////////////////////////////////////////////////////////
 // EffectHeap 
-// A simple class which assists in adding data to a block of memory
+// A simple class which assists in adding data to a chain of memory blocks
 //////////////////////////////////////////////////////////////////////////
 
-CEffectHeap::CEffectHeap() : m_pData(nullptr), m_dwSize(0), m_dwBufferSize(0)
+// Blocks added on demand double in size from c_HeapInitialGrowSize up to c_HeapMaxGrowSize; an
+// allocation larger than that gets a block of its own size
+static const uint32_t c_HeapInitialGrowSize = 4096;
+static const uint32_t c_HeapMaxGrowSize = 1024 * 1024;
+
+CEffectHeap::CEffectHeap() : m_pFirst(nullptr), m_pLast(nullptr), m_dwBufferSize(0), m_dwSize(0), m_dwGrowSize(0)
 {
 }
 
 CEffectHeap::~CEffectHeap()
 {
-    SAFE_DELETE_ARRAY(m_pData);
+    FreeMemory();
 }
 
 uint32_t  CEffectHeap::GetSize()
@@ -200,24 +218,105 @@ uint32_t  CEffectHeap::GetSize()
     return m_dwSize;
 }
 
-HRESULT CEffectHeap::ReserveMemory(uint32_t dwSize)
+// The block header shares the allocation of its data
+HRESULT CEffectHeap::AddBlock(uint32_t dwSize)
 {
     HRESULT hr = S_OK;
+    CCheckedDword chkAllocSize( AlignToPowerOf2((uint32_t)sizeof(SBlock), c_DataAlignment) );
+    CCheckedDword chkBufferSize( m_dwBufferSize );
+    uint32_t  allocSize, bufferSize;
+    SBlock *pBlock;
 
-    assert(!m_pData);
     assert(dwSize == AlignToPowerOf2(dwSize, c_DataAlignment));
 
-    m_dwBufferSize = dwSize;
+    chkAllocSize += dwSize;
+    chkBufferSize += dwSize;
+    VHD( chkAllocSize.GetValue(&allocSize), "Overflow while adding data to Effect heap." );
+    VHD( chkBufferSize.GetValue(&bufferSize), "Overflow while adding data to Effect heap." );
+
+    VN( pBlock = (SBlock*) AllocateEffectMemory(allocSize) );
+    pBlock->pNext = nullptr;
+    pBlock->pData = (uint8_t*) pBlock + AlignToPowerOf2((uint32_t)sizeof(SBlock), c_DataAlignment);
+    pBlock->Offset = m_dwSize;
+    pBlock->BufferSize = dwSize;
 
-    VN( m_pData = new uint8_t[m_dwBufferSize] );
-    
     // make sure that we have machine word alignment
-    assert(m_pData == AlignToPowerOf2(m_pData, c_DataAlignment));
+    assert(pBlock->pData == AlignToPowerOf2(pBlock->pData, c_DataAlignment));
+
+    if (nullptr != m_pLast)
+    {
+        m_pLast->pNext = pBlock;
+    }
+    else
+    {
+        m_pFirst = pBlock;
+    }
+    m_pLast = pBlock;
+    m_dwBufferSize = bufferSize;
 
 lExit:
     return hr;
 }
 
+HRESULT CEffectHeap::ReserveMemory(uint32_t dwSize)
+{
+    assert(nullptr == m_pFirst);
+    assert(dwSize == AlignToPowerOf2(dwSize, c_DataAlignment));
+
+    if (0 == dwSize)
+        return S_OK;
+
+    return AddBlock(dwSize);
+}
+
+void CEffectHeap::EnableGrowth()
+{
+    if (0 == m_dwGrowSize)
+    {
+        m_dwGrowSize = c_HeapInitialGrowSize;
+    }
+}
+
+void CEffectHeap::FreeMemory()
+{
+    SBlock *pBlock = m_pFirst;
+    while (pBlock)
+    {
+        SBlock *pCurrent = pBlock;
+        pBlock = pBlock->pNext;
+        FreeEffectMemory(pCurrent);
+    }
+
+    m_pFirst = m_pLast = nullptr;
+    m_dwBufferSize = m_dwSize = 0;
+}
+
+_Use_decl_annotations_
+bool CEffectHeap::GetOffset(const void *pData, uint32_t *pOffset) const
+{
+    for (const SBlock *pBlock = m_pFirst; nullptr != pBlock; pBlock = pBlock->pNext)
+    {
+        if (pData >= pBlock->pData && pData < (pBlock->pData + GetBlockSize(pBlock)))
+        {
+            *pOffset = pBlock->Offset + (uint32_t) ((const uint8_t*) pData - pBlock->pData);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t* CEffectHeap::GetPointer(uint32_t Offset) const
+{
+    for (const SBlock *pBlock = m_pFirst; nullptr != pBlock; pBlock = pBlock->pNext)
+    {
+        if (Offset - pBlock->Offset < GetBlockSize(pBlock))
+            return pBlock->pData + (Offset - pBlock->Offset);
+    }
+
+    assert(0);
+    return nullptr;
+}
+
 _Use_decl_annotations_
 HRESULT CEffectHeap::AddString(const char *pString, char **ppPointer)
 {
@@ -241,9 +340,22 @@ HRESULT CEffectHeap::AddDataInternal(_In_reads_bytes_(dwSize) const void *pData,
     
     // align original value
     finalSize = AlignToPowerOf2(finalSize - c_DataAlignment, c_DataAlignment);
-    VBD( finalSize <= m_dwBufferSize, "Overflow adding data to Effect heap." );
 
-    *ppPointer = m_pData + m_dwSize;
+    if (nullptr == m_pLast || finalSize - m_pLast->Offset > m_pLast->BufferSize)
+    {
+        if (0 == dwSize)
+        {
+            *ppPointer = nullptr;
+            goto lExit;
+        }
+
+        // The rest of the last block is left unused, so that the used parts of the blocks stay contiguous in the logical layout
+        VBD( m_dwGrowSize > 0, "Overflow adding data to Effect heap." );
+        VH( AddBlock(std::max(finalSize - m_dwSize, m_dwGrowSize)) );
+        m_dwGrowSize = std::min(m_dwGrowSize, c_HeapMaxGrowSize / 2) * 2;
+    }
+
+    *ppPointer = m_pLast->pData + (m_dwSize - m_pLast->Offset);
     assert(*ppPointer == AlignToPowerOf2(*ppPointer, c_DataAlignment));
 
     if( bCopyData )
@@ -265,38 +377,28 @@ HRESULT CEffectHeap::AddData(const void *pData, uint32_t  dwSize, void **ppPoint
     return AddDataInternal<true>( pData, dwSize, ppPointer );
 }
 
-// Moves a string from the general heap to the private heap and modifies the pointer to
-//   point to the new memory block.
-// The general heap is freed as a whole, so we don't worry about leaking the given string pointer.
-// This data is forcibly aligned, so make sure you account for that in calculating heap size
-_Use_decl_annotations_
-HRESULT CEffectHeap::MoveString(char **ppString)
+void* CEffectHeap::Allocate(uint32_t dwSize)
 {
-    HRESULT hr;
-    char *pNewPointer;
-
-    if (*ppString == nullptr)
-        return S_OK;
+    void *pPointer;
 
-    hr = AddString(*ppString, &pNewPointer);
-    if ( SUCCEEDED(hr) )
-        *ppString = pNewPointer;
+    if (FAILED(AddDataInternal<false>(nullptr, dwSize, &pPointer)))
+        return nullptr;
 
-    return hr;
+    return pPointer;
 }
 
-// Allocates space but does not move data
-// The general heap is freed as a whole, so we don't worry about leaking the given string pointer.
+// Moves data from the general heap to the private heap and modifies the pointer to
+//   point to the new memory block 
+// The general heap is freed as a whole, so we don't worry about leaking the given pointer.
 // This data is forcibly aligned, so make sure you account for that in calculating heap size
-_Use_decl_annotations_  
-HRESULT CEffectHeap::MoveEmptyDataBlock(void **ppData, uint32_t  size)
+_Use_decl_annotations_
+HRESULT CEffectHeap::MoveData(void **ppData, uint32_t  size)
 {
     HRESULT hr;
     void *pNewPointer;
 
-    hr = AddDataInternal<false>(*ppData, size, &pNewPointer);
-
-    if (SUCCEEDED(hr))
+    hr = AddData(*ppData, size, &pNewPointer);
+    if ( SUCCEEDED(hr) )
     {
         *ppData = pNewPointer;
         if (size == 0)
@@ -309,59 +411,37 @@ HRESULT CEffectHeap::MoveEmptyDataBlock(void **ppData, uint32_t  size)
     return hr;
 }
 
-// Moves an array of SInterfaceParameters from the general heap to the private heap and modifies the pointer to
-//   point to the new memory block.
-// The general heap is freed as a whole, so we don't worry about leaking the given string pointer.
-// This data is forcibly aligned, so make sure you account for that in calculating heap size
 _Use_decl_annotations_
-HRESULT CEffectHeap::MoveInterfaceParameters(uint32_t InterfaceCount, SShaderBlock::SInterfaceParameter **ppInterfaces)
+HRESULT CEffectHeap::CopyFrom(CEffectHeap &Heap)
 {
-    HRESULT hr;
-    SShaderBlock::SInterfaceParameter *pNewPointer;
+    HRESULT hr = S_OK;
 
-    if (*ppInterfaces == nullptr)
-        return S_OK;
+    assert(nullptr == m_pFirst);
 
-    VBD( InterfaceCount <= D3D11_SHADER_MAX_INTERFACES, "Internal loading error: InterfaceCount > D3D11_SHADER_MAX_INTERFACES." );
-    VH( AddData(*ppInterfaces, InterfaceCount * sizeof(SShaderBlock::SInterfaceParameter), (void**)&pNewPointer) );
+    if (0 == Heap.m_dwSize)
+        goto lExit;
 
-    for( size_t i=0; i < InterfaceCount; i++ )
+    VH( ReserveMemory(Heap.m_dwSize) );
+    for (const SBlock *pBlock = Heap.m_pFirst; nullptr != pBlock; pBlock = pBlock->pNext)
     {
-        VH( MoveString( &pNewPointer[i].pName ) );
+        memcpy(m_pFirst->pData + pBlock->Offset, pBlock->pData, Heap.GetBlockSize(pBlock));
     }
-
-    *ppInterfaces = pNewPointer;
+    m_dwSize = Heap.m_dwSize;
 
 lExit:
     return hr;
 }
 
-
-// Moves data from the general heap to the private heap and modifies the pointer to
-//   point to the new memory block 
-// The general heap is freed as a whole, so we don't worry about leaking the given pointer.
-// This data is forcibly aligned, so make sure you account for that in calculating heap size
 _Use_decl_annotations_
-HRESULT CEffectHeap::MoveData(void **ppData, uint32_t  size)
+void CEffectHeap::Swap(CEffectHeap &Heap)
 {
-    HRESULT hr;
-    void *pNewPointer;
-
-    hr = AddData(*ppData, size, &pNewPointer);
-    if ( SUCCEEDED(hr) )
-    {
-        *ppData = pNewPointer;
-        if (size == 0)
-        {
-            // To help catch bugs, set zero-byte blocks to null. There's no real reason to do this
-            *ppData = nullptr;
-        }
-    }
-
-    return hr;
+    std::swap(m_pFirst, Heap.m_pFirst);
+    std::swap(m_pLast, Heap.m_pLast);
+    std::swap(m_dwBufferSize, Heap.m_dwBufferSize);
+    std::swap(m_dwSize, Heap.m_dwSize);
+    std::swap(m_dwGrowSize, Heap.m_dwGrowSize);
 }
 
-
 //////////////////////////////////////////////////////////////////////////
 // Load API 
 //////////////////////////////////////////////////////////////////////////
@@ -379,11 +459,13 @@ HRESULT CEffect::LoadEffect(const void *pEffectBuffer, uint32_t cbEffectBuffer)
     }
     
     VH( loader.LoadEffect(this, pEffectBuffer, cbEffectBuffer) );
+    VH( BuildSemanticBindings() );
+    VH( RecordRelocations() );
 
 lExit:
     if( FAILED( hr ) )
     {
-        // Release here because m_pShaderBlocks may still be in loader.m_BulkHeap if loading failed before we reallocated the memory
+        // Release here because the shader blocks loaded so far hold references to their reflection and input signatures
         ReleaseShaderRefection();
     }
     return hr;
@@ -392,8 +474,39 @@ lExit:
 //////////////////////////////////////////////////////////////////////////
 // CEffectLoader
 // A helper class which loads an effect
+//
+// The effect data is placed straight into the heaps of the effect, where it stays:
+//   m_pEffect->m_Heap:              variables, blocks, constant buffers and their stores, groups and passes
+//   m_pEffect->m_RuntimeHeap:       pass records, assignments and shader dependency arrays
+//   m_pReflection->m_Heap:          names, annotations and other reflection data
+//   m_pReflection->m_BytecodeHeap:  shader bytecode
+// The heaps grow by adding blocks, so nothing is moved or fixed up once it is loaded.
 //////////////////////////////////////////////////////////////////////////
 
+// Allocates an array in one of the effect heaps. Empty arrays are nullptr.
+template<class T> static HRESULT AllocateArray(_Inout_ CEffectHeap &Heap, _In_ uint32_t Count, _Outptr_result_maybenull_ T **ppArray)
+{
+    HRESULT hr = S_OK;
+    CCheckedDword chkSize = Count;
+    uint32_t  size;
+
+    *ppArray = nullptr;
+    if (0 == Count)
+        goto lExit;
+
+    chkSize *= (uint32_t) sizeof(T);
+    VHD( chkSize.GetValue(&size), "Overflow: too many Effect objects." );
+    VN( *ppArray = (T*) Heap.Allocate(size) );
+
+    for (uint32_t i = 0; i < Count; ++ i)
+    {
+        new(*ppArray + i) T;
+    }
+
+lExit:
+    return hr;
+}
+
 _Use_decl_annotations_
 HRESULT CEffectLoader::GetUnstructuredDataBlock(uint32_t offset, uint32_t  *pdwSize, void **ppData)
 {
@@ -410,10 +523,6 @@ lExit:
 }
 
 // position in buffer is lost on error
-//
-// This function should be used in 1:1 conjunction with CEffectHeap::MoveString;
-// that is, any string added to the reflection heap with this function
-// must be relocated with MoveString at some point later on.
 _Use_decl_annotations_
 HRESULT CEffectLoader::GetStringAndAddToReflection(uint32_t offset, char **ppString)
 {
@@ -430,8 +539,7 @@ HRESULT CEffectLoader::GetStringAndAddToReflection(uint32_t offset, char **ppStr
     oldPos = m_msUnstructured.GetPosition();
 
     VH( m_msUnstructured.ReadAtOffset(offset, &pName) );
-    m_ReflectionMemory += AlignToPowerOf2( (uint32_t)strlen(pName) + 1, c_DataAlignment);
-    *ppString = const_cast<char*>(pName);
+    VH( m_pReflection->m_Heap.AddString(pName, ppString) );
     
     m_msUnstructured.Seek(oldPos);
 
@@ -440,10 +548,6 @@ lExit:
 }
 
 // position in buffer is lost on error
-//
-// This function should be used in 1:1 conjunction with CEffectHeap::MoveInterfaceParameters;
-// that is, any array of parameters added to the reflection heap with this function
-// must be relocated with MoveInterfaceParameters at some point later on.
 _Use_decl_annotations_  
 HRESULT CEffectLoader::GetInterfaceParametersAndAddToReflection( uint32_t InterfaceCount, uint32_t offset, SShaderBlock::SInterfaceParameter **ppInterfaces )
 {
@@ -460,21 +564,21 @@ HRESULT CEffectLoader::GetInterfaceParametersAndAddToReflection( uint32_t Interf
     oldPos = m_msUnstructured.GetPosition();
 
     VBD( InterfaceCount <= D3D11_SHADER_MAX_INTERFACES, "Internal loading error: InterfaceCount > D3D11_SHADER_MAX_INTERFACES." );
-    m_ReflectionMemory += AlignToPowerOf2(InterfaceCount * sizeof(SShaderBlock::SInterfaceParameter), c_DataAlignment);
     assert( ppInterfaces != 0 );
     _Analysis_assume_( ppInterfaces != 0 );
-    (*ppInterfaces) = PRIVATENEW SShaderBlock::SInterfaceParameter[InterfaceCount];
-    VN( *ppInterfaces );
+    VH( AllocateArray(m_pReflection->m_Heap, InterfaceCount, ppInterfaces) );
 
     VHD( m_msUnstructured.ReadAtOffset(offset, sizeof(SBinaryInterfaceInitializer) * InterfaceCount, (void**)&pInterfaceInitializer),
          "Invalid pEffectBuffer: cannot read interface initializer." );
 
     for( size_t i=0; i < InterfaceCount; i++ )
     {
+        LPCSTR pName;
+
         (*ppInterfaces)[i].Index = pInterfaceInitializer[i].ArrayIndex;
-        VHD( m_msUnstructured.ReadAtOffset(pInterfaceInitializer[i].oInstanceName, const_cast<LPCSTR*>(&(*ppInterfaces)[i].pName)),
+        VHD( m_msUnstructured.ReadAtOffset(pInterfaceInitializer[i].oInstanceName, &pName),
              "Invalid pEffectBuffer: cannot read interface initializer." );
-        m_ReflectionMemory += AlignToPowerOf2( (uint32_t)strlen((*ppInterfaces)[i].pName) + 1, c_DataAlignment);
+        VH( m_pReflection->m_Heap.AddString(pName, &(*ppInterfaces)[i].pName) );
     }
 
     m_msUnstructured.Seek(oldPos);
@@ -483,369 +587,165 @@ lExit:
     return hr;
 }
 
-HRESULT CEffectLoader::FixupCBPointer(_Inout_ SConstantBuffer **ppCB)
+// Adds the size that AllocateArray takes in the heap for an array
+template<class T> static void AddArraySize(_Inout_ CCheckedDword64 &chkSize, _In_ uint32_t Count)
 {
-    HRESULT hr = S_OK;
-    
-    size_t index = (SConstantBuffer*)*ppCB - m_pOldCBs;
-    assert( index * sizeof(SConstantBuffer) == ((size_t)(SConstantBuffer*)*ppCB - (size_t)m_pOldCBs) );
-    VBD( index < m_pEffect->m_CBCount, "Internal loading error: invalid constant buffer index." );
-    *ppCB = (SConstantBuffer*)(m_pEffect->m_pCBs + index);
-    
-lExit:
-    return hr;
+    chkSize += ((uint64_t) Count * sizeof(T) + c_DataAlignment - 1) & ~((uint64_t) c_DataAlignment - 1);
 }
 
-HRESULT CEffectLoader::FixupShaderPointer(_Inout_ SShaderBlock **ppShaderBlock)
+static HRESULT GetEffectVersion( _In_ uint32_t effectFileTag, _Out_ DWORD* pVersion )
 {
-    HRESULT hr = S_OK;
-    if (*ppShaderBlock != &g_NullVS && *ppShaderBlock != &g_NullGS && *ppShaderBlock != &g_NullPS &&
-        *ppShaderBlock != &g_NullHS && *ppShaderBlock != &g_NullDS && *ppShaderBlock != &g_NullCS && 
-        *ppShaderBlock != nullptr)
-    {
-        size_t index = *ppShaderBlock - m_pOldShaders;
-        assert( index * sizeof(SShaderBlock) == ((size_t)*ppShaderBlock - (size_t)m_pOldShaders) );
-        VBD( index < m_pEffect->m_ShaderBlockCount, "Internal loading error: invalid shader index."  );
-        *ppShaderBlock = m_pEffect->m_pShaderBlocks + index;
-    }
-lExit:
-    return hr;
-}
+    assert( pVersion != nullptr );
+    if( !pVersion )
+        return E_FAIL;
 
-HRESULT CEffectLoader::FixupDSPointer(_Inout_ SDepthStencilBlock **ppDSBlock)
-{
-    HRESULT hr = S_OK;
-    if (*ppDSBlock != &g_NullDepthStencil && *ppDSBlock != nullptr)
+    for( size_t i = 0; i < _countof(g_EffectVersions); i++ )
     {
-        size_t index = *ppDSBlock - m_pOldDS;
-        assert( index * sizeof(SDepthStencilBlock) == ((size_t)*ppDSBlock - (size_t)m_pOldDS) );
-        VBD( index < m_pEffect->m_DepthStencilBlockCount, "Internal loading error: invalid depth-stencil state index." );
-        *ppDSBlock = m_pEffect->m_pDepthStencilBlocks + index;
+        if( g_EffectVersions[i].m_Tag == effectFileTag )
+        {
+            *pVersion = g_EffectVersions[i].m_Version;
+            return S_OK;
+        }
     }
-lExit:
-    return hr;
-}
 
-HRESULT CEffectLoader::FixupABPointer(_Inout_ SBlendBlock **ppABBlock)
-{
-    HRESULT hr = S_OK;
-    if (*ppABBlock != &g_NullBlend && *ppABBlock != nullptr)
-    {
-        size_t index = *ppABBlock - m_pOldAB;
-        assert( index * sizeof(SBlendBlock) == ((size_t)*ppABBlock - (size_t)m_pOldAB) );
-        VBD( index < m_pEffect->m_BlendBlockCount, "Internal loading error: invalid blend state index." );
-        *ppABBlock = m_pEffect->m_pBlendBlocks + index;
-    }
-lExit:
-    return hr;
+    return E_FAIL;
 }
 
-HRESULT CEffectLoader::FixupRSPointer(_Inout_ SRasterizerBlock **ppRSBlock)
+_Use_decl_annotations_
+HRESULT CEffectLoader::LoadEffect(CEffect *pEffect, const void *pEffectBuffer, uint32_t cbEffectBuffer)
 {
-    HRESULT hr = S_OK;
-    if (*ppRSBlock != &g_NullRasterizer && *ppRSBlock != nullptr)
-    {
-        size_t index = *ppRSBlock - m_pOldRS;
-        assert( index * sizeof(SRasterizerBlock) == ((size_t)*ppRSBlock - (size_t)m_pOldRS) );
-        VBD( index < m_pEffect->m_RasterizerBlockCount, "Internal loading error: invalid rasterizer state index." );
-        *ppRSBlock = m_pEffect->m_pRasterizerBlocks + index;
-    }
-lExit:
-    return hr;
-}
 
-HRESULT CEffectLoader::FixupSamplerPointer(_Inout_ SSamplerBlock **ppSampler)
-{
     HRESULT hr = S_OK;
-    size_t index = *ppSampler - m_pOldSamplers;
-    assert( index * sizeof(SSamplerBlock) == ((size_t)*ppSampler - (size_t)m_pOldSamplers) );
-    VBD( index < m_pEffect->m_SamplerBlockCount, "Internal loading error: invalid sampler index." );
-    *ppSampler = m_pEffect->m_pSamplerBlocks + index;
+    uint32_t  i, cVariables, varSize, cMemberDataBlocks;
+    CCheckedDword chkVariables = 0;
+    CCheckedDword64 chkHeapSize = 0;
+    uint64_t  heapSize;
+    uint8_t *pVariables;
 
-lExit:
-    return hr;
-}
+    assert(pEffect && pEffectBuffer);
+    m_pEffect = pEffect;
 
-HRESULT CEffectLoader::FixupInterfacePointer(_Inout_ SInterface **ppInterface, _In_ bool CheckBackgroundInterfaces)
-{
-    HRESULT hr = S_OK;
-    if (*ppInterface != &g_NullInterface && *ppInterface != nullptr)
-    {
-        size_t index = *ppInterface - m_pOldInterfaces;
-        if(index < m_OldInterfaceCount)
-        {
-            assert( index * sizeof(SInterface) == ((size_t)*ppInterface - (size_t)m_pOldInterfaces) );
-            *ppInterface = m_pEffect->m_pInterfaces + index;
-        }
-        else
-        {
-            VBD( CheckBackgroundInterfaces, "Internal loading error: invalid interface pointer." );
-            for( index=0; index < m_BackgroundInterfaces.GetSize(); index++ )
-            {
-                if( *ppInterface == m_BackgroundInterfaces[ (uint32_t)index ] )
-                {
-                    // The interfaces m_BackgroundInterfaces were concatenated to the original ones in m_pEffect->m_pInterfaces
-                    *ppInterface = m_pEffect->m_pInterfaces + (m_OldInterfaceCount + index);
-                    break;
-                }
-            }
-            VBD( index < m_BackgroundInterfaces.GetSize(), "Internal loading error: invalid interface pointer." );
-        }
-    }
+    VN( m_pEffect->m_pReflection = new CEffectReflection() );
+    m_pReflection = m_pEffect->m_pReflection;
 
-lExit:
-    return hr;
-}
+    // Begin effect load
+    VN( m_pEffect->m_pTypePool = new CEffect::CTypeHashTable );
+    VN( m_pEffect->m_pStringPool = new CEffect::CStringHashTable );
+    VN( m_pEffect->m_pPooledHeap = new CDataBlockStore );
+    m_pEffect->m_pPooledHeap->EnableAlignment();
+    m_pEffect->m_pTypePool->SetPrivateHeap(m_pEffect->m_pPooledHeap);
+    m_pEffect->m_pStringPool->SetPrivateHeap(m_pEffect->m_pPooledHeap);
 
-HRESULT CEffectLoader::FixupShaderResourcePointer(_Inout_ SShaderResource **ppResource)
-{
-    HRESULT hr = S_OK;
-    if (*ppResource != &g_NullTexture && *ppResource != nullptr)
+    VH( m_pEffect->m_pTypePool->AutoGrow() );
+    VH( m_pEffect->m_pStringPool->AutoGrow() );
+
+    // Load from blob
+    m_pData = (uint8_t*)pEffectBuffer;
+    m_dwBufferSize = cbEffectBuffer;
+
+    VH( m_msStructured.SetData(m_pData, m_dwBufferSize) );
+
+    // At this point, we assume that the blob is valid
+    VHD( m_msStructured.Read((void**) &m_pHeader, sizeof(*m_pHeader)), "pEffectBuffer is too small." );
+
+    // Verify the version
+    if( FAILED( hr = GetEffectVersion( m_pHeader->Tag, &m_Version ) ) )
     {
-        size_t index = *ppResource - m_pOldShaderResources;
-        assert( index * sizeof(SShaderResource) == ((size_t)*ppResource - (size_t)m_pOldShaderResources) );
-        
-        // could be a TBuffer or a texture; better check first
-        if (index < m_pEffect->m_ShaderResourceCount)
-        {
-            *ppResource = m_pEffect->m_pShaderResources + index;
-        }
-        else
-        {
-            // if this is a TBuffer, then the shader resource pointer
-            // actually points into a SConstantBuffer's TBuffer field
-            index = (SConstantBuffer*)*ppResource - (SConstantBuffer*)&m_pOldCBs->TBuffer;
-            assert( index * sizeof(SConstantBuffer) == ((size_t)(SConstantBuffer*)*ppResource - (size_t)(SConstantBuffer*)&m_pOldCBs->TBuffer) );
-            VBD( index < m_pEffect->m_CBCount, "Internal loading error: invalid SRV index." );
-            *ppResource = &m_pEffect->m_pCBs[index].TBuffer;
-        }
+        DPF(0, "Effect version is unrecognized.  This runtime supports fx_5_0 to %s.", g_EffectVersions[_countof(g_EffectVersions)-1].m_pName );
+        VH( hr );
     }
-    
-lExit:
-    return hr;
-}
 
-HRESULT CEffectLoader::FixupUnorderedAccessViewPointer(_Inout_ SUnorderedAccessView **ppUnorderedAccessView)
-{
-    HRESULT hr = S_OK;
-    if (*ppUnorderedAccessView != &g_NullUnorderedAccessView && *ppUnorderedAccessView != nullptr)
+    if( m_pHeader->RequiresPool() || m_pHeader->Pool.cObjectVariables > 0 || m_pHeader->Pool.cNumericVariables > 0 )
     {
-        size_t index = *ppUnorderedAccessView - m_pOldUnorderedAccessViews;
-        assert( index * sizeof(SUnorderedAccessView) == ((size_t)*ppUnorderedAccessView - (size_t)m_pOldUnorderedAccessViews) );
-
-        VBD( index < m_pEffect->m_UnorderedAccessViewCount, "Internal loading error: invalid UAV index." );
-        *ppUnorderedAccessView = m_pEffect->m_pUnorderedAccessViews + index;
+        DPF(0, "Effect11 does not support EffectPools." );
+        VH( E_FAIL );
     }
 
-lExit:
-    return hr;
-}
+    // Get shader block count
+    VBD( m_pHeader->cInlineShaders <= m_pHeader->cTotalShaders, "Invalid Effect header: cInlineShaders > cTotalShaders." );
 
-HRESULT CEffectLoader::FixupRenderTargetViewPointer(_Inout_ SRenderTargetView **ppRenderTargetView)
-{
-    HRESULT hr = S_OK;
-    if (*ppRenderTargetView != &g_NullRenderTargetView && *ppRenderTargetView != nullptr)
+    // Make sure the counts for the Effect don't overflow
+    chkVariables = m_pHeader->Effect.cObjectVariables;
+    chkVariables += m_pHeader->Effect.cNumericVariables;
+    chkVariables += m_pHeader->cInterfaceVariables;
+    VHD( chkVariables.GetValue(&cVariables), "Overflow: too many Effect variables." );
+    chkVariables *= sizeof(SGlobalVariable);
+    VH( chkVariables.GetValue(&varSize) );
+
+    // Make sure the counts for the SMemberDataPointers don't overflow
+    chkVariables = m_pHeader->cClassInstanceElements;
+    chkVariables += m_pHeader->cBlendStateBlocks;
+    chkVariables += m_pHeader->cRasterizerStateBlocks;
+    chkVariables += m_pHeader->cDepthStencilBlocks;
+    chkVariables += m_pHeader->cSamplers;
+    chkVariables += m_pHeader->Effect.cCBs; // Buffer (for CBuffers and TBuffers)
+    chkVariables += m_pHeader->Effect.cCBs; // SRV (for TBuffers)
+    VHD( chkVariables.GetValue(&cMemberDataBlocks), "Overflow: too many Effect variables." );
+
+    // The arrays allocated up front get a block of their own at the start of the heap; the rest
+    // of the effect heap, and the other heaps, grow as the effect is loaded
+    AddArraySize<SConstantBuffer>(chkHeapSize, m_pHeader->Effect.cCBs);
+    AddArraySize<SConstantBufferRuntime>(chkHeapSize, m_pHeader->Effect.cCBs);
+    AddArraySize<SDepthStencilBlock>(chkHeapSize, m_pHeader->cDepthStencilBlocks);
+    AddArraySize<SRasterizerBlock>(chkHeapSize, m_pHeader->cRasterizerStateBlocks);
+    AddArraySize<SBlendBlock>(chkHeapSize, m_pHeader->cBlendStateBlocks);
+    AddArraySize<SSamplerBlock>(chkHeapSize, m_pHeader->cSamplers);
+    AddArraySize<uint8_t>(chkHeapSize, varSize);
+    AddArraySize<Timer>(chkHeapSize, cVariables);
+    AddArraySize<SAnonymousShader>(chkHeapSize, m_pHeader->cInlineShaders);
+    AddArraySize<SGroup>(chkHeapSize, m_pHeader->cGroups);
+    AddArraySize<SShaderBlock>(chkHeapSize, m_pHeader->cTotalShaders);
+    AddArraySize<SShaderBlock::SDescData>(chkHeapSize, m_pHeader->cTotalShaders);
+    AddArraySize<SShaderResource>(chkHeapSize, m_pHeader->cShaderResources);
+    AddArraySize<SUnorderedAccessView>(chkHeapSize, m_pHeader->cUnorderedAccessViews);
+    AddArraySize<SInterface>(chkHeapSize, m_pHeader->cInterfaceVariableElements);
+    AddArraySize<SMemberDataPointer>(chkHeapSize, cMemberDataBlocks);
+    AddArraySize<SRenderTargetView>(chkHeapSize, m_pHeader->cRenderTargetViews);
+    AddArraySize<SDepthStencilView>(chkHeapSize, m_pHeader->cDepthStencilViews);
+    VHD( chkHeapSize.GetValue(&heapSize), "Overflow: too many Effect objects." );
+    VBD( heapSize <= 0xffffffff, "Overflow: too many Effect objects." );
+
+    VHD( m_pEffect->m_Heap.ReserveMemory((uint32_t) heapSize), "Internal loading error: cannot reserve effect memory." );
+    m_pEffect->m_Heap.EnableGrowth();
+    m_pEffect->m_RuntimeHeap.EnableGrowth();
+    m_pReflection->m_Heap.EnableGrowth();
+    m_pReflection->m_BytecodeHeap.EnableGrowth();
+
+    // Allocate effect resources
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->Effect.cCBs, &m_pEffect->m_pCBs) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->Effect.cCBs, &m_pEffect->m_pCBRuntimes) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cDepthStencilBlocks, &m_pEffect->m_pDepthStencilBlocks) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cRasterizerStateBlocks, &m_pEffect->m_pRasterizerBlocks) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cBlendStateBlocks, &m_pEffect->m_pBlendBlocks) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cSamplers, &m_pEffect->m_pSamplerBlocks) );
+    
+    // we allocate raw bytes for variables because they are polymorphic types that need to be placement new'ed
+    VH( AllocateArray(m_pEffect->m_Heap, varSize, &pVariables) );
+    m_pEffect->m_pVariables = (SGlobalVariable *) pVariables;
+    VH( AllocateArray(m_pEffect->m_Heap, cVariables, &m_pEffect->m_pVariableTimes) );
+    for (i=0; i<cVariables; i++)
     {
-        size_t index = *ppRenderTargetView - m_pOldRenderTargetViews;
-        assert( index * sizeof(SRenderTargetView) == ((size_t)*ppRenderTargetView - (size_t)m_pOldRenderTargetViews) );
-        VBD( index < m_pEffect->m_RenderTargetViewCount, "Internal loading error: invalid RTV index." );
-        *ppRenderTargetView = m_pEffect->m_pRenderTargetViews + index;
+        m_pEffect->m_pVariableTimes[i] = 0;
     }
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cInlineShaders, &m_pEffect->m_pAnonymousShaders) );
 
-lExit:
-    return hr;
-}
-
-HRESULT CEffectLoader::FixupDepthStencilViewPointer(_Inout_ SDepthStencilView **ppDepthStencilView)
-{
-    HRESULT hr = S_OK;
-    if (*ppDepthStencilView != &g_NullDepthStencilView && *ppDepthStencilView != nullptr)
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cGroups, &m_pEffect->m_pGroups) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cTotalShaders, &m_pEffect->m_pShaderBlocks) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cTotalShaders, &m_pEffect->m_pShaderDescs) );
+    for (i=0; i<m_pHeader->cTotalShaders; i++)
     {
-        size_t index = *ppDepthStencilView - m_pOldDepthStencilViews;
-        assert( index * sizeof(SDepthStencilView) == ((size_t)*ppDepthStencilView - (size_t)m_pOldDepthStencilViews) );
-        VBD( index < m_pEffect->m_DepthStencilViewCount, "Internal loading error: invalid DSV index." );
-        *ppDepthStencilView = m_pEffect->m_pDepthStencilViews + index;
+        m_pEffect->m_pShaderBlocks[i].pDescData = &m_pEffect->m_pShaderDescs[i];
     }
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cShaderResources, &m_pEffect->m_pShaderResources) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cUnorderedAccessViews, &m_pEffect->m_pUnorderedAccessViews) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cInterfaceVariableElements, &m_pEffect->m_pInterfaces) );
+    VH( AllocateArray(m_pEffect->m_Heap, cMemberDataBlocks, &m_pEffect->m_pMemberDataBlocks) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cRenderTargetViews, &m_pEffect->m_pRenderTargetViews) );
+    VH( AllocateArray(m_pEffect->m_Heap, m_pHeader->cDepthStencilViews, &m_pEffect->m_pDepthStencilViews) );
+    assert( m_pEffect->m_Heap.GetSize() == heapSize );
 
-lExit:
-    return hr;
-}
-
-HRESULT CEffectLoader::FixupStringPointer(_Inout_ SString **ppString)
-{
-    HRESULT hr = S_OK;
-    size_t index = *ppString - m_pOldStrings;
-    assert( index * sizeof(SString) == ((size_t)*ppString - (size_t)m_pOldStrings) );
-    VBD(index < m_pEffect->m_StringCount, "Internal loading error: invalid string index." );
-    *ppString = m_pEffect->m_pStrings + index;
-lExit:
-    return hr;
-}
-
-HRESULT CEffectLoader::FixupMemberDataPointer(_Inout_ SMemberDataPointer **ppMemberData)
-{
-    HRESULT hr = S_OK;
-    size_t index = *ppMemberData - m_pOldMemberDataBlocks;
-    assert( index * sizeof(SMemberDataPointer) == ((size_t)*ppMemberData - (size_t)m_pOldMemberDataBlocks) );
-    VBD( index < m_pEffect->m_MemberDataCount, "Internal loading error: invalid member block index." );
-    *ppMemberData = m_pEffect->m_pMemberDataBlocks + index;
-lExit:
-    return hr;
-}
-
-HRESULT CEffectLoader::FixupVariablePointer(_Inout_ SGlobalVariable **ppVar)
-{
-    HRESULT hr = S_OK;
-    size_t index = *ppVar - m_pOldVars;
-
-    if( index < m_pEffect->m_VariableCount )
-    {
-        assert( index * sizeof(SGlobalVariable) == ((size_t)*ppVar - (size_t)m_pOldVars) );
-        *ppVar = m_pEffect->m_pVariables + index;
-    }
-    else if( m_pvOldMemberInterfaces )
-    {
-        // When cloning, m_pvOldMemberInterfaces may be non-nullptr, and *ppVar may point to a variable in it.
-        const size_t Members = m_pvOldMemberInterfaces->GetSize();
-        for( index=0; index < Members; index++ )
-        {
-            if( (ID3DX11EffectVariable*)(*m_pvOldMemberInterfaces)[ (uint32_t)index] == (ID3DX11EffectVariable*)*ppVar )
-            {
-                break;
-            }
-        }
-        VBD( index < Members, "Internal loading error: invalid member pointer." );
-        *ppVar = (SGlobalVariable*)m_pEffect->m_pMemberInterfaces[ (uint32_t)index];
-    }
-lExit:
-    return hr;
-}
-
-HRESULT CEffectLoader::FixupGroupPointer(_Inout_ SGroup **ppGroup)
-{
-    HRESULT hr = S_OK;
-    if( *ppGroup != nullptr )
-    {
-        size_t index = *ppGroup - m_pOldGroups;
-        assert( index * sizeof(SGroup) == ((size_t)*ppGroup - (size_t)m_pOldGroups) );
-        VBD( index < m_pEffect->m_GroupCount, "Internal loading error: invalid group index." );
-        *ppGroup = m_pEffect->m_pGroups + index;
-    }
-lExit:
-    return hr;
-}
-
-static HRESULT GetEffectVersion( _In_ uint32_t effectFileTag, _Out_ DWORD* pVersion )
-{
-    assert( pVersion != nullptr );
-    if( !pVersion )
-        return E_FAIL;
-
-    for( size_t i = 0; i < _countof(g_EffectVersions); i++ )
-    {
-        if( g_EffectVersions[i].m_Tag == effectFileTag )
-        {
-            *pVersion = g_EffectVersions[i].m_Version;
-            return S_OK;
-        }
-    }
-
-    return E_FAIL;
-}
-
-_Use_decl_annotations_
-HRESULT CEffectLoader::LoadEffect(CEffect *pEffect, const void *pEffectBuffer, uint32_t cbEffectBuffer)
-{
-
-    HRESULT hr = S_OK;
-    uint32_t  i, varSize, cMemberDataBlocks;
-    CCheckedDword chkVariables = 0;
-
-    // Used for cloning
-    m_pvOldMemberInterfaces = nullptr;
-
-    m_BulkHeap.EnableAlignment();
-
-    assert(pEffect && pEffectBuffer);
-    m_pEffect = pEffect;
-    m_EffectMemory = m_ReflectionMemory = 0;
-
-    VN( m_pEffect->m_pReflection = new CEffectReflection() );
-    m_pReflection = m_pEffect->m_pReflection;
-
-    // Begin effect load
-    VN( m_pEffect->m_pTypePool = new CEffect::CTypeHashTable );
-    VN( m_pEffect->m_pStringPool = new CEffect::CStringHashTable );
-    VN( m_pEffect->m_pPooledHeap = new CDataBlockStore );
-    m_pEffect->m_pPooledHeap->EnableAlignment();
-    m_pEffect->m_pTypePool->SetPrivateHeap(m_pEffect->m_pPooledHeap);
-    m_pEffect->m_pStringPool->SetPrivateHeap(m_pEffect->m_pPooledHeap);
-
-    VH( m_pEffect->m_pTypePool->AutoGrow() );
-    VH( m_pEffect->m_pStringPool->AutoGrow() );
-
-    // Load from blob
-    m_pData = (uint8_t*)pEffectBuffer;
-    m_dwBufferSize = cbEffectBuffer;
-
-    VH( m_msStructured.SetData(m_pData, m_dwBufferSize) );
-
-    // At this point, we assume that the blob is valid
-    VHD( m_msStructured.Read((void**) &m_pHeader, sizeof(*m_pHeader)), "pEffectBuffer is too small." );
-
-    // Verify the version
-    if( FAILED( hr = GetEffectVersion( m_pHeader->Tag, &m_Version ) ) )
-    {
-        DPF(0, "Effect version is unrecognized.  This runtime supports fx_5_0 to %s.", g_EffectVersions[_countof(g_EffectVersions)-1].m_pName );
-        VH( hr );
-    }
-
-    if( m_pHeader->RequiresPool() || m_pHeader->Pool.cObjectVariables > 0 || m_pHeader->Pool.cNumericVariables > 0 )
-    {
-        DPF(0, "Effect11 does not support EffectPools." );
-        VH( E_FAIL );
-    }
-
-    // Get shader block count
-    VBD( m_pHeader->cInlineShaders <= m_pHeader->cTotalShaders, "Invalid Effect header: cInlineShaders > cTotalShaders." );
-
-    // Make sure the counts for the Effect don't overflow
-    chkVariables = m_pHeader->Effect.cObjectVariables;
-    chkVariables += m_pHeader->Effect.cNumericVariables;
-    chkVariables += m_pHeader->cInterfaceVariables;
-    chkVariables *= sizeof(SGlobalVariable);
-    VH( chkVariables.GetValue(&varSize) );
-
-    // Make sure the counts for the SMemberDataPointers don't overflow
-    chkVariables = m_pHeader->cClassInstanceElements;
-    chkVariables += m_pHeader->cBlendStateBlocks;
-    chkVariables += m_pHeader->cRasterizerStateBlocks;
-    chkVariables += m_pHeader->cDepthStencilBlocks;
-    chkVariables += m_pHeader->cSamplers;
-    chkVariables += m_pHeader->Effect.cCBs; // Buffer (for CBuffers and TBuffers)
-    chkVariables += m_pHeader->Effect.cCBs; // SRV (for TBuffers)
-    VHD( chkVariables.GetValue(&cMemberDataBlocks), "Overflow: too many Effect variables." );
-
-    // Allocate effect resources
-    VN( m_pEffect->m_pCBs = PRIVATENEW SConstantBuffer[m_pHeader->Effect.cCBs] );
-    VN( m_pEffect->m_pDepthStencilBlocks = PRIVATENEW SDepthStencilBlock[m_pHeader->cDepthStencilBlocks] );
-    VN( m_pEffect->m_pRasterizerBlocks = PRIVATENEW SRasterizerBlock[m_pHeader->cRasterizerStateBlocks] );
-    VN( m_pEffect->m_pBlendBlocks = PRIVATENEW SBlendBlock[m_pHeader->cBlendStateBlocks] );
-    VN( m_pEffect->m_pSamplerBlocks = PRIVATENEW SSamplerBlock[m_pHeader->cSamplers] );
-    
-    // we allocate raw bytes for variables because they are polymorphic types that need to be placement new'ed
-    VN( m_pEffect->m_pVariables = (SGlobalVariable *)PRIVATENEW uint8_t[varSize] );
-    VN( m_pEffect->m_pAnonymousShaders = PRIVATENEW SAnonymousShader[m_pHeader->cInlineShaders] );
-
-    VN( m_pEffect->m_pGroups = PRIVATENEW SGroup[m_pHeader->cGroups] );
-    VN( m_pEffect->m_pShaderBlocks = PRIVATENEW SShaderBlock[m_pHeader->cTotalShaders] );
-    VN( m_pEffect->m_pStrings = PRIVATENEW SString[m_pHeader->cStrings] );
-    VN( m_pEffect->m_pShaderResources = PRIVATENEW SShaderResource[m_pHeader->cShaderResources] );
-    VN( m_pEffect->m_pUnorderedAccessViews = PRIVATENEW SUnorderedAccessView[m_pHeader->cUnorderedAccessViews] );
-    VN( m_pEffect->m_pInterfaces = PRIVATENEW SInterface[m_pHeader->cInterfaceVariableElements] );
-    VN( m_pEffect->m_pMemberDataBlocks = PRIVATENEW SMemberDataPointer[cMemberDataBlocks] );
-    VN( m_pEffect->m_pRenderTargetViews = PRIVATENEW SRenderTargetView[m_pHeader->cRenderTargetViews] );
-    VN( m_pEffect->m_pDepthStencilViews = PRIVATENEW SDepthStencilView[m_pHeader->cDepthStencilViews] );
+    // Strings are reflection data
+    VH( AllocateArray(m_pReflection->m_Heap, m_pHeader->cStrings, &m_pEffect->m_pStrings) );
 
     uint32_t oStructured = m_pHeader->cbUnstructured + sizeof(SBinaryHeader5);
     VHD( m_msStructured.Seek(oStructured), "Invalid pEffectBuffer: Missing structured data block." );
@@ -874,7 +774,7 @@ HRESULT CEffectLoader::LoadEffect(CEffect *pEffect, const void *pEffectBuffer, u
 
             for( size_t iPass=0; iPass < pTech->PassCount; iPass++ )
             {
-                SPassBlock *pPass = &pTech->pPasses[iPass];
+                SPassRuntime *pPass = pTech->pPasses[iPass].pRuntime;
 
                 pTech->HasDependencies |= pPass->CheckDependencies();
             }
@@ -882,18 +782,33 @@ HRESULT CEffectLoader::LoadEffect(CEffect *pEffect, const void *pEffectBuffer, u
         }
     }
 
-    VH( InitializeReflectionDataAndMoveStrings() );
-    VH( ReallocateReflectionData() );
-    VH( ReallocateEffectData() );
+    // Evaluate the assignments once. Pass assignments are evaluated last, once the blocks and shaders they select are initialized
+    VH( InitializeBlockAssignments(m_pEffect->m_pDepthStencilBlocks, m_pEffect->m_DepthStencilBlockCount) );
+    VH( InitializeBlockAssignments(m_pEffect->m_pBlendBlocks, m_pEffect->m_BlendBlockCount) );
+    VH( InitializeBlockAssignments(m_pEffect->m_pRasterizerBlocks, m_pEffect->m_RasterizerBlockCount) );
+    VH( InitializeBlockAssignments(m_pEffect->m_pSamplerBlocks, m_pEffect->m_SamplerBlockCount) );
+    for (i=0; i<m_pEffect->m_GroupCount; i++)
+    {
+        SGroup *pGroup = &m_pEffect->m_pGroups[i];
+
+        for (size_t j=0; j<pGroup->TechniqueCount; j++)
+        {
+            STechnique *pTech = &pGroup->pTechniques[j];
 
-    VB( m_pReflection->m_Heap.GetSize() == m_ReflectionMemory );
+            // The pass records of a technique are one array in the runtime heap (see LoadTechnique)
+            if (pTech->PassCount > 0)
+            {
+                VH( InitializeBlockAssignments(pTech->pPasses[0].pRuntime, pTech->PassCount) );
+            }
+        }
+    }
     
     // Verify that all of the various block/variable types were loaded
     VBD( m_pEffect->m_VariableCount == (m_pHeader->Effect.cObjectVariables + m_pHeader->Effect.cNumericVariables + m_pHeader->cInterfaceVariables), "Internal loading error: mismatched variable count." );
     VBD( m_pEffect->m_ShaderBlockCount == m_pHeader->cTotalShaders, "Internal loading error: mismatched shader block count." );
     VBD( m_pEffect->m_AnonymousShaderCount == m_pHeader->cInlineShaders, "Internal loading error: mismatched anonymous variable count." );
     VBD( m_pEffect->m_ShaderResourceCount == m_pHeader->cShaderResources, "Internal loading error: mismatched SRV count." );
-    VBD( m_pEffect->m_InterfaceCount == m_pHeader->cInterfaceVariableElements + m_BackgroundInterfaces.GetSize(), "Internal loading error: mismatched interface count." );
+    VBD( m_pEffect->m_InterfaceCount == m_pHeader->cInterfaceVariableElements, "Internal loading error: mismatched interface count." );
     VBD( m_pEffect->m_UnorderedAccessViewCount == m_pHeader->cUnorderedAccessViews, "Internal loading error: mismatched UAV count." );
     VBD( m_pEffect->m_MemberDataCount == cMemberDataBlocks, "Internal loading error: mismatched member data block count." );
     VBD( m_pEffect->m_RenderTargetViewCount == m_pHeader->cRenderTargetViews, "Internal loading error: mismatched RTV count." );
@@ -905,7 +820,8 @@ HRESULT CEffectLoader::LoadEffect(CEffect *pEffect, const void *pEffectBuffer, u
     VBD( m_pEffect->m_StringCount == m_pHeader->cStrings, "Internal loading error: mismatched string count." );
 
     // Uncomment if you really need this information
-    // DPF(0, "Effect heap size: %d, reflection heap size: %d, allocations avoided: %d", m_EffectMemory, m_ReflectionMemory, m_BulkHeap.m_cAllocations);
+    // DPF(0, "Effect heap size: %d, runtime heap size: %d, reflection heap size: %d", m_pEffect->m_Heap.GetBufferSize(),
+    //     m_pEffect->m_RuntimeHeap.GetBufferSize(), m_pReflection->m_Heap.GetBufferSize());
     
 lExit:
     return hr;
@@ -965,6 +881,7 @@ HRESULT CEffectLoader::LoadTypeAndAddToPool(SType **ppType, uint32_t  dwOffset)
     CEffect::CTypeHashTable::CIterator iter;
     uint8_t *pHashBuffer;
     uint32_t  hash;
+    CEffectVector<SVariable> tempMembers;
     SVariable *pTempMembers = nullptr;
     
     m_HashBuffer.Empty();
@@ -1045,7 +962,11 @@ HRESULT CEffectLoader::LoadTypeAndAddToPool(SType **ppType, uint32_t  dwOffset)
 
         temporaryType.StructType.Members = cMembers;
 
-        VN( pTempMembers = new SVariable[cMembers] );
+        if (cMembers > 0)
+        {
+            // Member-less structs (such as empty classes) keep a nullptr member array
+            VN( pTempMembers = tempMembers.AddRange(cMembers) );
+        }
         temporaryType.StructType.pMembers = pTempMembers;
         
         // read up all of the member descriptors at once
@@ -1139,7 +1060,6 @@ HRESULT CEffectLoader::LoadTypeAndAddToPool(SType **ppType, uint32_t  dwOffset)
     }
 
 lExit:
-    SAFE_DELETE_ARRAY(pTempMembers);
     return hr;
 }
 
@@ -1254,6 +1174,7 @@ HRESULT CEffectLoader::LoadNumericVariable(_In_ SConstantBuffer *pParentCB)
     
     // Make sure the right polymorphic type is created
     VH( PlacementNewVariable(pVar, pType, false) );
+    pVar->pLastModifiedTime = &m_pEffect->m_pVariableTimes[m_pEffect->m_VariableCount];
 
     if (psVar->Flags & D3DX11_EFFECT_VARIABLE_EXPLICIT_BIND_POINT)
     {
@@ -1267,12 +1188,12 @@ HRESULT CEffectLoader::LoadNumericVariable(_In_ SConstantBuffer *pParentCB)
     pVar->pEffect = m_pEffect;
     pVar->pType = pType;
     pVar->pCB = pParentCB;
-    pVar->Data.pGeneric = pParentCB->pBackingStore + psVar->Offset;
-    VBD( psVar->Offset + pVar->pType->TotalSize <= pVar->pCB->Size, "Invalid pEffectBuffer: invalid variable offset." );
+    pVar->Data.pGeneric = pParentCB->pRuntime->pBackingStore + psVar->Offset;
+    VBD( psVar->Offset + pVar->pType->TotalSize <= pVar->pCB->pRuntime->Size, "Invalid pEffectBuffer: invalid variable offset." );
 
-    if (pType->VarType == EVT_Struct && pType->StructType.ImplementsInterface && !pParentCB->IsTBuffer)
+    if (pType->VarType == EVT_Struct && pType->StructType.ImplementsInterface && !pParentCB->pRuntime->IsTBuffer)
     {
-        pVar->MemberDataOffsetPlus4 = m_pEffect->m_MemberDataCount * sizeof(SMemberDataPointer) + 4;
+        pVar->pMemberData = m_pEffect->m_pMemberDataBlocks + m_pEffect->m_MemberDataCount;
         m_pEffect->m_MemberDataCount += std::max<uint32_t>(pType->Elements,1);
     }
 
@@ -1281,7 +1202,7 @@ HRESULT CEffectLoader::LoadNumericVariable(_In_ SConstantBuffer *pParentCB)
     VHD( GetStringAndAddToReflection(psVar->oSemantic, &pVar->pSemantic), "Invalid pEffectBuffer: cannot read variable semantic." );
 
     // Ensure the variable fits in the CBuffer and doesn't overflow
-    VBD( pType->TotalSize + psVar->Offset <= pParentCB->Size &&
+    VBD( pType->TotalSize + psVar->Offset <= pParentCB->pRuntime->Size &&
          pType->TotalSize + psVar->Offset >= pType->TotalSize, "Invalid pEffectBuffer: variable does not fit in CB." );
 
     ZeroMemory(pVar->Data.pGeneric, pType->TotalSize);
@@ -1294,9 +1215,6 @@ HRESULT CEffectLoader::LoadNumericVariable(_In_ SConstantBuffer *pParentCB)
         VH( UnpackData((uint8_t*) pVar->Data.pGeneric, (uint8_t*) pDefaultValue, pType->PackedSize, pType, &bytesUnpacked) );
         VBD( bytesUnpacked == pType->PackedSize, "Invalid pEffectBuffer: invalid type packed size.");
     }
-    
-    // We need to use offsets until we fixup
-    pVar->Data.Offset = psVar->Offset;
 
     // Read annotations
     VH( LoadAnnotations(&pVar->AnnotationCount, &pVar->pAnnotations) );
@@ -1320,17 +1238,19 @@ HRESULT CEffectLoader::LoadCBs()
 
         VHD( m_msStructured.Read((void**) &psCB, sizeof(*psCB)), "Invalid pEffectBuffer: cannot read CB." );
         pCB = &m_pEffect->m_pCBs[iCB];
+        pCB->pRuntime = &m_pEffect->m_pCBRuntimes[iCB];
 
         VHD( GetStringAndAddToReflection(psCB->oName, &pCB->pName), "Invalid pEffectBuffer: cannot read CB name." );
 
-        pCB->IsTBuffer = (psCB->Flags & SBinaryConstantBuffer::c_IsTBuffer) != 0 ? true : false;
+        pCB->pRuntime->IsTBuffer = (psCB->Flags & SBinaryConstantBuffer::c_IsTBuffer) != 0 ? true : false;
         pCB->IsSingle = (psCB->Flags & SBinaryConstantBuffer::c_IsSingle) != 0 ? true : false;
-        pCB->Size = psCB->Size;
+        pCB->pRuntime->Size = psCB->Size;
         pCB->ExplicitBindPoint = psCB->ExplicitBindPoint;
-        VBD( pCB->Size == AlignToPowerOf2(pCB->Size, SType::c_RegisterSize), "Invalid pEffectBuffer: CB size not a power of 2." );
-        VN( pCB->pBackingStore = PRIVATENEW uint8_t[pCB->Size] );
+        VBD( pCB->pRuntime->Size == AlignToPowerOf2(pCB->pRuntime->Size, SType::c_RegisterSize), "Invalid pEffectBuffer: CB size not a power of 2." );
+        VH( AllocateArray(m_pEffect->m_Heap, pCB->pRuntime->Size, &pCB->pRuntime->pBackingStore) );
+        pCB->pEffect = m_pEffect;
         
-        pCB->MemberDataOffsetPlus4 = m_pEffect->m_MemberDataCount * sizeof(SMemberDataPointer) + 4;
+        pCB->pMemberData = m_pEffect->m_pMemberDataBlocks + m_pEffect->m_MemberDataCount;
         m_pEffect->m_MemberDataCount += 2;
 
         // point this CB to variables that it owns
@@ -1422,6 +1342,23 @@ lExit:
 }
 
 
+// Only the assignments that depend on variables are kept; the others are executed as they are loaded
+static bool IsRuntimeAssignment(_In_ const SBinaryAssignment &Assignment)
+{
+    switch (Assignment.AssignmentType)
+    {
+    case ECAT_Variable:
+    case ECAT_ConstIndex:
+        return !IsObjectAssignmentHelper(g_lvGeneral[Assignment.iState].m_LhsType);
+
+    case ECAT_VariableIndex:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
 // Read info from the compiled blob and initialize a set of assignments
 _Use_decl_annotations_
 HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAssignments,
@@ -1431,8 +1368,10 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
     uint32_t  i, j;
 
     SBinaryAssignment *psAssignments;
-    uint32_t  finalAssignments = 0;             // the number of assignments worth keeping    
+    uint32_t  runtimeAssignments = 0;           // the number of assignments worth keeping
+    uint32_t  finalAssignments = 0;             // the number of assignments kept so far
     uint32_t  renderTargetViewAssns = 0;        // Number of render target view assns, used by passes since SetRTV is a vararg call
+    SAssignment discardedAssignment;
 
     *pFinalAssignments = 0;
     if (pRTVAssignments)
@@ -1440,24 +1379,29 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
 
     VHD( m_msStructured.Read((void**) &psAssignments, sizeof(*psAssignments) * Assignments), "Invalid pEffectBuffer: cannot read assignments." );
 
-    // allocate enough room to store all of the assignments (even though some may go unused)
-    VN( (*ppAssignments) = PRIVATENEW SAssignment[Assignments] )
+    for (i = 0; i < Assignments; ++ i)
+    {
+        VBD( psAssignments[i].iState < NUM_STATES, "Invalid pEffectBuffer: invalid assignment state." );
+        if (IsRuntimeAssignment(psAssignments[i]))
+            ++ runtimeAssignments;
+    }
+
+    // allocate exactly the assignments worth keeping in the runtime heap
+    VH( AllocateArray(m_pEffect->m_RuntimeHeap, runtimeAssignments, ppAssignments) );
     
     //
     // In this loop, we read assignments 1-by-1, keeping some and discarding others.
-    // We write to the "next" assignment which is given by &(*ppAssignments)[finalAssignments];
-    // if an assignment is worth keeping, we increment finalAssignments.
-    // This means that if you want to keep an assignment, you must be careful to initialize
-    // all members of SAssignment because old values from preceding discarded assignments might remain.
+    // An assignment worth keeping is written to the "next" assignment, which is given by
+    // &(*ppAssignments)[finalAssignments], and finalAssignments is incremented.
+    // The others are only executed, through discardedAssignment.
     //
     for (i = 0; i < Assignments; ++ i)
     {
         SGlobalVariable *pVarArray, *pVarIndex, *pVar;
         const char *pGlobalVarName;
-        SAssignment *pAssignment = &(*ppAssignments)[finalAssignments];
+        SAssignment *pAssignment = IsRuntimeAssignment(psAssignments[i]) ? &(*ppAssignments)[finalAssignments] : &discardedAssignment;
         uint8_t *pLHS;
 
-        VBD( psAssignments[i].iState < NUM_STATES, "Invalid pEffectBuffer: invalid assignment state." );
         VBD( psAssignments[i].Index < g_lvGeneral[psAssignments[i].iState].m_Indices, "Invalid pEffectBuffer: invalid assignment index." );
 
         pAssignment->LhsType = g_lvGeneral[psAssignments[i].iState].m_LhsType;
@@ -1471,8 +1415,6 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
         case D3D_SVT_UINT8:
             assert(g_lvGeneral[psAssignments[i].iState].m_Cols == 1); // uint8_t arrays not supported
             pAssignment->DataSize = sizeof(uint8_t);
-            // Store an offset for destination instead of a pointer so that it's easy to relocate it later
-            
             break;
 
         case D3D_SVT_BOOL:
@@ -1551,11 +1493,10 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
         else
             lhsStride = pAssignment->DataSize;
 
-        // Store only the destination offset so that the backing store pointers can be easily fixed up later
-        pAssignment->Destination.Offset = g_lvGeneral[psAssignments[i].iState].m_Offset + lhsStride * psAssignments[i].Index;
-
-        // As a result, you should use pLHS in this function instead of the destination pointer
-        pLHS = pBackingStore + pAssignment->Destination.Offset;
+        // The block is already where it stays, so this points into its backing store (see InitializeBlockAssignments);
+        // only pass records are moved again, by PackRuntimeData, which moves their destinations with them
+        pLHS = pBackingStore + g_lvGeneral[psAssignments[i].iState].m_Offset + lhsStride * psAssignments[i].Index;
+        pAssignment->Destination.pGeneric = pLHS;
 
         switch (psAssignments[i].AssignmentType)
         {
@@ -1648,11 +1589,11 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
                 VBD( pVar->pType->BelongsInConstantBuffer(), "Invalid pEffectBuffer: assignment type mismatch." );
 
                 pAssignment->DependencyCount = 1;
-                VN( pAssignment->pDependencies = PRIVATENEW SAssignment::SDependency[pAssignment->DependencyCount] );
+                VH( AllocateArray(m_pEffect->m_RuntimeHeap, pAssignment->DependencyCount, &pAssignment->pDependencies) );
                 pAssignment->pDependencies->pVariable = pVar;
+                pAssignment->pDependencies->pLastModifiedTime = pVar->pLastModifiedTime;
 
-                // Store an offset for numeric values instead of a pointer so that it's easy to relocate it later
-                pAssignment->Source.Offset = pVar->Data.Offset;
+                pAssignment->Source.pNumeric = pVar->Data.pNumeric;
                 pAssignment->AssignmentType = ERAT_NumericVariable;
 
                 // Can't get rid of this assignment
@@ -1687,8 +1628,9 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
                 VBD( pVarArray->pType->BelongsInConstantBuffer(), "Invalid pEffectBuffer: assignment type mismatch." );
 
                 pAssignment->DependencyCount = 1;
-                VN( pAssignment->pDependencies = PRIVATENEW SAssignment::SDependency[pAssignment->DependencyCount] );
+                VH( AllocateArray(m_pEffect->m_RuntimeHeap, pAssignment->DependencyCount, &pAssignment->pDependencies) );
                 pAssignment->pDependencies->pVariable = pVarArray;
+                pAssignment->pDependencies->pLastModifiedTime = pVarArray->pLastModifiedTime;
 
                 CCheckedDword chkDataLen = psConstIndex->Index;
                 uint32_t  dataLen;
@@ -1697,7 +1639,7 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
                 VHD( chkDataLen.GetValue(&dataLen), "Overflow: assignment size." );
                 VBD( dataLen <= pVarArray->pType->TotalSize, "Internal loading error: assignment size mismatch" );
 
-                pAssignment->Source.Offset = pVarArray->Data.Offset + psConstIndex->Index * SType::c_ScalarSize;
+                pAssignment->Source.pNumeric = pVarArray->Data.pNumeric + psConstIndex->Index * SType::c_ScalarSize;
 
                 // _NumericConstIndex is not used here because _NumericVariable 
                 // does the same stuff in a more general fashion with no perf hit.  
@@ -1737,8 +1679,9 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
                 pAssignment->MaxElements = pVarArray->pType->Elements;
 
                 pAssignment->DependencyCount = 1;
-                VN( pAssignment->pDependencies = PRIVATENEW SAssignment::SDependency[pAssignment->DependencyCount] );
+                VH( AllocateArray(m_pEffect->m_RuntimeHeap, pAssignment->DependencyCount, &pAssignment->pDependencies) );
                 pAssignment->pDependencies[0].pVariable = pVarIndex;
+                pAssignment->pDependencies[0].pLastModifiedTime = pVarIndex->pLastModifiedTime;
 
                 // Point this assignment to the start of the variable's object array.
                 // When this assignment is dirty, we write the value of this pointer plus
@@ -1751,9 +1694,11 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
                 VBD( pVarArray->pType->BelongsInConstantBuffer(), "Invalid pEffectBuffer: assignment type mismatch." );
 
                 pAssignment->DependencyCount = 2;
-                VN( pAssignment->pDependencies = PRIVATENEW SAssignment::SDependency[pAssignment->DependencyCount] );
+                VH( AllocateArray(m_pEffect->m_RuntimeHeap, pAssignment->DependencyCount, &pAssignment->pDependencies) );
                 pAssignment->pDependencies[0].pVariable = pVarIndex;
+                pAssignment->pDependencies[0].pLastModifiedTime = pVarIndex->pLastModifiedTime;
                 pAssignment->pDependencies[1].pVariable = pVarArray;
+                pAssignment->pDependencies[1].pLastModifiedTime = pVarArray->pLastModifiedTime;
 
                 // When pVarIndex is updated, we update the source pointer.
                 // When pVarArray is updated, we copy data from the source to the destination.
@@ -1817,10 +1762,11 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
 
             if (cbShaderBin > 0)
             {
-                VN( pShaderBlock->pReflectionData = PRIVATENEW SShaderBlock::SReflectionData );
+                VH( AllocateArray(m_pReflection->m_Heap, 1, &pShaderBlock->pReflectionData) );
 
                 pShaderBlock->pReflectionData->BytecodeLength = cbShaderBin;
-                pShaderBlock->pReflectionData->pBytecode = (uint8_t*) pShaderBin;
+                VHD( m_pReflection->m_BytecodeHeap.AddData(pShaderBin, cbShaderBin, (void**) &pShaderBlock->pReflectionData->pBytecode),
+                     "Internal loading error: cannot add shader bytecode." );
                 pShaderBlock->pReflectionData->pStreamOutDecls[0] =
                 pShaderBlock->pReflectionData->pStreamOutDecls[1] =
                 pShaderBlock->pReflectionData->pStreamOutDecls[2] =
@@ -1907,6 +1853,8 @@ HRESULT CEffectLoader::LoadAssignments( uint32_t Assignments, SAssignment **ppAs
         }
     }
 
+    VBD( finalAssignments == runtimeAssignments, "Internal loading error: mismatched assignment count." );
+
     *pFinalAssignments = finalAssignments;
     if (pRTVAssignments)
         *pRTVAssignments = renderTargetViewAssns;
@@ -1943,6 +1891,7 @@ HRESULT CEffectLoader::LoadObjectVariables()
 
         // Make sure the right polymorphic type is created
         VH( PlacementNewVariable(pVar, pType, false) );
+        pVar->pLastModifiedTime = &m_pEffect->m_pVariableTimes[m_pEffect->m_VariableCount];
 
         pVar->pEffect = m_pEffect;
         pVar->pType = pType;
@@ -1951,7 +1900,7 @@ HRESULT CEffectLoader::LoadObjectVariables()
 
         if( pType->IsStateBlockObject() )
         {
-            pVar->MemberDataOffsetPlus4 = m_pEffect->m_MemberDataCount * sizeof(SMemberDataPointer) + 4;
+            pVar->pMemberData = m_pEffect->m_pMemberDataBlocks + m_pEffect->m_MemberDataCount;
             m_pEffect->m_MemberDataCount += std::max<uint32_t>(pType->Elements,1);
         }
 
@@ -2082,10 +2031,11 @@ HRESULT CEffectLoader::LoadObjectVariables()
 
                 if (cbShaderBin > 0)
                 {
-                    VN( pShaderBlock->pReflectionData = PRIVATENEW SShaderBlock::SReflectionData );
+                    VH( AllocateArray(m_pReflection->m_Heap, 1, &pShaderBlock->pReflectionData) );
 
                     pShaderBlock->pReflectionData->BytecodeLength = cbShaderBin;
-                    pShaderBlock->pReflectionData->pBytecode = (uint8_t*) pShaderBin;
+                    VHD( m_pReflection->m_BytecodeHeap.AddData(pShaderBin, cbShaderBin, (void**) &pShaderBlock->pReflectionData->pBytecode),
+                         "Internal loading error: cannot add shader bytecode." );
                     pShaderBlock->pReflectionData->pStreamOutDecls[0] =
                     pShaderBlock->pReflectionData->pStreamOutDecls[1] =
                     pShaderBlock->pReflectionData->pStreamOutDecls[2] =
@@ -2280,6 +2230,7 @@ HRESULT CEffectLoader::LoadInterfaceVariables()
 
         // Make sure the right polymorphic type is created
         VH( PlacementNewVariable(pVar, pType, false) );
+        pVar->pLastModifiedTime = &m_pEffect->m_pVariableTimes[m_pEffect->m_VariableCount];
 
         pVar->pEffect = m_pEffect;
         pVar->pType = pType;
@@ -2358,7 +2309,7 @@ HRESULT CEffectLoader::LoadGroups()
         // Read group info
         VHD( m_msStructured.Read((void**) &psGroup, sizeof(*psGroup)), "Invalid pEffectBuffer: cannot read group." );
         pGroup->TechniqueCount = psGroup->cTechniques;
-        VN( pGroup->pTechniques = PRIVATENEW STechnique[pGroup->TechniqueCount] );
+        VH( AllocateArray(m_pEffect->m_Heap, pGroup->TechniqueCount, &pGroup->pTechniques) );
         VHD( GetStringAndAddToReflection(psGroup->oName, &pGroup->pName), "Invalid pEffectBuffer: cannot read group name." );
 
         if( pGroup->pName == nullptr )
@@ -2393,11 +2344,13 @@ HRESULT CEffectLoader::LoadTechnique( STechnique* pTech )
     uint32_t  iPass;
 
     SBinaryTechnique *psTech;
+    SPassRuntime *pPassRuntimes;
 
     // Read technique info
     VHD( m_msStructured.Read((void**) &psTech, sizeof(*psTech)), "Invalid pEffectBuffer: cannot read technique." );
     pTech->PassCount = psTech->cPasses;
-    VN( pTech->pPasses = PRIVATENEW SPassBlock[pTech->PassCount] );
+    VH( AllocateArray(m_pEffect->m_Heap, pTech->PassCount, &pTech->pPasses) );
+    VH( AllocateArray(m_pEffect->m_RuntimeHeap, pTech->PassCount, &pPassRuntimes) );
     VHD( GetStringAndAddToReflection(psTech->oName, &pTech->pName), "Invalid pEffectBuffer: cannot read technique name." );
 
     // Read annotations
@@ -2407,6 +2360,9 @@ HRESULT CEffectLoader::LoadTechnique( STechnique* pTech )
     {
         SBinaryPass *psPass;
         SPassBlock *pPass = &pTech->pPasses[iPass];
+        SPassRuntime *pRuntime = &pPassRuntimes[iPass];
+
+        pPass->pRuntime = pRuntime;
 
         // Read pass info
         VHD( m_msStructured.Read((void**) &psPass, sizeof(SBinaryPass)), "Invalid pEffectBuffer: cannot read pass." );
@@ -2415,12 +2371,12 @@ HRESULT CEffectLoader::LoadTechnique( STechnique* pTech )
         // Read annotations
         VH( LoadAnnotations(&pPass->AnnotationCount, &pPass->pAnnotations) );
 
-        VH( LoadAssignments( psPass->cAssignments, &pPass->pAssignments, (uint8_t*)pPass, &pPass->BackingStore.RenderTargetViewCount, &pPass->AssignmentCount ) );
-        VBD( pPass->BackingStore.RenderTargetViewCount <= D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, "Invalid pEffectBuffer: too many RTVs in pass." );
+        VH( LoadAssignments( psPass->cAssignments, &pRuntime->pAssignments, (uint8_t*)pRuntime, &pRuntime->BackingStore.RenderTargetViewCount, &pRuntime->AssignmentCount ) );
+        VBD( pRuntime->BackingStore.RenderTargetViewCount <= D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, "Invalid pEffectBuffer: too many RTVs in pass." );
 
         // Initialize other pass information
-        pPass->pEffect = m_pEffect;
-        pPass->BlockType = EBT_Pass;
+        pRuntime->pEffect = m_pEffect;
+        pRuntime->BlockType = EBT_Pass;
     }
 
 lExit:
@@ -2441,13 +2397,15 @@ HRESULT CEffectLoader::LoadAnnotations(uint32_t  *pcAnnotations, SAnnotation **p
     {
         uint32_t  annotationsSize;
         CCheckedDword chkAnnotationsSize;
+        uint8_t *pAnnotationData;
 
         chkAnnotationsSize = cAnnotations;
         chkAnnotationsSize *= sizeof(SAnnotation);
         VHD( chkAnnotationsSize.GetValue(&annotationsSize), "Overflow in annotations."  );
         
         // we allocate raw bytes for annotations because they are polymorphic types that need to be placement new'ed
-        VN( pAnnotations = (SAnnotation *) PRIVATENEW uint8_t[annotationsSize] );
+        VH( AllocateArray(m_pReflection->m_Heap, annotationsSize, &pAnnotationData) );
+        pAnnotations = (SAnnotation *) pAnnotationData;
         
         for (i=0; i<cAnnotations; i++)
         {
@@ -2471,7 +2429,7 @@ HRESULT CEffectLoader::LoadAnnotations(uint32_t  *pcAnnotations, SAnnotation **p
             {
                 uint32_t  cElements = std::max<uint32_t>(1, pType->Elements);
                 uint32_t  j;
-                VN( pAn->Data.pString = PRIVATENEW SString[cElements] );
+                VH( AllocateArray(m_pReflection->m_Heap, cElements, &pAn->Data.pString) );
                 for (j = 0; j < cElements; ++ j)
                 {
                     // Read initializer offset
@@ -2489,7 +2447,7 @@ HRESULT CEffectLoader::LoadAnnotations(uint32_t  *pcAnnotations, SAnnotation **p
 
                 VBD( oData != 0, "Invalid pEffectBuffer: invalid anotation offset." );
 
-                VN( pAn->Data.pGeneric = PRIVATENEW uint8_t[pType->TotalSize] );
+                VH( AllocateArray(m_pReflection->m_Heap, pType->TotalSize, &pAn->Data.pNumeric) );
                 ZeroMemory(pAn->Data.pGeneric, pType->TotalSize);
                 VHD( m_msUnstructured.ReadAtOffset(oData, pType->PackedSize, &pDefaultValue), "Invalid pEffectBuffer: cannot read variable default value."  );
                 VH( UnpackData((uint8_t*) pAn->Data.pGeneric, (uint8_t*) pDefaultValue, pType->PackedSize, pType, &bytesUnpacked) );
@@ -2521,10 +2479,13 @@ lExit:
 HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
 {
     HRESULT hr = S_OK;
-    CEffectVector<SRange> vRanges[ER_Count], *pvRange;
+
+    // Most shaders only have a few ranges of each kind, so these live on the stack
+    CEffectInlineVector<SRange, 4> vRanges[ER_Count];
+    CEffectVector<SRange> *pvRange;
 
     SRange *pRange = nullptr;
-    CEffectVector<SConstantBuffer*> vTBuffers;
+    CEffectInlineVector<SConstantBufferRuntime*, 4> vTBuffers;
     
     //////////////////////////////////////////////////////////////////////////
     // Step 1: iterate through the resource binding structures and build
@@ -2582,7 +2543,7 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
             
             pCB = m_pEffect->FindCB(pName);
             VBD( nullptr != pCB, "Loading error: cannot find tbuffer." );
-            VBD( false != pCB->IsTBuffer, "Loading error: cbuffer found where tbuffer is expected." );
+            VBD( false != pCB->pRuntime->IsTBuffer, "Loading error: cbuffer found where tbuffer is expected." );
             VBD( size == 1, "Loading error: tbuffer arrays are not supported." );
             pShaderResource = &pCB->TBuffer;
             break;
@@ -2681,12 +2642,7 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
 
             if ( pRange->last != bindPoint )
             {
-                if( eRange != ER_UnorderedAccessView )
-                {
-                    // No we can't. Begin a new range by setting rangeCount to 0 and triggering the next IF
-                    rangeCount = 0;
-                }
-                else
+                if( eRange == ER_UnorderedAccessView )
                 {
                     // UAVs will always be located in one range, as they are more expensive to set
                     while(pRange->last < bindPoint)
@@ -2695,6 +2651,29 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
                         pRange->last++;
                     }
                 }
+                else if( ( eRange == ER_Texture || eRange == ER_Sampler ) &&
+                         bindPoint - pRange->last <= D3DX11_EFFECT_MAX_RANGE_GAP )
+                {
+                    // Close enough: unbinding a few unused slots is cheaper than another Set call.
+                    // CBuffers are never padded, since every slot of their ranges is uploaded on apply.
+                    while(pRange->last < bindPoint)
+                    {
+                        if( eRange == ER_Texture )
+                        {
+                            VHD( pRange->vResources.Add(&g_NullTexture), "Internal loading error: cannot add SRV to range." );
+                        }
+                        else
+                        {
+                            VHD( pRange->vResources.Add(&g_NullSampler), "Internal loading error: cannot add sampler to range." );
+                        }
+                        pRange->last++;
+                    }
+                }
+                else
+                {
+                    // No we can't. Begin a new range by setting rangeCount to 0 and triggering the next IF
+                    rangeCount = 0;
+                }
             }
         }
 
@@ -2709,11 +2688,11 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
         switch( ResourceDesc.Type )
         {
         case D3D_SIT_CBUFFER:
-            VHD( pRange->vResources.Add(pCB), "Internal loading error: cannot add cbuffer to range." );
+            VHD( pRange->vResources.Add(pCB->pRuntime), "Internal loading error: cannot add cbuffer to range." );
             break;
         case D3D_SIT_TBUFFER:
             VHD( pRange->vResources.Add(pShaderResource), "Internal loading error: cannot add tbuffer to range." );
-            VHD( vTBuffers.Add( (SConstantBuffer*)pCB ), "Internal loading error: cannot add tbuffer to vector." );
+            VHD( vTBuffers.Add( pCB->pRuntime ), "Internal loading error: cannot add tbuffer to vector." );
             break;
         case D3D_SIT_TEXTURE:
         case D3D_SIT_STRUCTURED:
@@ -2853,12 +2832,12 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
                 {
                     // For class instances, we create background interfaces which point to the class instance.  This is done so
                     // the shader can always expect SInterface dependencies, rather than a mix of SInterfaces and class instances
-                    VN( pInterface = PRIVATENEW SInterface[size] );
+                    VH( AllocateArray(m_pEffect->m_Heap, size, &pInterface) );
                     if( VariableElements == 0 )
                     {
                         assert( size == 1 );
                         pInterface[0].pClassInstance = (SClassInstanceGlobalVariable*)pVariable;
-                        m_BackgroundInterfaces.Add( &pInterface[0] );
+                        m_pEffect->m_BackgroundInterfaceCount++;
                     }
                     else
                     {
@@ -2869,7 +2848,7 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
                             SGlobalVariable *pElement = (SGlobalVariable*)pVariable->GetElement( iElement );
                             VBD( pElement->IsValid(), "Internal loading error: class instance array index out of range." );
                             pInterface[iElement].pClassInstance = (SClassInstanceGlobalVariable*)pElement;
-                            m_BackgroundInterfaces.Add( &pInterface[iElement] );
+                            m_pEffect->m_BackgroundInterfaceCount++;
                         }
                     }
                 }
@@ -2945,12 +2924,13 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
     pShaderBlock->UAVDepCount = vRanges[ ER_UnorderedAccessView ].GetSize();
     pShaderBlock->TBufferDepCount = vTBuffers.GetSize();
 
-    VN( pShaderBlock->pSampDeps = PRIVATENEW SShaderSamplerDependency[pShaderBlock->SampDepCount] );
-    VN( pShaderBlock->pCBDeps = PRIVATENEW SShaderCBDependency[pShaderBlock->CBDepCount] );
-    VN( pShaderBlock->pInterfaceDeps = PRIVATENEW SInterfaceDependency[pShaderBlock->InterfaceDepCount] );
-    VN( pShaderBlock->pResourceDeps = PRIVATENEW SShaderResourceDependency[pShaderBlock->ResourceDepCount] );
-    VN( pShaderBlock->pUAVDeps = PRIVATENEW SUnorderedAccessViewDependency[pShaderBlock->UAVDepCount] );
-    VN( pShaderBlock->ppTbufDeps = PRIVATENEW SConstantBuffer*[pShaderBlock->TBufferDepCount] );
+    // These arrays, and the arrays of each dependency, are read on every apply, so they live in the runtime heap
+    VH( AllocateArray(m_pEffect->m_RuntimeHeap, pShaderBlock->SampDepCount, &pShaderBlock->pSampDeps) );
+    VH( AllocateArray(m_pEffect->m_RuntimeHeap, pShaderBlock->CBDepCount, &pShaderBlock->pCBDeps) );
+    VH( AllocateArray(m_pEffect->m_RuntimeHeap, pShaderBlock->InterfaceDepCount, &pShaderBlock->pInterfaceDeps) );
+    VH( AllocateArray(m_pEffect->m_RuntimeHeap, pShaderBlock->ResourceDepCount, &pShaderBlock->pResourceDeps) );
+    VH( AllocateArray(m_pEffect->m_RuntimeHeap, pShaderBlock->UAVDepCount, &pShaderBlock->pUAVDeps) );
+    VH( AllocateArray(m_pEffect->m_RuntimeHeap, pShaderBlock->TBufferDepCount, &pShaderBlock->ppTbufDeps) );
 
     for (size_t i=0; i<pShaderBlock->CBDepCount; ++i)
     {
@@ -2960,13 +2940,13 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
 
         pDep->StartIndex = pRange->start;
         pDep->Count = pRange->last - pDep->StartIndex;
-        pDep->ppFXPointers = PRIVATENEW SConstantBuffer*[ pDep->Count ];
-        pDep->ppD3DObjects = PRIVATENEW ID3D11Buffer*[ pDep->Count ];
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppFXPointers) );
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppD3DObjects) );
 
         assert(pDep->Count == pRange->vResources.GetSize());
         for (size_t j=0; j<pDep->Count; ++j)
         {
-            pDep->ppFXPointers[j] = (SConstantBuffer *)pRange->vResources[j];
+            pDep->ppFXPointers[j] = (SConstantBufferRuntime *)pRange->vResources[j];
             pDep->ppD3DObjects[j] = nullptr;
         }
     }
@@ -2979,8 +2959,8 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
 
         pDep->StartIndex = pRange->start;
         pDep->Count = pRange->last - pDep->StartIndex;
-        pDep->ppFXPointers = PRIVATENEW SSamplerBlock*[ pDep->Count ];
-        pDep->ppD3DObjects = PRIVATENEW ID3D11SamplerState*[ pDep->Count ];
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppFXPointers) );
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppD3DObjects) );
 
         assert(pDep->Count == pRange->vResources.GetSize());
         for (size_t j=0; j<pDep->Count; ++j)
@@ -2998,8 +2978,8 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
 
         pDep->StartIndex = pRange->start;
         pDep->Count = pRange->last - pDep->StartIndex;
-        pDep->ppFXPointers = PRIVATENEW SInterface*[ pDep->Count ];
-        pDep->ppD3DObjects = PRIVATENEW ID3D11ClassInstance*[ pDep->Count ];
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppFXPointers) );
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppD3DObjects) );
 
         assert(pDep->Count == pRange->vResources.GetSize());
         for (size_t j=0; j<pDep->Count; ++j)
@@ -3017,8 +2997,8 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
 
         pDep->StartIndex = pRange->start;
         pDep->Count = pRange->last - pDep->StartIndex;
-        pDep->ppFXPointers = PRIVATENEW SShaderResource*[ pDep->Count ];
-        pDep->ppD3DObjects = PRIVATENEW ID3D11ShaderResourceView*[ pDep->Count ];
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppFXPointers) );
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppD3DObjects) );
 
         assert(pDep->Count == pRange->vResources.GetSize());
         for (size_t j=0; j<pDep->Count; ++j)
@@ -3036,8 +3016,8 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
 
         pDep->StartIndex = pRange->start;
         pDep->Count = pRange->last - pDep->StartIndex;
-        pDep->ppFXPointers = PRIVATENEW SUnorderedAccessView*[ pDep->Count ];
-        pDep->ppD3DObjects = PRIVATENEW ID3D11UnorderedAccessView*[ pDep->Count ];
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppFXPointers) );
+        VH( AllocateArray(m_pEffect->m_RuntimeHeap, pDep->Count, &pDep->ppD3DObjects) );
 
         assert(pDep->Count == pRange->vResources.GetSize());
         for (size_t j=0; j<pDep->Count; ++j)
@@ -3049,7 +3029,7 @@ HRESULT CEffectLoader::GrabShaderData(SShaderBlock *pShaderBlock)
 
     if (pShaderBlock->TBufferDepCount > 0)
     {
-        memcpy(pShaderBlock->ppTbufDeps, &vTBuffers[0], pShaderBlock->TBufferDepCount * sizeof(SConstantBuffer*));
+        memcpy(pShaderBlock->ppTbufDeps, &vTBuffers[0], pShaderBlock->TBufferDepCount * sizeof(SConstantBufferRuntime*));
     }
 
 lExit:
@@ -3086,10 +3066,10 @@ HRESULT CEffectLoader::BuildShaderBlock(SShaderBlock *pShaderBlock)
     // Grab input signatures for VS
     if( EOT_VertexShader == pShaderBlock->GetShaderType() )
     {
-        assert( pShaderBlock->pInputSignatureBlob == nullptr );
+        assert( pShaderBlock->pDescData->pInputSignatureBlob == nullptr );
         VHD( D3DGetBlobPart( pShaderBlock->pReflectionData->pBytecode, pShaderBlock->pReflectionData->BytecodeLength, 
                              D3D_BLOB_INPUT_SIGNATURE_BLOB, 0,
-                             &pShaderBlock->pInputSignatureBlob ),
+                             &pShaderBlock->pDescData->pInputSignatureBlob ),
              "Internal loading error: cannot get input signature." );
     }
 
@@ -3097,905 +3077,39 @@ lExit:
     return hr;
 }
 
-#undef PRIVATENEW
-
-
-//////////////////////////////////////////////////////////////////////////
-// Code to relocate data to private heaps (reflection & runtime effect)
-//
-// Important note about alignment: all reasonable chunks of data are 
-// machine word aligned (that is, any piece of data moved as a whole is 
-// aligned as a whole.  This means that when computing m_ReflectionMemory
-// or m_EffectMemory, each addition is aligned.  This also means 
-// that, when later relocating that same memory, you must call MoveData
-// or MoveString on the same chunks that were aligned.  This is 
-// because:   Align(a * b) != a * Align(b).
-//////////////////////////////////////////////////////////////////////////
-
 //////////////////////////////////////////////////////////////////////////
-// Reflection reallocation code
+// Block assignment initialization
 //////////////////////////////////////////////////////////////////////////
 
-HRESULT CEffectLoader::CalculateAnnotationSize(uint32_t  cAnnotations, SAnnotation *pAnnotations)
-{
-    HRESULT hr = S_OK;
-    uint32_t  i;
-
-    m_ReflectionMemory += AlignToPowerOf2(cAnnotations * sizeof(SAnnotation), c_DataAlignment);
-    for (i=0; i<cAnnotations; i++)
-    {
-        if (pAnnotations[i].pType->BelongsInConstantBuffer())
-        {
-            m_ReflectionMemory += AlignToPowerOf2(pAnnotations[i].pType->TotalSize, c_DataAlignment);
-        }
-        else
-        {
-            VBD( pAnnotations[i].pType->IsObjectType(EOT_String), "Invalid pEffectBuffer: invalid annotation type." );
-
-            uint32_t  cElements = std::max<uint32_t>(1, pAnnotations[i].pType->Elements);
-            
-            m_ReflectionMemory += AlignToPowerOf2(cElements * sizeof(SString), c_DataAlignment);
-            
-        }
-    }
-
-lExit:
-    return hr;
-}
-
-HRESULT CEffectLoader::ReallocateAnnotationData(uint32_t  cAnnotations, SAnnotation **ppAnnotations)
-{
-    HRESULT hr = S_OK;
-    uint32_t  i;
-    SAnnotation *pAnnotations;
-
-    VHD( m_pReflection->m_Heap.MoveData((void**) ppAnnotations, cAnnotations * sizeof(SAnnotation)),
-         "Internal loading error: cannot move annotation data." );
-    pAnnotations = *ppAnnotations;
-
-    for (i=0; i<cAnnotations; i++)
-    {
-        SAnnotation *pAn = &pAnnotations[i];
-        pAn->pEffect = m_pEffect;
-
-        VHD( m_pReflection->m_Heap.MoveString(&pAn->pName), "Internal loading error: cannot move annotation name." );
-
-        // Reallocate type later
-        if (pAn->pType->BelongsInConstantBuffer())
-        {
-            VHD( m_pReflection->m_Heap.MoveData( &pAn->Data.pGeneric, pAn->pType->TotalSize ), "Internal loading error: cannot move annotation data." );
-        }
-        else if (pAnnotations[i].pType->IsObjectType(EOT_String))
-        {
-            uint32_t  cElements = std::max<uint32_t>(1, pAn->pType->Elements);
-                        
-            VHD( m_pReflection->m_Heap.MoveData((void**) &pAn->Data.pString, cElements * sizeof(SString)), "Internal loading error: cannot move annotation string." );
-            for (size_t j = 0; j < cElements; ++ j)
-            {
-                VHD( m_pReflection->m_Heap.MoveString(&pAn->Data.pString[j].pString), "Internal loading error: cannot move annotation string element." );
-            }
-        }
-        else
-        {
-            VHD( E_FAIL, "Invalid pEffectBuffer: invalid annotation type." );
-        }
-    }
-
-lExit:
-    return hr;
-}
-
-HRESULT CEffectLoader::InitializeReflectionDataAndMoveStrings( uint32_t KnownSize )
+// Assignments are loaded in place, so all that is left once every block, shader
+// and variable exists is to check the destinations and evaluate each assignment
+template<class T> HRESULT CEffectLoader::InitializeBlockAssignments(T *pBlocks, uint32_t cBlocks)
 {
     HRESULT hr = S_OK;
-    uint32_t  cbStrings;
-    CEffectHeap *pHeap = &m_pReflection->m_Heap;
 
-    // Get byte counts
-    cbStrings = m_pEffect->m_StringCount * sizeof( SString );
-
-    if( KnownSize )
-    {
-        m_ReflectionMemory = KnownSize;
-    }
-    else
+    for(size_t i=0; i<cBlocks; i++)
     {
-        m_ReflectionMemory += AlignToPowerOf2(cbStrings, c_DataAlignment);
-
-        for (size_t i=0; i<m_pEffect->m_CBCount; i++)
-        {
-            VH( CalculateAnnotationSize(m_pEffect->m_pCBs[i].AnnotationCount, m_pEffect->m_pCBs[i].pAnnotations) );
-        }
+        T *pBlock = &pBlocks[i];
 
-        for (size_t i=0; i<m_pEffect->m_VariableCount; i++)
+        for (size_t j=0; j<pBlock->AssignmentCount; j++)
         {
-            VH( CalculateAnnotationSize(m_pEffect->m_pVariables[i].AnnotationCount, m_pEffect->m_pVariables[i].pAnnotations) );
-        }
+            SAssignment *pAssignment = &pBlock->pAssignments[j];
 
-        for (size_t i=0; i<m_pEffect->m_GroupCount; i++)
-        {
-            VH( CalculateAnnotationSize(m_pEffect->m_pGroups[i].AnnotationCount, m_pEffect->m_pGroups[i].pAnnotations) );
+            // Make sure the data pointer points into the backing store
+            VBD( pAssignment->Destination.pGeneric >= &pBlock->BackingStore && 
+                 pAssignment->Destination.pGeneric < (uint8_t*) &pBlock->BackingStore + sizeof(pBlock->BackingStore), 
+                 "Internal loading error: assignment destination out of range." );
 
-            for (size_t j=0; j<m_pEffect->m_pGroups[i].TechniqueCount; j++)
-            {
-                VH( CalculateAnnotationSize(m_pEffect->m_pGroups[i].pTechniques[j].AnnotationCount, m_pEffect->m_pGroups[i].pTechniques[j].pAnnotations) );
+            // Non-object assignments must have at least one dependency or they would have been pruned by now
+            assert( pAssignment->IsObjectAssignment() || pAssignment->DependencyCount > 0 );
 
-                for (size_t k=0; k<m_pEffect->m_pGroups[i].pTechniques[j].PassCount; k++)
-                {
-                    VH( CalculateAnnotationSize(m_pEffect->m_pGroups[i].pTechniques[j].pPasses[k].AnnotationCount, m_pEffect->m_pGroups[i].pTechniques[j].pPasses[k].pAnnotations) );
-                }
-            }
+            assert(m_pEffect->m_LocalTimer > 0);
+            m_pEffect->EvaluateAssignment(pAssignment);
         }
-
-        // Calculate shader reflection data size
-        for (size_t i=0; i<m_pEffect->m_ShaderBlockCount; i++)
-        {
-            if (nullptr != m_pEffect->m_pShaderBlocks[i].pReflectionData)
-            {
-                m_ReflectionMemory += AlignToPowerOf2(sizeof(SShaderBlock::SReflectionData), c_DataAlignment);
-                m_ReflectionMemory += AlignToPowerOf2(m_pEffect->m_pShaderBlocks[i].pReflectionData->BytecodeLength, c_DataAlignment);
-                // stream out decl is handled as a string, and thus its size is already factored because of GetStringAndAddToReflection
-            }
-        }
-    }
-
-    VHD( pHeap->ReserveMemory(m_ReflectionMemory), "Internal loading error: failed to reserve reflection memory." );
-
-    // Strings are handled separately because we are moving them to reflection
-    m_pOldStrings = m_pEffect->m_pStrings;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pStrings, cbStrings), "Internal loading error: cannot move string data." );
-    for(size_t i=0; i<m_pEffect->m_StringCount; i++)
-    {
-        VHD( pHeap->MoveString( &m_pEffect->m_pStrings[i].pString), "Internal loading error: cannot move string pointer." );
-    }
-
-lExit:
-    return hr;
-}
-
-// Move all reflection data to private heap
-HRESULT CEffectLoader::ReallocateReflectionData( bool Cloning )
-{
-    HRESULT hr = S_OK;
-    CEffectHeap *pHeap = &m_pReflection->m_Heap;
-
-    for(size_t i=0; i<m_pEffect->m_CBCount; i++)
-    {
-        VHD( pHeap->MoveString( &m_pEffect->m_pCBs[i].pName ), "Internal loading error: cannot move CB name." );
-        VH( ReallocateAnnotationData(m_pEffect->m_pCBs[i].AnnotationCount, &m_pEffect->m_pCBs[i].pAnnotations) );
-    }
-
-    for(size_t i=0; i<m_pEffect->m_VariableCount; i++)
-    {
-        VHD( pHeap->MoveString( &m_pEffect->m_pVariables[i].pName ), "Internal loading error: cannot move variable name." );
-        VHD( pHeap->MoveString( &m_pEffect->m_pVariables[i].pSemantic ), "Internal loading error: cannot move variable semantic." );
-        VH( ReallocateAnnotationData(m_pEffect->m_pVariables[i].AnnotationCount, &m_pEffect->m_pVariables[i].pAnnotations) );
-    }
-
-    for(size_t i=0; i<m_pEffect->m_GroupCount; i++)
-    {
-        VHD( pHeap->MoveString( &m_pEffect->m_pGroups[i].pName ), "Internal loading error: cannot move group name." );
-        VH( ReallocateAnnotationData(m_pEffect->m_pGroups[i].AnnotationCount, &m_pEffect->m_pGroups[i].pAnnotations) );
-
-        for(size_t j=0; j<m_pEffect->m_pGroups[i].TechniqueCount; j++)
-        {
-            VHD( pHeap->MoveString( &m_pEffect->m_pGroups[i].pTechniques[j].pName ), "Internal loading error: cannot move technique name." );
-            VH( ReallocateAnnotationData(m_pEffect->m_pGroups[i].pTechniques[j].AnnotationCount, &m_pEffect->m_pGroups[i].pTechniques[j].pAnnotations) );
-            
-            for(size_t k=0; k<m_pEffect->m_pGroups[i].pTechniques[j].PassCount; k++)
-            {
-                VHD( pHeap->MoveString( &m_pEffect->m_pGroups[i].pTechniques[j].pPasses[k].pName ), "Internal loading error: cannot move pass name." );
-                VH( ReallocateAnnotationData(m_pEffect->m_pGroups[i].pTechniques[j].pPasses[k].AnnotationCount, &m_pEffect->m_pGroups[i].pTechniques[j].pPasses[k].pAnnotations) );
-            }
-        }
-    }
-
-    if( !Cloning )
-    {
-        // When not cloning, every member in m_pMemberInterfaces is from a global variable, so we can take pName and pSemantic
-        // from the parent variable, which were updated above
-        for (size_t i = 0; i < m_pEffect->m_pMemberInterfaces.GetSize(); ++ i)
-        {
-            SMember* pMember = m_pEffect->m_pMemberInterfaces[i];
-            SGlobalVariable* pTopLevelEntity = (SGlobalVariable*)pMember->pTopLevelEntity;
-            VH( FixupVariablePointer( &pTopLevelEntity ) );
-            pMember->pName = pTopLevelEntity->pName;
-            pMember->pSemantic = pTopLevelEntity->pSemantic;
-        }
-    }
-
-    // Move shader bytecode
-    for (size_t i=0; i<m_pEffect->m_ShaderBlockCount; i++)
-    {
-        if (nullptr != m_pEffect->m_pShaderBlocks[i].pReflectionData)
-        {
-            VHD( pHeap->MoveData((void**)&m_pEffect->m_pShaderBlocks[i].pReflectionData, sizeof(SShaderBlock::SReflectionData)),
-                 "Internal loading error: cannot move shader reflection block." );
-            VHD( pHeap->MoveData((void**)&m_pEffect->m_pShaderBlocks[i].pReflectionData->pBytecode, m_pEffect->m_pShaderBlocks[i].pReflectionData->BytecodeLength),
-                 "Internal loading error: cannot move shader bytecode.");
-            for( size_t iDecl=0; iDecl < D3D11_SO_STREAM_COUNT; ++iDecl )
-            {
-                VHD( pHeap->MoveString(&m_pEffect->m_pShaderBlocks[i].pReflectionData->pStreamOutDecls[iDecl]), "Internal loading error: cannot move SO decl." );
-            }
-            VH( pHeap->MoveInterfaceParameters(m_pEffect->m_pShaderBlocks[i].pReflectionData->InterfaceParameterCount, &m_pEffect->m_pShaderBlocks[i].pReflectionData->pInterfaceParameters ) );
-        }
-        
-    }
-
-lExit:
-    return hr;
-}
-
-//////////////////////////////////////////////////////////////////////////
-// Runtime effect reallocation code
-//////////////////////////////////////////////////////////////////////////
-
-template<class T> HRESULT CEffectLoader::ReallocateBlockAssignments(T* &pBlocks, uint32_t  cBlocks, T* pOldBlocks)
-{
-    HRESULT hr = S_OK;
-    CEffectHeap *pHeap = &m_pEffect->m_Heap;
-    
-    for(size_t i=0; i<cBlocks; i++)
-    {
-        T *pBlock = &pBlocks[i];
-        VHD( pHeap->MoveData((void**) &pBlock->pAssignments, sizeof(SAssignment)*pBlock->AssignmentCount), "Internal loading error: cannot move assignment count." );
-
-        for (size_t j=0; j<pBlock->AssignmentCount; j++)
-        {
-            SAssignment *pAssignment = &pBlock->pAssignments[j];
-            uint32_t  cbDeps;
-
-            // When cloning, convert pointers back into offsets
-            if( pOldBlocks )
-            {
-                T *pOldBlock = &pOldBlocks[i];
-                pAssignment->Destination.Offset = (uint32_t)( (UINT_PTR)pAssignment->Destination.pGeneric - (UINT_PTR)pOldBlock ) ;
-            }
-
-            // Convert destination pointers from offset to real pointer
-            pAssignment->Destination.pGeneric = (uint8_t*) pBlock + pAssignment->Destination.Offset;
-
-            // Make sure the data pointer points into the backing store
-            VBD( pAssignment->Destination.pGeneric >= &pBlock->BackingStore && 
-                 pAssignment->Destination.pGeneric < (uint8_t*) &pBlock->BackingStore + sizeof(pBlock->BackingStore), 
-                 "Internal loading error: assignment destination out of range." );
-
-            // Fixup dependencies
-            cbDeps = pAssignment->DependencyCount * sizeof(SAssignment::SDependency);
-            VHD( pHeap->MoveData((void**) &pAssignment->pDependencies, cbDeps), "Internal loading error: cannot move assignment dependencies." );
-
-            SGlobalVariable *pOldVariable = nullptr;
-            for(size_t iDep=0; iDep<pAssignment->DependencyCount; iDep++)
-            {
-                SAssignment::SDependency *pDep = &pAssignment->pDependencies[iDep];
-                // We ignore all but the last variable because below, we only use the last dependency
-                pOldVariable = pDep->pVariable;
-                VH( FixupVariablePointer(&pDep->pVariable) );
-            }
-
-            // Fixup source pointers
-            switch(pAssignment->LhsType)
-            {
-            case ELHS_VertexShaderBlock:
-            case ELHS_PixelShaderBlock:
-            case ELHS_GeometryShaderBlock:
-            case ELHS_HullShaderBlock:
-            case ELHS_DomainShaderBlock:
-            case ELHS_ComputeShaderBlock:
-                VH( FixupShaderPointer(&pAssignment->Source.pShader) );
-                break;
-
-            case ELHS_DepthStencilBlock:
-                VH( FixupDSPointer((SDepthStencilBlock**)&pAssignment->Source.pBlock) );
-                break;
-            case ELHS_BlendBlock:
-                VH( FixupABPointer((SBlendBlock**) &pAssignment->Source.pBlock) );
-                break;
-            case ELHS_RasterizerBlock:
-                VH( FixupRSPointer((SRasterizerBlock**) &pAssignment->Source.pBlock) );
-                break;
-
-            case ELHS_Texture:
-                VH( FixupShaderResourcePointer((SShaderResource**) &pAssignment->Source.pShaderResource) );
-                break;
-
-            default:
-                // Non-object assignment (must have at least one dependency or it would have been pruned by now)
-                assert( !pAssignment->IsObjectAssignment() && pAssignment->DependencyCount > 0 );
-
-                // Numeric variables must be relocated before this function is called
-                
-                switch (pAssignment->AssignmentType)
-                {
-                case ERAT_NumericVariable:
-                case ERAT_NumericVariableIndex:
-                    // the variable or variable array is always the last dependency in the chain
-                    SGlobalVariable *pVariable;
-                    pVariable = pAssignment->pDependencies[pAssignment->DependencyCount - 1].pVariable;
-                    assert( pVariable->pType->BelongsInConstantBuffer() && nullptr != pVariable->pCB );
-
-                    // When cloning, convert pointers back into offsets
-                    if( pOldBlocks )
-                    {
-                        VBD( pOldVariable != nullptr, "Internal loading error: pOldVariable is nullptr." );
-                        pAssignment->Source.Offset = pAssignment->Source.pNumeric - pOldVariable->pCB->pBackingStore;
-                    }
-
-                    // Convert from offset to pointer
-                    pAssignment->Source.pNumeric = pVariable->pCB->pBackingStore + pAssignment->Source.Offset;
-                    break;
-
-                default:
-                    // Shouldn't be able to get here
-                    assert(0);
-                    VHD( E_FAIL, "Loading error: invalid assignment type." );
-                }
-                break;
-
-            case ELHS_Invalid:
-                VHD( E_FAIL, "Loading error: invalid assignment type." );
-            }
-
-            assert(m_pEffect->m_LocalTimer > 0);
-            m_pEffect->EvaluateAssignment(pAssignment);
-        }
-    }
-
-lExit:
-    return hr;
-}
-
-template<class T> uint32_t  CEffectLoader::CalculateBlockAssignmentSize(T* &pBlocks, uint32_t  cBlocks)
-{
-    uint32_t  dwSize = 0;
-
-    for(size_t i=0; i<cBlocks; i++)
-    {
-        SBaseBlock *pBlock = &pBlocks[i];
-        dwSize += AlignToPowerOf2(pBlock->AssignmentCount * sizeof(SAssignment), c_DataAlignment);
-        
-        for (size_t j=0; j<pBlock->AssignmentCount; j++)
-        {
-            SAssignment *pAssignment = &pBlock->pAssignments[j];
-            
-            dwSize += AlignToPowerOf2(pAssignment->DependencyCount * sizeof(SAssignment::SDependency), c_DataAlignment);
-        }
-    }
-
-    return dwSize;
-}
-
-HRESULT CEffectLoader::ReallocateShaderBlocks()
-{
-    HRESULT hr = S_OK;
-    CEffectHeap *pHeap = &m_pEffect->m_Heap;
-    const char* pError = "Internal loading error: cannot move shader data.";
-    
-    for (size_t i=0; i<m_pEffect->m_ShaderBlockCount; i++)
-    {
-        SShaderBlock *pShader = &m_pEffect->m_pShaderBlocks[i];
-
-        // pShader->pReflection data and all of its members (bytecode, SO decl, etc.) are handled by ReallocateReflectionData()
-        VHD( pHeap->MoveData((void**) &pShader->pCBDeps, pShader->CBDepCount * sizeof(SShaderCBDependency)), pError );
-        VHD( pHeap->MoveData((void**) &pShader->pSampDeps, pShader->SampDepCount * sizeof(SShaderSamplerDependency)), pError );
-        VHD( pHeap->MoveData((void**) &pShader->pInterfaceDeps, pShader->InterfaceDepCount * sizeof(SInterfaceDependency)), pError );
-        VHD( pHeap->MoveData((void**) &pShader->pResourceDeps, pShader->ResourceDepCount * sizeof(SShaderResourceDependency)), pError );
-        VHD( pHeap->MoveData((void**) &pShader->pUAVDeps, pShader->UAVDepCount * sizeof(SUnorderedAccessViewDependency)), pError );
-        VHD( pHeap->MoveData((void**) &pShader->ppTbufDeps, pShader->TBufferDepCount * sizeof(SConstantBuffer*)), pError );
-        
-        for (size_t j=0; j<pShader->CBDepCount; j++)
-        {
-            SShaderCBDependency *pCBDeps = &pShader->pCBDeps[j];
-            VHD( pHeap->MoveData((void**) &pCBDeps->ppD3DObjects, pCBDeps->Count * sizeof(ID3D11Buffer*)), pError );
-            VHD( pHeap->MoveData((void**) &pCBDeps->ppFXPointers, pCBDeps->Count * sizeof(SConstantBuffer*)), pError );
-
-            for (size_t k=0; k<pCBDeps->Count; k++)
-            {
-                VH( FixupCBPointer( &pCBDeps->ppFXPointers[k] ) );
-            }
-        }
-
-        for (size_t j=0; j<pShader->SampDepCount; j++)
-        {
-            SShaderSamplerDependency *pSampDeps = &pShader->pSampDeps[j];
-            VHD( pHeap->MoveData((void**) &pSampDeps->ppD3DObjects, pSampDeps->Count * sizeof(ID3D11SamplerState*)), pError );
-            VHD( pHeap->MoveData((void**) &pSampDeps->ppFXPointers, pSampDeps->Count * sizeof(SSamplerBlock*)), pError );
-
-            for (size_t k=0; k<pSampDeps->Count; k++)
-            {
-                VH( FixupSamplerPointer(&pSampDeps->ppFXPointers[k]) );
-            }
-        }
-
-        for (size_t j=0; j<pShader->InterfaceDepCount; j++)
-        {
-            SInterfaceDependency *pInterfaceDeps = &pShader->pInterfaceDeps[j];
-            VHD( pHeap->MoveData((void**) &pInterfaceDeps->ppD3DObjects, pInterfaceDeps->Count * sizeof(ID3D11ClassInstance*)), pError );
-            VHD( pHeap->MoveData((void**) &pInterfaceDeps->ppFXPointers, pInterfaceDeps->Count * sizeof(SInterface*)), pError );
-
-            for (size_t k=0; k<pInterfaceDeps->Count; k++)
-            {
-                VH( FixupInterfacePointer(&pInterfaceDeps->ppFXPointers[k], true) );
-            }
-        }
-
-        for (size_t j=0; j<pShader->ResourceDepCount; j++)
-        {
-            SShaderResourceDependency *pResourceDeps = &pShader->pResourceDeps[j];
-            VHD( pHeap->MoveData((void**) &pResourceDeps->ppD3DObjects, pResourceDeps->Count * sizeof(ID3D11ShaderResourceView*)), pError );
-            VHD( pHeap->MoveData((void**) &pResourceDeps->ppFXPointers, pResourceDeps->Count * sizeof(SShaderResource*)), pError );
-
-            for (size_t k=0; k<pResourceDeps->Count; k++)
-            {
-                VH( FixupShaderResourcePointer(&pResourceDeps->ppFXPointers[k]) );
-            }
-        }
-
-        for (size_t j=0; j<pShader->UAVDepCount; j++)
-        {
-            SUnorderedAccessViewDependency *pUAVDeps = &pShader->pUAVDeps[j];
-            VHD( pHeap->MoveData((void**) &pUAVDeps->ppD3DObjects, pUAVDeps->Count * sizeof(ID3D11UnorderedAccessView*)), pError );
-            VHD( pHeap->MoveData((void**) &pUAVDeps->ppFXPointers, pUAVDeps->Count * sizeof(SUnorderedAccessView*)), pError );
-
-            for (size_t k=0; k<pUAVDeps->Count; k++)
-            {
-                VH( FixupUnorderedAccessViewPointer(&pUAVDeps->ppFXPointers[k]) );
-            }
-        }
-
-        for (size_t j=0; j<pShader->TBufferDepCount; j++)
-        {
-            VH( FixupCBPointer( &pShader->ppTbufDeps[j] ) );
-        }
-    }
-
-lExit:
-    return hr;
-}
-
-
-uint32_t  CEffectLoader::CalculateShaderBlockSize()
-{
-    uint32_t  dwSize = 0;
-    
-    for (size_t i=0; i<m_pEffect->m_ShaderBlockCount; i++)
-    {
-        SShaderBlock *pShader = &m_pEffect->m_pShaderBlocks[i];
-
-        dwSize += AlignToPowerOf2(pShader->CBDepCount * sizeof(SShaderCBDependency), c_DataAlignment);
-        dwSize += AlignToPowerOf2(pShader->SampDepCount * sizeof(SShaderSamplerDependency), c_DataAlignment);
-        dwSize += AlignToPowerOf2(pShader->InterfaceDepCount * sizeof(SInterfaceDependency), c_DataAlignment);
-        dwSize += AlignToPowerOf2(pShader->ResourceDepCount * sizeof(SShaderResourceDependency), c_DataAlignment);
-        dwSize += AlignToPowerOf2(pShader->UAVDepCount * sizeof(SUnorderedAccessViewDependency), c_DataAlignment);
-        dwSize += AlignToPowerOf2(pShader->TBufferDepCount * sizeof(SConstantBuffer*), c_DataAlignment);
-
-        for (size_t j=0; j<pShader->CBDepCount; j++)
-        {
-            SShaderCBDependency *pCBDeps = &pShader->pCBDeps[j];
-            dwSize += AlignToPowerOf2(pCBDeps->Count * sizeof(ID3D11Buffer*), c_DataAlignment);
-            dwSize += AlignToPowerOf2(pCBDeps->Count * sizeof(SConstantBuffer*), c_DataAlignment);
-        }
-
-        for (size_t j=0; j<pShader->SampDepCount; j++)
-        {
-            SShaderSamplerDependency *pSampDeps = &pShader->pSampDeps[j];
-            dwSize += AlignToPowerOf2(pSampDeps->Count * sizeof(ID3D11SamplerState*), c_DataAlignment);
-            dwSize += AlignToPowerOf2(pSampDeps->Count * sizeof(SSamplerBlock*), c_DataAlignment);
-        }
-
-        for (size_t j=0; j<pShader->InterfaceDepCount; j++)
-        {
-            SInterfaceDependency *pInterfaceDeps = &pShader->pInterfaceDeps[j];
-            dwSize += AlignToPowerOf2(pInterfaceDeps->Count * sizeof(ID3D11ClassInstance*), c_DataAlignment);
-            dwSize += AlignToPowerOf2(pInterfaceDeps->Count * sizeof(SInterface*), c_DataAlignment);
-        }
-
-        for (size_t j=0; j<pShader->ResourceDepCount; j++)
-        {
-            SShaderResourceDependency *pResourceDeps = &pShader->pResourceDeps[j];
-            dwSize += AlignToPowerOf2(pResourceDeps->Count * sizeof(ID3D11ShaderResourceView*), c_DataAlignment);
-            dwSize += AlignToPowerOf2(pResourceDeps->Count * sizeof(SShaderResource*), c_DataAlignment);
-        }
-
-        for (size_t j=0; j<pShader->UAVDepCount; j++)
-        {
-            SUnorderedAccessViewDependency *pUAVDeps = &pShader->pUAVDeps[j];
-            dwSize += AlignToPowerOf2(pUAVDeps->Count * sizeof(ID3D11UnorderedAccessView*), c_DataAlignment);
-            dwSize += AlignToPowerOf2(pUAVDeps->Count * sizeof(SUnorderedAccessView*), c_DataAlignment);
-        }
-    }
-
-    return dwSize;
-}
-
-// Move all (non-reflection) effect data to private heap
-#pragma warning(push)
-#pragma warning(disable: 4616 6239 )
-HRESULT CEffectLoader::ReallocateEffectData( bool Cloning )
-{
-    HRESULT hr = S_OK;
-    CEffectHeap *pHeap = &m_pEffect->m_Heap;
-    uint32_t cbCBs = sizeof(SConstantBuffer) * m_pEffect->m_CBCount;
-    uint32_t cbVariables = sizeof(SGlobalVariable) * m_pEffect->m_VariableCount;
-    uint32_t cbGroups = sizeof(STechnique) * m_pEffect->m_GroupCount;
-    uint32_t cbShaders = sizeof(SShaderBlock) * m_pEffect->m_ShaderBlockCount;
-    uint32_t cbDS = sizeof(SDepthStencilBlock) * m_pEffect->m_DepthStencilBlockCount;
-    uint32_t cbAB = sizeof(SBlendBlock) * m_pEffect->m_BlendBlockCount;
-    uint32_t cbRS = sizeof(SRasterizerBlock) * m_pEffect->m_RasterizerBlockCount;
-    uint32_t cbSamplers = sizeof(SSamplerBlock) * m_pEffect->m_SamplerBlockCount;
-    uint32_t cbMemberDatas = sizeof(SMemberDataPointer) * m_pEffect->m_MemberDataCount;
-    uint32_t cbInterfaces = sizeof(SInterface) * m_pEffect->m_InterfaceCount;
-    uint32_t cbBackgroundInterfaces = sizeof(SInterface) * m_BackgroundInterfaces.GetSize();
-    uint32_t cbShaderResources = sizeof(SShaderResource) * m_pEffect->m_ShaderResourceCount;
-    uint32_t cbUnorderedAccessViews = sizeof(SUnorderedAccessView) * m_pEffect->m_UnorderedAccessViewCount;
-    uint32_t cbRenderTargetViews = sizeof(SRenderTargetView) * m_pEffect->m_RenderTargetViewCount;
-    uint32_t cbDepthStencilViews = sizeof(SDepthStencilView) * m_pEffect->m_DepthStencilViewCount;
-    uint32_t cbAnonymousShaders = sizeof(SAnonymousShader) * m_pEffect->m_AnonymousShaderCount;
-
-    // Calculate memory needed
-    m_EffectMemory += AlignToPowerOf2(cbCBs, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbVariables, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbGroups, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbShaders, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbMemberDatas, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbInterfaces + cbBackgroundInterfaces, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbShaderResources, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbUnorderedAccessViews, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbRenderTargetViews, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbDepthStencilViews, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbDS, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbAB, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbRS, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbSamplers, c_DataAlignment);
-    m_EffectMemory += AlignToPowerOf2(cbAnonymousShaders, c_DataAlignment);
-
-    m_EffectMemory += CalculateShaderBlockSize();
-
-    for (size_t i=0; i<m_pEffect->m_CBCount; i++)
-    {
-        SConstantBuffer *pCB = &m_pEffect->m_pCBs[i];
-
-        m_EffectMemory += AlignToPowerOf2(pCB->Size, c_DataAlignment);
-    }
-
-    for (size_t i=0; i<m_pEffect->m_GroupCount; i++)
-    {
-        SGroup *pGroup = &m_pEffect->m_pGroups[i];
-
-        m_EffectMemory += AlignToPowerOf2(pGroup->TechniqueCount * sizeof(STechnique), c_DataAlignment);
-
-        for (size_t j=0; j<pGroup->TechniqueCount; j++)
-        {
-            STechnique *pTech = &pGroup->pTechniques[j];
-
-            m_EffectMemory += AlignToPowerOf2(pTech->PassCount * sizeof(SPassBlock), c_DataAlignment);
-            m_EffectMemory += CalculateBlockAssignmentSize(pTech->pPasses, pTech->PassCount);
-        }
-    };
-
-    m_EffectMemory += CalculateBlockAssignmentSize(m_pEffect->m_pBlendBlocks, m_pEffect->m_BlendBlockCount);
-    m_EffectMemory += CalculateBlockAssignmentSize(m_pEffect->m_pDepthStencilBlocks, m_pEffect->m_DepthStencilBlockCount);
-    m_EffectMemory += CalculateBlockAssignmentSize(m_pEffect->m_pRasterizerBlocks, m_pEffect->m_RasterizerBlockCount);
-    m_EffectMemory += CalculateBlockAssignmentSize(m_pEffect->m_pSamplerBlocks, m_pEffect->m_SamplerBlockCount);
-
-    // Reserve memory
-    VHD( pHeap->ReserveMemory(m_EffectMemory), "Internal loading error: cannot reserve effect memory." );
-
-    // Move DataMemberPointer blocks
-    m_pOldMemberDataBlocks = m_pEffect->m_pMemberDataBlocks;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pMemberDataBlocks, cbMemberDatas), "Internal loading error: cannot move member data blocks." );
-
-    // Move CBs
-    m_pOldCBs = m_pEffect->m_pCBs;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pCBs, cbCBs), "Internal loading error: cannot move CB count." );
-    for (size_t i=0; i<m_pEffect->m_CBCount; i++)
-    {
-        SConstantBuffer *pCB = &m_pEffect->m_pCBs[i];
-
-        VHD( pHeap->MoveData((void**) &pCB->pBackingStore, pCB->Size), "Internal loading error: cannot move CB backing store." );
-
-        if( !Cloning )
-        {
-            // When creating the effect, MemberDataOffsetPlus4 is used, not pMemberData
-            if( pCB->MemberDataOffsetPlus4 )
-            {
-                pCB->pMemberData = (SMemberDataPointer*)( (uint8_t*)m_pEffect->m_pMemberDataBlocks + ( pCB->MemberDataOffsetPlus4 - 4 ) );
-            }
-        }
-        else if (pCB->pMemberData)
-        {
-            // When cloning an effect, pMemberData points to valid data in the original effect
-            VH( FixupMemberDataPointer( &pCB->pMemberData ) );
-        }
-    }
-
-    // Move numeric variables; move all variable types
-    m_pOldVars = m_pEffect->m_pVariables;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pVariables, cbVariables), "Internal loading error: cannot move variable count." );
-    for (size_t i=0; i<m_pEffect->m_VariableCount; i++)
-    {
-        SGlobalVariable *pVar = &m_pEffect->m_pVariables[i];
-        pVar->pEffect = m_pEffect;
-
-        if( Cloning && pVar->pType->BelongsInConstantBuffer())
-        {
-            // Convert pointer back to offset
-            // pVar->pCB refers to the old CB
-            pVar->Data.Offset = (UINT_PTR)pVar->Data.pGeneric - (UINT_PTR)pVar->pCB->pBackingStore;
-        }
-
-        if (pVar->pCB)
-        {
-            VH( FixupCBPointer( &pVar->pCB ) );
-        }
-
-        if( !Cloning )
-        {
-            // When creating the effect, MemberDataOffsetPlus4 is used, not pMemberData
-            if( pVar->MemberDataOffsetPlus4 )
-            {
-                pVar->pMemberData = (SMemberDataPointer*)( (uint8_t*)m_pEffect->m_pMemberDataBlocks + ( pVar->MemberDataOffsetPlus4 - 4 ) );
-            }
-        }
-        else if (pVar->pMemberData)
-        {
-            // When cloning an effect, pMemberData points to valid data in the original effect
-            VH( FixupMemberDataPointer( &pVar->pMemberData ) );
-        }
-
-        if (pVar->pType->BelongsInConstantBuffer())
-        {
-            // Convert from offsets to pointers
-            pVar->Data.pGeneric = pVar->pCB->pBackingStore + pVar->Data.Offset;
-        }
-    }
-
-    // Fixup each CB's array of child variable pointers
-    for (size_t i=0; i<m_pEffect->m_CBCount; i++)
-    {
-        SConstantBuffer *pCB = &m_pEffect->m_pCBs[i];
-        pCB->pEffect = m_pEffect;
-
-        if (pCB->pVariables != nullptr)
-        {
-            VH( FixupVariablePointer(&pCB->pVariables) );
-        }
-    }
-
-    // Move shaders
-    m_pOldShaders = m_pEffect->m_pShaderBlocks;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pShaderBlocks, cbShaders), "Internal loading error: cannot move shader count." );
-
-    // Move interfaces, combining global interfaces and those that were created during shader initialization
-    m_pOldInterfaces = m_pEffect->m_pInterfaces;
-    m_OldInterfaceCount = m_pEffect->m_InterfaceCount;
-    VHD( pHeap->MoveEmptyDataBlock((void**) &m_pEffect->m_pInterfaces, cbInterfaces + cbBackgroundInterfaces), "Internal loading error: cannot move shader." );
-    memcpy( m_pEffect->m_pInterfaces, m_pOldInterfaces, cbInterfaces );
-    for( size_t i=0; i < m_BackgroundInterfaces.GetSize(); i++ )
-    {
-        assert( m_BackgroundInterfaces[i] != nullptr );
-        uint8_t* pDst = (uint8_t*)m_pEffect->m_pInterfaces  + ( m_pEffect->m_InterfaceCount * sizeof(SInterface) );
-        memcpy( pDst, m_BackgroundInterfaces[i], sizeof(SInterface) );
-        m_pEffect->m_InterfaceCount++;
-    }
-
-    m_pOldShaderResources = m_pEffect->m_pShaderResources;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pShaderResources, cbShaderResources), "Internal loading error: cannot move SRVs." );
-
-    m_pOldUnorderedAccessViews = m_pEffect->m_pUnorderedAccessViews;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pUnorderedAccessViews, cbUnorderedAccessViews), "Internal loading error: cannot move UAVS." );
-
-    m_pOldRenderTargetViews = m_pEffect->m_pRenderTargetViews;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pRenderTargetViews, cbRenderTargetViews), "Internal loading error: cannot move RTVs." );
-
-    m_pOldDepthStencilViews = m_pEffect->m_pDepthStencilViews;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pDepthStencilViews, cbDepthStencilViews), "Internal loading error: cannot move DSVs." );
-
-    m_pOldDS = m_pEffect->m_pDepthStencilBlocks;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pDepthStencilBlocks, cbDS), "Internal loading error: cannot move depth-stencil state blocks." );
-    VH( ReallocateBlockAssignments(m_pEffect->m_pDepthStencilBlocks, m_pEffect->m_DepthStencilBlockCount, Cloning ? m_pOldDS : nullptr) );
-    
-    m_pOldAB = m_pEffect->m_pBlendBlocks;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pBlendBlocks, cbAB), "Internal loading error: cannot move blend state blocks." );
-    VH( ReallocateBlockAssignments(m_pEffect->m_pBlendBlocks, m_pEffect->m_BlendBlockCount, Cloning ? m_pOldAB : nullptr) );
-
-    m_pOldRS = m_pEffect->m_pRasterizerBlocks;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pRasterizerBlocks, cbRS), "Internal loading error: cannot move rasterizer state blocks." );
-    VH( ReallocateBlockAssignments(m_pEffect->m_pRasterizerBlocks, m_pEffect->m_RasterizerBlockCount, Cloning ? m_pOldRS : nullptr) );
-
-    m_pOldSamplers = m_pEffect->m_pSamplerBlocks;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pSamplerBlocks, cbSamplers), "Internal loading error: cannot move samplers." );
-    VH( ReallocateBlockAssignments(m_pEffect->m_pSamplerBlocks, m_pEffect->m_SamplerBlockCount, Cloning ? m_pOldSamplers : nullptr) );
-    
-    // Fixup sampler backing stores
-    for (size_t i=0; i<m_pEffect->m_SamplerBlockCount; ++i)
-    {
-        VH( FixupShaderResourcePointer(&m_pEffect->m_pSamplerBlocks[i].BackingStore.pTexture) );
     }
 
-    // Fixup each interface's class instance variable pointer
-    for (size_t i=0; i<m_pEffect->m_InterfaceCount; i++)
-    {
-        SInterface *pInterface = &m_pEffect->m_pInterfaces[i];
-
-        if (pInterface->pClassInstance != nullptr)
-        {
-            VH( FixupVariablePointer( (SGlobalVariable**)&pInterface->pClassInstance ) );
-        }
-    }
-
-    // Fixup pointers for non-numeric variables
-    for (size_t i=0; i<m_pEffect->m_VariableCount; i++)
-    {
-        SGlobalVariable *pVar = &m_pEffect->m_pVariables[i];
-
-        if (pVar->pType->IsShader())
-        {
-            VH( FixupShaderPointer(&pVar->Data.pShader) );
-        }
-        else if (pVar->pType->IsShaderResource())
-        {
-            VH( FixupShaderResourcePointer(&pVar->Data.pShaderResource) );
-        }
-        else if (pVar->pType->IsUnorderedAccessView())
-        {
-            VH( FixupUnorderedAccessViewPointer(&pVar->Data.pUnorderedAccessView) );
-        }
-        else if (pVar->pType->IsInterface())
-        {
-            VH( FixupInterfacePointer(&pVar->Data.pInterface, false) );
-        }
-        else if (pVar->pType->IsObjectType(EOT_String))
-        {
-            if( !m_pEffect->IsOptimized() )
-            {
-                VH( FixupStringPointer(&pVar->Data.pString) );
-            }
-        }
-        else if (pVar->pType->IsStateBlockObject())
-        {
-            switch(pVar->pType->ObjectType)
-            {
-                case EOT_DepthStencil:
-                    VH( FixupDSPointer((SDepthStencilBlock**) &pVar->Data.pBlock) );
-                    break;
-                case EOT_Blend:
-                    VH( FixupABPointer((SBlendBlock**) &pVar->Data.pBlock) );
-                    break;
-                case EOT_Rasterizer:
-                    VH( FixupRSPointer((SRasterizerBlock**) &pVar->Data.pBlock) );
-                    break;
-                case EOT_Sampler:
-                    VB(pVar->pType->IsSampler());
-                    VH( FixupSamplerPointer((SSamplerBlock**) &pVar->Data.pBlock) );
-                    break;
-                default:
-                    VH( E_FAIL );
-            }
-        }
-        else if (pVar->pType->VarType == EVT_Struct || pVar->pType->VarType == EVT_Numeric)
-        {
-            if( pVar->pType->IsClassInstance() )
-            {
-                // do nothing
-            }
-            else
-            {
-                // do nothing
-            }
-        }
-        else if (pVar->pType->IsRenderTargetView())
-        {
-            VH( FixupRenderTargetViewPointer(&pVar->Data.pRenderTargetView) );
-        } 
-        else if (pVar->pType->IsDepthStencilView())
-        {
-            VH( FixupDepthStencilViewPointer(&pVar->Data.pDepthStencilView) );
-        }
-        else
-        {
-            VHD( E_FAIL, "Internal loading error: Invalid variable type." );
-        }
-    }
-
-    // Fixup created members
-    for (size_t i = 0; i < m_pEffect->m_pMemberInterfaces.GetSize(); ++ i)
-    {
-        SMember* pMember = m_pEffect->m_pMemberInterfaces[i];
-        SGlobalVariable** ppTopLevelEntity = (SGlobalVariable**)&pMember->pTopLevelEntity;
-        VN( *ppTopLevelEntity );
-
-        // This might be set to false later, for supporting textures inside classes
-        const bool bGlobalMemberDataBlock = true;
-
-        if( Cloning )
-        {
-            if( pMember->pType->BelongsInConstantBuffer() )
-            {
-                assert( pMember->Data.pGeneric == nullptr || (*ppTopLevelEntity)->pEffect->m_Heap.IsInHeap(pMember->Data.pGeneric) );
-                pMember->Data.Offset = (uint32_t)( (uint8_t*)pMember->Data.pGeneric - (uint8_t*)(*ppTopLevelEntity)->pCB->pBackingStore );
-            }
-            if( bGlobalMemberDataBlock && pMember->pMemberData )
-            {
-                pMember->MemberDataOffsetPlus4 = (uint32_t)( (uint8_t*)pMember->pMemberData - (uint8_t*)(*ppTopLevelEntity)->pEffect->m_pMemberDataBlocks ) + 4;
-            }
-        }
-
-        VH( FixupVariablePointer( ppTopLevelEntity ) );
-
-        if (pMember->pType->BelongsInConstantBuffer())
-        {
-            // Convert from offsets to pointers
-            pMember->Data.pGeneric = (*ppTopLevelEntity)->pCB->pBackingStore + pMember->Data.Offset;
-        }
-        if( bGlobalMemberDataBlock && pMember->MemberDataOffsetPlus4 )
-        {
-            pMember->pMemberData = (SMemberDataPointer*)( (uint8_t*)m_pEffect->m_pMemberDataBlocks + ( pMember->MemberDataOffsetPlus4 - 4 ) );
-        }
-    }
-
-    // Fixup shader data
-    VH( ReallocateShaderBlocks() );
-
-    // Move groups, techniques, and passes
-    m_pOldGroups = m_pEffect->m_pGroups;
-    VHD( pHeap->MoveData((void**) &m_pEffect->m_pGroups, cbGroups), "Internal loading error: cannot move groups." );
-    for (size_t i=0; i<m_pEffect->m_GroupCount; i++)
-    {
-        SGroup *pGroup = &m_pEffect->m_pGroups[i];
-        uint32_t  cbTechniques;
-
-        cbTechniques = pGroup->TechniqueCount * sizeof(STechnique);
-        VHD( pHeap->MoveData((void**) &pGroup->pTechniques, cbTechniques), "Internal loading error: cannot move techniques." );
-
-        for (size_t j=0; j<pGroup->TechniqueCount; j++)
-        {
-            STechnique *pTech = &pGroup->pTechniques[j];
-            uint32_t  cbPass;
-
-            cbPass = pTech->PassCount * sizeof(SPassBlock);
-            SPassBlock* pOldPasses = Cloning ? pTech->pPasses : nullptr;
-            VHD( pHeap->MoveData((void**) &pTech->pPasses, cbPass), "Internal loading error: cannot move passes." );
-
-            for (size_t iPass = 0; iPass < pTech->PassCount; ++ iPass)
-            {
-                pTech->pPasses[iPass].pEffect = m_pEffect;
-
-                // Fixup backing store pointers in passes
-                VH( FixupABPointer((SBlendBlock**) &pTech->pPasses[iPass].BackingStore.pBlendBlock) );
-                VH( FixupDSPointer((SDepthStencilBlock**) &pTech->pPasses[iPass].BackingStore.pDepthStencilBlock) );
-                VH( FixupRSPointer((SRasterizerBlock**) &pTech->pPasses[iPass].BackingStore.pRasterizerBlock) );
-                VH( FixupShaderPointer((SShaderBlock**) &pTech->pPasses[iPass].BackingStore.pVertexShaderBlock) );
-                VH( FixupShaderPointer((SShaderBlock**) &pTech->pPasses[iPass].BackingStore.pPixelShaderBlock) );
-                VH( FixupShaderPointer((SShaderBlock**) &pTech->pPasses[iPass].BackingStore.pGeometryShaderBlock) );
-                VH( FixupShaderPointer((SShaderBlock**) &pTech->pPasses[iPass].BackingStore.pHullShaderBlock) );
-                VH( FixupShaderPointer((SShaderBlock**) &pTech->pPasses[iPass].BackingStore.pDomainShaderBlock) );
-                VH( FixupShaderPointer((SShaderBlock**) &pTech->pPasses[iPass].BackingStore.pComputeShaderBlock) );
-                VH( FixupDepthStencilViewPointer( &pTech->pPasses[iPass].BackingStore.pDepthStencilView) );
-                for (size_t iRT = 0; iRT < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; iRT++)
-                {
-                    VH( FixupRenderTargetViewPointer( &pTech->pPasses[iPass].BackingStore.pRenderTargetViews[iRT] ) );
-                }
-            }        
-
-            VH( ReallocateBlockAssignments( pTech->pPasses, pTech->PassCount, pOldPasses ) );
-        }
-    }
-    VH( FixupGroupPointer( &m_pEffect->m_pNullGroup ) );
-
-    // Move anonymous shader variables
-    VHD( pHeap->MoveData((void **) &m_pEffect->m_pAnonymousShaders, cbAnonymousShaders), "Internal loading error: cannot move anonymous shaders." );
-    for (size_t i=0; i<m_pEffect->m_AnonymousShaderCount; ++i)
-    {
-        SAnonymousShader *pAnonymousShader = m_pEffect->m_pAnonymousShaders + i;
-        VH( FixupShaderPointer((SShaderBlock**) &pAnonymousShader->pShaderBlock) );
-    }
-
-    VBD( pHeap->GetSize() == m_EffectMemory, "Loading error: effect size mismatch." );
-
 lExit:
     return hr;
 }
-#pragma warning(pop)
 
 }
@@ -21,6 +21,12 @@ namespace D3DX11Effects
 
 // Ranges are used for dependency checking during load
 
+// SRV and sampler ranges separated by at most this many unused slots are merged into one
+// range, and the unused slots are bound to null. Define as 0 to only merge adjacent ranges.
+#ifndef D3DX11_EFFECT_MAX_RANGE_GAP
+#define D3DX11_EFFECT_MAX_RANGE_GAP 4
+#endif
+
 enum ERanges
 {
     ER_CBuffer = 0,
@@ -33,9 +39,18 @@ enum ERanges
 
 struct SRange
 {
-    uint32_t              start;
-    uint32_t              last;
-    CEffectVector<void *> vResources; // should be (last - start) in length, resource type depends on the range type
+    uint32_t                        start;
+    uint32_t                        last;
+    CEffectInlineVector<void *, 8>  vResources; // should be (last - start) in length, resource type depends on the range type
+
+    SRange()
+    {
+    }
+
+    // Ranges are moved when their vector grows
+    SRange(_Inout_ SRange &&Other) : start(Other.start), last(Other.last), vResources(std::move(Other.vResources))
+    {
+    }
 };
 
 // Used during load to validate assignments
@@ -45,12 +60,7 @@ D3D_SHADER_VARIABLE_TYPE GetSimpleParameterTypeFromObjectType(EObjectType Object
 // A class to facilitate loading an Effect.  This class is a friend of CEffect.
 class CEffectLoader
 {
-    friend HRESULT CEffect::CloneEffect(_In_ uint32_t Flags, _Outptr_ ID3DX11Effect** ppClonedEffect );
-
 protected:
-    // Load-time allocations that eventually get moved happen out of the TempHeap. This heap will grow as needed
-    CDataBlockStore             m_BulkHeap;
-
     uint8_t                     *m_pData;
     SBinaryHeader5              *m_pHeader;
     DWORD                       m_Version;
@@ -66,31 +76,6 @@ protected:
 
     uint32_t                    m_dwBufferSize;     // Size of data buffer in bytes
 
-    // List of SInterface blocks created to back class instances bound to shaders
-    CEffectVector<SInterface*>  m_BackgroundInterfaces;
-
-    // Pointers to pre-reallocation data
-    SGlobalVariable             *m_pOldVars;
-    SShaderBlock                *m_pOldShaders;
-    SDepthStencilBlock          *m_pOldDS;
-    SBlendBlock                 *m_pOldAB;
-    SRasterizerBlock            *m_pOldRS;
-    SConstantBuffer             *m_pOldCBs;
-    SSamplerBlock               *m_pOldSamplers;
-    uint32_t                        m_OldInterfaceCount;
-    SInterface                  *m_pOldInterfaces;
-    SShaderResource             *m_pOldShaderResources;
-    SUnorderedAccessView        *m_pOldUnorderedAccessViews;
-    SRenderTargetView           *m_pOldRenderTargetViews;
-    SDepthStencilView           *m_pOldDepthStencilViews;
-    SString                     *m_pOldStrings;
-    SMemberDataPointer          *m_pOldMemberDataBlocks;
-    CEffectVectorOwner<SMember> *m_pvOldMemberInterfaces;
-    SGroup                      *m_pOldGroups;
-
-    uint32_t                    m_EffectMemory;     // Effect private heap
-    uint32_t                    m_ReflectionMemory; // Reflection private heap
-
     // Loader helpers
     HRESULT LoadCBs();
     HRESULT LoadNumericVariable(_In_ SConstantBuffer *pParentCB);
@@ -113,39 +98,14 @@ protected:
     HRESULT GrabShaderData(SShaderBlock *pShaderBlock);
     HRESULT BuildShaderBlock(SShaderBlock *pShaderBlock);
 
-    // Memory compactors
-    HRESULT InitializeReflectionDataAndMoveStrings( uint32_t KnownSize = 0 );
-    HRESULT ReallocateReflectionData( bool Cloning = false );
-    HRESULT ReallocateEffectData( bool Cloning = false );
-    HRESULT ReallocateShaderBlocks();
-    template<class T> HRESULT ReallocateBlockAssignments(T* &pBlocks, uint32_t  cBlocks, T* pOldBlocks = nullptr);
-    HRESULT ReallocateAnnotationData(uint32_t  cAnnotations, SAnnotation **ppAnnotations);
-
-    HRESULT CalculateAnnotationSize(uint32_t  cAnnotations, SAnnotation *pAnnotations);
-    uint32_t  CalculateShaderBlockSize();
-    template<class T> uint32_t  CalculateBlockAssignmentSize(T* &pBlocks, uint32_t  cBlocks);
-
-    HRESULT FixupCBPointer(_Inout_ SConstantBuffer **ppCB);
-    HRESULT FixupShaderPointer(_Inout_ SShaderBlock **ppShaderBlock);
-    HRESULT FixupDSPointer(_Inout_ SDepthStencilBlock **ppDSBlock);
-    HRESULT FixupABPointer(_Inout_ SBlendBlock **ppABBlock);
-    HRESULT FixupRSPointer(_Inout_ SRasterizerBlock **ppRSBlock);
-    HRESULT FixupInterfacePointer(_Inout_ SInterface **ppInterface, _In_ bool CheckBackgroundInterfaces);
-    HRESULT FixupShaderResourcePointer(_Inout_ SShaderResource **ppResource);
-    HRESULT FixupUnorderedAccessViewPointer(_Inout_ SUnorderedAccessView **ppResource);
-    HRESULT FixupRenderTargetViewPointer(_Inout_ SRenderTargetView **ppRenderTargetView);
-    HRESULT FixupDepthStencilViewPointer(_Inout_ SDepthStencilView **ppDepthStencilView);
-    HRESULT FixupSamplerPointer(_Inout_ SSamplerBlock **ppSampler);
-    HRESULT FixupVariablePointer(_Inout_ SGlobalVariable **ppVar);
-    HRESULT FixupStringPointer(_Inout_ SString **ppString);
-    HRESULT FixupMemberDataPointer(_Inout_ SMemberDataPointer **ppMemberData);
-    HRESULT FixupGroupPointer(_Inout_ SGroup **ppGroup);
+    // Evaluates the assignments of blocks that have been loaded
+    template<class T> HRESULT InitializeBlockAssignments(_In_reads_(cBlocks) T *pBlocks, _In_ uint32_t cBlocks);
 
     // Methods to retrieve data from the unstructured block
-    // (these do not make copies; they simply return pointers into the block)
-    HRESULT GetStringAndAddToReflection(_In_ uint32_t offset, _Outptr_result_maybenull_z_ char **ppPointer);  // Returns a string from the file string block, updates m_EffectMemory
+    // (GetUnstructuredDataBlock simply returns a pointer into the block; the others copy into the reflection heap)
+    HRESULT GetStringAndAddToReflection(_In_ uint32_t offset, _Outptr_result_maybenull_z_ char **ppPointer);
     HRESULT GetUnstructuredDataBlock(_In_ uint32_t offset, _Out_ uint32_t *pdwSize, _Outptr_result_buffer_(*pdwSize) void **ppData);
-    // This function makes a copy of the array of SInterfaceParameters, but not a copy of the strings
+    // This function copies the array of SInterfaceParameters and their names
     HRESULT GetInterfaceParametersAndAddToReflection( _In_ uint32_t InterfaceCount, _In_ uint32_t offset, _Outptr_result_buffer_all_maybenull_(InterfaceCount) SShaderBlock::SInterfaceParameter **ppInterfaces );
 public:
 
@@ -18,29 +18,65 @@
 
 #include "pchfx.h"
 #include "SOParser.h"
+#include "EffectConstantBufferRing.h"
 
 namespace D3DX11Effects
 {
 
 extern SUnorderedAccessView g_NullUnorderedAccessView;
+extern SSamplerBlock g_NullSampler;
 
 SBaseBlock::SBaseBlock()
 : BlockType(EBT_Invalid)
 , IsUserManaged(false)
 , AssignmentCount(0)
 , pAssignments(nullptr)
+, IdentityHash(0)
 {
 
 }
 
+void SBaseBlock::UpdateIdentityHash()
+{
+    uint64_t hash = ComputeHash64((const uint8_t*) &BlockType, sizeof(BlockType));
+
+    // The descs are zeroed in the constructors, so their padding hashes consistently
+    switch (BlockType)
+    {
+    case EBT_Sampler:
+        hash = ComputeHash64((const uint8_t*) &AsSampler()->BackingStore.SamplerDesc, sizeof(D3D11_SAMPLER_DESC), hash);
+        break;
+    case EBT_DepthStencil:
+        hash = ComputeHash64((const uint8_t*) &AsDepthStencil()->BackingStore, sizeof(D3D11_DEPTH_STENCIL_DESC), hash);
+        break;
+    case EBT_Blend:
+        hash = ComputeHash64((const uint8_t*) &AsBlend()->BackingStore, sizeof(D3D11_BLEND_DESC), hash);
+        break;
+    case EBT_Rasterizer:
+        hash = ComputeHash64((const uint8_t*) &AsRasterizer()->BackingStore, sizeof(D3D11_RASTERIZER_DESC), hash);
+        break;
+    default:
+        // Passes are hashed from their shaders and states on demand (see SPassBlock::GetIdentity)
+        return;
+    }
+
+    IdentityHash = hash;
+}
+
+SPassRuntime::SPassRuntime()
+{
+    pEffect = nullptr;
+    InitiallyValid = true;
+    HasDependencies = false;
+    ZeroMemory(&BackingStore, sizeof(BackingStore));
+}
+
 SPassBlock::SPassBlock()
 {
+    pRuntime = nullptr;
     pName = nullptr;
     AnnotationCount = 0;
     pAnnotations = nullptr;
-    InitiallyValid = true;
-    HasDependencies = false;
-    ZeroMemory(&BackingStore, sizeof(BackingStore));
 }
 
 STechnique::STechnique()
@@ -173,7 +209,54 @@ SShaderBlock::SShaderBlock(SD3DShaderVTable *pVirtualTable)
     TBufferDepCount = 0;
     ppTbufDeps = nullptr;
 
-    pInputSignatureBlob = nullptr;
+    pDescData = nullptr;
+}
+
+void SShaderBlock::UpdateIdentityHash()
+{
+    static const uint32_t c_DXBCChecksumOffset = 4;
+    static const uint32_t c_DXBCChecksumSize = 16;
+
+    if (nullptr == pDescData)
+        return;
+
+    pDescData->IdentityHash = 0;
+
+    if (nullptr == pReflectionData)
+        return;
+
+    const uint8_t *pBytecode = pReflectionData->pBytecode;
+    uint32_t bytecodeLength = pReflectionData->BytecodeLength;
+    uint64_t hash = ComputeHash64((const uint8_t*) &pVT->Stage, sizeof(pVT->Stage));
+
+    // Compiled shaders start with "DXBC" and a checksum of the rest of the container,
+    // which identifies the bytecode as well as hashing all of it would
+    if (bytecodeLength >= c_DXBCChecksumOffset + c_DXBCChecksumSize && 0 == memcmp(pBytecode, "DXBC", c_DXBCChecksumOffset))
+    {
+        hash = ComputeHash64(pBytecode + c_DXBCChecksumOffset, c_DXBCChecksumSize, hash);
+        hash = ComputeHash64((const uint8_t*) &bytecodeLength, sizeof(bytecodeLength), hash);
+    }
+    else
+    {
+        hash = ComputeHash64(pBytecode, bytecodeLength, hash);
+    }
+
+    // The same geometry shader with different stream out declarations creates different objects
+    for (size_t i = 0; i < _countof(pReflectionData->pStreamOutDecls); ++ i)
+    {
+        if (nullptr != pReflectionData->pStreamOutDecls[i])
+        {
+            hash = ComputeHash64((const uint8_t*) pReflectionData->pStreamOutDecls[i], (uint32_t) strlen(pReflectionData->pStreamOutDecls[i]) + 1, hash);
+        }
+        else
+        {
+            hash = ComputeHash64((const uint8_t*) "", 1, hash);
+        }
+    }
+    hash = ComputeHash64((const uint8_t*) &pReflectionData->RasterizedStream, sizeof(pReflectionData->RasterizedStream), hash);
+
+    // 0 is reserved for nullptr shaders
+    pDescData->IdentityHash = (0 == hash) ? 1 : hash;
 }
 
 HRESULT SShaderBlock::OnDeviceBind()
@@ -204,7 +287,8 @@ HRESULT SShaderBlock::OnDeviceBind()
         {
             pSampDeps[i].ppD3DObjects[j] = pSampDeps[i].ppFXPointers[j]->pD3DObject;
 
-            if ( !pSampDeps[i].ppD3DObjects[j] )
+            // Slots padded at load time are intentionally unbound
+            if ( !pSampDeps[i].ppD3DObjects[j] && pSampDeps[i].ppFXPointers[j] != &g_NullSampler )
                 VH( E_FAIL );
         }
     }
@@ -367,7 +451,7 @@ HRESULT SShaderBlock::GetShaderDesc(_Out_ D3DX11_EFFECT_SHADER_DESC *pDesc, _In_
     
     ZeroMemory(pDesc, sizeof(*pDesc));
 
-    pDesc->pInputSignature = pInputSignatureBlob ? (const uint8_t*)pInputSignatureBlob->GetBufferPointer() : nullptr;
+    pDesc->pInputSignature = (pDescData && pDescData->pInputSignatureBlob) ? (const uint8_t*)pDescData->pInputSignatureBlob->GetBufferPointer() : nullptr;
     pDesc->IsInline = IsInline;
 
     if (nullptr != pReflectionData)
@@ -381,17 +465,17 @@ HRESULT SShaderBlock::GetShaderDesc(_Out_ D3DX11_EFFECT_SHADER_DESC *pDesc, _In_
         }
         pDesc->RasterizedStream = pReflectionData->RasterizedStream;
 
-        // get # of input & output signature entries
-        assert( pReflectionData->pReflection != 0 );
-        _Analysis_assume_( pReflectionData->pReflection != 0 );
-
-        D3D11_SHADER_DESC ShaderDesc;
-        hr = pReflectionData->pReflection->GetDesc( &ShaderDesc );
-        if ( SUCCEEDED(hr) )
+        // get # of input & output signature entries, unless the reflection was discarded with the bytecode
+        if (nullptr != pReflectionData->pReflection)
         {
-            pDesc->NumInputSignatureEntries = ShaderDesc.InputParameters;
-            pDesc->NumOutputSignatureEntries = ShaderDesc.OutputParameters;
-            pDesc->NumPatchConstantSignatureEntries = ShaderDesc.PatchConstantParameters;
+            D3D11_SHADER_DESC ShaderDesc;
+            hr = pReflectionData->pReflection->GetDesc( &ShaderDesc );
+            if ( SUCCEEDED(hr) )
+            {
+                pDesc->NumInputSignatureEntries = ShaderDesc.InputParameters;
+                pDesc->NumOutputSignatureEntries = ShaderDesc.OutputParameters;
+                pDesc->NumPatchConstantSignatureEntries = ShaderDesc.PatchConstantParameters;
+            }
         }
     }
 lExit:
@@ -531,12 +615,9 @@ HRESULT SShaderBlock::GetSignatureElementDesc(ESigType SigType, uint32_t Element
         return E_FAIL;
     };
 
-    if (nullptr != pReflectionData)
+    if (nullptr != pReflectionData && nullptr != pReflectionData->pReflection)
     {
         // get # of signature entries
-        assert( pReflectionData->pReflection != 0 );
-        _Analysis_assume_( pReflectionData->pReflection != 0 );
-
         D3D11_SHADER_DESC ShaderDesc;
         VH( pReflectionData->pReflection->GetDesc( &ShaderDesc ) );
 
@@ -611,7 +692,7 @@ HRESULT SShaderBlock::GetSignatureElementDesc(ESigType SigType, uint32_t Element
     }
     else
     {
-        DPF(0, "%s: Cannot get signatures; shader bytecode is not present", pFuncName);
+        DPF(0, "%s: Cannot get signatures; shader bytecode is not present (the effect was optimized or its shader data was discarded)", pFuncName);
         VH( D3DERR_INVALIDCALL );
     }
     
@@ -709,20 +790,24 @@ void * GetBlockByIndex(EVarType VarType, EObjectType ObjectType, void *pBaseBloc
 // CEffect
 //--------------------------------------------------------------------------------------
 
-CEffect::CEffect( uint32_t Flags )
+CEffect::CEffect( uint32_t Flags, ID3DX11EffectAllocator *pAllocator )
 {
     m_RefCount = 1;
+    m_pAllocator = pAllocator;
 
     m_pVariables = nullptr;
+    m_pVariableTimes = nullptr;
     m_pAnonymousShaders = nullptr;
     m_pGroups = nullptr;
     m_pNullGroup = nullptr;
     m_pShaderBlocks = nullptr;
+    m_pShaderDescs = nullptr;
     m_pDepthStencilBlocks = nullptr;
     m_pBlendBlocks = nullptr;
     m_pRasterizerBlocks = nullptr;
     m_pSamplerBlocks = nullptr;
     m_pCBs = nullptr;
+    m_pCBRuntimes = nullptr;
     m_pStrings = nullptr;
     m_pMemberDataBlocks = nullptr;
     m_pInterfaces = nullptr;
@@ -734,6 +819,17 @@ CEffect::CEffect( uint32_t Flags )
     m_pClassLinkage = nullptr;
     m_pContext = nullptr;
 
+    m_pCBRing = nullptr;
+    m_CBRingActive = false;
+
+    m_BindingFlags = 0;
+    m_pBindingContext = nullptr;
+    ZeroMemory(m_pLastAppliedShaderBlocks, sizeof(m_pLastAppliedShaderBlocks));
+
+    m_IndexedTypeInterfaces = 0;
+    m_IndexedMemberInterfaces = 0;
+    InitializeSRWLock(&m_InterfacePoolLock);
+
     m_VariableCount = 0;
     m_AnonymousShaderCount = 0;
     m_ShaderBlockCount = 0;
@@ -744,6 +840,7 @@ CEffect::CEffect( uint32_t Flags )
     m_StringCount = 0;
     m_MemberDataCount = 0;
     m_InterfaceCount = 0;
+    m_BackgroundInterfaceCount = 0;
     m_ShaderResourceCount = 0;
     m_UnorderedAccessViewCount = 0;
     m_RenderTargetViewCount = 0;
@@ -761,13 +858,15 @@ CEffect::CEffect( uint32_t Flags )
     m_pStringPool = nullptr;
     m_pPooledHeap = nullptr;
     m_pOptimizedTypeHeap = nullptr;
+    m_pCloneHeap = nullptr;
+    m_RelocationsRecorded = false;
 }
 
 void CEffect::ReleaseShaderRefection()
 {
     for( size_t i = 0; i < m_ShaderBlockCount; ++ i )
     {
-        SAFE_RELEASE( m_pShaderBlocks[i].pInputSignatureBlob );
+        SAFE_RELEASE( m_pShaderDescs[i].pInputSignatureBlob );
         if( m_pShaderBlocks[i].pReflectionData )
         {
             SAFE_RELEASE( m_pShaderBlocks[i].pReflectionData->pReflection );
@@ -808,6 +907,7 @@ CEffect::~CEffect()
     SAFE_DELETE( m_pStringPool );
     SAFE_DELETE( m_pPooledHeap );
     SAFE_DELETE( m_pOptimizedTypeHeap );
+    SAFE_DELETE( m_pCloneHeap );
 
     // this code assumes the effect has been loaded & relocated,
     // so check for that before freeing the resources
@@ -843,13 +943,19 @@ CEffect::~CEffect()
         assert(nullptr == m_pShaderResources || m_Heap.IsInHeap(m_pShaderResources));
         for (size_t i = 0; i < m_ShaderResourceCount; ++ i)
         {
-            SAFE_RELEASE(m_pShaderResources[i].pShaderResource);
+            if (!m_pShaderResources[i].IsWeakReference)
+            {
+                SAFE_RELEASE(m_pShaderResources[i].pShaderResource);
+            }
         }
 
         assert(nullptr == m_pUnorderedAccessViews || m_Heap.IsInHeap(m_pUnorderedAccessViews));
         for (size_t i = 0; i < m_UnorderedAccessViewCount; ++ i)
         {
-            SAFE_RELEASE(m_pUnorderedAccessViews[i].pUnorderedAccessView);
+            if (!m_pUnorderedAccessViews[i].IsWeakReference)
+            {
+                SAFE_RELEASE(m_pUnorderedAccessViews[i].pUnorderedAccessView);
+            }
         }
 
         assert(nullptr == m_pRenderTargetViews || m_Heap.IsInHeap(m_pRenderTargetViews));
@@ -898,8 +1004,18 @@ CEffect::~CEffect()
         assert(nullptr == m_pCBs || m_Heap.IsInHeap(m_pCBs));
         for (size_t i = 0; i < m_CBCount; ++ i)
         {
-            SAFE_RELEASE(m_pCBs[i].TBuffer.pShaderResource);
-            SAFE_RELEASE(m_pCBs[i].pD3DObject);
+            if (!m_pCBs[i].TBuffer.IsWeakReference)
+            {
+                SAFE_RELEASE(m_pCBs[i].TBuffer.pShaderResource);
+            }
+            if (!m_pCBs[i].IsWeakReference)
+            {
+                SAFE_RELEASE(m_pCBRuntimes[i].pD3DObject);
+            }
+            if (nullptr != m_pCBRuntimes[i].pSharedCB)
+            {
+                m_pCBRuntimes[i].pSharedCB->pRegistry->Release();
+            }
         }
 
         assert(nullptr == m_pShaderBlocks || m_Heap.IsInHeap(m_pShaderBlocks));
@@ -909,6 +1025,13 @@ CEffect::~CEffect()
             SAFE_RELEASE(m_pShaderBlocks[i].pD3DObject);
         }
 
+        m_SamplerStateCache.Clear();
+        m_BlendStateCache.Clear();
+        m_DepthStencilStateCache.Clear();
+        m_RasterizerStateCache.Clear();
+
+        ReleaseCBRing();
+
         SAFE_RELEASE( m_pDevice );
     }
     SAFE_RELEASE( m_pClassLinkage );
@@ -934,7 +1057,7 @@ void CEffect::AddRefAllForCloning( _In_ CEffect* pEffectSource )
 
     for( size_t i = 0; i < m_ShaderBlockCount; ++ i )
     {
-        SAFE_ADDREF( m_pShaderBlocks[i].pInputSignatureBlob );
+        SAFE_ADDREF( m_pShaderDescs[i].pInputSignatureBlob );
         if( m_pShaderBlocks[i].pReflectionData )
         {
             SAFE_ADDREF( m_pShaderBlocks[i].pReflectionData->pReflection );
@@ -966,15 +1089,22 @@ void CEffect::AddRefAllForCloning( _In_ CEffect* pEffectSource )
     }
 
     assert(nullptr == m_pShaderResources || pEffectSource->m_Heap.IsInHeap(m_pShaderResources));
+    // Weak references stay weak in the clone
     for ( size_t i = 0; i < m_ShaderResourceCount; ++ i)
     {
-        SAFE_ADDREF(m_pShaderResources[i].pShaderResource);
+        if (!m_pShaderResources[i].IsWeakReference)
+        {
+            SAFE_ADDREF(m_pShaderResources[i].pShaderResource);
+        }
     }
 
     assert(nullptr == m_pUnorderedAccessViews || pEffectSource->m_Heap.IsInHeap(m_pUnorderedAccessViews));
     for ( size_t i = 0; i < m_UnorderedAccessViewCount; ++ i)
     {
-        SAFE_ADDREF(m_pUnorderedAccessViews[i].pUnorderedAccessView);
+        if (!m_pUnorderedAccessViews[i].IsWeakReference)
+        {
+            SAFE_ADDREF(m_pUnorderedAccessViews[i].pUnorderedAccessView);
+        }
     }
 
     assert(nullptr == m_pRenderTargetViews || pEffectSource->m_Heap.IsInHeap(m_pRenderTargetViews));
@@ -1024,8 +1154,20 @@ void CEffect::AddRefAllForCloning( _In_ CEffect* pEffectSource )
     assert(nullptr == m_pCBs || pEffectSource->m_Heap.IsInHeap(m_pCBs));
     for ( size_t i = 0; i < m_CBCount; ++ i)
     {
-        SAFE_ADDREF(m_pCBs[i].TBuffer.pShaderResource);
-        SAFE_ADDREF(m_pCBs[i].pD3DObject);
+        if (!m_pCBs[i].TBuffer.IsWeakReference)
+        {
+            SAFE_ADDREF(m_pCBs[i].TBuffer.pShaderResource);
+        }
+        if (!m_pCBs[i].IsWeakReference)
+        {
+            SAFE_ADDREF(m_pCBRuntimes[i].pD3DObject);
+        }
+
+        // Clones keep sharing the CBs that the source effect shares
+        if (nullptr != m_pCBRuntimes[i].pSharedCB)
+        {
+            m_pCBRuntimes[i].pSharedCB->pRegistry->AddRef();
+        }
     }
 
     assert(nullptr == m_pShaderBlocks || pEffectSource->m_Heap.IsInHeap(m_pShaderBlocks));
@@ -1074,14 +1216,16 @@ EXIT:
 
 ULONG CEffect::AddRef()
 {
-    return ++ m_RefCount;
+    return (ULONG) InterlockedIncrement(&m_RefCount);
 }
 
 ULONG CEffect::Release()
 {
-    if (-- m_RefCount > 0)
+    LONG refCount = InterlockedDecrement(&m_RefCount);
+
+    if (refCount > 0)
     {
-        return m_RefCount;
+        return (ULONG) refCount;
     }
     else
     {
@@ -1101,7 +1245,7 @@ void CEffect::ReplaceCBReference(SConstantBuffer *pOldBufferBlock, ID3D11Buffer
         {
             for (size_t iCB = 0; iCB < m_pShaderBlocks[iShaderBlock].pCBDeps[iCBDep].Count; iCB++)
             {
-                if (m_pShaderBlocks[iShaderBlock].pCBDeps[iCBDep].ppFXPointers[iCB] == pOldBufferBlock)
+                if (m_pShaderBlocks[iShaderBlock].pCBDeps[iCBDep].ppFXPointers[iCB] == pOldBufferBlock->pRuntime)
                     m_pShaderBlocks[iShaderBlock].pCBDeps[iCBDep].ppD3DObjects[iCB] = pNewBuffer;
             }
         }
@@ -1119,7 +1263,10 @@ void CEffect::ReplaceSamplerReference(SSamplerBlock *pOldSamplerBlock, ID3D11Sam
             for (size_t  iSampler = 0; iSampler < m_pShaderBlocks[iShaderBlock].pSampDeps[iSamplerDep].Count; iSampler++)
             {
                 if (m_pShaderBlocks[iShaderBlock].pSampDeps[iSamplerDep].ppFXPointers[iSampler] == pOldSamplerBlock)
+                {
                     m_pShaderBlocks[iShaderBlock].pSampDeps[iSamplerDep].ppD3DObjects[iSampler] = pNewSampler;
+                    m_pShaderBlocks[iShaderBlock].pSampDeps[iSamplerDep].LastAppliedTime = 0;
+                }
             }
         }
     }
@@ -1158,54 +1305,54 @@ HRESULT CEffect::BindToDevice(ID3D11Device *pDevice, LPCSTR srcName)
     SConstantBuffer *pCBLast = m_pCBs + m_CBCount;
     for(; pCB != pCBLast; pCB++)
     {
-        SAFE_RELEASE(pCB->pD3DObject);
+        SAFE_RELEASE(pCB->pRuntime->pD3DObject);
         SAFE_RELEASE(pCB->TBuffer.pShaderResource);
 
         // This is a CBuffer
-        if (pCB->Size > 0)
+        if (pCB->pRuntime->Size > 0)
         {
-            if (pCB->IsTBuffer)
+            if (pCB->pRuntime->IsTBuffer)
             {
                 D3D11_BUFFER_DESC bufDesc;
                 // size is always register aligned
-                bufDesc.ByteWidth = pCB->Size;
+                bufDesc.ByteWidth = pCB->pRuntime->Size;
                 bufDesc.Usage = D3D11_USAGE_DEFAULT;
                 bufDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
                 bufDesc.CPUAccessFlags = 0;
                 bufDesc.MiscFlags = 0;
 
-                VH( pDevice->CreateBuffer( &bufDesc, nullptr, &pCB->pD3DObject) );
-                SetDebugObjectName(pCB->pD3DObject, srcName );
+                VH( pDevice->CreateBuffer( &bufDesc, nullptr, &pCB->pRuntime->pD3DObject) );
+                SetDebugObjectName(pCB->pRuntime->pD3DObject, srcName );
                 
                 D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
                 viewDesc.Format = DXGI_FORMAT_R32G32B32A32_UINT;
                 viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
                 viewDesc.Buffer.ElementOffset = 0;
-                viewDesc.Buffer.ElementWidth = pCB->Size / SType::c_RegisterSize;
+                viewDesc.Buffer.ElementWidth = pCB->pRuntime->Size / SType::c_RegisterSize;
 
-                VH( pDevice->CreateShaderResourceView( pCB->pD3DObject, &viewDesc, &pCB->TBuffer.pShaderResource) );
+                VH( pDevice->CreateShaderResourceView( pCB->pRuntime->pD3DObject, &viewDesc, &pCB->TBuffer.pShaderResource) );
                 SetDebugObjectName(pCB->TBuffer.pShaderResource, srcName );
             }
             else
             {
                 D3D11_BUFFER_DESC bufDesc;
                 // size is always register aligned
-                bufDesc.ByteWidth = pCB->Size;
+                bufDesc.ByteWidth = pCB->pRuntime->Size;
                 bufDesc.Usage = D3D11_USAGE_DEFAULT;
                 bufDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
                 bufDesc.CPUAccessFlags = 0;
                 bufDesc.MiscFlags = 0;
 
-                VH( pDevice->CreateBuffer( &bufDesc, nullptr, &pCB->pD3DObject) );
-                SetDebugObjectName( pCB->pD3DObject, srcName );
+                VH( pDevice->CreateBuffer( &bufDesc, nullptr, &pCB->pRuntime->pD3DObject) );
+                SetDebugObjectName( pCB->pRuntime->pD3DObject, srcName );
                 pCB->TBuffer.pShaderResource = nullptr;
             }
 
-            pCB->IsDirty = true;
+            pCB->pRuntime->IsDirty = true;
         }
         else
         {
-            pCB->IsDirty = false;
+            pCB->pRuntime->IsDirty = false;
         }
     }
 
@@ -1215,10 +1362,16 @@ HRESULT CEffect::BindToDevice(ID3D11Device *pDevice, LPCSTR srcName)
     for(; pRB != pRBLast; pRB++)
     {
         SAFE_RELEASE(pRB->pRasterizerObject);
+        pRB->UpdateIdentityHash();
         if( SUCCEEDED( m_pDevice->CreateRasterizerState( &pRB->BackingStore, &pRB->pRasterizerObject) ) )
         {
             pRB->IsValid = true;
             SetDebugObjectName( pRB->pRasterizerObject, srcName );
+            if( pRB->AssignmentCount > 0 )
+            {
+                // This block can be recreated at runtime, remember its initial state
+                m_RasterizerStateCache.Add( &pRB->BackingStore, pRB->pRasterizerObject );
+            }
         }
         else
             pRB->IsValid = false;
@@ -1230,10 +1383,16 @@ HRESULT CEffect::BindToDevice(ID3D11Device *pDevice, LPCSTR srcName)
     for(; pDS != pDSLast; pDS++)
     {
         SAFE_RELEASE(pDS->pDSObject);
+        pDS->UpdateIdentityHash();
         if( SUCCEEDED( m_pDevice->CreateDepthStencilState( &pDS->BackingStore, &pDS->pDSObject) ) )
         {
             pDS->IsValid = true;
             SetDebugObjectName( pDS->pDSObject, srcName );
+            if( pDS->AssignmentCount > 0 )
+            {
+                // This block can be recreated at runtime, remember its initial state
+                m_DepthStencilStateCache.Add( &pDS->BackingStore, pDS->pDSObject );
+            }
         }
         else
             pDS->IsValid = false;
@@ -1245,10 +1404,16 @@ HRESULT CEffect::BindToDevice(ID3D11Device *pDevice, LPCSTR srcName)
     for(; pBlend != pBlendLast; pBlend++)
     {
         SAFE_RELEASE(pBlend->pBlendObject);
+        pBlend->UpdateIdentityHash();
         if( SUCCEEDED( m_pDevice->CreateBlendState( &pBlend->BackingStore, &pBlend->pBlendObject ) ) )
         {
             pBlend->IsValid = true;
             SetDebugObjectName( pBlend->pBlendObject, srcName );
+            if( pBlend->AssignmentCount > 0 )
+            {
+                // This block can be recreated at runtime, remember its initial state
+                m_BlendStateCache.Add( &pBlend->BackingStore, pBlend->pBlendObject );
+            }
         }
         else
             pBlend->IsValid = false;
@@ -1260,9 +1425,14 @@ HRESULT CEffect::BindToDevice(ID3D11Device *pDevice, LPCSTR srcName)
     for(; pSampler != pSamplerLast; pSampler++)
     {
         SAFE_RELEASE(pSampler->pD3DObject);
+        pSampler->UpdateIdentityHash();
 
         VH( m_pDevice->CreateSamplerState( &pSampler->BackingStore.SamplerDesc, &pSampler->pD3DObject) );
         SetDebugObjectName( pSampler->pD3DObject, srcName );
+        if( pSampler->AssignmentCount > 0 )
+        {
+            m_SamplerStateCache.Add( &pSampler->BackingStore.SamplerDesc, pSampler->pD3DObject );
+        }
     }
 
     // Create all shaders
@@ -1272,6 +1442,7 @@ HRESULT CEffect::BindToDevice(ID3D11Device *pDevice, LPCSTR srcName)
     for(; pShader != pShaderLast; pShader++)
     {
         SAFE_RELEASE(pShader->pD3DObject);
+        pShader->UpdateIdentityHash();
 
         if (nullptr == pShader->pReflectionData)
         {
@@ -1425,7 +1596,7 @@ HRESULT CEffect::BindToDevice(ID3D11Device *pDevice, LPCSTR srcName)
            
             for( size_t iPass = 0; iPass < pTechnique->PassCount; iPass++ )
             {
-                SPassBlock* pPass = &pTechnique->pPasses[iPass];
+                SPassRuntime* pPass = pTechnique->pPasses[iPass].pRuntime;
                 pPass->InitiallyValid = true;
 
                 if( pPass->BackingStore.pBlendBlock != nullptr && !pPass->BackingStore.pBlendBlock->IsValid )
@@ -1457,6 +1628,181 @@ lExit:
     return hr;
 }
 
+// With D3DX11_EFFECT_BINDING_SKIP_CLEAN_RANGES, ApplyShaderBlock does not set the sampler, SRV and CS UAV
+// ranges of a shader block that was the last one applied to its stage of the same context, as long as
+// none of the objects in the range changed since. Setting the flags also forgets what was last applied,
+// which the application must do whenever it changes those bindings itself.
+// With D3DX11_EFFECT_BINDING_WEAK_REFERENCES, variable setters store objects through BindObject without
+// taking references; each slot remembers whether it holds one, so the flag can be toggled at any time.
+HRESULT CEffect::SetBindingFlags(_In_ uint32_t Flags)
+{
+    if (Flags & ~D3DX11_EFFECT_BINDING_VALID_FLAGS)
+    {
+        DPF(0, "D3DX11EffectSetBindingFlags: Invalid flags");
+        return E_INVALIDARG;
+    }
+
+    m_BindingFlags = Flags;
+    InvalidateAppliedBindings();
+    return S_OK;
+}
+
+void CEffect::InvalidateAppliedBindings()
+{
+    m_pBindingContext = nullptr;
+    ZeroMemory(m_pLastAppliedShaderBlocks, sizeof(m_pLastAppliedShaderBlocks));
+}
+
+// Heap sizes are the reserved sizes, which is what the allocator handed out. Device objects shared
+// with clones or the source effect are counted by every effect that holds them, except cbuffers
+// shared through a registry or with the source effect (see ClonedSingle), which this effect does not own.
+_Use_decl_annotations_
+void CEffect::GetMemoryUsage(D3DX11_EFFECT_MEMORY_USAGE *pUsage)
+{
+    ZeroMemory(pUsage, sizeof(*pUsage));
+
+    pUsage->RuntimeHeapSize = m_Heap.GetBufferSize() + m_RuntimeHeap.GetBufferSize();
+
+    if (nullptr != m_pReflection)
+    {
+        pUsage->ReflectionHeapSize = m_pReflection->m_Heap.GetBufferSize();
+        pUsage->ShaderBytecodeSize = m_pReflection->m_BytecodeHeap.GetBufferSize();
+    }
+
+    if (nullptr != m_pPooledHeap)
+    {
+        SDataBlockStoreStats stats;
+
+        m_pPooledHeap->GetStats(&stats);
+        pUsage->TypePoolSize = stats.ReservedSize;
+    }
+
+    if (nullptr != m_pOptimizedTypeHeap)
+    {
+        pUsage->OptimizedTypeHeapSize = m_pOptimizedTypeHeap->GetBufferSize();
+    }
+
+    for (uint32_t i = 0; i < m_pTypeInterfaces.GetSize(); ++ i)
+    {
+        if (nullptr != m_pTypeInterfaces[i])
+            pUsage->InterfacePoolSize += sizeof(SSingleElementType);
+    }
+    for (uint32_t i = 0; i < m_pMemberInterfaces.GetSize(); ++ i)
+    {
+        // Optimize drops the members of reflection-only variables
+        if (nullptr != m_pMemberInterfaces[i])
+            pUsage->InterfacePoolSize += sizeof(SMember);
+    }
+
+    pUsage->TableSize = (m_HeapRelocations.GetSize() + m_ReflectionRelocations.GetSize() + m_VariableRelocations.GetSize()) * sizeof(uint32_t);
+    if (nullptr != m_pCloneHeap)
+    {
+        SDataBlockStoreStats stats;
+
+        m_pCloneHeap->GetStats(&stats);
+        pUsage->TableSize += stats.ReservedSize;
+    }
+    for (uint32_t i = 0; i < m_SemanticBindings.GetSize(); ++ i)
+    {
+        SSemanticBinding *pBinding = m_SemanticBindings[i];
+
+        pUsage->TableSize += sizeof(SSemanticBinding) + (uint32_t) strlen(pBinding->pSemantic) + 1;
+        pUsage->TableSize += pBinding->Variables.GetSize() * sizeof(SGlobalVariable*);
+    }
+
+    for (uint32_t i = 0; i < m_ShaderBlockCount; ++ i)
+    {
+        SShaderBlock *pShader = &m_pShaderBlocks[i];
+
+        if (nullptr != pShader->pReflectionData && nullptr != pShader->pReflectionData->pReflection)
+        {
+            ++ pUsage->ShaderReflectionCount;
+        }
+        if (nullptr != pShader->pDescData->pInputSignatureBlob)
+        {
+            pUsage->ShaderSignatureSize += (uint32_t) pShader->pDescData->pInputSignatureBlob->GetBufferSize();
+        }
+        if (nullptr != pShader->pD3DObject)
+        {
+            ++ pUsage->ShaderCount;
+        }
+    }
+
+    for (uint32_t i = 0; i < m_DepthStencilBlockCount; ++ i)
+    {
+        if (nullptr != m_pDepthStencilBlocks[i].pDSObject)
+            ++ pUsage->StateObjectCount;
+    }
+    for (uint32_t i = 0; i < m_BlendBlockCount; ++ i)
+    {
+        if (nullptr != m_pBlendBlocks[i].pBlendObject)
+            ++ pUsage->StateObjectCount;
+    }
+    for (uint32_t i = 0; i < m_RasterizerBlockCount; ++ i)
+    {
+        if (nullptr != m_pRasterizerBlocks[i].pRasterizerObject)
+            ++ pUsage->StateObjectCount;
+    }
+    for (uint32_t i = 0; i < m_SamplerBlockCount; ++ i)
+    {
+        if (nullptr != m_pSamplerBlocks[i].pD3DObject)
+            ++ pUsage->StateObjectCount;
+    }
+
+    for (uint32_t i = 0; i < m_CBCount; ++ i)
+    {
+        SConstantBuffer *pCB = &m_pCBs[i];
+        ID3D11Buffer *pBuffer;
+        D3D11_BUFFER_DESC bufDesc;
+
+        if (0 == pCB->pRuntime->Size || nullptr != pCB->pRuntime->pSharedCB || pCB->ClonedSingle())
+            continue;
+
+        // The effect's own buffer of a user-managed cbuffer is kept aside (see SetConstantBuffer)
+        pBuffer = pCB->IsUserManaged ? pCB->pMemberData[0].Data.pD3DEffectsManagedConstantBuffer : pCB->pRuntime->pD3DObject;
+        if (nullptr == pBuffer)
+            continue;
+
+        pBuffer->GetDesc(&bufDesc);
+        ++ pUsage->ConstantBufferCount;
+        pUsage->ConstantBufferSize += bufDesc.ByteWidth;
+    }
+
+    if (nullptr != m_pCBRing)
+    {
+        pUsage->ConstantBufferRingSize = m_pCBRing->GetSize();
+    }
+}
+
+// Shaders, identity hashes and input signature blobs are all made from the bytecode in BindToDevice,
+// which creation calls, so afterwards only reflection queries read it. The rest of the reflection
+// data stays where it is, since names, annotations and stream out declarations handed out point into
+// it; the bytecode slots are only cleared, so the relocation tables stay valid.
+HRESULT CEffect::DiscardShaderData()
+{
+    if (nullptr == m_pReflection)
+    {
+        // Optimize already discarded the shader data
+        return S_OK;
+    }
+
+    for (size_t i = 0; i < m_ShaderBlockCount; ++ i)
+    {
+        SShaderBlock::SReflectionData *pReflectionData = m_pShaderBlocks[i].pReflectionData;
+
+        if (nullptr != pReflectionData)
+        {
+            // pReflection is a COM object, not part of the reflection heap
+            SAFE_RELEASE( pReflectionData->pReflection );
+            pReflectionData->pBytecode = nullptr;
+            pReflectionData->BytecodeLength = 0;
+        }
+    }
+
+    m_pReflection->m_BytecodeHeap.FreeMemory();
+    return S_OK;
+}
+
 // FindVariableByName, plus an understanding of literal indices
 // This code handles A[i].
 // It does not handle anything else, like A.B, A[B[i]], A[B]
@@ -1555,100 +1901,322 @@ SGlobalVariable * CEffect::FindLocalVariableByName(_In_z_ LPCSTR pName)
     return nullptr;
 }
 
+// True if pName is the Length characters of pToken
+static bool IsPathToken(_In_opt_z_ LPCSTR pName, _In_reads_(Length) LPCSTR pToken, _In_ size_t Length)
+{
+    return nullptr != pName && 0 == strncmp(pName, pToken, Length) && 0 == pName[Length];
+}
 
-//
-// Checks to see if two types are equivalent (either at runtime
-// or during the type-pooling load process)
-//
-// Major assumption: if both types are structures, then their
-// member types & names should already have been added to the pool,
-// in which case their member type & name pointers should be equal.
-//
-// This is true because complex data types (structures) have all
-// sub-types translated before the containing type is translated,
-// which means that simple sub-types (numeric types) have already
-// been pooled.
-//
-bool SType::IsEqual(SType *pOtherType) const
+// Finds a member of a structure, looking into its base class as GetMemberByName does, and adds its offset to *pOffset
+static SVariable *FindPathMember(_In_ SType *pType, _In_reads_(Length) LPCSTR pToken, _In_ size_t Length, _Inout_ uint32_t *pOffset)
 {
-    if (VarType != pOtherType->VarType || Elements != pOtherType->Elements
-        || strcmp(pTypeName, pOtherType->pTypeName) != 0)
+    SVariable *pMembers = pType->StructType.pMembers;
+    SVariable *pMember;
+    uint32_t offset;
+
+    for (uint32_t i = 0; i < pType->StructType.Members; ++ i)
     {
-        return false;
+        if (IsPathToken(pMembers[i].pName, pToken, Length))
+        {
+            *pOffset += (uint32_t)pMembers[i].Data.Offset;
+            return &pMembers[i];
+        }
     }
 
-    switch (VarType)
+    if (0 == pType->StructType.Members || nullptr == pMembers[0].pName || 0 != strcmp(pMembers[0].pName, "$super"))
+        return nullptr;
+
+    offset = *pOffset + (uint32_t)pMembers[0].Data.Offset;
+    pMember = FindPathMember(pMembers[0].pType, pToken, Length, &offset);
+    if (nullptr != pMember)
     {
-    case EVT_Struct:
-        {
-            if (StructType.Members != pOtherType->StructType.Members)
-            {
-                return false;
-            }
-            assert(StructType.pMembers != nullptr && pOtherType->StructType.pMembers != nullptr);
+        *pOffset = offset;
+    }
+    return pMember;
+}
 
-            uint32_t  i;
-            for (i = 0; i < StructType.Members; ++ i)
-            {
-                // names for types must exist (not true for semantics)
-                assert(StructType.pMembers[i].pName != nullptr && pOtherType->StructType.pMembers[i].pName != nullptr);
+// Parses a selection of consecutive components of a vector (x, yz, rgb...)
+static bool ParseComponentSelection(_In_reads_(Length) LPCSTR pToken, _In_ size_t Length, _In_ uint32_t Columns,
+                                    _Out_ uint32_t *pFirst, _Out_ uint32_t *pCount)
+{
+    static const char c_Positions[] = "xyzw";
+    static const char c_Colors[] = "rgba";
+    const char *pSet;
 
-                if (StructType.pMembers[i].pType != pOtherType->StructType.pMembers[i].pType ||
-                    StructType.pMembers[i].Data.Offset != pOtherType->StructType.pMembers[i].Data.Offset ||
-                    StructType.pMembers[i].pName != pOtherType->StructType.pMembers[i].pName ||
-                    StructType.pMembers[i].pSemantic != pOtherType->StructType.pMembers[i].pSemantic)
-                {
-                    return false;
-                }
-            }
-        }
-        break;
+    *pFirst = 0;
+    *pCount = 0;
 
-    case EVT_Object:
-        {
-            if (ObjectType != pOtherType->ObjectType)
-            {
-                return false;
-            }
-        }
-        break;
+    if (0 == Length || Length > 4)
+        return false;
 
-    case EVT_Numeric:
-        {
-            if (NumericType.Rows != pOtherType->NumericType.Rows ||
-                NumericType.Columns != pOtherType->NumericType.Columns ||
-                NumericType.ScalarType != pOtherType->NumericType.ScalarType ||
-                NumericType.NumericLayout != pOtherType->NumericType.NumericLayout ||
-                NumericType.IsColumnMajor != pOtherType->NumericType.IsColumnMajor ||
-                NumericType.IsPackedArray != pOtherType->NumericType.IsPackedArray)
-            {
-                return false;
-            }
-        }
-        break;
+    pSet = (nullptr != strchr(c_Colors, pToken[0])) ? c_Colors : c_Positions;
+    for (size_t i = 0; i < Length; ++ i)
+    {
+        const char *pComponent = strchr(pSet, pToken[i]);
+        uint32_t component = (uint32_t)(pComponent - pSet);
 
-    case EVT_Interface:
-        {
-            // VarType and pTypeName handled above
-        }
-        break;
+        if (nullptr == pComponent || component >= Columns || (i > 0 && component != *pFirst + i))
+            return false;
 
-    default:
+        if (0 == i)
         {
-            assert(0);
-            return false;
+            *pFirst = component;
         }
-        break;
     }
 
-    assert(TotalSize == pOtherType->TotalSize && Stride == pOtherType->Stride && PackedSize == pOtherType->PackedSize);
-
+    *pCount = (uint32_t)Length;
     return true;
 }
 
-uint32_t SType::GetTotalUnpackedSize(_In_ bool IsSingleElement) const
+// Compiles a path made of a global variable name followed by any number of "[index]" and ".member"
+// suffixes, and optionally by a component selection, against the type tree; no interface is created
+_Use_decl_annotations_
+HRESULT CEffect::GetVariableHandle(LPCSTR pPath, D3DX11_EFFECT_VARIABLE_HANDLE *pHandle)
 {
-    if (VarType == EVT_Object)
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "D3DX11EffectGetVariableHandle";
+    SGlobalVariable *pVariable = nullptr;
+    SType *pType;
+    bool isElement = false;         // pType is the type of the array that the path selected an element of
+    bool isSelection = false;       // the path ends with a component selection
+    uint32_t offset;
+    uint32_t firstComponent, componentCount = 0;
+    LPCSTR pToken;
+    size_t length;
+    SVariableHandle handle;
+
+    VERIFYPARAMETER(pPath != nullptr && pHandle != nullptr);
+
+    *pHandle = 0;
+
+    if (IsOptimized())
+    {
+        DPF(0, "%s: Cannot resolve variables; effect has been Optimize()'ed", pFuncName);
+        VH( E_FAIL );
+    }
+
+    pToken = pPath;
+    length = strcspn(pToken, ".[");
+    for (uint32_t i = 0; i < m_VariableCount; ++ i)
+    {
+        if (IsPathToken(m_pVariables[i].pName, pToken, length))
+        {
+            pVariable = &m_pVariables[i];
+            break;
+        }
+    }
+
+    if (nullptr == pVariable || !pVariable->pType->BelongsInConstantBuffer())
+    {
+        DPF(0, "%s: Variable [%s] not found in a cbuffer", pFuncName, pPath);
+        VH( E_INVALIDARG );
+    }
+
+    assert(pVariable->pCB != nullptr);
+    _Analysis_assume_(pVariable->pCB != nullptr);
+
+    pType = pVariable->pType;
+    offset = (uint32_t)(pVariable->Data.pNumeric - pVariable->pCB->pRuntime->pBackingStore);
+    pToken += length;
+
+    while (0 != *pToken)
+    {
+        if (isSelection)
+        {
+            DPF(0, "%s: [%s] continues after a component selection", pFuncName, pPath);
+            VH( E_INVALIDARG );
+        }
+
+        if ('[' == *pToken)
+        {
+            char *pEnd;
+            unsigned long index;
+
+            if (0 == pType->Elements || isElement || pToken[1] < '0' || pToken[1] > '9')
+            {
+                DPF(0, "%s: Invalid element selection in [%s]", pFuncName, pPath);
+                VH( E_INVALIDARG );
+            }
+
+            index = strtoul(pToken + 1, &pEnd, 10);
+            if (']' != *pEnd || index >= pType->Elements)
+            {
+                DPF(0, "%s: Invalid element index in [%s] (total: %u)", pFuncName, pPath, pType->Elements);
+                VH( E_INVALIDARG );
+            }
+
+            offset += pType->Stride * (uint32_t)index;
+            isElement = true;
+            pToken = pEnd + 1;
+        }
+        else
+        {
+            ++ pToken;
+            length = strcspn(pToken, ".[");
+
+            if (pType->Elements > 0 && !isElement)
+            {
+                DPF(0, "%s: An element must be selected before a member in [%s]", pFuncName, pPath);
+                VH( E_INVALIDARG );
+            }
+
+            if (EVT_Struct == pType->VarType)
+            {
+                SVariable *pMember = FindPathMember(pType, pToken, length, &offset);
+                if (nullptr == pMember)
+                {
+                    DPF(0, "%s: Member not found in [%s]", pFuncName, pPath);
+                    VH( E_INVALIDARG );
+                }
+
+                pType = pMember->pType;
+                isElement = false;
+            }
+            else if (EVT_Numeric == pType->VarType && ENL_Matrix != pType->NumericType.NumericLayout &&
+                     ParseComponentSelection(pToken, length, pType->NumericType.Columns, &firstComponent, &componentCount))
+            {
+                offset += firstComponent * SType::c_ScalarSize;
+                isSelection = true;
+            }
+            else
+            {
+                DPF(0, "%s: Invalid member or component selection in [%s]", pFuncName, pPath);
+                VH( E_INVALIDARG );
+            }
+
+            pToken += length;
+        }
+    }
+
+    if (EVT_Numeric != pType->VarType || (pType->Elements > 0 && !isElement))
+    {
+        DPF(0, "%s: [%s] is not a scalar, vector or matrix", pFuncName, pPath);
+        VH( E_INVALIDARG );
+    }
+
+    handle.Offset = offset;
+    handle.ConstantBuffer = (uint32_t)(pVariable->pCB - m_pCBs);
+    handle.Variable = (uint32_t)(pVariable - m_pVariables);
+    handle.Rows = pType->NumericType.Rows;
+    handle.Columns = isSelection ? componentCount : pType->NumericType.Columns;
+    handle.ScalarType = pType->NumericType.ScalarType;
+
+    if (ENL_Matrix != pType->NumericType.NumericLayout)
+    {
+        handle.Layout = EVHL_Vector;
+    }
+    else
+    {
+        handle.Layout = pType->NumericType.IsColumnMajor ? EVHL_ColumnMajorMatrix : EVHL_RowMajorMatrix;
+    }
+
+    if (handle.Offset > SVariableHandle::c_MaxOffset || handle.ConstantBuffer > SVariableHandle::c_MaxConstantBuffer ||
+        handle.Variable > SVariableHandle::c_MaxVariable)
+    {
+        DPF(0, "%s: [%s] cannot be encoded in a handle", pFuncName, pPath);
+        VH( E_FAIL );
+    }
+
+    *pHandle = handle.Encode();
+
+lExit:
+    return hr;
+}
+
+
+//
+// Checks to see if two types are equivalent (either at runtime
+// or during the type-pooling load process)
+//
+// Major assumption: if both types are structures, then their
+// member types & names should already have been added to the pool,
+// in which case their member type & name pointers should be equal.
+//
+// This is true because complex data types (structures) have all
+// sub-types translated before the containing type is translated,
+// which means that simple sub-types (numeric types) have already
+// been pooled.
+//
+bool SType::IsEqual(SType *pOtherType) const
+{
+    if (VarType != pOtherType->VarType || Elements != pOtherType->Elements
+        || strcmp(pTypeName, pOtherType->pTypeName) != 0)
+    {
+        return false;
+    }
+
+    switch (VarType)
+    {
+    case EVT_Struct:
+        {
+            if (StructType.Members != pOtherType->StructType.Members)
+            {
+                return false;
+            }
+            assert(StructType.pMembers != nullptr && pOtherType->StructType.pMembers != nullptr);
+
+            uint32_t  i;
+            for (i = 0; i < StructType.Members; ++ i)
+            {
+                // names for types must exist (not true for semantics)
+                assert(StructType.pMembers[i].pName != nullptr && pOtherType->StructType.pMembers[i].pName != nullptr);
+
+                if (StructType.pMembers[i].pType != pOtherType->StructType.pMembers[i].pType ||
+                    StructType.pMembers[i].Data.Offset != pOtherType->StructType.pMembers[i].Data.Offset ||
+                    StructType.pMembers[i].pName != pOtherType->StructType.pMembers[i].pName ||
+                    StructType.pMembers[i].pSemantic != pOtherType->StructType.pMembers[i].pSemantic)
+                {
+                    return false;
+                }
+            }
+        }
+        break;
+
+    case EVT_Object:
+        {
+            if (ObjectType != pOtherType->ObjectType)
+            {
+                return false;
+            }
+        }
+        break;
+
+    case EVT_Numeric:
+        {
+            if (NumericType.Rows != pOtherType->NumericType.Rows ||
+                NumericType.Columns != pOtherType->NumericType.Columns ||
+                NumericType.ScalarType != pOtherType->NumericType.ScalarType ||
+                NumericType.NumericLayout != pOtherType->NumericType.NumericLayout ||
+                NumericType.IsColumnMajor != pOtherType->NumericType.IsColumnMajor ||
+                NumericType.IsPackedArray != pOtherType->NumericType.IsPackedArray)
+            {
+                return false;
+            }
+        }
+        break;
+
+    case EVT_Interface:
+        {
+            // VarType and pTypeName handled above
+        }
+        break;
+
+    default:
+        {
+            assert(0);
+            return false;
+        }
+        break;
+    }
+
+    assert(TotalSize == pOtherType->TotalSize && Stride == pOtherType->Stride && PackedSize == pOtherType->PackedSize);
+
+    return true;
+}
+
+uint32_t SType::GetTotalUnpackedSize(_In_ bool IsSingleElement) const
+{
+    if (VarType == EVT_Object)
     {
         return 0;
     }
@@ -1989,9 +2557,9 @@ HRESULT CEffect::RecreateCBs()
     {
         SConstantBuffer* pCB = &m_pCBs[i];
 
-        pCB->IsNonUpdatable = pCB->IsUserManaged || pCB->ClonedSingle();
+        pCB->pRuntime->IsNonUpdatable = pCB->IsUserManaged || pCB->ClonedSingle();
 
-        if( pCB->Size > 0 && !pCB->ClonedSingle() )
+        if( pCB->pRuntime->Size > 0 && !pCB->ClonedSingle() && nullptr == pCB->pRuntime->pSharedCB )
         {
             ID3D11Buffer** ppOriginalBuffer;
             ID3D11ShaderResourceView** ppOriginalTBufferView;
@@ -2003,7 +2571,7 @@ HRESULT CEffect::RecreateCBs()
             }
             else
             {
-                ppOriginalBuffer = &pCB->pD3DObject;
+                ppOriginalBuffer = &pCB->pRuntime->pD3DObject;
                 ppOriginalTBufferView = &pCB->TBuffer.pShaderResource;
             }
 
@@ -2017,7 +2585,7 @@ HRESULT CEffect::RecreateCBs()
             (*ppOriginalBuffer) = pNewBuffer;
             pNewBuffer = nullptr;
 
-            if( pCB->IsTBuffer )
+            if( pCB->pRuntime->IsTBuffer )
             {
                 VN( *ppOriginalTBufferView );
                 D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
@@ -2035,7 +2603,7 @@ HRESULT CEffect::RecreateCBs()
                 ReplaceCBReference( pCB, (*ppOriginalBuffer) );
             }
 
-            pCB->IsDirty = true;
+            pCB->pRuntime->IsDirty = true;
         }
     }
 
@@ -2048,12 +2616,13 @@ _Use_decl_annotations_
 HRESULT CEffect::FixupMemberInterface( SMember* pMember, CEffect* pEffectSource, CPointerMappingTable& mappingTableStrings )
 {
     HRESULT hr = S_OK;
+    uint32_t offset;
 
     if( pMember->pName )
     {
-        if( pEffectSource->m_pReflection && pEffectSource->m_pReflection->m_Heap.IsInHeap(pMember->pName) )
+        if( pEffectSource->m_pReflection && pEffectSource->m_pReflection->m_Heap.GetOffset(pMember->pName, &offset) )
         {
-            pMember->pName = (char*)((UINT_PTR)pMember->pName - (UINT_PTR)pEffectSource->m_pReflection->m_Heap.GetDataStart() + (UINT_PTR)m_pReflection->m_Heap.GetDataStart());
+            pMember->pName = (char*) m_pReflection->m_Heap.GetPointer(offset);
         }
         else
         {
@@ -2062,9 +2631,9 @@ HRESULT CEffect::FixupMemberInterface( SMember* pMember, CEffect* pEffectSource,
     }
     if( pMember->pSemantic )
     {
-        if( pEffectSource->m_pReflection && pEffectSource->m_pReflection->m_Heap.IsInHeap(pMember->pSemantic) )
+        if( pEffectSource->m_pReflection && pEffectSource->m_pReflection->m_Heap.GetOffset(pMember->pSemantic, &offset) )
         {
-            pMember->pSemantic = (char*)((UINT_PTR)pMember->pSemantic - (UINT_PTR)pEffectSource->m_pReflection->m_Heap.GetDataStart() + (UINT_PTR)m_pReflection->m_Heap.GetDataStart());
+            pMember->pSemantic = (char*) m_pReflection->m_Heap.GetPointer(offset);
         }
         else
         {
@@ -2081,15 +2650,15 @@ lExit:
 HRESULT CEffect::CloneEffect(_In_ uint32_t Flags, _Outptr_ ID3DX11Effect** ppClonedEffect )
 {
     HRESULT hr = S_OK;
+    CEffectAllocatorScope allocatorScope(m_pAllocator);
     CPointerMappingTable mappingTableTypes;
     CPointerMappingTable mappingTableStrings;
 
-    CEffectLoader loader;
     CEffect* pNewEffect = nullptr;    
     CDataBlockStore* pTempHeap = nullptr;
 
 
-    VN( pNewEffect = new CEffect( m_Flags ) );
+    VN( pNewEffect = new CEffect( m_Flags, m_pAllocator ) );
     if( Flags & D3DX11_EFFECT_CLONE_FORCE_NONSINGLE )
     {
         // The effect is cloned as if there was no original, so don't mark it as cloned
@@ -2102,6 +2671,7 @@ HRESULT CEffect::CloneEffect(_In_ uint32_t Flags, _Outptr_ ID3DX11Effect** ppClo
 
     pNewEffect->m_VariableCount = m_VariableCount;
     pNewEffect->m_pVariables = m_pVariables;
+    pNewEffect->m_pVariableTimes = m_pVariableTimes;
     pNewEffect->m_AnonymousShaderCount = m_AnonymousShaderCount;
     pNewEffect->m_pAnonymousShaders = m_pAnonymousShaders;
     pNewEffect->m_TechniqueCount = m_TechniqueCount;
@@ -2110,6 +2680,7 @@ HRESULT CEffect::CloneEffect(_In_ uint32_t Flags, _Outptr_ ID3DX11Effect** ppClo
     pNewEffect->m_pNullGroup = m_pNullGroup;
     pNewEffect->m_ShaderBlockCount = m_ShaderBlockCount;
     pNewEffect->m_pShaderBlocks = m_pShaderBlocks;
+    pNewEffect->m_pShaderDescs = m_pShaderDescs;
     pNewEffect->m_DepthStencilBlockCount = m_DepthStencilBlockCount;
     pNewEffect->m_pDepthStencilBlocks = m_pDepthStencilBlocks;
     pNewEffect->m_BlendBlockCount = m_BlendBlockCount;
@@ -2122,8 +2693,10 @@ HRESULT CEffect::CloneEffect(_In_ uint32_t Flags, _Outptr_ ID3DX11Effect** ppClo
     pNewEffect->m_pMemberDataBlocks = m_pMemberDataBlocks;
     pNewEffect->m_InterfaceCount = m_InterfaceCount;
     pNewEffect->m_pInterfaces = m_pInterfaces;
+    pNewEffect->m_BackgroundInterfaceCount = m_BackgroundInterfaceCount;
     pNewEffect->m_CBCount = m_CBCount;
     pNewEffect->m_pCBs = m_pCBs;
+    pNewEffect->m_pCBRuntimes = m_pCBRuntimes;
     pNewEffect->m_StringCount = m_StringCount;
     pNewEffect->m_pStrings = m_pStrings;
     pNewEffect->m_ShaderResourceCount = m_ShaderResourceCount;
@@ -2138,6 +2711,7 @@ HRESULT CEffect::CloneEffect(_In_ uint32_t Flags, _Outptr_ ID3DX11Effect** ppClo
     pNewEffect->m_FXLIndex = m_FXLIndex;
     pNewEffect->m_pDevice = m_pDevice;
     pNewEffect->m_pClassLinkage = m_pClassLinkage;
+    pNewEffect->m_BindingFlags = m_BindingFlags;
 
     pNewEffect->AddRefAllForCloning( this );
 
@@ -2146,30 +2720,24 @@ HRESULT CEffect::CloneEffect(_In_ uint32_t Flags, _Outptr_ ID3DX11Effect** ppClo
     // or during Effect loading when an interface is initialized to a global class variable elment.
     VH( pNewEffect->CopyMemberInterfaces( this ) );
 
-    loader.m_pvOldMemberInterfaces = &m_pMemberInterfaces;
-    loader.m_pEffect = pNewEffect;
-    loader.m_EffectMemory = loader.m_ReflectionMemory = 0;
-
-
-    // Move data from current effect to new effect
-    if( !IsOptimized() )
-    {
-        VN( pNewEffect->m_pReflection = new CEffectReflection() );
-        loader.m_pReflection = pNewEffect->m_pReflection;
-
-        // make sure strings are moved before ReallocateEffectData
-        VH( loader.InitializeReflectionDataAndMoveStrings( m_pReflection->m_Heap.GetSize() ) );
-    }
-    VH( loader.ReallocateEffectData( true ) );
-    if( !IsOptimized() )
+    // The tables are recorded when the effect is loaded or optimized; they are only
+    // missing if that failed to allocate them
+    if( !m_RelocationsRecorded )
     {
-        VH( loader.ReallocateReflectionData( true ) );
+        VH( RecordRelocations() );
     }
 
+    // Copy the heaps whole and rebase their pointers through the relocation tables
+    VH( pNewEffect->CopyHeapsForCloning( this ) );
+
 
     // Data structures for remapping type pointers and string pointers
-    VN( pTempHeap = new CDataBlockStore );
-    pTempHeap->EnableAlignment();
+    if( nullptr == m_pCloneHeap )
+    {
+        VN( m_pCloneHeap = new CDataBlockStore );
+        m_pCloneHeap->EnableAlignment();
+    }
+    pTempHeap = m_pCloneHeap;
     mappingTableTypes.SetPrivateHeap(pTempHeap);
     mappingTableStrings.SetPrivateHeap(pTempHeap);
     VH( mappingTableTypes.AutoGrow() );
@@ -2201,9 +2769,20 @@ HRESULT CEffect::CloneEffect(_In_ uint32_t Flags, _Outptr_ ID3DX11Effect** ppClo
         VH( pNewEffect->FixupMemberInterface( pMember, this, mappingTableStrings ) );
     }
 
+    VH( pNewEffect->CopySemanticBindings( this ) );
+
+    // Member interfaces may have been looked up while their pointers were being fixed up
+    pNewEffect->InvalidateInterfacePoolIndices();
+
 
 lExit:
-    SAFE_DELETE( pTempHeap );
+    if( nullptr != pTempHeap )
+    {
+        // The entries of the mapping tables go with the allocations of the store
+        mappingTableTypes.Cleanup();
+        mappingTableStrings.Cleanup();
+        pTempHeap->Reset();
+    }
     if( FAILED( hr ) )
     {
         SAFE_DELETE( pNewEffect );
@@ -2277,84 +2856,917 @@ lExit:
 }
 
 //////////////////////////////////////////////////////////////////////////
-// Public API to shed this effect of its reflection data
+// Runtime data packing
 
-HRESULT CEffect::Optimize()
+// Moves the arrays of the runtime heap into a new heap, in the order they are moved in
+class CRuntimeDataPacker
 {
-    HRESULT hr = S_OK;
-    CEffectHeap *pOptimizedTypeHeap = nullptr;
-    
-    if (IsOptimized())
+protected:
+    CEffectHeap *m_pHeap;
+
+public:
+    CRuntimeDataPacker() : m_pHeap(nullptr)
     {
-        DPF(0, "ID3DX11Effect::Optimize: Effect has already been Optimize()'ed");
-        return S_OK;
     }
 
-    // Delete annotations, names, semantics, and string data on variables
-    
-    for (size_t i = 0; i < m_VariableCount; ++ i)
+    void Initialize(_In_ CEffectHeap *pHeap)
     {
-        m_pVariables[i].AnnotationCount = 0;
-        m_pVariables[i].pAnnotations = nullptr;
-        m_pVariables[i].pName = nullptr;
-        m_pVariables[i].pSemantic = nullptr;
+        m_pHeap = pHeap;
+    }
 
-        // 2) Point string variables to nullptr
-        if (m_pVariables[i].pType->IsObjectType(EOT_String))
-        {
-            assert(nullptr != m_pVariables[i].Data.pString);
-            m_pVariables[i].Data.pString = nullptr;
-        }
+    // The heap is a single block the size of the runtime heap, which holds each array once,
+    // so the moves can't fail
+    template<class T> void MoveArray(_Inout_ T **ppArray, _In_ uint32_t Count)
+    {
+        // Empty arrays are nullptr
+        if (nullptr == *ppArray)
+            return;
+
+        HRESULT hr = m_pHeap->MoveData((void**) ppArray, Count * sizeof(T));
+        assert(SUCCEEDED(hr));
+        (void) hr;
     }
 
-    // Delete annotations and names on CBs
+    template<class T> void MoveDependencies(_Inout_ T **ppDeps, _In_ uint32_t Count);
+    void MoveAssignments(_Inout_ SBaseBlock *pBlock);
+    void MovePassRecord(_Inout_ SPassBlock *pPass);
+    void MoveShaderData(_Inout_ SShaderBlock *pShader);
+};
 
-    for (size_t i = 0; i < m_CBCount; ++ i)
+template<class T> void CRuntimeDataPacker::MoveDependencies(_Inout_ T **ppDeps, _In_ uint32_t Count)
+{
+    MoveArray(ppDeps, Count);
+    for (size_t i = 0; i < Count; ++ i)
     {
-        m_pCBs[i].AnnotationCount = 0;
-        m_pCBs[i].pAnnotations = nullptr;
-        m_pCBs[i].pName = nullptr;
-        m_pCBs[i].IsEffectOptimized = true;
+        MoveArray(&(*ppDeps)[i].ppD3DObjects, (*ppDeps)[i].Count);
+        MoveArray(&(*ppDeps)[i].ppFXPointers, (*ppDeps)[i].Count);
+    }
+}
+
+void CRuntimeDataPacker::MoveAssignments(_Inout_ SBaseBlock *pBlock)
+{
+    MoveArray(&pBlock->pAssignments, pBlock->AssignmentCount);
+    for (size_t i = 0; i < pBlock->AssignmentCount; ++ i)
+    {
+        MoveArray(&pBlock->pAssignments[i].pDependencies, pBlock->pAssignments[i].DependencyCount);
     }
+}
 
-    // Delete annotations and names on techniques and passes
+// The assignments of a pass write into its record, so their destinations move with it
+void CRuntimeDataPacker::MovePassRecord(_Inout_ SPassBlock *pPass)
+{
+    uint8_t *pOldRecord = (uint8_t*) pPass->pRuntime;
 
-    for (size_t i = 0; i < m_GroupCount; ++ i)
+    MoveArray(&pPass->pRuntime, 1);
+    for (size_t i = 0; i < pPass->pRuntime->AssignmentCount; ++ i)
     {
-        m_pGroups[i].AnnotationCount = 0;
-        m_pGroups[i].pAnnotations = nullptr;
-        m_pGroups[i].pName = nullptr;
+        SAssignment *pAssignment = &pPass->pRuntime->pAssignments[i];
 
-        for (size_t j = 0; j < m_pGroups[i].TechniqueCount; ++ j)
-        {
-            m_pGroups[i].pTechniques[j].AnnotationCount = 0;
-            m_pGroups[i].pTechniques[j].pAnnotations = nullptr;
-            m_pGroups[i].pTechniques[j].pName = nullptr;
+        pAssignment->Destination.pGeneric = (uint8_t*) pPass->pRuntime + ((uint8_t*) pAssignment->Destination.pGeneric - pOldRecord);
+    }
+}
 
-            for (size_t k = 0; k < m_pGroups[i].pTechniques[j].PassCount; ++ k)
-            {
-                m_pGroups[i].pTechniques[j].pPasses[k].AnnotationCount = 0;
-                m_pGroups[i].pTechniques[j].pPasses[k].pAnnotations = nullptr;
-                m_pGroups[i].pTechniques[j].pPasses[k].pName = nullptr;
-            }
-        }
-    };
+void CRuntimeDataPacker::MoveShaderData(_Inout_ SShaderBlock *pShader)
+{
+    MoveDependencies(&pShader->pCBDeps, pShader->CBDepCount);
+    MoveDependencies(&pShader->pSampDeps, pShader->SampDepCount);
+    MoveDependencies(&pShader->pInterfaceDeps, pShader->InterfaceDepCount);
+    MoveDependencies(&pShader->pResourceDeps, pShader->ResourceDepCount);
+    MoveDependencies(&pShader->pUAVDeps, pShader->UAVDepCount);
+    MoveArray(&pShader->ppTbufDeps, pShader->TBufferDepCount);
+}
 
-    // 2) Remove shader bytecode & stream out decls
-    //    (all are contained within pReflectionData)
+static HRESULT InitializeMovedFlags(_Inout_ CEffectVector<bool> &vMoved, _In_ uint32_t Count)
+{
+    HRESULT hr = S_OK;
 
-    for (size_t i = 0; i < m_ShaderBlockCount; ++ i)
+    VH( vMoved.Reserve(Count) );
+    for (uint32_t i = 0; i < Count; ++ i)
     {
-        if( m_pShaderBlocks[i].pReflectionData )
-        {
-            // pReflection was not created with PRIVATENEW
-            SAFE_RELEASE( m_pShaderBlocks[i].pReflectionData->pReflection );
-
-            m_pShaderBlocks[i].pReflectionData = nullptr;
-        }
+        VH( vMoved.Add(false) );
     }
 
-    uint32_t Members = m_pMemberInterfaces.GetSize();
+lExit:
+    return hr;
+}
+
+// Returns true the first time it is called for a block of the given array. The null
+// blocks, which are not part of the effect, are never moved.
+template<class T> static bool MarkMoved(_In_opt_ T *pBlock, _In_opt_ T *pBlocks, _Inout_ CEffectVector<bool> &vMoved)
+{
+    if (nullptr == pBlock || pBlock < pBlocks || pBlock >= pBlocks + vMoved.GetSize())
+        return false;
+
+    if (vMoved[(uint32_t) (pBlock - pBlocks)])
+        return false;
+
+    vMoved[(uint32_t) (pBlock - pBlocks)] = true;
+    return true;
+}
+
+// Lays the runtime heap out again in the order in which Apply walks it: the records of all
+// passes, in one array, then each pass's assignments, then the assignments of its state
+// blocks, then the dependency arrays of its shaders followed by the assignments of their
+// samplers. Blocks that no pass selects when this is called are moved after all of the passes.
+HRESULT CEffect::PackRuntimeData()
+{
+    HRESULT hr = S_OK;
+    uint32_t heapSize = m_RuntimeHeap.GetSize();
+    CEffectHeap packedHeap;
+    CRuntimeDataPacker packer;
+    CEffectVector<bool> vShaderMoved, vDSMoved, vABMoved, vRSMoved, vSamplerMoved;
+
+    if (0 == heapSize)
+        goto lExit;
+
+    VH( InitializeMovedFlags(vShaderMoved, m_ShaderBlockCount) );
+    VH( InitializeMovedFlags(vDSMoved, m_DepthStencilBlockCount) );
+    VH( InitializeMovedFlags(vABMoved, m_BlendBlockCount) );
+    VH( InitializeMovedFlags(vRSMoved, m_RasterizerBlockCount) );
+    VH( InitializeMovedFlags(vSamplerMoved, m_SamplerBlockCount) );
+
+    // The arrays fit in a single block of the current size, which only adds the unused ends of
+    // the blocks of the runtime heap; nothing can fail past this point, which matters since the
+    // moved pointers would dangle into packedHeap if it were freed half way
+    VH( packedHeap.ReserveMemory(heapSize) );
+    packer.Initialize(&packedHeap);
+
+    for (size_t iGroup = 0; iGroup < m_GroupCount; ++ iGroup)
+    {
+        for (size_t iTech = 0; iTech < m_pGroups[iGroup].TechniqueCount; ++ iTech)
+        {
+            STechnique *pTech = &m_pGroups[iGroup].pTechniques[iTech];
+
+            for (size_t iPass = 0; iPass < pTech->PassCount; ++ iPass)
+            {
+                packer.MovePassRecord(&pTech->pPasses[iPass]);
+            }
+        }
+    }
+
+    for (size_t iGroup = 0; iGroup < m_GroupCount; ++ iGroup)
+    {
+        for (size_t iTech = 0; iTech < m_pGroups[iGroup].TechniqueCount; ++ iTech)
+        {
+            STechnique *pTech = &m_pGroups[iGroup].pTechniques[iTech];
+
+            for (size_t iPass = 0; iPass < pTech->PassCount; ++ iPass)
+            {
+                SPassRuntime *pPass = pTech->pPasses[iPass].pRuntime;
+                SShaderBlock *pShaders[] = { pPass->BackingStore.pVertexShaderBlock, pPass->BackingStore.pPixelShaderBlock,
+                                             pPass->BackingStore.pGeometryShaderBlock, pPass->BackingStore.pHullShaderBlock,
+                                             pPass->BackingStore.pDomainShaderBlock, pPass->BackingStore.pComputeShaderBlock };
+
+                packer.MoveAssignments(pPass);
+
+                if (MarkMoved(pPass->BackingStore.pBlendBlock, m_pBlendBlocks, vABMoved))
+                {
+                    packer.MoveAssignments(pPass->BackingStore.pBlendBlock);
+                }
+                if (MarkMoved(pPass->BackingStore.pDepthStencilBlock, m_pDepthStencilBlocks, vDSMoved))
+                {
+                    packer.MoveAssignments(pPass->BackingStore.pDepthStencilBlock);
+                }
+                if (MarkMoved(pPass->BackingStore.pRasterizerBlock, m_pRasterizerBlocks, vRSMoved))
+                {
+                    packer.MoveAssignments(pPass->BackingStore.pRasterizerBlock);
+                }
+
+                for (size_t iShader = 0; iShader < _countof(pShaders); ++ iShader)
+                {
+                    if (!MarkMoved(pShaders[iShader], m_pShaderBlocks, vShaderMoved))
+                        continue;
+
+                    packer.MoveShaderData(pShaders[iShader]);
+                    for (size_t iDep = 0; iDep < pShaders[iShader]->SampDepCount; ++ iDep)
+                    {
+                        SShaderSamplerDependency *pSampDep = &pShaders[iShader]->pSampDeps[iDep];
+
+                        for (size_t i = 0; i < pSampDep->Count; ++ i)
+                        {
+                            if (MarkMoved(pSampDep->ppFXPointers[i], m_pSamplerBlocks, vSamplerMoved))
+                            {
+                                packer.MoveAssignments(pSampDep->ppFXPointers[i]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Blocks that are only selected through variables
+    for (size_t i = 0; i < m_BlendBlockCount; ++ i)
+    {
+        if (MarkMoved(&m_pBlendBlocks[i], m_pBlendBlocks, vABMoved))
+        {
+            packer.MoveAssignments(&m_pBlendBlocks[i]);
+        }
+    }
+    for (size_t i = 0; i < m_DepthStencilBlockCount; ++ i)
+    {
+        if (MarkMoved(&m_pDepthStencilBlocks[i], m_pDepthStencilBlocks, vDSMoved))
+        {
+            packer.MoveAssignments(&m_pDepthStencilBlocks[i]);
+        }
+    }
+    for (size_t i = 0; i < m_RasterizerBlockCount; ++ i)
+    {
+        if (MarkMoved(&m_pRasterizerBlocks[i], m_pRasterizerBlocks, vRSMoved))
+        {
+            packer.MoveAssignments(&m_pRasterizerBlocks[i]);
+        }
+    }
+    for (size_t i = 0; i < m_ShaderBlockCount; ++ i)
+    {
+        if (MarkMoved(&m_pShaderBlocks[i], m_pShaderBlocks, vShaderMoved))
+        {
+            packer.MoveShaderData(&m_pShaderBlocks[i]);
+        }
+    }
+    for (size_t i = 0; i < m_SamplerBlockCount; ++ i)
+    {
+        if (MarkMoved(&m_pSamplerBlocks[i], m_pSamplerBlocks, vSamplerMoved))
+        {
+            packer.MoveAssignments(&m_pSamplerBlocks[i]);
+        }
+    }
+
+    assert(packedHeap.GetSize() <= heapSize);
+
+    // The old blocks are freed with packedHeap
+    m_RuntimeHeap.Swap(packedHeap);
+
+lExit:
+    return hr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Relocation tables
+
+// Collects the logical offsets of the pointer slots of an effect's heaps
+class CRelocationRecorder
+{
+protected:
+    CEffectHeap             *m_pHeap;
+    CEffectHeap             *m_pRuntimeHeap;
+    CEffectHeap             *m_pReflectionHeap;     // nullptr once the effect is optimized
+    CEffectVector<uint32_t> *m_pHeapSlots;
+    CEffectVector<uint32_t> *m_pRuntimeSlots;
+    CEffectVector<uint32_t> *m_pReflectionSlots;
+    CEffectVector<uint32_t> *m_pVariableSlots;
+    CEffectVector<uint32_t> *m_pRuntimeVariableSlots;
+
+public:
+    CRelocationRecorder() : m_pHeap(nullptr), m_pRuntimeHeap(nullptr), m_pReflectionHeap(nullptr), m_pHeapSlots(nullptr), m_pRuntimeSlots(nullptr),
+                            m_pReflectionSlots(nullptr), m_pVariableSlots(nullptr), m_pRuntimeVariableSlots(nullptr)
+    {
+    }
+
+    void Initialize(_In_ CEffectHeap *pHeap, _In_ CEffectHeap *pRuntimeHeap, _In_opt_ CEffectHeap *pReflectionHeap)
+    {
+        m_pHeap = pHeap;
+        m_pRuntimeHeap = pRuntimeHeap;
+        m_pReflectionHeap = pReflectionHeap;
+    }
+
+    void InitializeSlots(_Inout_ CEffectVector<uint32_t> *pHeapSlots, _Inout_ CEffectVector<uint32_t> *pRuntimeSlots,
+                         _Inout_ CEffectVector<uint32_t> *pReflectionSlots, _Inout_ CEffectVector<uint32_t> *pVariableSlots,
+                         _Inout_ CEffectVector<uint32_t> *pRuntimeVariableSlots)
+    {
+        m_pHeapSlots = pHeapSlots;
+        m_pRuntimeSlots = pRuntimeSlots;
+        m_pReflectionSlots = pReflectionSlots;
+        m_pVariableSlots = pVariableSlots;
+        m_pRuntimeVariableSlots = pRuntimeVariableSlots;
+    }
+
+    // Every slot is recorded, whatever it holds now: most of them can be changed after load
+    template<class T> HRESULT Record(_In_ T **ppSlot)
+    {
+        uint32_t offset;
+
+        if (m_pHeap->GetOffset(ppSlot, &offset))
+            return m_pHeapSlots->Add(offset);
+
+        if (m_pRuntimeHeap->GetOffset(ppSlot, &offset))
+            return m_pRuntimeSlots->Add(offset);
+
+        if (nullptr != m_pReflectionHeap && m_pReflectionHeap->GetOffset(ppSlot, &offset))
+            return m_pReflectionSlots->Add(offset);
+
+        // Only the heaps hold pointer slots
+        assert(0);
+        return E_FAIL;
+    }
+
+    template<class T> HRESULT RecordVariable(_In_ T **ppSlot)
+    {
+        uint32_t offset;
+
+        if (m_pHeap->GetOffset(ppSlot, &offset))
+            return m_pVariableSlots->Add(offset);
+
+        if (m_pRuntimeHeap->GetOffset(ppSlot, &offset))
+            return m_pRuntimeVariableSlots->Add(offset);
+
+        assert(0);
+        return E_FAIL;
+    }
+
+    template<class T> HRESULT RecordDependencies(_In_ T *pDeps, _In_ uint32_t Count);
+    HRESULT RecordAnnotations(_In_reads_(Count) SAnnotation *pAnnotations, _In_ uint32_t Count);
+    HRESULT RecordAssignments(_In_ SBaseBlock *pBlock);
+    HRESULT RecordShader(_In_ SShaderBlock *pShader);
+    HRESULT RecordPass(_In_ SPassBlock *pPass);
+};
+
+template<class T> HRESULT CRelocationRecorder::RecordDependencies(_In_ T *pDeps, _In_ uint32_t Count)
+{
+    HRESULT hr = S_OK;
+
+    for (size_t i = 0; i < Count; ++ i)
+    {
+        VH( Record(&pDeps[i].ppFXPointers) );
+        VH( Record(&pDeps[i].ppD3DObjects) );
+        for (size_t j = 0; j < pDeps[i].Count; ++ j)
+        {
+            VH( Record(&pDeps[i].ppFXPointers[j]) );
+        }
+    }
+
+lExit:
+    return hr;
+}
+
+HRESULT CRelocationRecorder::RecordAnnotations(_In_reads_(Count) SAnnotation *pAnnotations, _In_ uint32_t Count)
+{
+    HRESULT hr = S_OK;
+
+    for (size_t i = 0; i < Count; ++ i)
+    {
+        SAnnotation *pAn = &pAnnotations[i];
+
+        VH( Record(&pAn->pEffect) );
+        VH( Record(&pAn->pName) );
+        VH( Record(&pAn->pSemantic) );
+        VH( Record(&pAn->Data.pGeneric) );
+
+        if (pAn->pType->IsObjectType(EOT_String))
+        {
+            uint32_t cElements = std::max<uint32_t>(1, pAn->pType->Elements);
+
+            for (size_t j = 0; j < cElements; ++ j)
+            {
+                VH( Record(&pAn->Data.pString[j].pString) );
+            }
+        }
+    }
+
+lExit:
+    return hr;
+}
+
+HRESULT CRelocationRecorder::RecordAssignments(_In_ SBaseBlock *pBlock)
+{
+    HRESULT hr = S_OK;
+
+    VH( Record(&pBlock->pAssignments) );
+    for (size_t i = 0; i < pBlock->AssignmentCount; ++ i)
+    {
+        SAssignment *pAssignment = &pBlock->pAssignments[i];
+
+        VH( Record(&pAssignment->pDependencies) );
+        for (size_t j = 0; j < pAssignment->DependencyCount; ++ j)
+        {
+            VH( RecordVariable(&pAssignment->pDependencies[j].pVariable) );
+            VH( Record(&pAssignment->pDependencies[j].pLastModifiedTime) );
+        }
+        VH( Record(&pAssignment->Destination.pGeneric) );
+        VH( Record(&pAssignment->Source.pGeneric) );
+    }
+
+lExit:
+    return hr;
+}
+
+HRESULT CRelocationRecorder::RecordShader(_In_ SShaderBlock *pShader)
+{
+    HRESULT hr = S_OK;
+
+    VH( Record(&pShader->pCBDeps) );
+    VH( Record(&pShader->pSampDeps) );
+    VH( Record(&pShader->pInterfaceDeps) );
+    VH( Record(&pShader->pResourceDeps) );
+    VH( Record(&pShader->pUAVDeps) );
+    VH( Record(&pShader->ppTbufDeps) );
+    VH( Record(&pShader->pDescData) );
+
+    VH( RecordDependencies(pShader->pCBDeps, pShader->CBDepCount) );
+    VH( RecordDependencies(pShader->pSampDeps, pShader->SampDepCount) );
+    VH( RecordDependencies(pShader->pInterfaceDeps, pShader->InterfaceDepCount) );
+    VH( RecordDependencies(pShader->pResourceDeps, pShader->ResourceDepCount) );
+    VH( RecordDependencies(pShader->pUAVDeps, pShader->UAVDepCount) );
+    for (size_t i = 0; i < pShader->TBufferDepCount; ++ i)
+    {
+        VH( Record(&pShader->ppTbufDeps[i]) );
+    }
+
+    VH( Record(&pShader->pReflectionData) );
+    if (nullptr != pShader->pReflectionData)
+    {
+        SShaderBlock::SReflectionData *pReflectionData = pShader->pReflectionData;
+
+        VH( Record(&pReflectionData->pBytecode) );
+        for (size_t i = 0; i < D3D11_SO_STREAM_COUNT; ++ i)
+        {
+            VH( Record(&pReflectionData->pStreamOutDecls[i]) );
+        }
+        VH( Record(&pReflectionData->pInterfaceParameters) );
+        for (size_t i = 0; i < pReflectionData->InterfaceParameterCount; ++ i)
+        {
+            VH( Record(&pReflectionData->pInterfaceParameters[i].pName) );
+        }
+    }
+
+lExit:
+    return hr;
+}
+
+HRESULT CRelocationRecorder::RecordPass(_In_ SPassBlock *pPass)
+{
+    HRESULT hr = S_OK;
+    SPassRuntime *pRuntime = pPass->pRuntime;
+
+    VH( Record(&pPass->pRuntime) );
+    VH( Record(&pPass->pName) );
+    VH( Record(&pPass->pAnnotations) );
+    VH( RecordAnnotations(pPass->pAnnotations, pPass->AnnotationCount) );
+
+    VH( Record(&pRuntime->pEffect) );
+    VH( Record(&pRuntime->BackingStore.pBlendBlock) );
+    VH( Record(&pRuntime->BackingStore.pDepthStencilBlock) );
+    VH( Record(&pRuntime->BackingStore.pRasterizerBlock) );
+    for (size_t i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++ i)
+    {
+        VH( Record(&pRuntime->BackingStore.pRenderTargetViews[i]) );
+    }
+    VH( Record(&pRuntime->BackingStore.pDepthStencilView) );
+    VH( Record(&pRuntime->BackingStore.pVertexShaderBlock) );
+    VH( Record(&pRuntime->BackingStore.pPixelShaderBlock) );
+    VH( Record(&pRuntime->BackingStore.pGeometryShaderBlock) );
+    VH( Record(&pRuntime->BackingStore.pComputeShaderBlock) );
+    VH( Record(&pRuntime->BackingStore.pDomainShaderBlock) );
+    VH( Record(&pRuntime->BackingStore.pHullShaderBlock) );
+    VH( RecordAssignments(pRuntime) );
+
+lExit:
+    return hr;
+}
+
+// Records every pointer slot of the heaps, following the structures that CEffectLoader
+// placed in them. Must be called again whenever the layout of the heaps changes.
+HRESULT CEffect::RecordRelocations()
+{
+    HRESULT hr = S_OK;
+    CRelocationRecorder recorder;
+
+    m_RelocationsRecorded = false;
+    m_HeapRelocations.Empty();
+    m_RuntimeRelocations.Empty();
+    m_ReflectionRelocations.Empty();
+    m_VariableRelocations.Empty();
+    m_RuntimeVariableRelocations.Empty();
+
+    recorder.Initialize(&m_Heap, &m_RuntimeHeap, (nullptr != m_pReflection) ? &m_pReflection->m_Heap : nullptr);
+    recorder.InitializeSlots(&m_HeapRelocations, &m_RuntimeRelocations, &m_ReflectionRelocations,
+                             &m_VariableRelocations, &m_RuntimeVariableRelocations);
+
+    for (size_t i = 0; i < m_CBCount; ++ i)
+    {
+        SConstantBuffer *pCB = &m_pCBs[i];
+
+        VH( recorder.Record(&pCB->pRuntime) );
+        VH( recorder.Record(&pCB->pRuntime->pBackingStore) );
+        VH( recorder.Record(&pCB->pEffect) );
+        VH( recorder.Record(&pCB->pName) );
+        VH( recorder.Record(&pCB->pAnnotations) );
+        VH( recorder.RecordAnnotations(pCB->pAnnotations, pCB->AnnotationCount) );
+        VH( recorder.Record(&pCB->pVariables) );
+        VH( recorder.Record(&pCB->pMemberData) );
+    }
+
+    // Variable types live in the type pool, which CloneEffect remaps separately
+    for (size_t i = 0; i < m_VariableCount; ++ i)
+    {
+        SGlobalVariable *pVar = &m_pVariables[i];
+
+        VH( recorder.Record(&pVar->Data.pGeneric) );
+        VH( recorder.Record(&pVar->pMemberData) );
+        VH( recorder.Record(&pVar->pName) );
+        VH( recorder.Record(&pVar->pSemantic) );
+        VH( recorder.Record(&pVar->pEffect) );
+        VH( recorder.Record(&pVar->pCB) );
+        VH( recorder.Record(&pVar->pLastModifiedTime) );
+        VH( recorder.Record(&pVar->pAnnotations) );
+        VH( recorder.RecordAnnotations(pVar->pAnnotations, pVar->AnnotationCount) );
+    }
+
+    for (size_t i = 0; i < m_ShaderBlockCount; ++ i)
+    {
+        VH( recorder.RecordShader(&m_pShaderBlocks[i]) );
+    }
+
+    for (size_t i = 0; i < m_InterfaceCount; ++ i)
+    {
+        VH( recorder.RecordVariable(&m_pInterfaces[i].pClassInstance) );
+    }
+
+    // Background interfaces are only reachable through the interface dependencies of the
+    // shaders, each of them from exactly one slot. The other slots hold global interfaces
+    // or the null interface, which is not part of the effect.
+    for (size_t i = 0; i < m_ShaderBlockCount; ++ i)
+    {
+        SShaderBlock *pShader = &m_pShaderBlocks[i];
+
+        for (size_t j = 0; j < pShader->InterfaceDepCount; ++ j)
+        {
+            SInterfaceDependency *pDep = &pShader->pInterfaceDeps[j];
+
+            for (size_t k = 0; k < pDep->Count; ++ k)
+            {
+                SInterface *pInterface = pDep->ppFXPointers[k];
+
+                if (!m_Heap.IsInHeap(pInterface) ||
+                    (pInterface >= m_pInterfaces && pInterface < m_pInterfaces + m_InterfaceCount))
+                    continue;
+
+                VH( recorder.RecordVariable(&pInterface->pClassInstance) );
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m_DepthStencilBlockCount; ++ i)
+    {
+        VH( recorder.RecordAssignments(&m_pDepthStencilBlocks[i]) );
+    }
+    for (size_t i = 0; i < m_BlendBlockCount; ++ i)
+    {
+        VH( recorder.RecordAssignments(&m_pBlendBlocks[i]) );
+    }
+    for (size_t i = 0; i < m_RasterizerBlockCount; ++ i)
+    {
+        VH( recorder.RecordAssignments(&m_pRasterizerBlocks[i]) );
+    }
+    for (size_t i = 0; i < m_SamplerBlockCount; ++ i)
+    {
+        VH( recorder.Record(&m_pSamplerBlocks[i].BackingStore.pTexture) );
+        VH( recorder.RecordAssignments(&m_pSamplerBlocks[i]) );
+    }
+
+    for (size_t i = 0; i < m_GroupCount; ++ i)
+    {
+        SGroup *pGroup = &m_pGroups[i];
+
+        VH( recorder.Record(&pGroup->pName) );
+        VH( recorder.Record(&pGroup->pTechniques) );
+        VH( recorder.Record(&pGroup->pAnnotations) );
+        VH( recorder.RecordAnnotations(pGroup->pAnnotations, pGroup->AnnotationCount) );
+
+        for (size_t j = 0; j < pGroup->TechniqueCount; ++ j)
+        {
+            STechnique *pTech = &pGroup->pTechniques[j];
+
+            VH( recorder.Record(&pTech->pName) );
+            VH( recorder.Record(&pTech->pPasses) );
+            VH( recorder.Record(&pTech->pAnnotations) );
+            VH( recorder.RecordAnnotations(pTech->pAnnotations, pTech->AnnotationCount) );
+
+            for (size_t k = 0; k < pTech->PassCount; ++ k)
+            {
+                VH( recorder.RecordPass(&pTech->pPasses[k]) );
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m_AnonymousShaderCount; ++ i)
+    {
+        VH( recorder.Record(&m_pAnonymousShaders[i].pShaderBlock) );
+    }
+
+    if (nullptr != m_pReflection)
+    {
+        for (size_t i = 0; i < m_StringCount; ++ i)
+        {
+            VH( recorder.Record(&m_pStrings[i].pString) );
+        }
+    }
+
+    m_RelocationsRecorded = true;
+
+lExit:
+    return hr;
+}
+
+// Rebases pointers copied from the heaps of an effect into the heaps of its clone.
+// The copies keep the logical layout of their source heaps.
+class CHeapRelocator
+{
+protected:
+    enum
+    {
+        Heap,
+        RuntimeHeap,
+        ReflectionHeap,
+        BytecodeHeap,
+        HeapCount
+    };
+
+    CEffect     *m_pOldEffect;
+    CEffect     *m_pNewEffect;
+    CEffectHeap *m_pOldHeaps[HeapCount];
+    CEffectHeap *m_pNewHeaps[HeapCount];
+
+public:
+    CHeapRelocator() : m_pOldEffect(nullptr), m_pNewEffect(nullptr)
+    {
+        ZeroMemory(m_pOldHeaps, sizeof(m_pOldHeaps));
+        ZeroMemory(m_pNewHeaps, sizeof(m_pNewHeaps));
+    }
+
+    void Initialize(_In_ CEffect *pOldEffect, _In_ CEffect *pNewEffect, _In_ CEffectHeap *pOldHeap, _In_ CEffectHeap *pNewHeap,
+                    _In_ CEffectHeap *pOldRuntimeHeap, _In_ CEffectHeap *pNewRuntimeHeap)
+    {
+        m_pOldEffect = pOldEffect;
+        m_pNewEffect = pNewEffect;
+        m_pOldHeaps[Heap] = pOldHeap;
+        m_pNewHeaps[Heap] = pNewHeap;
+        m_pOldHeaps[RuntimeHeap] = pOldRuntimeHeap;
+        m_pNewHeaps[RuntimeHeap] = pNewRuntimeHeap;
+    }
+
+    void InitializeReflection(_In_ CEffectHeap *pOldReflectionHeap, _In_ CEffectHeap *pNewReflectionHeap,
+                              _In_ CEffectHeap *pOldBytecodeHeap, _In_ CEffectHeap *pNewBytecodeHeap)
+    {
+        m_pOldHeaps[ReflectionHeap] = pOldReflectionHeap;
+        m_pNewHeaps[ReflectionHeap] = pNewReflectionHeap;
+        m_pOldHeaps[BytecodeHeap] = pOldBytecodeHeap;
+        m_pNewHeaps[BytecodeHeap] = pNewBytecodeHeap;
+    }
+
+    // Returns false if the pointer is neither into the heaps nor to the source effect; such
+    // pointers (nullptr, shared cbuffer data, member interfaces) are left as they are
+    template<class T> bool Relocate(_Inout_ T **ppPointer) const
+    {
+        uint32_t offset;
+
+        if (nullptr == *ppPointer)
+            return false;
+
+        for (size_t i = 0; i < HeapCount; ++ i)
+        {
+            if (nullptr != m_pOldHeaps[i] && m_pOldHeaps[i]->GetOffset(*ppPointer, &offset))
+            {
+                *ppPointer = (T*) m_pNewHeaps[i]->GetPointer(offset);
+                return true;
+            }
+        }
+
+        if ((void*) *ppPointer == (void*) m_pOldEffect)
+        {
+            *ppPointer = (T*) m_pNewEffect;
+            return true;
+        }
+        return false;
+    }
+
+    void RelocateSlots(_In_ CEffectHeap &NewHeap, _In_ CEffectVector<uint32_t> &Slots) const
+    {
+        for (uint32_t i = 0; i < Slots.GetSize(); ++ i)
+        {
+            Relocate((void**) NewHeap.GetPointer(Slots[i]));
+        }
+    }
+};
+
+// Index of a member interface of the source effect of a clone, by address
+struct SMemberInterfaceIndex
+{
+    ID3DX11EffectVariable   *pInterface;
+    uint32_t                Index;
+
+    uint32_t ComputeHash() const
+    {
+        return ::ComputeHash((const uint8_t*) &pInterface, sizeof(pInterface));
+    }
+
+    static bool AreInterfacesEqual(const SMemberInterfaceIndex &Index1, const SMemberInterfaceIndex &Index2)
+    {
+        return Index1.pInterface == Index2.pInterface;
+    }
+};
+
+typedef CEffectHashTable<SMemberInterfaceIndex, SMemberInterfaceIndex::AreInterfacesEqual> CMemberInterfaceIndexTable;
+
+// Used in cloning: copies the heaps of pEffectSource as they are and rebases the pointers
+// recorded in its relocation tables. The copy keeps the logical layout of the source, so
+// the runtime data of an optimized effect stays packed and the tables remain valid.
+HRESULT CEffect::CopyHeapsForCloning( _In_ CEffect* pEffectSource )
+{
+    HRESULT hr = S_OK;
+    CHeapRelocator relocator;
+    CMemberInterfaceIndexTable memberIndex;
+    bool isMemberIndexBuilt = false;
+    uint32_t variableSlots = pEffectSource->m_VariableRelocations.GetSize();
+    uint32_t runtimeVariableSlots = pEffectSource->m_RuntimeVariableRelocations.GetSize();
+
+    assert( pEffectSource->m_RelocationsRecorded );
+
+    VH( m_Heap.CopyFrom(pEffectSource->m_Heap) );
+    VH( m_RuntimeHeap.CopyFrom(pEffectSource->m_RuntimeHeap) );
+    relocator.Initialize(pEffectSource, this, &pEffectSource->m_Heap, &m_Heap, &pEffectSource->m_RuntimeHeap, &m_RuntimeHeap);
+
+    if( !pEffectSource->IsOptimized() )
+    {
+        VN( m_pReflection = new CEffectReflection() );
+        VH( m_pReflection->m_Heap.CopyFrom(pEffectSource->m_pReflection->m_Heap) );
+
+        // Empty once the source's shader data was discarded
+        VH( m_pReflection->m_BytecodeHeap.CopyFrom(pEffectSource->m_pReflection->m_BytecodeHeap) );
+        relocator.InitializeReflection(&pEffectSource->m_pReflection->m_Heap, &m_pReflection->m_Heap,
+                                       &pEffectSource->m_pReflection->m_BytecodeHeap, &m_pReflection->m_BytecodeHeap);
+
+        relocator.RelocateSlots(m_pReflection->m_Heap, pEffectSource->m_ReflectionRelocations);
+    }
+
+    relocator.RelocateSlots(m_Heap, pEffectSource->m_HeapRelocations);
+    relocator.RelocateSlots(m_RuntimeHeap, pEffectSource->m_RuntimeRelocations);
+
+    // Variable slots of the effect heap come first, then those of the runtime heap
+    for (uint32_t i = 0; i < variableSlots + runtimeVariableSlots; ++ i)
+    {
+        SGlobalVariable **ppVar = (i < variableSlots) ?
+            (SGlobalVariable**) m_Heap.GetPointer(pEffectSource->m_VariableRelocations[i]) :
+            (SGlobalVariable**) m_RuntimeHeap.GetPointer(pEffectSource->m_RuntimeVariableRelocations[i - variableSlots]);
+
+        if (nullptr != *ppVar && !relocator.Relocate(ppVar))
+        {
+            // Interfaces may be bound to an element of a class instance array, which is a member interface.
+            // The slots can be rebound after they are recorded, so members are found by address, through
+            // an index built on the first such slot.
+            CMemberInterfaceIndexTable::CIterator iter;
+            SMemberInterfaceIndex key;
+
+            if (!isMemberIndexBuilt)
+            {
+                uint32_t Members = pEffectSource->m_pMemberInterfaces.GetSize();
+
+                VH( memberIndex.Grow(Members * 2 + 1) );
+                for (uint32_t j = 0; j < Members; ++ j)
+                {
+                    if (nullptr != pEffectSource->m_pMemberInterfaces[j])
+                    {
+                        key.pInterface = (ID3DX11EffectVariable*)pEffectSource->m_pMemberInterfaces[j];
+                        key.Index = j;
+                        VH( memberIndex.AddValueWithHash(key, key.ComputeHash()) );
+                    }
+                }
+                isMemberIndexBuilt = true;
+            }
+
+            key.pInterface = (ID3DX11EffectVariable*)*ppVar;
+            key.Index = 0;
+            VBD( SUCCEEDED(memberIndex.FindValueWithHash(key, key.ComputeHash(), &iter)), "Internal loading error: invalid member pointer." );
+            *ppVar = (SGlobalVariable*)m_pMemberInterfaces[iter.GetData().Index];
+        }
+    }
+
+    // The arrays of this effect still point into the source heaps (see CloneEffect)
+    relocator.Relocate(&m_pVariables);
+    relocator.Relocate(&m_pVariableTimes);
+    relocator.Relocate(&m_pAnonymousShaders);
+    relocator.Relocate(&m_pGroups);
+    relocator.Relocate(&m_pNullGroup);
+    relocator.Relocate(&m_pShaderBlocks);
+    relocator.Relocate(&m_pShaderDescs);
+    relocator.Relocate(&m_pDepthStencilBlocks);
+    relocator.Relocate(&m_pBlendBlocks);
+    relocator.Relocate(&m_pRasterizerBlocks);
+    relocator.Relocate(&m_pSamplerBlocks);
+    relocator.Relocate(&m_pMemberDataBlocks);
+    relocator.Relocate(&m_pInterfaces);
+    relocator.Relocate(&m_pCBs);
+    relocator.Relocate(&m_pCBRuntimes);
+    relocator.Relocate(&m_pStrings);
+    relocator.Relocate(&m_pShaderResources);
+    relocator.Relocate(&m_pUnorderedAccessViews);
+    relocator.Relocate(&m_pRenderTargetViews);
+    relocator.Relocate(&m_pDepthStencilViews);
+
+    // Names and semantics of the copied member interfaces are fixed up by FixupMemberInterface
+    for (uint32_t i = 0; i < m_pMemberInterfaces.GetSize(); ++ i)
+    {
+        SMember *pMember = m_pMemberInterfaces[i];
+
+        if (nullptr != pMember)
+        {
+            relocator.Relocate(&pMember->pTopLevelEntity);
+            relocator.Relocate(&pMember->Data.pGeneric);
+            relocator.Relocate(&pMember->pMemberData);
+        }
+    }
+
+    VH( m_HeapRelocations.CopyFrom(pEffectSource->m_HeapRelocations) );
+    VH( m_RuntimeRelocations.CopyFrom(pEffectSource->m_RuntimeRelocations) );
+    VH( m_ReflectionRelocations.CopyFrom(pEffectSource->m_ReflectionRelocations) );
+    VH( m_VariableRelocations.CopyFrom(pEffectSource->m_VariableRelocations) );
+    VH( m_RuntimeVariableRelocations.CopyFrom(pEffectSource->m_RuntimeVariableRelocations) );
+    m_RelocationsRecorded = true;
+
+lExit:
+    return hr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Public API to shed this effect of its reflection data
+
+HRESULT CEffect::Optimize()
+{
+    HRESULT hr = S_OK;
+    CEffectAllocatorScope allocatorScope(m_pAllocator);
+    CEffectHeap *pOptimizedTypeHeap = nullptr;
+    
+    if (IsOptimized())
+    {
+        DPF(0, "ID3DX11Effect::Optimize: Effect has already been Optimize()'ed");
+        return S_OK;
+    }
+
+    // Delete annotations, names, semantics, and string data on variables
+    
+    for (size_t i = 0; i < m_VariableCount; ++ i)
+    {
+        m_pVariables[i].AnnotationCount = 0;
+        m_pVariables[i].pAnnotations = nullptr;
+        m_pVariables[i].pName = nullptr;
+        m_pVariables[i].pSemantic = nullptr;
+
+        // 2) Point string variables to nullptr
+        if (m_pVariables[i].pType->IsObjectType(EOT_String))
+        {
+            assert(nullptr != m_pVariables[i].Data.pString);
+            m_pVariables[i].Data.pString = nullptr;
+        }
+    }
+
+    // Delete annotations and names on CBs
+
+    for (size_t i = 0; i < m_CBCount; ++ i)
+    {
+        m_pCBs[i].AnnotationCount = 0;
+        m_pCBs[i].pAnnotations = nullptr;
+        m_pCBs[i].pName = nullptr;
+        m_pCBs[i].IsEffectOptimized = true;
+    }
+
+    // Delete annotations and names on techniques and passes
+
+    for (size_t i = 0; i < m_GroupCount; ++ i)
+    {
+        m_pGroups[i].AnnotationCount = 0;
+        m_pGroups[i].pAnnotations = nullptr;
+        m_pGroups[i].pName = nullptr;
+
+        for (size_t j = 0; j < m_pGroups[i].TechniqueCount; ++ j)
+        {
+            m_pGroups[i].pTechniques[j].AnnotationCount = 0;
+            m_pGroups[i].pTechniques[j].pAnnotations = nullptr;
+            m_pGroups[i].pTechniques[j].pName = nullptr;
+
+            for (size_t k = 0; k < m_pGroups[i].pTechniques[j].PassCount; ++ k)
+            {
+                m_pGroups[i].pTechniques[j].pPasses[k].AnnotationCount = 0;
+                m_pGroups[i].pTechniques[j].pPasses[k].pAnnotations = nullptr;
+                m_pGroups[i].pTechniques[j].pPasses[k].pName = nullptr;
+            }
+        }
+    };
+
+    // 2) Remove shader bytecode & stream out decls
+    //    (all are contained within pReflectionData)
+
+    for (size_t i = 0; i < m_ShaderBlockCount; ++ i)
+    {
+        if( m_pShaderBlocks[i].pReflectionData )
+        {
+            // pReflection is a COM object, not part of the reflection heap
+            SAFE_RELEASE( m_pShaderBlocks[i].pReflectionData->pReflection );
+
+            m_pShaderBlocks[i].pReflectionData = nullptr;
+        }
+    }
+
+    uint32_t Members = m_pMemberInterfaces.GetSize();
     for( size_t i=0; i < Members; i++ )
     {
         assert( m_pMemberInterfaces[i] != nullptr );
@@ -2372,6 +3784,9 @@ HRESULT CEffect::Optimize()
         }
     }
 
+    // No interface is created once the effect is optimized
+    InvalidateInterfacePoolIndices();
+
 
 
     // get rid of the name/type hash tables and string data, 
@@ -2382,6 +3797,12 @@ HRESULT CEffect::Optimize()
     CCheckedDword chkSpaceNeeded = 0;
     uint32_t  spaceNeeded;
 
+    // Shipping code always optimizes, so this is where the runtime data is laid out for Apply.
+    // PackRuntimeData only fails before it moves anything, in which case the relocation tables
+    // still hold; once it succeeds they are stale until recorded again below.
+    VH( PackRuntimeData() );
+    m_RelocationsRecorded = false;
+
     // first pass: compute needed space
     for (m_pTypePool->GetFirstEntry(&typeIter); !m_pTypePool->PastEnd(&typeIter); m_pTypePool->GetNextEntry(&typeIter))
     {
@@ -2463,10 +3884,12 @@ HRESULT CEffect::Optimize()
     SAFE_DELETE(m_pStringPool);
     SAFE_DELETE(m_pPooledHeap);
 
-    DPF(0, "ID3DX11Effect::Optimize: %d bytes of reflection data freed.", m_pReflection->m_Heap.GetSize());
+    DPF(0, "ID3DX11Effect::Optimize: %d bytes of reflection data freed.", m_pReflection->m_Heap.GetSize() + m_pReflection->m_BytecodeHeap.GetSize());
     SAFE_DELETE(m_pReflection);
     m_Flags |= D3DX11_EFFECT_OPTIMIZED;
 
+    VH( RecordRelocations() );
+
 lExit:
     SAFE_DELETE(pOptimizedTypeHeap);
     return hr;
@@ -0,0 +1,368 @@
+//--------------------------------------------------------------------------------------
+// File: EffectParameterTable.cpp
+//
+// Direct3D 11 Effects table of global parameters published by semantic
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#include "pchfx.h"
+
+#include "EffectParameterTable.h"
+
+namespace D3DX11Effects
+{
+
+//--------------------------------------------------------------------------------------
+// CEffect semantic bindings
+//--------------------------------------------------------------------------------------
+
+static SSemanticBinding *FindSemanticBinding(_In_ CEffectVectorOwner<SSemanticBinding> &Bindings, _In_z_ LPCSTR pSemantic)
+{
+    for (uint32_t i = 0; i < Bindings.GetSize(); ++ i)
+    {
+        if (_stricmp(Bindings[i]->pSemantic, pSemantic) == 0)
+            return Bindings[i];
+    }
+    return nullptr;
+}
+
+static HRESULT AddSemanticBinding(_Inout_ CEffectVectorOwner<SSemanticBinding> &Bindings, _In_z_ LPCSTR pSemantic, _Outptr_ SSemanticBinding **ppBinding)
+{
+    HRESULT hr = S_OK;
+    SSemanticBinding *pBinding = nullptr;
+    size_t semanticLength = strlen(pSemantic) + 1;
+
+    VN( pBinding = new SSemanticBinding );
+    VN( pBinding->pSemantic = (char*) AllocateEffectMemory(semanticLength) );
+    memcpy(pBinding->pSemantic, pSemantic, semanticLength);
+
+    VH( Bindings.Add(pBinding) );
+    *ppBinding = pBinding;
+    pBinding = nullptr;
+
+lExit:
+    SAFE_DELETE(pBinding);
+    return hr;
+}
+
+// Groups the global variables by semantic, so that parameter tables never have to look them up
+HRESULT CEffect::BuildSemanticBindings()
+{
+    HRESULT hr = S_OK;
+
+    for (uint32_t i = 0; i < m_VariableCount; ++ i)
+    {
+        SGlobalVariable *pVariable = &m_pVariables[i];
+        SSemanticBinding *pBinding;
+
+        if (nullptr == pVariable->pSemantic || 0 == pVariable->pSemantic[0])
+            continue;
+
+        pBinding = FindSemanticBinding(m_SemanticBindings, pVariable->pSemantic);
+        if (nullptr == pBinding)
+        {
+            VH( AddSemanticBinding(m_SemanticBindings, pVariable->pSemantic, &pBinding) );
+        }
+        VH( pBinding->Variables.Add(pVariable) );
+    }
+
+lExit:
+    return hr;
+}
+
+// The source effect may have been optimized, so the bindings are remapped by variable index
+HRESULT CEffect::CopySemanticBindings(_In_ CEffect *pEffectSource)
+{
+    HRESULT hr = S_OK;
+
+    for (uint32_t i = 0; i < pEffectSource->m_SemanticBindings.GetSize(); ++ i)
+    {
+        SSemanticBinding *pSourceBinding = pEffectSource->m_SemanticBindings[i];
+        SSemanticBinding *pBinding;
+
+        VH( AddSemanticBinding(m_SemanticBindings, pSourceBinding->pSemantic, &pBinding) );
+        for (uint32_t j = 0; j < pSourceBinding->Variables.GetSize(); ++ j)
+        {
+            size_t index = pSourceBinding->Variables[j] - pEffectSource->m_pVariables;
+            assert(index < m_VariableCount);
+            VH( pBinding->Variables.Add(&m_pVariables[index]) );
+        }
+    }
+
+lExit:
+    return hr;
+}
+
+//--------------------------------------------------------------------------------------
+// CParameterTable
+//--------------------------------------------------------------------------------------
+
+void SParameterTableEntry::PublishTo(_In_ SGlobalVariable *pVariable)
+{
+    if (pVariable->pType->BelongsInConstantBuffer())
+    {
+        if (Value.GetSize() > 0)
+        {
+            pVariable->SetRawValue(Value.GetData(), 0, std::min(Value.GetSize(), pVariable->pType->TotalSize));
+        }
+    }
+    else if (pVariable->pType->IsShaderResource())
+    {
+        if (HasResource)
+        {
+            pVariable->AsShaderResource()->SetResource(pResource);
+        }
+    }
+}
+
+CParameterTable::CParameterTable()
+{
+    m_RefCount = 1;
+}
+
+CParameterTable::~CParameterTable()
+{
+    m_Entries.Clear();
+    for (uint32_t i = 0; i < m_Effects.GetSize(); ++ i)
+    {
+        SAFE_RELEASE(m_Effects[i]);
+    }
+}
+
+SParameterTableEntry *CParameterTable::FindEntry(_In_z_ LPCSTR pSemantic)
+{
+    for (uint32_t i = 0; i < m_Entries.GetSize(); ++ i)
+    {
+        if (_stricmp(m_Entries[i]->pSemantic, pSemantic) == 0)
+            return m_Entries[i];
+    }
+    return nullptr;
+}
+
+_Use_decl_annotations_
+HRESULT CParameterTable::FindOrAddEntry(LPCSTR pSemantic, SParameterTableEntry **ppEntry)
+{
+    HRESULT hr = S_OK;
+    SParameterTableEntry *pEntry = nullptr;
+    size_t semanticLength;
+
+    *ppEntry = FindEntry(pSemantic);
+    if (nullptr != *ppEntry)
+        goto lExit;
+
+    semanticLength = strlen(pSemantic) + 1;
+    VN( pEntry = new SParameterTableEntry );
+    VN( pEntry->pSemantic = (char*) AllocateEffectMemory(semanticLength) );
+    memcpy(pEntry->pSemantic, pSemantic, semanticLength);
+
+    VH( m_Entries.Add(pEntry) );
+    *ppEntry = pEntry;
+    pEntry = nullptr;
+
+lExit:
+    SAFE_DELETE(pEntry);
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT CParameterTable::QueryInterface(REFIID iid, LPVOID *ppv)
+{
+    if (nullptr == ppv)
+    {
+        DPF(0, "ID3DX11ParameterTable::QueryInterface: nullptr parameter");
+        return E_INVALIDARG;
+    }
+
+    *ppv = nullptr;
+    if (IsEqualIID(iid, IID_IUnknown))
+    {
+        *ppv = (IUnknown *) this;
+    }
+    else if (IsEqualIID(iid, IID_ID3DX11ParameterTable))
+    {
+        *ppv = (ID3DX11ParameterTable *) this;
+    }
+    else
+    {
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG CParameterTable::AddRef()
+{
+    return ++ m_RefCount;
+}
+
+ULONG CParameterTable::Release()
+{
+    if (-- m_RefCount > 0)
+    {
+        return m_RefCount;
+    }
+    else
+    {
+        delete this;
+    }
+
+    return 0;
+}
+
+_Use_decl_annotations_
+HRESULT CParameterTable::AddEffect(ID3DX11Effect *pEffect)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11ParameterTable::AddEffect";
+    CEffect *pFX = (CEffect*) pEffect;
+
+    VERIFYPARAMETER(pEffect != nullptr);
+
+    for (uint32_t i = 0; i < m_Effects.GetSize(); ++ i)
+    {
+        if (m_Effects[i] == pFX)
+        {
+            DPF(1, "%s: The effect has already been added", pFuncName);
+            goto lExit;
+        }
+    }
+
+    VH( m_Effects.Add(pFX) );
+    pFX->AddRef();
+
+    for (uint32_t i = 0; i < pFX->GetSemanticBindingCount(); ++ i)
+    {
+        SSemanticBinding *pBinding = pFX->GetSemanticBinding(i);
+        SParameterTableEntry *pEntry;
+
+        VH( FindOrAddEntry(pBinding->pSemantic, &pEntry) );
+        VH( pEntry->Variables.AddRange(pBinding->Variables.GetData(), pBinding->Variables.GetSize()) );
+
+        // Bring the effect up to date with the values published before it was added
+        for (uint32_t j = 0; j < pBinding->Variables.GetSize(); ++ j)
+        {
+            pEntry->PublishTo(pBinding->Variables[j]);
+        }
+    }
+
+lExit:
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT CParameterTable::RemoveEffect(ID3DX11Effect *pEffect)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11ParameterTable::RemoveEffect";
+    CEffect *pFX = (CEffect*) pEffect;
+    uint32_t effectIndex = (uint32_t) -1;
+
+    VERIFYPARAMETER(pEffect != nullptr);
+
+    for (uint32_t i = 0; i < m_Effects.GetSize(); ++ i)
+    {
+        if (m_Effects[i] == pFX)
+        {
+            effectIndex = i;
+            break;
+        }
+    }
+
+    if (effectIndex == (uint32_t) -1)
+    {
+        DPF(0, "%s: The effect was not added to this table", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    for (uint32_t i = 0; i < m_Entries.GetSize(); ++ i)
+    {
+        CEffectVector<SGlobalVariable*> &variables = m_Entries[i]->Variables;
+        for (uint32_t j = variables.GetSize(); j > 0; -- j)
+        {
+            if (variables[j - 1]->pEffect == pFX)
+            {
+                variables.QuickDelete(j - 1);
+            }
+        }
+    }
+
+    m_Effects.QuickDelete(effectIndex);
+    pFX->Release();
+
+lExit:
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT CParameterTable::SetRawValue(LPCSTR Semantic, const void *pData, uint32_t ByteCount)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11ParameterTable::SetRawValue";
+    SParameterTableEntry *pEntry;
+
+    VERIFYPARAMETER(Semantic != nullptr && pData != nullptr && ByteCount > 0);
+
+    VH( FindOrAddEntry(Semantic, &pEntry) );
+
+    pEntry->Value.Clear();
+    VH( pEntry->Value.AddRange((const uint8_t*) pData, ByteCount) );
+
+    for (uint32_t i = 0; i < pEntry->Variables.GetSize(); ++ i)
+    {
+        pEntry->PublishTo(pEntry->Variables[i]);
+    }
+
+lExit:
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT CParameterTable::SetResource(LPCSTR Semantic, ID3D11ShaderResourceView *pResource)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11ParameterTable::SetResource";
+    SParameterTableEntry *pEntry;
+
+    VERIFYPARAMETER(Semantic != nullptr);
+
+    VH( FindOrAddEntry(Semantic, &pEntry) );
+
+    SAFE_ADDREF(pResource);
+    SAFE_RELEASE(pEntry->pResource);
+    pEntry->pResource = pResource;
+    pEntry->HasResource = true;
+
+    for (uint32_t i = 0; i < pEntry->Variables.GetSize(); ++ i)
+    {
+        pEntry->PublishTo(pEntry->Variables[i]);
+    }
+
+lExit:
+    return hr;
+}
+
+}
+
+//--------------------------------------------------------------------------------------
+
+using namespace D3DX11Effects;
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11CreateParameterTable(ID3DX11ParameterTable **ppTable)
+{
+    HRESULT hr = S_OK;
+
+    if (!ppTable)
+        return E_INVALIDARG;
+
+    VN( *ppTable = new CParameterTable );
+
+lExit:
+    return hr;
+}
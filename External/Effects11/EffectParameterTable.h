@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// File: EffectParameterTable.h
+//
+// Direct3D 11 Effects table of global parameters published by semantic
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace D3DX11Effects
+{
+
+// One semantic of the table: the variables of every added effect that carry it, and the
+// last published value, which is also written to the variables of effects added later
+struct SParameterTableEntry : public SSemanticBinding
+{
+    CEffectVector<uint8_t>      Value;
+    ID3D11ShaderResourceView    *pResource;
+    bool                        HasResource;
+
+    SParameterTableEntry()
+    {
+        pResource = nullptr;
+        HasResource = false;
+    }
+
+    ~SParameterTableEntry()
+    {
+        SAFE_RELEASE(pResource);
+    }
+
+    void PublishTo(_In_ SGlobalVariable *pVariable);
+};
+
+class CParameterTable : public ID3DX11ParameterTable
+{
+protected:
+    uint32_t                                    m_RefCount;
+    CEffectVector<CEffect*>                     m_Effects;      // AddRef'ed
+    CEffectVectorOwner<SParameterTableEntry>    m_Entries;
+
+    SParameterTableEntry *FindEntry(_In_z_ LPCSTR pSemantic);
+    HRESULT FindOrAddEntry(_In_z_ LPCSTR pSemantic, _Outptr_ SParameterTableEntry **ppEntry);
+
+public:
+    CParameterTable();
+    virtual ~CParameterTable();
+
+    // IUnknown
+    STDMETHOD(QueryInterface)(REFIID iid, _COM_Outptr_ LPVOID *ppv) override;
+    STDMETHOD_(ULONG, AddRef)() override;
+    STDMETHOD_(ULONG, Release)() override;
+
+    // ID3DX11ParameterTable
+    STDMETHOD(AddEffect)(_In_ ID3DX11Effect *pEffect) override;
+    STDMETHOD(RemoveEffect)(_In_ ID3DX11Effect *pEffect) override;
+    STDMETHOD(SetRawValue)(_In_z_ LPCSTR Semantic, _In_reads_bytes_(ByteCount) const void *pData, _In_ uint32_t ByteCount) override;
+    STDMETHOD(SetResource)(_In_z_ LPCSTR Semantic, _In_opt_ ID3D11ShaderResourceView *pResource) override;
+};
+
+}
@@ -86,21 +86,133 @@ ID3DX11EffectVariable * GetAnnotationByNameHelper(const char *pClassName, LPCSTR
 // Effect routines to pool interfaces
 //////////////////////////////////////////////////////////////////////////
 
+static SInterfacePoolKey MakeTypeInterfaceKey(_In_ SType *pType)
+{
+    SInterfacePoolKey key;
+
+    ZeroMemory(&key, sizeof(key));
+    key.pType = pType;
+    return key;
+}
+
+static SInterfacePoolKey MakeMemberInterfaceKey(_In_ void *pTopLevelEntity, _In_ const SVariable *pMember,
+                                                _In_ void *pData, _In_ bool IsSingleElement)
+{
+    SInterfacePoolKey key;
+
+    ZeroMemory(&key, sizeof(key));
+    key.pTopLevelEntity = pTopLevelEntity;
+    key.pData = pData;
+    key.pType = pMember->pType;
+    key.pName = pMember->pName;
+    key.pSemantic = pMember->pSemantic;
+    key.IsSingleElement = IsSingleElement;
+    return key;
+}
+
+static HRESULT AddToInterfacePoolIndex(_Inout_ CInterfacePoolTable &Index, _In_ SInterfacePoolKey Key, _In_ uint32_t Position)
+{
+    HRESULT hr = S_OK;
+
+    Key.Index = Position;
+    VH( Index.AutoGrow() );
+    VH( Index.AddValueWithHash(Key, Key.ComputeHash()) );
+
+lExit:
+    return hr;
+}
+
+void CEffect::InvalidateInterfacePoolIndices()
+{
+    m_TypeInterfaceIndex.Cleanup();
+    m_MemberInterfaceIndex.Cleanup();
+    m_IndexedTypeInterfaces = 0;
+    m_IndexedMemberInterfaces = 0;
+}
+
+// Indexes the interfaces added to the master lists since the last lookup (all of them, after a load,
+// a clone or InvalidateInterfacePoolIndices)
+HRESULT CEffect::IndexInterfacePools()
+{
+    HRESULT hr = S_OK;
+
+    for (; m_IndexedTypeInterfaces < m_pTypeInterfaces.GetSize(); ++ m_IndexedTypeInterfaces)
+    {
+        SSingleElementType *pType = m_pTypeInterfaces[m_IndexedTypeInterfaces];
+
+        VH( AddToInterfacePoolIndex(m_TypeInterfaceIndex, MakeTypeInterfaceKey(pType->pType), m_IndexedTypeInterfaces) );
+    }
+
+    for (; m_IndexedMemberInterfaces < m_pMemberInterfaces.GetSize(); ++ m_IndexedMemberInterfaces)
+    {
+        SMember *pMember = m_pMemberInterfaces[m_IndexedMemberInterfaces];
+
+        if (nullptr == pMember)
+            continue;
+
+        VH( AddToInterfacePoolIndex(m_MemberInterfaceIndex,
+                                    MakeMemberInterfaceKey(pMember->pTopLevelEntity, pMember, pMember->Data.pGeneric, pMember->IsSingleElement != 0),
+                                    m_IndexedMemberInterfaces) );
+    }
+
+lExit:
+    if (FAILED(hr))
+    {
+        InvalidateInterfacePoolIndices();
+    }
+    return hr;
+}
+
 ID3DX11EffectType * CEffect::CreatePooledSingleElementTypeInterface(_In_ SType *pType)
 {
+    CEffectAllocatorScope allocatorScope(m_pAllocator);
+    ID3DX11EffectType *pInterface;
+
+    AcquireSRWLockExclusive(&m_InterfacePoolLock);
+    pInterface = FindOrCreateTypeInterface(pType);
+    ReleaseSRWLockExclusive(&m_InterfacePoolLock);
+
+    return pInterface;
+}
+
+// Create a member variable (via GetMemberBy* or GetElement)
+_Use_decl_annotations_
+ID3DX11EffectVariable * CEffect::CreatePooledVariableMemberInterface(TTopLevelVariable<ID3DX11EffectVariable> *pTopLevelEntity,
+                                                                     const SVariable *pMember,
+                                                                     const UDataPointer Data, bool IsSingleElement, uint32_t Index)
+{
+    CEffectAllocatorScope allocatorScope(m_pAllocator);
+    ID3DX11EffectVariable *pInterface;
+
+    AcquireSRWLockExclusive(&m_InterfacePoolLock);
+    pInterface = FindOrCreateMemberInterface(pTopLevelEntity, pMember, Data, IsSingleElement, Index);
+    ReleaseSRWLockExclusive(&m_InterfacePoolLock);
+
+    return pInterface;
+}
+
+ID3DX11EffectType * CEffect::FindOrCreateTypeInterface(_In_ SType *pType)
+{
+    SInterfacePoolKey key = MakeTypeInterfaceKey(pType);
+    CInterfacePoolTable::CIterator iter;
+
     if (IsOptimized())
     {
         DPF(0, "ID3DX11Effect: Cannot create new type interfaces since the effect has been Optimize()'ed");
         return &g_InvalidType;
     }
 
-    for (size_t i = 0; i < m_pTypeInterfaces.GetSize(); ++ i)
+    if (FAILED(IndexInterfacePools()))
     {
-        if (m_pTypeInterfaces[i]->pType == pType)
-        {
-            return (SSingleElementType*)m_pTypeInterfaces[i];
-        }
+        DPF(0, "ID3DX11Effect: Out of memory while trying to create new type interface");
+        return &g_InvalidType;
+    }
+
+    if (m_IndexedTypeInterfaces > 0 && SUCCEEDED(m_TypeInterfaceIndex.FindValueWithHash(key, key.ComputeHash(), &iter)))
+    {
+        return (SSingleElementType*)m_pTypeInterfaces[iter.GetData().Index];
     }
+
     SSingleElementType *pNewType;
     if (nullptr == (pNewType = new SSingleElementType))
     {
@@ -109,18 +221,24 @@ ID3DX11EffectType * CEffect::CreatePooledSingleElementTypeInterface(_In_ SType *
     }
 
     pNewType->pType = pType;
-    m_pTypeInterfaces.Add(pNewType);
+    if (FAILED(m_pTypeInterfaces.Add(pNewType)))
+    {
+        SAFE_DELETE(pNewType);
+        DPF(0, "ID3DX11Effect: Out of memory while trying to create new type interface");
+        return &g_InvalidType;
+    }
 
     return pNewType;
 }
 
-// Create a member variable (via GetMemberBy* or GetElement)
 _Use_decl_annotations_
-ID3DX11EffectVariable * CEffect::CreatePooledVariableMemberInterface(TTopLevelVariable<ID3DX11EffectVariable> *pTopLevelEntity,
-                                                                     const SVariable *pMember,
-                                                                     const UDataPointer Data, bool IsSingleElement, uint32_t Index)
+ID3DX11EffectVariable * CEffect::FindOrCreateMemberInterface(TTopLevelVariable<ID3DX11EffectVariable> *pTopLevelEntity,
+                                                             const SVariable *pMember,
+                                                             const UDataPointer Data, bool IsSingleElement, uint32_t Index)
 {
     bool IsAnnotation;
+    SInterfacePoolKey key = MakeMemberInterfaceKey(pTopLevelEntity, pMember, Data.pGeneric, IsSingleElement);
+    CInterfacePoolTable::CIterator iter;
 
     if (IsOptimized())
     {
@@ -128,17 +246,15 @@ ID3DX11EffectVariable * CEffect::CreatePooledVariableMemberInterface(TTopLevelVa
         return &g_InvalidScalarVariable;
     }
 
-    for (size_t i = 0; i < m_pMemberInterfaces.GetSize(); ++ i)
+    if (FAILED(IndexInterfacePools()))
     {
-        if (m_pMemberInterfaces[i]->pType == pMember->pType && 
-            m_pMemberInterfaces[i]->pName == pMember->pName &&
-            m_pMemberInterfaces[i]->pSemantic == pMember->pSemantic &&
-            m_pMemberInterfaces[i]->Data.pGeneric == Data.pGeneric &&
-            m_pMemberInterfaces[i]->IsSingleElement == (uint32_t)IsSingleElement &&
-            ((SMember*)m_pMemberInterfaces[i])->pTopLevelEntity == pTopLevelEntity)
-        {
-            return (ID3DX11EffectVariable *) m_pMemberInterfaces[i];
-        }
+        DPF(0, "ID3DX11Effect: Out of memory while trying to create new member variable interface");
+        return &g_InvalidScalarVariable;
+    }
+
+    if (m_IndexedMemberInterfaces > 0 && SUCCEEDED(m_MemberInterfaceIndex.FindValueWithHash(key, key.ComputeHash(), &iter)))
+    {
+        return (ID3DX11EffectVariable *) m_pMemberInterfaces[iter.GetData().Index];
     }
 
     // is this annotation or runtime data?
@@ -149,16 +265,16 @@ ID3DX11EffectVariable * CEffect::CreatePooledVariableMemberInterface(TTopLevelVa
     }
     else
     {
-        // if the heap is empty, we are still loading the Effect, and thus creating a member for a variable initializer
-        // ex. Interface myInt = myClassArray[2];
-        if( pTopLevelEntity->pEffect->m_Heap.GetSize() > 0 )
+        // variables are placed in the effect heap as they are loaded, so this also holds for
+        // members created for variable initializers (ex. Interface myInt = myClassArray[2];)
+        assert( pTopLevelEntity->pEffect->IsRuntimeData(pTopLevelEntity) );
+        if (!pTopLevelEntity->pType->IsObjectType(EOT_String))
         {
-            assert( pTopLevelEntity->pEffect->IsRuntimeData(pTopLevelEntity) );
-            if (!pTopLevelEntity->pType->IsObjectType(EOT_String))
-            {
-                // strings are funny; their data is reflection data, so ignore those
-                assert( pTopLevelEntity->pEffect->IsRuntimeData(Data.pGeneric) );
-            }
+            // strings are funny; their data is reflection data, so ignore those
+            // shared CBs keep their data in the CB registry
+            assert( pTopLevelEntity->pEffect->IsRuntimeData(Data.pGeneric) ||
+                    (pTopLevelEntity->pType->BelongsInConstantBuffer() &&
+                     nullptr != ((SGlobalVariable*)pTopLevelEntity)->pCB->pRuntime->pSharedCB) );
         }
         IsAnnotation = false;
     }
@@ -1045,9 +1161,9 @@ ID3DX11EffectConstantBuffer * SConstantBuffer::AsConstantBuffer()
 
 HRESULT SConstantBuffer::GetDesc(_Out_ D3DX11_EFFECT_TYPE_DESC *pDesc)
 {
-    pDesc->TypeName = IsTBuffer ? "tbuffer" : "cbuffer";
+    pDesc->TypeName = pRuntime->IsTBuffer ? "tbuffer" : "cbuffer";
     pDesc->Class = D3D_SVC_OBJECT;
-    pDesc->Type = IsTBuffer ? D3D_SVT_TBUFFER : D3D_SVT_CBUFFER;
+    pDesc->Type = pRuntime->IsTBuffer ? D3D_SVT_TBUFFER : D3D_SVT_CBUFFER;
 
     pDesc->Elements = 0;
     pDesc->Members = VariableCount;
@@ -1061,7 +1177,7 @@ HRESULT SConstantBuffer::GetDesc(_Out_ D3DX11_EFFECT_TYPE_DESC *pDesc)
         pDesc->PackedSize += pVariables[i].pType->PackedSize;
     }
 
-    pDesc->UnpackedSize = Size;
+    pDesc->UnpackedSize = pRuntime->Size;
     assert(pDesc->UnpackedSize >= pDesc->PackedSize);
 
     pDesc->Stride = AlignToPowerOf2(pDesc->UnpackedSize, SType::c_RegisterSize);
@@ -1134,7 +1250,7 @@ HRESULT SConstantBuffer::SetRawValue(const void *pData, uint32_t Offset, uint32_
 
     if ((Offset + Count < Offset) ||
         (Count + (uint8_t*)pData < (uint8_t*)pData) ||
-        ((Offset + Count) > Size))
+        ((Offset + Count) > pRuntime->Size))
     {
         // overflow of some kind
         DPF(0, "%s: Invalid range specified", pFuncName);
@@ -1152,10 +1268,10 @@ HRESULT SConstantBuffer::SetRawValue(const void *pData, uint32_t Offset, uint32_
     }
     else
     {
-        IsDirty = true;
+        pRuntime->SetDirty();
     }
 
-    memcpy(pBackingStore + Offset, pData, Count);
+    memcpy(pRuntime->pBackingStore + Offset, pData, Count);
 
 lExit:
     return hr;
@@ -1173,7 +1289,7 @@ HRESULT SConstantBuffer::GetRawValue(void *pData, uint32_t Offset, uint32_t Coun
 
     if ((Offset + Count < Offset) ||
         (Count + (uint8_t*)pData < (uint8_t*)pData) ||
-        ((Offset + Count) > Size))
+        ((Offset + Count) > pRuntime->Size))
     {
         // overflow of some kind
         DPF(0, "%s: Invalid range specified", pFuncName);
@@ -1181,7 +1297,7 @@ HRESULT SConstantBuffer::GetRawValue(void *pData, uint32_t Offset, uint32_t Coun
     }
 #endif
 
-    memcpy(pData, pBackingStore + Offset, Count);
+    memcpy(pData, pRuntime->pBackingStore + Offset, Count);
 
 lExit:
     return hr;
@@ -1197,7 +1313,7 @@ HRESULT SConstantBuffer::SetConstantBuffer(_In_ ID3D11Buffer *pConstantBuffer)
     HRESULT hr = S_OK;
     static LPCSTR pFuncName = "ID3DX11EffectConstantBuffer::SetConstantBuffer";
 
-    if (IsTBuffer)
+    if (pRuntime->IsTBuffer)
     {
         DPF(0, "%s: This is a texture buffer; use SetTextureBuffer instead", pFuncName);
         VH(D3DERR_INVALIDCALL);
@@ -1211,15 +1327,13 @@ HRESULT SConstantBuffer::SetConstantBuffer(_In_ ID3D11Buffer *pConstantBuffer)
         // Save original cbuffer in case we UndoSet
         assert( pMemberData[0].Type == MDT_Buffer );
         VB( pMemberData[0].Data.pD3DEffectsManagedConstantBuffer == nullptr );
-        pMemberData[0].Data.pD3DEffectsManagedConstantBuffer = pD3DObject;
-        pD3DObject = nullptr;
+        pMemberData[0].Data.pD3DEffectsManagedConstantBuffer = pRuntime->pD3DObject;
+        pRuntime->pD3DObject = nullptr;
         IsUserManaged = true;
-        IsNonUpdatable = true;
+        pRuntime->IsNonUpdatable = true;
     }
 
-    SAFE_ADDREF( pConstantBuffer );
-    SAFE_RELEASE( pD3DObject );
-    pD3DObject = pConstantBuffer;
+    BindObject( &pRuntime->pD3DObject, &IsWeakReference, pConstantBuffer, pEffect->UsesWeakReferences() );
 
 lExit:
     return hr;
@@ -1232,15 +1346,15 @@ HRESULT SConstantBuffer::GetConstantBuffer(_Outptr_ ID3D11Buffer **ppConstantBuf
 
     VERIFYPARAMETER(ppConstantBuffer);
 
-    if (IsTBuffer)
+    if (pRuntime->IsTBuffer)
     {
         DPF(0, "%s: This is a texture buffer; use GetTextureBuffer instead", pFuncName);
         VH(D3DERR_INVALIDCALL);
     }
 
-    assert( pD3DObject );
-    _Analysis_assume_( pD3DObject );
-    *ppConstantBuffer = pD3DObject;
+    assert( pRuntime->pD3DObject );
+    _Analysis_assume_( pRuntime->pD3DObject );
+    *ppConstantBuffer = pRuntime->pD3DObject;
     SAFE_ADDREF(*ppConstantBuffer);
 
 lExit:
@@ -1252,7 +1366,7 @@ HRESULT SConstantBuffer::UndoSetConstantBuffer()
     HRESULT hr = S_OK;
     static LPCSTR pFuncName = "ID3DX11EffectConstantBuffer::UndoSetConstantBuffer";
 
-    if (IsTBuffer)
+    if (pRuntime->IsTBuffer)
     {
         DPF(0, "%s: This is a texture buffer; use UndoSetTextureBuffer instead", pFuncName);
         VH(D3DERR_INVALIDCALL);
@@ -1267,11 +1381,15 @@ HRESULT SConstantBuffer::UndoSetConstantBuffer()
     pEffect->ReplaceCBReference(this, pMemberData[0].Data.pD3DEffectsManagedConstantBuffer);
 
     // Revert to original cbuffer
-    SAFE_RELEASE( pD3DObject );
-    pD3DObject = pMemberData[0].Data.pD3DEffectsManagedConstantBuffer;
+    if( !IsWeakReference )
+    {
+        SAFE_RELEASE( pRuntime->pD3DObject );
+    }
+    pRuntime->pD3DObject = pMemberData[0].Data.pD3DEffectsManagedConstantBuffer;
     pMemberData[0].Data.pD3DEffectsManagedConstantBuffer = nullptr;
+    IsWeakReference = false;
     IsUserManaged = false;
-    IsNonUpdatable = ClonedSingle();
+    pRuntime->IsNonUpdatable = ClonedSingle();
 
 lExit:
     return hr;
@@ -1282,7 +1400,7 @@ HRESULT SConstantBuffer::SetTextureBuffer(_In_ ID3D11ShaderResourceView *pTextur
     HRESULT hr = S_OK;
     static LPCSTR pFuncName = "ID3DX11EffectConstantBuffer::SetTextureBuffer";
 
-    if (!IsTBuffer)
+    if (!pRuntime->IsTBuffer)
     {
         DPF(0, "%s: This is a constant buffer; use SetConstantBuffer instead", pFuncName);
         VH(D3DERR_INVALIDCALL);
@@ -1293,20 +1411,19 @@ HRESULT SConstantBuffer::SetTextureBuffer(_In_ ID3D11ShaderResourceView *pTextur
         // Save original cbuffer and tbuffer in case we UndoSet
         assert( pMemberData[0].Type == MDT_Buffer );
         VB( pMemberData[0].Data.pD3DEffectsManagedConstantBuffer == nullptr );
-        pMemberData[0].Data.pD3DEffectsManagedConstantBuffer = pD3DObject;
-        pD3DObject = nullptr;
+        pMemberData[0].Data.pD3DEffectsManagedConstantBuffer = pRuntime->pD3DObject;
+        pRuntime->pD3DObject = nullptr;
         assert( pMemberData[1].Type == MDT_ShaderResourceView );
         VB( pMemberData[1].Data.pD3DEffectsManagedTextureBuffer == nullptr );
         pMemberData[1].Data.pD3DEffectsManagedTextureBuffer = TBuffer.pShaderResource;
         TBuffer.pShaderResource = nullptr;
         IsUserManaged = true;
-        IsNonUpdatable = true;
+        pRuntime->IsNonUpdatable = true;
     }
 
-    SAFE_ADDREF( pTextureBuffer );
-    SAFE_RELEASE(pD3DObject); // won't be needing this anymore...
-    SAFE_RELEASE( TBuffer.pShaderResource );
-    TBuffer.pShaderResource = pTextureBuffer;
+    SAFE_RELEASE(pRuntime->pD3DObject); // won't be needing this anymore...
+    BindObject( &TBuffer.pShaderResource, &TBuffer.IsWeakReference, pTextureBuffer, pEffect->UsesWeakReferences() );
+    TBuffer.LastModifiedTime = pEffect->GetCurrentTime();
 
 lExit:
     return hr;
@@ -1319,7 +1436,7 @@ HRESULT SConstantBuffer::GetTextureBuffer(_Outptr_ ID3D11ShaderResourceView **pp
 
     VERIFYPARAMETER(ppTextureBuffer);
 
-    if (!IsTBuffer)
+    if (!pRuntime->IsTBuffer)
     {
         DPF(0, "%s: This is a constant buffer; use GetConstantBuffer instead", pFuncName);
         VH(D3DERR_INVALIDCALL);
@@ -1339,7 +1456,7 @@ HRESULT SConstantBuffer::UndoSetTextureBuffer()
     HRESULT hr = S_OK;
     static LPCSTR pFuncName = "ID3DX11EffectConstantBuffer::UndoSetTextureBuffer";
 
-    if (!IsTBuffer)
+    if (!pRuntime->IsTBuffer)
     {
         DPF(0, "%s: This is a texture buffer; use UndoSetConstantBuffer instead", pFuncName);
         VH(D3DERR_INVALIDCALL);
@@ -1351,14 +1468,19 @@ HRESULT SConstantBuffer::UndoSetTextureBuffer()
     }
 
     // Revert to original cbuffer
-    SAFE_RELEASE( pD3DObject );
-    pD3DObject = pMemberData[0].Data.pD3DEffectsManagedConstantBuffer;
+    SAFE_RELEASE( pRuntime->pD3DObject );
+    pRuntime->pD3DObject = pMemberData[0].Data.pD3DEffectsManagedConstantBuffer;
     pMemberData[0].Data.pD3DEffectsManagedConstantBuffer = nullptr;
-    SAFE_RELEASE( TBuffer.pShaderResource );
+    if( !TBuffer.IsWeakReference )
+    {
+        SAFE_RELEASE( TBuffer.pShaderResource );
+    }
     TBuffer.pShaderResource = pMemberData[1].Data.pD3DEffectsManagedTextureBuffer;
+    TBuffer.IsWeakReference = false;
+    TBuffer.LastModifiedTime = pEffect->GetCurrentTime();
     pMemberData[1].Data.pD3DEffectsManagedTextureBuffer = nullptr;
     IsUserManaged = false;
-    IsNonUpdatable = ClonedSingle();
+    pRuntime->IsNonUpdatable = ClonedSingle();
 
 lExit:
     return hr;
@@ -1370,9 +1492,9 @@ lExit:
 
 bool SPassBlock::IsValid()
 {
-    if( HasDependencies )
-        return pEffect->ValidatePassBlock( this );
-    return InitiallyValid;
+    if( pRuntime->HasDependencies )
+        return pRuntime->pEffect->ValidatePassBlock( pRuntime );
+    return pRuntime->InitiallyValid;
 }
 
 HRESULT SPassBlock::GetDesc(_Out_ D3DX11_PASS_DESC *pDesc)
@@ -1389,30 +1511,32 @@ HRESULT SPassBlock::GetDesc(_Out_ D3DX11_PASS_DESC *pDesc)
     
     SAssignment *pAssignment;
     SAssignment *pLastAssn;
+    SShaderBlock *pVertexShaderBlock;
 
-    pEffect->IncrementTimer();
+    pRuntime->pEffect->IncrementTimer();
 
-    pAssignment = pAssignments;
-    pLastAssn = pAssignments + AssignmentCount;
+    pAssignment = pRuntime->pAssignments;
+    pLastAssn = pRuntime->pAssignments + pRuntime->AssignmentCount;
 
     for(; pAssignment < pLastAssn; pAssignment++)
     {
-        pEffect->EvaluateAssignment(pAssignment);
+        pRuntime->pEffect->EvaluateAssignment(pAssignment);
     }
 
-    if( BackingStore.pVertexShaderBlock && BackingStore.pVertexShaderBlock->pInputSignatureBlob )
+    pVertexShaderBlock = pRuntime->BackingStore.pVertexShaderBlock;
+    if( pVertexShaderBlock && pVertexShaderBlock->pDescData && pVertexShaderBlock->pDescData->pInputSignatureBlob )
     {
         // pInputSignatureBlob can be null if we're setting a nullptr VS "SetVertexShader( nullptr )"
-        pDesc->pIAInputSignature = (uint8_t*)BackingStore.pVertexShaderBlock->pInputSignatureBlob->GetBufferPointer();
-        pDesc->IAInputSignatureSize = BackingStore.pVertexShaderBlock->pInputSignatureBlob->GetBufferSize();
+        pDesc->pIAInputSignature = (uint8_t*)pVertexShaderBlock->pDescData->pInputSignatureBlob->GetBufferPointer();
+        pDesc->IAInputSignatureSize = pVertexShaderBlock->pDescData->pInputSignatureBlob->GetBufferSize();
     }
 
-    pDesc->StencilRef = BackingStore.StencilRef;
-    pDesc->SampleMask = BackingStore.SampleMask;
-    pDesc->BlendFactor[0] = BackingStore.BlendFactor[0];
-    pDesc->BlendFactor[1] = BackingStore.BlendFactor[1];
-    pDesc->BlendFactor[2] = BackingStore.BlendFactor[2];
-    pDesc->BlendFactor[3] = BackingStore.BlendFactor[3];
+    pDesc->StencilRef = pRuntime->BackingStore.StencilRef;
+    pDesc->SampleMask = pRuntime->BackingStore.SampleMask;
+    pDesc->BlendFactor[0] = pRuntime->BackingStore.BlendFactor[0];
+    pDesc->BlendFactor[1] = pRuntime->BackingStore.BlendFactor[1];
+    pDesc->BlendFactor[2] = pRuntime->BackingStore.BlendFactor[2];
+    pDesc->BlendFactor[3] = pRuntime->BackingStore.BlendFactor[3];
 
 lExit:
     return hr;
@@ -1440,39 +1564,39 @@ HRESULT SPassBlock::GetShaderDescHelper(D3DX11_PASS_SHADER_DESC *pDesc)
     LPCSTR pFuncName = nullptr;
     SShaderBlock *pShaderBlock = nullptr;
 
-    ApplyPassAssignments();
+    pRuntime->ApplyPassAssignments();
 
     switch (EShaderType)
     {
     case EOT_VertexShader:
     case EOT_VertexShader5:
         pFuncName = "ID3DX11EffectPass::GetVertexShaderDesc";
-        pShaderBlock = BackingStore.pVertexShaderBlock;
+        pShaderBlock = pRuntime->BackingStore.pVertexShaderBlock;
         break;
     case EOT_PixelShader:
     case EOT_PixelShader5:
         pFuncName = "ID3DX11EffectPass::GetPixelShaderDesc";
-        pShaderBlock = BackingStore.pPixelShaderBlock;
+        pShaderBlock = pRuntime->BackingStore.pPixelShaderBlock;
         break;
     case EOT_GeometryShader:
     case EOT_GeometryShader5:
         pFuncName = "ID3DX11EffectPass::GetGeometryShaderDesc";
-        pShaderBlock = BackingStore.pGeometryShaderBlock;
+        pShaderBlock = pRuntime->BackingStore.pGeometryShaderBlock;
         break;
     case EOT_HullShader5:
 #pragma prefast(suppress:__WARNING_UNUSED_POINTER_ASSIGNMENT, "pFuncName used in DPF")
         pFuncName = "ID3DX11EffectPass::GetHullShaderDesc";
-        pShaderBlock = BackingStore.pHullShaderBlock;
+        pShaderBlock = pRuntime->BackingStore.pHullShaderBlock;
         break;
     case EOT_DomainShader5:
 #pragma prefast(suppress:__WARNING_UNUSED_POINTER_ASSIGNMENT, "pFuncName used in DPF")
         pFuncName = "ID3DX11EffectPass::GetDomainShaderDesc";
-        pShaderBlock = BackingStore.pDomainShaderBlock;
+        pShaderBlock = pRuntime->BackingStore.pDomainShaderBlock;
         break;
     case EOT_ComputeShader5:
 #pragma prefast(suppress:__WARNING_UNUSED_POINTER_ASSIGNMENT, "pFuncName used in DPF")
         pFuncName = "ID3DX11EffectPass::GetComputeShaderDesc";
-        pShaderBlock = BackingStore.pComputeShaderBlock;
+        pShaderBlock = pRuntime->BackingStore.pComputeShaderBlock;
         break;
     default:
         assert(0);
@@ -1534,11 +1658,11 @@ HRESULT SPassBlock::GetShaderDescHelper(D3DX11_PASS_SHADER_DESC *pDesc)
         }
         else 
         {
-            VB( pEffect->IsRuntimeData(pShaderBlock) );
-            varCount = pEffect->m_VariableCount;
-            pVariables = pEffect->m_pVariables;
-            anonymousShaderCount = pEffect->m_AnonymousShaderCount;
-            pAnonymousShaders = pEffect->m_pAnonymousShaders;
+            VB( pRuntime->pEffect->IsRuntimeData(pShaderBlock) );
+            varCount = pRuntime->pEffect->m_VariableCount;
+            pVariables = pRuntime->pEffect->m_pVariables;
+            anonymousShaderCount = pRuntime->pEffect->m_AnonymousShaderCount;
+            pAnonymousShaders = pRuntime->pEffect->m_pAnonymousShaders;
         }
 
         for (i = 0; i < varCount; ++ i)
@@ -1626,15 +1750,48 @@ HRESULT SPassBlock::Apply(_In_ uint32_t Flags, _In_ ID3D11DeviceContext* pContex
     // Flags are unused, so should be 0
 
 
-    assert( pEffect->m_pContext == nullptr );
-    pEffect->m_pContext = pContext;
-    pEffect->ApplyPassBlock(this);
-    pEffect->m_pContext = nullptr;
+    assert( pRuntime->pEffect->m_pContext == nullptr );
+    pRuntime->pEffect->m_pContext = pContext;
+    pRuntime->pEffect->ApplyPassBlock(pRuntime);
+    pRuntime->pEffect->m_pContext = nullptr;
 
 lExit:
     return hr;
 }
 
+static uint64_t GetShaderIdentityHash(_In_opt_ SShaderBlock *pBlock)
+{
+    return (nullptr != pBlock && nullptr != pBlock->pDescData) ? pBlock->pDescData->IdentityHash : 0;
+}
+
+static uint64_t GetStateIdentityHash(_In_opt_ SBaseBlock *pBlock)
+{
+    return (nullptr != pBlock) ? pBlock->IdentityHash : 0;
+}
+
+// Only reads the hashes stored by BindToDevice and ApplyRenderStateBlock; the pass
+// assignments are not evaluated, so these are the shaders and states the pass selected
+// when it was last applied
+void SPassBlock::GetIdentity(_Out_ D3DX11_EFFECT_PASS_IDENTITY *pIdentity)
+{
+    pIdentity->VertexShaderHash = GetShaderIdentityHash(pRuntime->BackingStore.pVertexShaderBlock);
+    pIdentity->HullShaderHash = GetShaderIdentityHash(pRuntime->BackingStore.pHullShaderBlock);
+    pIdentity->DomainShaderHash = GetShaderIdentityHash(pRuntime->BackingStore.pDomainShaderBlock);
+    pIdentity->GeometryShaderHash = GetShaderIdentityHash(pRuntime->BackingStore.pGeometryShaderBlock);
+    pIdentity->PixelShaderHash = GetShaderIdentityHash(pRuntime->BackingStore.pPixelShaderBlock);
+    pIdentity->ComputeShaderHash = GetShaderIdentityHash(pRuntime->BackingStore.pComputeShaderBlock);
+    pIdentity->BlendStateHash = GetStateIdentityHash(pRuntime->BackingStore.pBlendBlock);
+    pIdentity->DepthStencilStateHash = GetStateIdentityHash(pRuntime->BackingStore.pDepthStencilBlock);
+    pIdentity->RasterizerStateHash = GetStateIdentityHash(pRuntime->BackingStore.pRasterizerBlock);
+
+    // The per-object hashes are laid out contiguously after PassHash
+    uint64_t hash = ComputeHash64((const uint8_t*) &pIdentity->VertexShaderHash, sizeof(*pIdentity) - offsetof(D3DX11_EFFECT_PASS_IDENTITY, VertexShaderHash));
+    hash = ComputeHash64((const uint8_t*) pRuntime->BackingStore.BlendFactor, sizeof(pRuntime->BackingStore.BlendFactor), hash);
+    hash = ComputeHash64((const uint8_t*) &pRuntime->BackingStore.SampleMask, sizeof(pRuntime->BackingStore.SampleMask), hash);
+    hash = ComputeHash64((const uint8_t*) &pRuntime->BackingStore.StencilRef, sizeof(pRuntime->BackingStore.StencilRef), hash);
+    pIdentity->PassHash = hash;
+}
+
 HRESULT SPassBlock::ComputeStateBlockMask(_Inout_ D3DX11_STATE_BLOCK_MASK *pStateBlockMask)
 {
     HRESULT hr = S_OK;
@@ -1642,11 +1799,11 @@ HRESULT SPassBlock::ComputeStateBlockMask(_Inout_ D3DX11_STATE_BLOCK_MASK *pStat
     // flags indicating whether the following shader types were caught by assignment checks or not
     bool bVS = false, bGS = false, bPS = false, bHS = false, bDS = false, bCS = false;
 
-    for (size_t i = 0; i < AssignmentCount; ++ i)
+    for (size_t i = 0; i < pRuntime->AssignmentCount; ++ i)
     {
         bool bShader = false;
         
-        switch (pAssignments[i].LhsType)
+        switch (pRuntime->pAssignments[i].LhsType)
         {
         case ELHS_VertexShaderBlock:
             bVS = true;
@@ -1690,52 +1847,52 @@ HRESULT SPassBlock::ComputeStateBlockMask(_Inout_ D3DX11_STATE_BLOCK_MASK *pStat
 
         if (bShader)
         {
-            for (size_t j = 0; j < pAssignments[i].MaxElements; ++ j)
+            for (size_t j = 0; j < pRuntime->pAssignments[i].MaxElements; ++ j)
             {
                 // compute state block mask for the union of ALL shaders
-                VH( pAssignments[i].Source.pShader[j].ComputeStateBlockMask(pStateBlockMask) );
+                VH( pRuntime->pAssignments[i].Source.pShader[j].ComputeStateBlockMask(pStateBlockMask) );
             }
         }
     }
 
     // go over the state block objects in case there was no corresponding assignment
-    if (nullptr != BackingStore.pRasterizerBlock)
+    if (nullptr != pRuntime->BackingStore.pRasterizerBlock)
     {
         pStateBlockMask->RSRasterizerState = 1;
     }
-    if (nullptr != BackingStore.pBlendBlock)
+    if (nullptr != pRuntime->BackingStore.pBlendBlock)
     {
         pStateBlockMask->OMBlendState = 1;
     }
-    if (nullptr != BackingStore.pDepthStencilBlock)
+    if (nullptr != pRuntime->BackingStore.pDepthStencilBlock)
     {
         pStateBlockMask->OMDepthStencilState = 1;
     }
 
     // go over the shaders only if an assignment didn't already catch them
-    if (false == bVS && nullptr != BackingStore.pVertexShaderBlock)
+    if (false == bVS && nullptr != pRuntime->BackingStore.pVertexShaderBlock)
     {
-        VH( BackingStore.pVertexShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
+        VH( pRuntime->BackingStore.pVertexShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
     }
-    if (false == bGS && nullptr != BackingStore.pGeometryShaderBlock)
+    if (false == bGS && nullptr != pRuntime->BackingStore.pGeometryShaderBlock)
     {
-        VH( BackingStore.pGeometryShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
+        VH( pRuntime->BackingStore.pGeometryShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
     }
-    if (false == bPS && nullptr != BackingStore.pPixelShaderBlock)
+    if (false == bPS && nullptr != pRuntime->BackingStore.pPixelShaderBlock)
     {
-        VH( BackingStore.pPixelShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
+        VH( pRuntime->BackingStore.pPixelShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
     }
-    if (false == bHS && nullptr != BackingStore.pHullShaderBlock)
+    if (false == bHS && nullptr != pRuntime->BackingStore.pHullShaderBlock)
     {
-        VH( BackingStore.pHullShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
+        VH( pRuntime->BackingStore.pHullShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
     }
-    if (false == bDS && nullptr != BackingStore.pDomainShaderBlock)
+    if (false == bDS && nullptr != pRuntime->BackingStore.pDomainShaderBlock)
     {
-        VH( BackingStore.pDomainShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
+        VH( pRuntime->BackingStore.pDomainShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
     }
-    if (false == bCS && nullptr != BackingStore.pComputeShaderBlock)
+    if (false == bCS && nullptr != pRuntime->BackingStore.pComputeShaderBlock)
     {
-        VH( BackingStore.pComputeShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
+        VH( pRuntime->BackingStore.pComputeShaderBlock->ComputeStateBlockMask(pStateBlockMask) );
     }
     
 lExit:
@@ -1948,7 +2105,7 @@ HRESULT CEffect::GetDesc(_Out_ D3DX11_EFFECT_DESC *pDesc)
     pDesc->GlobalVariables = m_VariableCount;
     pDesc->Techniques = m_TechniqueCount;
     pDesc->Groups = m_GroupCount;
-    pDesc->InterfaceVariables = m_InterfaceCount;
+    pDesc->InterfaceVariables = m_InterfaceCount + m_BackgroundInterfaceCount;
 
 lExit:
     return hr;    
@@ -17,6 +17,8 @@
 
 #include "pchfx.h"
 
+#include "EffectConstantBufferRing.h"
+
 namespace D3DX11Effects
 {
     // D3D11_KEEP_UNORDERED_ACCESS_VIEWS == (uint32_t)-1
@@ -38,7 +40,7 @@ bool SBaseBlock::ApplyAssignments(CEffect *pEffect)
     return bRecreate;
 }
 
-void SPassBlock::ApplyPassAssignments()
+void SPassRuntime::ApplyPassAssignments()
 {
     SAssignment *pAssignment = pAssignments;
     SAssignment *pLastAssn = pAssignments + AssignmentCount;
@@ -52,7 +54,7 @@ void SPassBlock::ApplyPassAssignments()
 }
 
 // Returns true if the shader uses global interfaces (since these interfaces can be updated through SetClassInstance)
-bool SPassBlock::CheckShaderDependencies( _In_ const SShaderBlock* pBlock )
+bool SPassRuntime::CheckShaderDependencies( _In_ const SShaderBlock* pBlock )
 {
     if( pBlock->InterfaceDepCount > 0 )
     {
@@ -73,7 +75,7 @@ bool SPassBlock::CheckShaderDependencies( _In_ const SShaderBlock* pBlock )
 // Returns true if the pass (and sets HasDependencies) if the pass sets objects whose backing stores can be updated
 #pragma warning(push)
 #pragma warning(disable: 4616 6282)
-bool SPassBlock::CheckDependencies()
+bool SPassRuntime::CheckDependencies()
 {
     if( HasDependencies )
         return true;
@@ -137,13 +139,153 @@ bool SPassBlock::CheckDependencies()
 #pragma warning(pop)
 
 // Update constant buffer contents if necessary
-inline void CheckAndUpdateCB_FX(ID3D11DeviceContext *pContext, SConstantBuffer *pCB)
+inline void CheckAndUpdateCB_FX(ID3D11DeviceContext *pContext, SConstantBufferRuntime *pCB)
 {
-    if (pCB->IsDirty && !pCB->IsNonUpdatable)
+    if (nullptr != pCB->pSharedCB)
+    {
+        // Shared CBs are uploaded once, by the first effect applying them after a change
+        SSharedConstantBuffer *pSharedCB = pCB->pSharedCB;
+        if (pSharedCB->IsDirty)
+        {
+            pContext->UpdateSubresource(pSharedCB->pD3DObject, 0, nullptr, pSharedCB->pBackingStore, pSharedCB->Size, pSharedCB->Size);
+            pSharedCB->IsDirty = false;
+        }
+        pCB->IsDirty = false;
+        return;
+    }
+
+    if ((pCB->IsDirty || pCB->IsBufferStale) && !pCB->IsNonUpdatable)
     {
         // CB out of date; rebuild it
         pContext->UpdateSubresource(pCB->pD3DObject, 0, nullptr, pCB->pBackingStore, pCB->Size, pCB->Size);
+        if (pCB->IsDirty)
+        {
+            // The copy in the CB ring (if any) is out of date as well
+            pCB->RingGeneration = 0;
+        }
         pCB->IsDirty = false;
+        pCB->IsBufferStale = false;
+    }
+}
+
+// Returns true if the contents of the CB can be sub-allocated from the CB ring
+inline bool IsRingCB_FX(_In_ const SConstantBufferRuntime *pCB)
+{
+    return !pCB->IsNonUpdatable && !pCB->IsTBuffer && nullptr == pCB->pSharedCB;
+}
+
+
+//--------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------
+
+// Makes room in the CB ring for every cbuffer the pass may upload, so that the ring is
+// never discarded between two cbuffers of the same pass while the first one is still bound.
+// The uploads of the pass form one batch, which maps the ring once (see CConstantBufferRing).
+void CEffect::ReserveCBRing(_In_ SPassRuntime *pBlock)
+{
+    SShaderBlock *pShaderBlocks[] = { pBlock->BackingStore.pVertexShaderBlock, pBlock->BackingStore.pPixelShaderBlock,
+                                      pBlock->BackingStore.pGeometryShaderBlock, pBlock->BackingStore.pHullShaderBlock,
+                                      pBlock->BackingStore.pDomainShaderBlock, pBlock->BackingStore.pComputeShaderBlock };
+    uint32_t Size = 0;
+
+    m_CBRingActive = false;
+    if (!m_pCBRing->IsContext(m_pContext))
+    {
+        // The ring is only written through the immediate context it was created for
+        return;
+    }
+
+    for (size_t i = 0; i < _countof(pShaderBlocks); ++ i)
+    {
+        if (nullptr == pShaderBlocks[i])
+            continue;
+
+        SShaderCBDependency *pCBDep = pShaderBlocks[i]->pCBDeps;
+        SShaderCBDependency *pLastCBDep = pShaderBlocks[i]->pCBDeps + pShaderBlocks[i]->CBDepCount;
+
+        for (; pCBDep<pLastCBDep; pCBDep++)
+        {
+            for (size_t j = 0; j < pCBDep->Count; ++ j)
+            {
+                if (IsRingCB_FX(pCBDep->ppFXPointers[j]))
+                {
+                    Size += pCBDep->ppFXPointers[j]->GetRingSize();
+                }
+            }
+        }
+    }
+
+    // Too big for the ring: this pass uses the per-cbuffer buffers
+    m_CBRingActive = m_pCBRing->Reserve(Size);
+}
+
+// Appends the contents of the CB to the CB ring if the ring does not already hold them.
+// Space was reserved by ReserveCBRing.
+bool CEffect::UploadCBToRing(_Inout_ SConstantBufferRuntime *pCB)
+{
+    if (!pCB->IsDirty && pCB->RingGeneration == m_pCBRing->GetGeneration())
+    {
+        return true;
+    }
+
+    if (!m_pCBRing->Append(pCB->pBackingStore, pCB->Size, pCB->GetRingSize(), &pCB->RingFirstConstant))
+    {
+        return false;
+    }
+
+    pCB->RingGeneration = m_pCBRing->GetGeneration();
+    pCB->IsBufferStale = pCB->IsBufferStale || pCB->IsDirty;
+    pCB->IsDirty = false;
+    return true;
+}
+
+// Binds a range of cbuffers, pointing each one that the ring holds at its copy there with
+// *SetConstantBuffers1. The others are bound whole with *SetConstantBuffers, since a buffer set with
+// ID3DX11EffectConstantBuffer::SetConstantBuffer can be smaller than the 16-constant granularity of
+// *SetConstantBuffers1; consecutive slots of the same kind are bound with one call.
+void CEffect::ApplyCBDependencyFromRing(_In_ SD3DShaderVTable *pVT, _In_ SShaderCBDependency *pCBDep)
+{
+    ID3D11Buffer *pRingBuffer = m_pCBRing->GetBuffer();
+    ID3D11Buffer *pBuffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+    uint32_t FirstConstant[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+    uint32_t NumConstants[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+
+    assert(pCBDep->Count <= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
+    _Analysis_assume_(pCBDep->Count <= D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
+
+    for (size_t i = 0; i < pCBDep->Count; ++ i)
+    {
+        SConstantBufferRuntime *pCB = pCBDep->ppFXPointers[i];
+
+        if (IsRingCB_FX(pCB) && UploadCBToRing(pCB))
+        {
+            pBuffers[i] = pRingBuffer;
+            FirstConstant[i] = pCB->RingFirstConstant;
+
+            // The whole cbuffer, rounded up to a multiple of 16 constants as *SetConstantBuffers1 requires
+            NumConstants[i] = pCB->GetRingSize() / (4 * sizeof(uint32_t));
+        }
+        else
+        {
+            CheckAndUpdateCB_FX(m_pContext, pCB);
+            pBuffers[i] = pCBDep->ppD3DObjects[i];
+        }
+    }
+
+    for (uint32_t first = 0, i = 1; i <= pCBDep->Count; ++ i)
+    {
+        if (i < pCBDep->Count && (pBuffers[i] == pRingBuffer) == (pBuffers[first] == pRingBuffer))
+            continue;
+
+        if (pBuffers[first] == pRingBuffer)
+        {
+            (m_pCBRing->GetContext()->*(pVT->pSetConstantBuffers1))(pCBDep->StartIndex + first, i - first, pBuffers + first, FirstConstant + first, NumConstants + first);
+        }
+        else
+        {
+            (m_pContext->*(pVT->pSetConstantBuffers))(pCBDep->StartIndex + first, i - first, pBuffers + first);
+        }
+        first = i;
     }
 }
 
@@ -152,10 +294,37 @@ inline void CheckAndUpdateCB_FX(ID3D11DeviceContext *pContext, SConstantBuffer *
 //--------------------------------------------------------------------------------------
 
 // Set the shader and dependent state (SRVs, samplers, UAVs, interfaces)
+// Returns true if none of the objects of the range changed since the range was last set
+template<class T, class D3DTYPE>
+static bool IsDependencyClean(_In_ const SShaderDependency<T*, D3DTYPE*> *pDep)
+{
+    if (0 == pDep->LastAppliedTime)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < pDep->Count; ++ i)
+    {
+        if (pDep->ppFXPointers[i]->LastModifiedTime >= pDep->LastAppliedTime)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 void CEffect::ApplyShaderBlock(_In_ SShaderBlock *pBlock)
 {
     SD3DShaderVTable *pVT = pBlock->pVT;
 
+    // If this block was the last one applied to its stage, its clean ranges are still bound
+    bool isStageCurrent = false;
+    if (m_BindingFlags & D3DX11_EFFECT_BINDING_SKIP_CLEAN_RANGES)
+    {
+        isStageCurrent = (m_pLastAppliedShaderBlocks[pVT->Stage] == pBlock);
+        m_pLastAppliedShaderBlocks[pVT->Stage] = pBlock;
+    }
+
     // Apply constant buffers first (tbuffers are done later)
     SShaderCBDependency *pCBDep = pBlock->pCBDeps;
     SShaderCBDependency *pLastCBDep = pBlock->pCBDeps + pBlock->CBDepCount;
@@ -164,9 +333,15 @@ void CEffect::ApplyShaderBlock(_In_ SShaderBlock *pBlock)
     {
         assert(pCBDep->ppFXPointers);
 
+        if (m_CBRingActive)
+        {
+            ApplyCBDependencyFromRing(pVT, pCBDep);
+            continue;
+        }
+
         for (size_t i = 0; i < pCBDep->Count; ++ i)
         {
-            CheckAndUpdateCB_FX(m_pContext, (SConstantBuffer*)pCBDep->ppFXPointers[i]);
+            CheckAndUpdateCB_FX(m_pContext, pCBDep->ppFXPointers[i]);
         }
 
         (m_pContext->*(pVT->pSetConstantBuffers))(pCBDep->StartIndex, pCBDep->Count, pCBDep->ppD3DObjects);
@@ -180,15 +355,24 @@ void CEffect::ApplyShaderBlock(_In_ SShaderBlock *pBlock)
     {
         assert(pSampDep->ppFXPointers);
 
+        // SetSampler and UndoSetSampler reset LastAppliedTime through ReplaceSamplerReference
+        bool isDirty = !isStageCurrent || 0 == pSampDep->LastAppliedTime;
+
         for (size_t i=0; i<pSampDep->Count; i++)
         {
             if ( ApplyRenderStateBlock(pSampDep->ppFXPointers[i]) )
             {
                 // If the sampler was updated, its pointer will have changed
                 pSampDep->ppD3DObjects[i] = pSampDep->ppFXPointers[i]->pD3DObject;
+                isDirty = true;
             }
         }
-        (m_pContext->*(pVT->pSetSamplers))(pSampDep->StartIndex, pSampDep->Count, pSampDep->ppD3DObjects);
+
+        if (isDirty)
+        {
+            (m_pContext->*(pVT->pSetSamplers))(pSampDep->StartIndex, pSampDep->Count, pSampDep->ppD3DObjects);
+            pSampDep->LastAppliedTime = m_LocalTimer;
+        }
     }
  
     // Set the UAVs
@@ -200,18 +384,28 @@ void CEffect::ApplyShaderBlock(_In_ SShaderBlock *pBlock)
         assert(pUAVDep->ppFXPointers != 0);
         _Analysis_assume_(pUAVDep->ppFXPointers != 0);
 
-        for (size_t i=0; i<pUAVDep->Count; i++)
+        // PS UAVs are gathered and set by ApplyOutputMergerViews, in the same call as the pass's render targets
+        bool isComputeShader = ( ESS_Compute == pVT->Stage );
+        bool isClean = isComputeShader && isStageCurrent && IsDependencyClean(pUAVDep);
+
+        if (!isClean && ESS_Pixel != pVT->Stage)
         {
-            pUAVDep->ppD3DObjects[i] = pUAVDep->ppFXPointers[i]->pUnorderedAccessView;
+            for (size_t i=0; i<pUAVDep->Count; i++)
+            {
+                pUAVDep->ppD3DObjects[i] = pUAVDep->ppFXPointers[i]->pUnorderedAccessView;
+            }
+            pUAVDep->LastAppliedTime = m_LocalTimer;
         }
 
-        if( EOT_ComputeShader5 == pBlock->GetShaderType() )
+        if( isComputeShader )
         {
-            m_pContext->CSSetUnorderedAccessViews( pUAVDep->StartIndex, pUAVDep->Count, pUAVDep->ppD3DObjects, g_pNegativeOnes );
+            if (!isClean)
+            {
+                m_pContext->CSSetUnorderedAccessViews( pUAVDep->StartIndex, pUAVDep->Count, pUAVDep->ppD3DObjects, g_pNegativeOnes );
+            }
         }
-        else
+        else if( ESS_Pixel != pVT->Stage )
         {
-            // This call could be combined with the call to set render targets if both exist in the pass
             m_pContext->OMSetRenderTargetsAndUnorderedAccessViews( D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, nullptr, nullptr, pUAVDep->StartIndex, pUAVDep->Count, pUAVDep->ppD3DObjects, g_pNegativeOnes );
         }
     }
@@ -220,12 +414,12 @@ void CEffect::ApplyShaderBlock(_In_ SShaderBlock *pBlock)
     // We keep two references to them. One is in as a standard texture dep, and that gets used for all sets
     // The other is as a part of the TBufferDeps array, which tells us to rebuild the matching CBs.
     // These two refs could be rolled into one, but then we would have to predicate on each CB or each texture.
-    SConstantBuffer **ppTB = pBlock->ppTbufDeps;
-    SConstantBuffer **ppLastTB = ppTB + pBlock->TBufferDepCount;
+    SConstantBufferRuntime **ppTB = pBlock->ppTbufDeps;
+    SConstantBufferRuntime **ppLastTB = ppTB + pBlock->TBufferDepCount;
 
     for (; ppTB<ppLastTB; ppTB++)
     {
-        CheckAndUpdateCB_FX(m_pContext, (SConstantBuffer*)*ppTB);
+        CheckAndUpdateCB_FX(m_pContext, *ppTB);
     }
 
     // Set the textures
@@ -237,12 +431,18 @@ void CEffect::ApplyShaderBlock(_In_ SShaderBlock *pBlock)
         assert(pResourceDep->ppFXPointers != 0);
         _Analysis_assume_(pResourceDep->ppFXPointers != 0);
 
+        if (isStageCurrent && IsDependencyClean(pResourceDep))
+        {
+            continue;
+        }
+
         for (size_t i=0; i<pResourceDep->Count; i++)
         {
             pResourceDep->ppD3DObjects[i] = pResourceDep->ppFXPointers[i]->pShaderResource;
         }
 
         (m_pContext->*(pVT->pSetShaderResources))(pResourceDep->StartIndex, pResourceDep->Count, pResourceDep->ppD3DObjects);
+        pResourceDep->LastAppliedTime = m_LocalTimer;
     }
 
     // Update Interface dependencies
@@ -290,6 +490,8 @@ bool CEffect::ApplyRenderStateBlock(_In_ SBaseBlock *pBlock)
 
     if (bRecreate)
     {
+        CEffectAllocatorScope allocatorScope(m_pAllocator);
+
         switch (pBlock->BlockType)
         {
         case EBT_Sampler:
@@ -300,11 +502,7 @@ bool CEffect::ApplyRenderStateBlock(_In_ SBaseBlock *pBlock)
                 _Analysis_assume_(pSBlock->pD3DObject != 0);
                 pSBlock->pD3DObject->Release();
 
-                HRESULT hr = m_pDevice->CreateSamplerState( &pSBlock->BackingStore.SamplerDesc, &pSBlock->pD3DObject );
-                if ( SUCCEEDED(hr) )
-                {
-                    SetDebugObjectName(pSBlock->pD3DObject, "D3DX11Effect");
-                }
+                m_SamplerStateCache.FindOrCreate( m_pDevice, &ID3D11Device::CreateSamplerState, &pSBlock->BackingStore.SamplerDesc, &pSBlock->pD3DObject );
             }
             break;
 
@@ -314,13 +512,7 @@ bool CEffect::ApplyRenderStateBlock(_In_ SBaseBlock *pBlock)
 
                 assert(nullptr != pDSBlock->pDSObject);
                 SAFE_RELEASE( pDSBlock->pDSObject );
-                if( SUCCEEDED( m_pDevice->CreateDepthStencilState( &pDSBlock->BackingStore, &pDSBlock->pDSObject ) ) )
-                {
-                    pDSBlock->IsValid = true;
-                    SetDebugObjectName( pDSBlock->pDSObject, "D3DX11Effect" );
-                }
-                else
-                    pDSBlock->IsValid = false;
+                pDSBlock->IsValid = SUCCEEDED( m_DepthStencilStateCache.FindOrCreate( m_pDevice, &ID3D11Device::CreateDepthStencilState, &pDSBlock->BackingStore, &pDSBlock->pDSObject ) );
             }
             break;
         
@@ -330,13 +522,7 @@ bool CEffect::ApplyRenderStateBlock(_In_ SBaseBlock *pBlock)
 
                 assert(nullptr != pBBlock->pBlendObject);
                 SAFE_RELEASE( pBBlock->pBlendObject );
-                if( SUCCEEDED( m_pDevice->CreateBlendState( &pBBlock->BackingStore, &pBBlock->pBlendObject ) ) )
-                {
-                    pBBlock->IsValid = true;
-                    SetDebugObjectName( pBBlock->pBlendObject, "D3DX11Effect" );
-                }
-                else
-                    pBBlock->IsValid = false;
+                pBBlock->IsValid = SUCCEEDED( m_BlendStateCache.FindOrCreate( m_pDevice, &ID3D11Device::CreateBlendState, &pBBlock->BackingStore, &pBBlock->pBlendObject ) );
             }
             break;
 
@@ -347,19 +533,16 @@ bool CEffect::ApplyRenderStateBlock(_In_ SBaseBlock *pBlock)
                 assert(nullptr != pRBlock->pRasterizerObject);
 
                 SAFE_RELEASE( pRBlock->pRasterizerObject );
-                if( SUCCEEDED( m_pDevice->CreateRasterizerState( &pRBlock->BackingStore, &pRBlock->pRasterizerObject ) ) )
-                {
-                    pRBlock->IsValid = true;
-                    SetDebugObjectName( pRBlock->pRasterizerObject, "D3DX11Effect" );
-                }
-                else
-                    pRBlock->IsValid = false;
+                pRBlock->IsValid = SUCCEEDED( m_RasterizerStateCache.FindOrCreate( m_pDevice, &ID3D11Device::CreateRasterizerState, &pRBlock->BackingStore, &pRBlock->pRasterizerObject ) );
             }
             break;
         
         default:
             assert(0);
         }
+
+        // The state object was replaced: hash the desc it was created from
+        pBlock->UpdateIdentityHash();
     }
 
     return bRecreate;
@@ -384,7 +567,7 @@ bool CEffect::EvaluateAssignment(_Inout_ SAssignment *pAssignment)
     {
     case ERAT_NumericVariable:
         assert(pAssignment->DependencyCount == 1);
-        if (pAssignment->pDependencies[0].pVariable->LastModifiedTime >= pAssignment->LastRecomputedTime)
+        if (*pAssignment->pDependencies[0].pLastModifiedTime >= pAssignment->LastRecomputedTime)
         {
             memcpy(pAssignment->Destination.pNumeric, pAssignment->Source.pNumeric, pAssignment->DataSize);
             bNeedUpdate = true;
@@ -393,11 +576,13 @@ bool CEffect::EvaluateAssignment(_Inout_ SAssignment *pAssignment)
 
     case ERAT_NumericVariableIndex:
         assert(pAssignment->DependencyCount == 2);
-        pVarDep0 = pAssignment->pDependencies[0].pVariable;
-        pVarDep1 = pAssignment->pDependencies[1].pVariable;
 
-        if (pVarDep0->LastModifiedTime >= pAssignment->LastRecomputedTime)
+        // The variables themselves are only read once the index changes
+        if (*pAssignment->pDependencies[0].pLastModifiedTime >= pAssignment->LastRecomputedTime)
         {
+            pVarDep0 = pAssignment->pDependencies[0].pVariable;
+            pVarDep1 = pAssignment->pDependencies[1].pVariable;
+
             m_FXLIndex = *pVarDep0->Data.pNumericDword;
 
             ValidateIndex(pVarDep1->pType->Elements);
@@ -409,7 +594,7 @@ bool CEffect::EvaluateAssignment(_Inout_ SAssignment *pAssignment)
             memcpy(pAssignment->Destination.pNumeric, pAssignment->Source.pNumeric, pAssignment->DataSize);
             bNeedUpdate = true;
         }
-        else if (pVarDep1->LastModifiedTime >= pAssignment->LastRecomputedTime)
+        else if (*pAssignment->pDependencies[1].pLastModifiedTime >= pAssignment->LastRecomputedTime)
         {
             // Only the array variable is dirty, copy the new data
             memcpy(pAssignment->Destination.pNumeric, pAssignment->Source.pNumeric, pAssignment->DataSize);
@@ -419,9 +604,9 @@ bool CEffect::EvaluateAssignment(_Inout_ SAssignment *pAssignment)
 
     case ERAT_ObjectVariableIndex:
         assert(pAssignment->DependencyCount == 1);
-        pVarDep0 = pAssignment->pDependencies[0].pVariable;
-        if (pVarDep0->LastModifiedTime >= pAssignment->LastRecomputedTime)
+        if (*pAssignment->pDependencies[0].pLastModifiedTime >= pAssignment->LastRecomputedTime)
         {
+            pVarDep0 = pAssignment->pDependencies[0].pVariable;
             m_FXLIndex = *pVarDep0->Data.pNumericDword;
             ValidateIndex(pAssignment->MaxElements);
 
@@ -471,7 +656,7 @@ bool CEffect::ValidateShaderBlock( _Inout_ SShaderBlock* pBlock )
 }
 
 // Returns false if any state in the pass is invalid
-bool CEffect::ValidatePassBlock( _Inout_ SPassBlock* pBlock )
+bool CEffect::ValidatePassBlock( _Inout_ SPassRuntime* pBlock )
 {
     pBlock->ApplyPassAssignments();
 
@@ -528,10 +713,73 @@ bool CEffect::ValidatePassBlock( _Inout_ SPassBlock* pBlock )
 }
 
 // Set all state defined in the pass
-void CEffect::ApplyPassBlock(_Inout_ SPassBlock *pBlock)
+// Render targets and PS UAVs share the output merger slots, so they are set with a single call.
+// Must be called before any shader block is applied: a texture still bound as a render target
+// would have its shader resource view unbound by the runtime when the shaders read from it.
+void CEffect::ApplyOutputMergerViews(_In_ SPassRuntime *pBlock)
 {
+    SUnorderedAccessViewDependency *pUAVDep = nullptr;
+    uint32_t UAVStartSlot = 7;
+    uint32_t UAVCount = D3D11_KEEP_UNORDERED_ACCESS_VIEWS;
+    ID3D11UnorderedAccessView *const *ppUAVs = nullptr;
+    const uint32_t *pUAVInitialCounts = nullptr;
+
+    if (nullptr != pBlock->BackingStore.pPixelShaderBlock && pBlock->BackingStore.pPixelShaderBlock->UAVDepCount > 0)
+    {
+        pUAVDep = pBlock->BackingStore.pPixelShaderBlock->pUAVDeps;
+        assert(pUAVDep->ppFXPointers != 0);
+        _Analysis_assume_(pUAVDep->ppFXPointers != 0);
+
+        // PS UAVs are always set, since setting render targets can unbind them
+        for (size_t i=0; i<pUAVDep->Count; i++)
+        {
+            pUAVDep->ppD3DObjects[i] = pUAVDep->ppFXPointers[i]->pUnorderedAccessView;
+        }
+        pUAVDep->LastAppliedTime = m_LocalTimer;
+
+        UAVStartSlot = pUAVDep->StartIndex;
+        UAVCount = pUAVDep->Count;
+        ppUAVs = pUAVDep->ppD3DObjects;
+        pUAVInitialCounts = g_pNegativeOnes;
+    }
+
+    if (nullptr != pBlock->BackingStore.pRenderTargetViews[0])
+    {
+        // Grab all render targets
+        ID3D11RenderTargetView *pRTV[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+
+        assert(pBlock->BackingStore.RenderTargetViewCount <= D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
+        _Analysis_assume_(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT >= pBlock->BackingStore.RenderTargetViewCount);
+
+        for (uint32_t i=0; i<pBlock->BackingStore.RenderTargetViewCount; i++)
+        {
+            pRTV[i] = pBlock->BackingStore.pRenderTargetViews[i]->pRenderTargetView;
+        }
+
+        m_pContext->OMSetRenderTargetsAndUnorderedAccessViews( pBlock->BackingStore.RenderTargetViewCount, pRTV, pBlock->BackingStore.pDepthStencilView->pDepthStencilView,
+                                                               UAVStartSlot, UAVCount, ppUAVs, pUAVInitialCounts );
+    }
+    else if (nullptr != pUAVDep)
+    {
+        m_pContext->OMSetRenderTargetsAndUnorderedAccessViews( D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, nullptr, nullptr, UAVStartSlot, UAVCount, ppUAVs, pUAVInitialCounts );
+    }
+}
+
+void CEffect::ApplyPassBlock(_Inout_ SPassRuntime *pBlock)
+{
+    if (m_pContext != m_pBindingContext)
+    {
+        InvalidateAppliedBindings();
+        m_pBindingContext = m_pContext;
+    }
+
     pBlock->ApplyPassAssignments();
 
+    if (nullptr != m_pCBRing)
+    {
+        ReserveCBRing(pBlock);
+    }
+
     if (nullptr != pBlock->BackingStore.pBlendBlock)
     {
         ApplyRenderStateBlock(pBlock->BackingStore.pBlendBlock);
@@ -567,22 +815,7 @@ void CEffect::ApplyPassBlock(_Inout_ SPassBlock *pBlock)
         m_pContext->RSSetState(pBlock->BackingStore.pRasterizerBlock->pRasterizerObject);
     }
 
-    if (nullptr != pBlock->BackingStore.pRenderTargetViews[0])
-    {
-        // Grab all render targets
-        ID3D11RenderTargetView *pRTV[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
-
-        assert(pBlock->BackingStore.RenderTargetViewCount <= D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT);
-        _Analysis_assume_(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT >= pBlock->BackingStore.RenderTargetViewCount);
-
-        for (uint32_t i=0; i<pBlock->BackingStore.RenderTargetViewCount; i++)
-        {
-            pRTV[i] = pBlock->BackingStore.pRenderTargetViews[i]->pRenderTargetView;
-        }
-
-        // This call could be combined with the call to set PS UAVs if both exist in the pass
-        m_pContext->OMSetRenderTargetsAndUnorderedAccessViews( pBlock->BackingStore.RenderTargetViewCount, pRTV, pBlock->BackingStore.pDepthStencilView->pDepthStencilView, 7, D3D11_KEEP_UNORDERED_ACCESS_VIEWS, nullptr, nullptr );
-    }
+    ApplyOutputMergerViews(pBlock);
 
     if (nullptr != pBlock->BackingStore.pVertexShaderBlock)
     {
@@ -637,6 +870,92 @@ void CEffect::ApplyPassBlock(_Inout_ SPassBlock *pBlock)
 #endif
         ApplyShaderBlock(pBlock->BackingStore.pComputeShaderBlock);
     }
+
+    if (m_CBRingActive)
+    {
+        // The pass's draws read the ring, which must not be mapped by then
+        m_pCBRing->EndBatch();
+        m_CBRingActive = false;
+    }
+}
+
+// Equivalent to setting the variable through its ID3DX11EffectVariable interface, without the
+// name lookups, virtual calls and type dispatch
+_Use_decl_annotations_
+HRESULT CEffect::SetVariableByHandle(D3DX11_EFFECT_VARIABLE_HANDLE Handle, D3D_SHADER_VARIABLE_TYPE Type, const void *pData, uint32_t ByteCount)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "D3DX11EffectSetVariableByHandle";
+    SVariableHandle handle;
+    SConstantBuffer *pCB;
+    uint8_t *pDest;
+    const float *pSource = (const float*) pData;
+
+    VERIFYPARAMETER(pData != nullptr);
+
+    if (!handle.Decode(Handle) || handle.ConstantBuffer >= m_CBCount || handle.Variable >= m_VariableCount ||
+        handle.Offset + handle.GetStoreSize() > m_pCBRuntimes[handle.ConstantBuffer].Size)
+    {
+        DPF(0, "%s: Invalid handle", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    if (!handle.AcceptsType(Type))
+    {
+        DPF(0, "%s: The value's type does not match the variable's scalar type", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    if (ByteCount < handle.GetValueSize())
+    {
+        DPF(0, "%s: The value is %u bytes, %u expected", pFuncName, ByteCount, handle.GetValueSize());
+        VH( E_INVALIDARG );
+    }
+
+    pCB = &m_pCBs[handle.ConstantBuffer];
+    pDest = pCB->pRuntime->pBackingStore + handle.Offset;
+
+    // A handle of another effect may still decode to valid indices of this one; it must name
+    // a value inside the variable it was resolved from
+    if (m_pVariables[handle.Variable].pCB != pCB || pDest < m_pVariables[handle.Variable].Data.pNumeric ||
+        pDest + handle.GetStoreSize() > m_pVariables[handle.Variable].Data.pNumeric + m_pVariables[handle.Variable].pType->TotalSize)
+    {
+        DPF(0, "%s: The handle was not resolved on this effect or one of its clones", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    switch (handle.Layout)
+    {
+    case EVHL_Vector:
+        memcpy(pDest, pSource, handle.Columns * SType::c_ScalarSize);
+        break;
+
+    case EVHL_RowMajorMatrix:
+        // Registers hold the rows of the source matrix
+        for (uint32_t i = 0; i < handle.Rows; ++ i)
+        {
+            memcpy(pDest + i * SType::c_RegisterSize, pSource + i * 4, handle.Columns * SType::c_ScalarSize);
+        }
+        break;
+
+    case EVHL_ColumnMajorMatrix:
+        // Registers hold the columns of the source matrix
+        for (uint32_t i = 0; i < handle.Columns; ++ i)
+        {
+            float *pRegister = (float*)(pDest + i * SType::c_RegisterSize);
+            for (uint32_t j = 0; j < handle.Rows; ++ j)
+            {
+                pRegister[j] = pSource[j * 4 + i];
+            }
+        }
+        break;
+    }
+
+    pCB->pRuntime->SetDirty();
+    m_pVariableTimes[handle.Variable] = m_LocalTimer;
+
+lExit:
+    return hr;
 }
 
 void CEffect::IncrementTimer()
@@ -668,7 +987,7 @@ void CEffect::HandleLocalTimerRollover()
     // step 1: update variables
     for (i = 0; i < m_VariableCount; ++ i)
     {
-        m_pVariables[i].LastModifiedTime = 0;
+        m_pVariableTimes[i] = 0;
     }
 
     // step 2: update assignments on all blocks (pass, depth stencil, rasterizer, blend, sampler)
@@ -678,9 +997,11 @@ void CEffect::HandleLocalTimerRollover()
         {
             for (j = 0; j < m_pGroups[iGroup].pTechniques[i].PassCount; ++ j)
             {
-                for (k = 0; k < m_pGroups[iGroup].pTechniques[i].pPasses[j].AssignmentCount; ++ k)
+                SPassRuntime *pPass = m_pGroups[iGroup].pTechniques[i].pPasses[j].pRuntime;
+
+                for (k = 0; k < pPass->AssignmentCount; ++ k)
                 {
-                    m_pGroups[iGroup].pTechniques[i].pPasses[j].pAssignments[k].LastRecomputedTime = 0;
+                    pPass->pAssignments[k].LastRecomputedTime = 0;
                 }
             }
         }
@@ -717,6 +1038,40 @@ void CEffect::HandleLocalTimerRollover()
             m_pSamplerBlocks[i].pAssignments[j].LastRecomputedTime = 0;
         }
     }
+
+    // step 3: update shader resources, UAVs and the ranges that bind them
+    for (i = 0; i < m_ShaderResourceCount; ++ i)
+    {
+        m_pShaderResources[i].LastModifiedTime = 0;
+    }
+
+    for (i = 0; i < m_CBCount; ++ i)
+    {
+        m_pCBs[i].TBuffer.LastModifiedTime = 0;
+    }
+
+    for (i = 0; i < m_UnorderedAccessViewCount; ++ i)
+    {
+        m_pUnorderedAccessViews[i].LastModifiedTime = 0;
+    }
+
+    for (i = 0; i < m_ShaderBlockCount; ++ i)
+    {
+        for (j = 0; j < m_pShaderBlocks[i].SampDepCount; ++ j)
+        {
+            m_pShaderBlocks[i].pSampDeps[j].LastAppliedTime = 0;
+        }
+        for (j = 0; j < m_pShaderBlocks[i].ResourceDepCount; ++ j)
+        {
+            m_pShaderBlocks[i].pResourceDeps[j].LastAppliedTime = 0;
+        }
+        for (j = 0; j < m_pShaderBlocks[i].UAVDepCount; ++ j)
+        {
+            m_pShaderBlocks[i].pUAVDeps[j].LastAppliedTime = 0;
+        }
+    }
+
+    InvalidateAppliedBindings();
 }
 
 }
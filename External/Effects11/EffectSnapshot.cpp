@@ -0,0 +1,335 @@
+//--------------------------------------------------------------------------------------
+// File: EffectSnapshot.cpp
+//
+// Direct3D 11 Effects snapshots of cbuffer contents and object bindings
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#include "pchfx.h"
+
+#include "EffectSnapshot.h"
+
+namespace D3DX11Effects
+{
+
+//--------------------------------------------------------------------------------------
+// CEffect snapshots
+//--------------------------------------------------------------------------------------
+
+_Use_decl_annotations_
+HRESULT CEffect::CreateSnapshot(ID3DX11EffectConstantBuffer *const *ppConstantBuffers, uint32_t ConstantBufferCount, uint32_t Flags,
+                                ID3DX11EffectSnapshot **ppSnapshot)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "D3DX11EffectCreateSnapshot";
+    CEffectSnapshot *pSnapshot = nullptr;
+    uint32_t count = (nullptr != ppConstantBuffers) ? ConstantBufferCount : m_CBCount;
+
+    VERIFYPARAMETER(ppSnapshot != nullptr);
+
+    *ppSnapshot = nullptr;
+
+    if (0 != (Flags & ~D3DX11_EFFECT_SNAPSHOT_VALID_FLAGS))
+    {
+        DPF(0, "%s: Invalid flags (0x%x)", pFuncName, Flags);
+        VH( E_INVALIDARG );
+    }
+
+    VN( pSnapshot = new CEffectSnapshot(Flags) );
+
+    for (uint32_t i = 0; i < count; ++ i)
+    {
+        SConstantBuffer *pCB = m_pCBs + i;
+        SSnapshotConstantBuffer cb;
+
+        if (nullptr != ppConstantBuffers)
+        {
+            pCB = (SConstantBuffer*) ppConstantBuffers[i];
+            if (pCB < m_pCBs || pCB >= m_pCBs + m_CBCount)
+            {
+                DPF(0, "%s: Constant buffer %u does not belong to the effect", pFuncName, i);
+                VH( E_INVALIDARG );
+            }
+        }
+
+        if (0 == pCB->pRuntime->Size)
+            continue;
+
+        cb.Index = (uint32_t)(pCB - m_pCBs);
+        cb.Size = pCB->pRuntime->Size;
+        cb.Offset = pSnapshot->m_Data.GetSize();
+
+        VN( pSnapshot->m_Data.AddRange(cb.Size) );
+        VH( pSnapshot->m_ConstantBuffers.Add(cb) );
+    }
+
+    VH( CaptureSnapshot(pSnapshot) );
+
+    *ppSnapshot = pSnapshot;
+    pSnapshot = nullptr;
+
+lExit:
+    SAFE_RELEASE(pSnapshot);
+    return hr;
+}
+
+// Snapshots can be used with the effect they were created on and with its clones, which have the
+// same cbuffers and object variables
+_Use_decl_annotations_
+bool CEffect::IsSnapshotCompatible(CEffectSnapshot *pSnapshot)
+{
+    for (uint32_t i = 0; i < pSnapshot->m_ConstantBuffers.GetSize(); ++ i)
+    {
+        SSnapshotConstantBuffer *pCB = &pSnapshot->m_ConstantBuffers[i];
+
+        if (pCB->Index >= m_CBCount || m_pCBRuntimes[pCB->Index].Size != pCB->Size)
+            return false;
+    }
+
+    // Object counts can only be checked once bindings have been captured
+    if (0 != (pSnapshot->m_Flags & D3DX11_EFFECT_SNAPSHOT_SHADER_RESOURCES) && pSnapshot->m_ShaderResources.GetSize() > 0 &&
+        pSnapshot->m_ShaderResources.GetSize() != m_ShaderResourceCount)
+        return false;
+
+    if (0 != (pSnapshot->m_Flags & D3DX11_EFFECT_SNAPSHOT_UNORDERED_ACCESS_VIEWS) && pSnapshot->m_UnorderedAccessViews.GetSize() > 0 &&
+        pSnapshot->m_UnorderedAccessViews.GetSize() != m_UnorderedAccessViewCount)
+        return false;
+
+    return true;
+}
+
+_Use_decl_annotations_
+HRESULT CEffect::CaptureSnapshot(CEffectSnapshot *pSnapshot)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11EffectSnapshot::Capture";
+    ID3D11ShaderResourceView **ppShaderResources;
+    ID3D11UnorderedAccessView **ppUnorderedAccessViews;
+
+    if (!IsSnapshotCompatible(pSnapshot))
+    {
+        DPF(0, "%s: The effect does not have the cbuffers and variables of the snapshot", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    for (uint32_t i = 0; i < pSnapshot->m_ConstantBuffers.GetSize(); ++ i)
+    {
+        SSnapshotConstantBuffer *pCB = &pSnapshot->m_ConstantBuffers[i];
+
+        memcpy(pSnapshot->m_Data.GetData() + pCB->Offset, m_pCBRuntimes[pCB->Index].pBackingStore, pCB->Size);
+    }
+
+    pSnapshot->ReleaseObjects();
+
+    if (0 != (pSnapshot->m_Flags & D3DX11_EFFECT_SNAPSHOT_SHADER_RESOURCES) && m_ShaderResourceCount > 0)
+    {
+        VN( ppShaderResources = pSnapshot->m_ShaderResources.AddRange(m_ShaderResourceCount) );
+        for (uint32_t i = 0; i < m_ShaderResourceCount; ++ i)
+        {
+            ppShaderResources[i] = m_pShaderResources[i].pShaderResource;
+            SAFE_ADDREF(ppShaderResources[i]);
+        }
+    }
+
+    if (0 != (pSnapshot->m_Flags & D3DX11_EFFECT_SNAPSHOT_UNORDERED_ACCESS_VIEWS) && m_UnorderedAccessViewCount > 0)
+    {
+        VN( ppUnorderedAccessViews = pSnapshot->m_UnorderedAccessViews.AddRange(m_UnorderedAccessViewCount) );
+        for (uint32_t i = 0; i < m_UnorderedAccessViewCount; ++ i)
+        {
+            ppUnorderedAccessViews[i] = m_pUnorderedAccessViews[i].pUnorderedAccessView;
+            SAFE_ADDREF(ppUnorderedAccessViews[i]);
+        }
+    }
+
+lExit:
+    return hr;
+}
+
+// Only what differs from the snapshot is written, and dirtied or timestamped like the variable setters
+// do, so the next Apply uploads and rebinds only what actually changed
+_Use_decl_annotations_
+HRESULT CEffect::RestoreSnapshot(CEffectSnapshot *pSnapshot)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11EffectSnapshot::Restore";
+
+    if (!IsSnapshotCompatible(pSnapshot))
+    {
+        DPF(0, "%s: The effect does not have the cbuffers and variables of the snapshot", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    for (uint32_t i = 0; i < pSnapshot->m_ConstantBuffers.GetSize(); ++ i)
+    {
+        SSnapshotConstantBuffer *pSnapshotCB = &pSnapshot->m_ConstantBuffers[i];
+        SConstantBuffer *pCB = &m_pCBs[pSnapshotCB->Index];
+        const uint8_t *pData = pSnapshot->m_Data.GetData() + pSnapshotCB->Offset;
+
+        if (0 == memcmp(pCB->pRuntime->pBackingStore, pData, pSnapshotCB->Size))
+            continue;
+
+        // Expressions that read a variable are re-evaluated when its timestamp changes
+        for (uint32_t j = 0; j < pCB->VariableCount; ++ j)
+        {
+            SGlobalVariable *pVariable = &pCB->pVariables[j];
+            size_t offset = pVariable->Data.pNumeric - pCB->pRuntime->pBackingStore;
+
+            if (0 != memcmp(pVariable->Data.pNumeric, pData + offset, pVariable->pType->TotalSize))
+            {
+                *pVariable->pLastModifiedTime = m_LocalTimer;
+            }
+        }
+
+        memcpy(pCB->pRuntime->pBackingStore, pData, pSnapshotCB->Size);
+        pCB->pRuntime->SetDirty();
+    }
+
+    for (uint32_t i = 0; i < pSnapshot->m_ShaderResources.GetSize(); ++ i)
+    {
+        SShaderResource *pResource = &m_pShaderResources[i];
+
+        if (pResource->pShaderResource != pSnapshot->m_ShaderResources[i])
+        {
+            BindObject(&pResource->pShaderResource, &pResource->IsWeakReference, pSnapshot->m_ShaderResources[i], UsesWeakReferences());
+            pResource->LastModifiedTime = m_LocalTimer;
+        }
+    }
+
+    for (uint32_t i = 0; i < pSnapshot->m_UnorderedAccessViews.GetSize(); ++ i)
+    {
+        SUnorderedAccessView *pView = &m_pUnorderedAccessViews[i];
+
+        if (pView->pUnorderedAccessView != pSnapshot->m_UnorderedAccessViews[i])
+        {
+            BindObject(&pView->pUnorderedAccessView, &pView->IsWeakReference, pSnapshot->m_UnorderedAccessViews[i], UsesWeakReferences());
+            pView->LastModifiedTime = m_LocalTimer;
+        }
+    }
+
+lExit:
+    return hr;
+}
+
+//--------------------------------------------------------------------------------------
+// CEffectSnapshot
+//--------------------------------------------------------------------------------------
+
+CEffectSnapshot::CEffectSnapshot(_In_ uint32_t Flags)
+{
+    m_RefCount = 1;
+    m_Flags = Flags;
+}
+
+CEffectSnapshot::~CEffectSnapshot()
+{
+    ReleaseObjects();
+}
+
+void CEffectSnapshot::ReleaseObjects()
+{
+    for (uint32_t i = 0; i < m_ShaderResources.GetSize(); ++ i)
+    {
+        SAFE_RELEASE(m_ShaderResources[i]);
+    }
+    for (uint32_t i = 0; i < m_UnorderedAccessViews.GetSize(); ++ i)
+    {
+        SAFE_RELEASE(m_UnorderedAccessViews[i]);
+    }
+    m_ShaderResources.Empty();
+    m_UnorderedAccessViews.Empty();
+}
+
+_Use_decl_annotations_
+HRESULT CEffectSnapshot::QueryInterface(REFIID iid, LPVOID *ppv)
+{
+    if (nullptr == ppv)
+    {
+        DPF(0, "ID3DX11EffectSnapshot::QueryInterface: nullptr parameter");
+        return E_INVALIDARG;
+    }
+
+    *ppv = nullptr;
+    if (IsEqualIID(iid, IID_IUnknown))
+    {
+        *ppv = (IUnknown *) this;
+    }
+    else if (IsEqualIID(iid, IID_ID3DX11EffectSnapshot))
+    {
+        *ppv = (ID3DX11EffectSnapshot *) this;
+    }
+    else
+    {
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG CEffectSnapshot::AddRef()
+{
+    return (ULONG) InterlockedIncrement(&m_RefCount);
+}
+
+ULONG CEffectSnapshot::Release()
+{
+    LONG refCount = InterlockedDecrement(&m_RefCount);
+
+    if (refCount > 0)
+    {
+        return (ULONG) refCount;
+    }
+    else
+    {
+        delete this;
+    }
+
+    return 0;
+}
+
+_Use_decl_annotations_
+HRESULT CEffectSnapshot::Capture(ID3DX11Effect *pEffect)
+{
+    if (nullptr == pEffect)
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*) pEffect)->CaptureSnapshot(this);
+}
+
+_Use_decl_annotations_
+HRESULT CEffectSnapshot::Restore(ID3DX11Effect *pEffect)
+{
+    if (nullptr == pEffect)
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*) pEffect)->RestoreSnapshot(this);
+}
+
+uint32_t CEffectSnapshot::GetDataSize()
+{
+    return m_Data.GetSize();
+}
+
+}
+
+//--------------------------------------------------------------------------------------
+
+using namespace D3DX11Effects;
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11EffectCreateSnapshot(ID3DX11Effect *pEffect, ID3DX11EffectConstantBuffer *const *ppConstantBuffers,
+                                          UINT ConstantBufferCount, UINT Flags, ID3DX11EffectSnapshot **ppSnapshot)
+{
+    if (!pEffect)
+        return E_INVALIDARG;
+
+    // CEffect is the only implementation of ID3DX11Effect
+    return ((CEffect*)pEffect)->CreateSnapshot(ppConstantBuffers, ConstantBufferCount, Flags, ppSnapshot);
+}
@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// File: EffectSnapshot.h
+//
+// Direct3D 11 Effects snapshots of cbuffer contents and object bindings
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace D3DX11Effects
+{
+
+struct SSnapshotConstantBuffer
+{
+    uint32_t    Index;              // into CEffect::m_pCBs
+    uint32_t    Size;               // in bytes
+    uint32_t    Offset;             // into CEffectSnapshot::m_Data
+};
+
+class CEffectSnapshot : public ID3DX11EffectSnapshot
+{
+    friend class CEffect;
+
+protected:
+    volatile LONG                               m_RefCount;         // atomic, like the effect's
+    uint32_t                                    m_Flags;            // D3DX11_EFFECT_SNAPSHOT_* flags
+    CEffectVector<SSnapshotConstantBuffer>      m_ConstantBuffers;
+    CEffectVector<uint8_t>                      m_Data;
+    CEffectVector<ID3D11ShaderResourceView*>    m_ShaderResources;  // AddRef'ed; one per SShaderResource of the effect
+    CEffectVector<ID3D11UnorderedAccessView*>   m_UnorderedAccessViews; // AddRef'ed; one per SUnorderedAccessView
+
+    void ReleaseObjects();
+
+public:
+    CEffectSnapshot(_In_ uint32_t Flags);
+    virtual ~CEffectSnapshot();
+
+    // IUnknown
+    STDMETHOD(QueryInterface)(REFIID iid, _COM_Outptr_ LPVOID *ppv) override;
+    STDMETHOD_(ULONG, AddRef)() override;
+    STDMETHOD_(ULONG, Release)() override;
+
+    // ID3DX11EffectSnapshot
+    STDMETHOD(Capture)(_In_ ID3DX11Effect *pEffect) override;
+    STDMETHOD(Restore)(_In_ ID3DX11Effect *pEffect) override;
+    STDMETHOD_(uint32_t, GetDataSize)() override;
+};
+
+}
@@ -0,0 +1,213 @@
+//--------------------------------------------------------------------------------------
+// File: EffectStagingLog.cpp
+//
+// Direct3D 11 Effects log of variable updates staged by one thread
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#include "pchfx.h"
+
+#include "EffectStagingLog.h"
+
+namespace D3DX11Effects
+{
+
+CStagingLog::CStagingLog()
+{
+    m_RefCount = 1;
+}
+
+CStagingLog::~CStagingLog()
+{
+    Clear();
+}
+
+_Use_decl_annotations_
+HRESULT CStagingLog::QueryInterface(REFIID iid, LPVOID *ppv)
+{
+    if (nullptr == ppv)
+    {
+        DPF(0, "ID3DX11StagingLog::QueryInterface: nullptr parameter");
+        return E_INVALIDARG;
+    }
+
+    *ppv = nullptr;
+    if (IsEqualIID(iid, IID_IUnknown))
+    {
+        *ppv = (IUnknown *) this;
+    }
+    else if (IsEqualIID(iid, IID_ID3DX11StagingLog))
+    {
+        *ppv = (ID3DX11StagingLog *) this;
+    }
+    else
+    {
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG CStagingLog::AddRef()
+{
+    return ++ m_RefCount;
+}
+
+ULONG CStagingLog::Release()
+{
+    if (-- m_RefCount > 0)
+    {
+        return m_RefCount;
+    }
+    else
+    {
+        delete this;
+    }
+
+    return 0;
+}
+
+_Use_decl_annotations_
+HRESULT CStagingLog::SetVariable(ID3DX11Effect *pEffect, D3DX11_EFFECT_VARIABLE_HANDLE Handle, D3D_SHADER_VARIABLE_TYPE Type,
+                                 const void *pData, uint32_t ByteCount)
+{
+    HRESULT hr = S_OK;
+    static LPCSTR pFuncName = "ID3DX11StagingLog::SetVariable";
+    SVariableHandle handle;
+    SStagedUpdate update;
+    bool referenced;
+
+    VERIFYPARAMETER(pEffect != nullptr && pData != nullptr && ByteCount > 0);
+
+    // The rest of the handle is checked against the effect when the log is flushed
+    if (!handle.Decode(Handle) || !handle.AcceptsType(Type))
+    {
+        DPF(0, "%s: Invalid handle, or the value's type does not match the variable's scalar type", pFuncName);
+        VH( E_INVALIDARG );
+    }
+
+    // CEffect is the only implementation of ID3DX11Effect
+    update.pEffect = (CEffect*) pEffect;
+    update.Handle = Handle;
+    update.Type = Type;
+    update.Offset = m_Data.GetSize();
+    update.ByteCount = ByteCount;
+
+    // Keeps the effect alive until the update is flushed, even if the application releases it first.
+    // A log usually stages many updates for the same few effects, so each is only AddRef'ed once.
+    referenced = (m_Updates.GetSize() > 0 && m_Updates[m_Updates.GetSize() - 1].pEffect == update.pEffect);
+    for (uint32_t i = 0; i < m_Effects.GetSize() && !referenced; ++ i)
+    {
+        referenced = (m_Effects[i] == update.pEffect);
+    }
+    if (!referenced)
+    {
+        VH( m_Effects.Add(update.pEffect) );
+        update.pEffect->AddRef();
+    }
+
+    VH( m_Updates.Add(update) );
+    hr = m_Data.AddRange((const uint8_t*) pData, ByteCount);
+    if (FAILED(hr))
+    {
+        // Nothing may refer past the end of the data
+        m_Updates.Delete(m_Updates.GetSize() - 1);
+        VH( hr );
+    }
+
+lExit:
+    return hr;
+}
+
+// Updates are stored in the order they were recorded, so the last value staged for a variable wins.
+// An update that fails does not prevent the following ones from being stored.
+HRESULT CStagingLog::Flush()
+{
+    HRESULT hr = S_OK;
+
+    for (uint32_t i = 0; i < m_Updates.GetSize(); ++ i)
+    {
+        SStagedUpdate *pUpdate = &m_Updates[i];
+        HRESULT hrUpdate = pUpdate->pEffect->SetVariableByHandle(pUpdate->Handle, pUpdate->Type, &m_Data[pUpdate->Offset], pUpdate->ByteCount);
+
+        if (FAILED(hrUpdate) && SUCCEEDED(hr))
+        {
+            hr = hrUpdate;
+        }
+    }
+
+    Clear();
+
+    return hr;
+}
+
+HRESULT CStagingLog::Clear()
+{
+    for (uint32_t i = 0; i < m_Effects.GetSize(); ++ i)
+    {
+        SAFE_RELEASE(m_Effects[i]);
+    }
+
+    // Capacity is kept, so that a log recording a steady number of updates per frame stops allocating
+    m_Updates.Empty();
+    m_Data.Empty();
+    m_Effects.Empty();
+
+    return S_OK;
+}
+
+uint32_t CStagingLog::GetCount()
+{
+    return m_Updates.GetSize();
+}
+
+}
+
+//--------------------------------------------------------------------------------------
+
+using namespace D3DX11Effects;
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11CreateStagingLog(ID3DX11StagingLog **ppLog)
+{
+    HRESULT hr = S_OK;
+
+    if (!ppLog)
+        return E_INVALIDARG;
+
+    VN( *ppLog = new CStagingLog );
+
+lExit:
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11FlushStagingLogs(ID3DX11StagingLog **ppLogs, UINT LogCount)
+{
+    HRESULT hr = S_OK;
+
+    if (!ppLogs && LogCount > 0)
+        return E_INVALIDARG;
+
+    for (UINT i = 0; i < LogCount; ++ i)
+    {
+        HRESULT hrLog;
+
+        if (!ppLogs[i])
+            continue;
+
+        hrLog = ppLogs[i]->Flush();
+        if (FAILED(hrLog) && SUCCEEDED(hr))
+        {
+            hr = hrLog;
+        }
+    }
+
+    return hr;
+}
@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// File: EffectStagingLog.h
+//
+// Direct3D 11 Effects log of variable updates staged by one thread
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace D3DX11Effects
+{
+
+struct SStagedUpdate
+{
+    CEffect                         *pEffect;       // referenced through CStagingLog::m_Effects
+    D3DX11_EFFECT_VARIABLE_HANDLE   Handle;
+    D3D_SHADER_VARIABLE_TYPE        Type;
+    uint32_t                        Offset;         // into CStagingLog::m_Data
+    uint32_t                        ByteCount;
+};
+
+// Only the thread that owns a log records into it, so recording takes no lock and only
+// AddRefs the effects, which is atomic; they are only written when the log is flushed
+class CStagingLog : public ID3DX11StagingLog
+{
+protected:
+    uint32_t                        m_RefCount;
+    CEffectVector<SStagedUpdate>    m_Updates;
+    CEffectVector<uint8_t>          m_Data;
+    CEffectInlineVector<CEffect*, 4> m_Effects;     // AddRef'ed once each, until the log is flushed or cleared
+
+public:
+    CStagingLog();
+    virtual ~CStagingLog();
+
+    // IUnknown
+    STDMETHOD(QueryInterface)(REFIID iid, _COM_Outptr_ LPVOID *ppv) override;
+    STDMETHOD_(ULONG, AddRef)() override;
+    STDMETHOD_(ULONG, Release)() override;
+
+    // ID3DX11StagingLog
+    STDMETHOD(SetVariable)(_In_ ID3DX11Effect *pEffect, _In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle, _In_ D3D_SHADER_VARIABLE_TYPE Type,
+                           _In_reads_bytes_(ByteCount) const void *pData, _In_ uint32_t ByteCount) override;
+    STDMETHOD(Flush)() override;
+    STDMETHOD(Clear)() override;
+    STDMETHOD_(uint32_t, GetCount)() override;
+};
+
+}
@@ -0,0 +1,569 @@
+//--------------------------------------------------------------------------------------
+// File: EffectStateBlock.cpp
+//
+// Direct3D 11 Effects state block (capture and restore of masked context state)
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#include "pchfx.h"
+
+#include "EffectStateBlock.h"
+
+namespace D3DX11Effects
+{
+
+extern uint32_t g_pNegativeOnes[8];
+
+// Appending (-1) restores stream output targets without resetting their offsets
+static UINT g_pSOAppendOffsets[D3D11_SO_BUFFER_SLOT_COUNT] = { (UINT) -1, (UINT) -1, (UINT) -1, (UINT) -1 };
+
+// these VTables must be setup in the proper order:
+// 1) GetShader, SetShader
+// 2) Get/SetConstantBuffers
+// 3) Get/SetSamplers
+// 4) Get/SetShaderResources
+#define STAGE_STATE_VTABLE(Stage) { \
+    (void (__stdcall ID3D11DeviceContext::*)(ID3D11DeviceChild**, ID3D11ClassInstance**, UINT*)) &ID3D11DeviceContext::Stage##GetShader, \
+    (void (__stdcall ID3D11DeviceContext::*)(ID3D11DeviceChild*, ID3D11ClassInstance*const*, UINT)) &ID3D11DeviceContext::Stage##SetShader, \
+    &ID3D11DeviceContext::Stage##GetConstantBuffers, \
+    &ID3D11DeviceContext::Stage##SetConstantBuffers, \
+    &ID3D11DeviceContext::Stage##GetSamplers, \
+    &ID3D11DeviceContext::Stage##SetSamplers, \
+    &ID3D11DeviceContext::Stage##GetShaderResources, \
+    &ID3D11DeviceContext::Stage##SetShaderResources }
+
+SStageStateVTable g_svtVS = STAGE_STATE_VTABLE(VS);
+SStageStateVTable g_svtHS = STAGE_STATE_VTABLE(HS);
+SStageStateVTable g_svtDS = STAGE_STATE_VTABLE(DS);
+SStageStateVTable g_svtGS = STAGE_STATE_VTABLE(GS);
+SStageStateVTable g_svtPS = STAGE_STATE_VTABLE(PS);
+SStageStateVTable g_svtCS = STAGE_STATE_VTABLE(CS);
+
+#undef STAGE_STATE_VTABLE
+
+//--------------------------------------------------------------------------------------
+// SStageState
+//--------------------------------------------------------------------------------------
+
+SStageState::SStageState()
+{
+    pVT = nullptr;
+    IsShaderMasked = false;
+    pShader = nullptr;
+    ClassInstanceCapacity = 0;
+    ClassInstanceCount = 0;
+    ppClassInstances = nullptr;
+}
+
+SStageState::~SStageState()
+{
+    ReleaseObjects();
+    SAFE_DELETE_ARRAY(ppClassInstances);
+}
+
+_Use_decl_annotations_
+HRESULT SStageState::Initialize(SStageStateVTable *pVirtualTable, uint8_t ShaderMask, const uint8_t *pConstantBufferMask,
+                                const uint8_t *pSamplerMask, const uint8_t *pShaderResourceMask, const uint8_t *pInterfaceMask)
+{
+    HRESULT hr = S_OK;
+
+    pVT = pVirtualTable;
+
+    // The class instances are set together with the shader, so masking any interface captures the shader
+    for (uint32_t i = 0; i < D3D11_SHADER_MAX_INTERFACES; ++ i)
+    {
+        if (_IS_BIT_SET(pInterfaceMask, i))
+        {
+            ClassInstanceCapacity = i + 1;
+        }
+    }
+    IsShaderMasked = (ShaderMask != 0) || (ClassInstanceCapacity > 0);
+
+    if (ClassInstanceCapacity > 0)
+    {
+        VN( ppClassInstances = new ID3D11ClassInstance*[ClassInstanceCapacity] );
+        ZeroMemory(ppClassInstances, ClassInstanceCapacity * sizeof(ID3D11ClassInstance*));
+    }
+
+    VH( ConstantBuffers.Initialize(pConstantBufferMask, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT) );
+    VH( Samplers.Initialize(pSamplerMask, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT) );
+    VH( ShaderResources.Initialize(pShaderResourceMask, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT) );
+
+lExit:
+    return hr;
+}
+
+void SStageState::Capture(_In_ ID3D11DeviceContext *pContext)
+{
+    if (IsShaderMasked)
+    {
+        ReleaseObjects();
+
+        ClassInstanceCount = ClassInstanceCapacity;
+        (pContext->*(pVT->pGetShader))(&pShader, ppClassInstances, ClassInstanceCapacity > 0 ? &ClassInstanceCount : nullptr);
+    }
+
+    ConstantBuffers.Capture(pContext, pVT->pGetConstantBuffers);
+    Samplers.Capture(pContext, pVT->pGetSamplers);
+    ShaderResources.Capture(pContext, pVT->pGetShaderResources);
+}
+
+void SStageState::Apply(_In_ ID3D11DeviceContext *pContext)
+{
+    if (IsShaderMasked)
+    {
+        (pContext->*(pVT->pSetShader))(pShader, ppClassInstances, ClassInstanceCount);
+    }
+
+    ConstantBuffers.Apply(pContext, pVT->pSetConstantBuffers);
+    Samplers.Apply(pContext, pVT->pSetSamplers);
+    ShaderResources.Apply(pContext, pVT->pSetShaderResources);
+}
+
+void SStageState::ReleaseObjects()
+{
+    SAFE_RELEASE(pShader);
+    for (uint32_t i = 0; i < ClassInstanceCount; ++ i)
+    {
+        SAFE_RELEASE(ppClassInstances[i]);
+    }
+    ClassInstanceCount = 0;
+
+    ConstantBuffers.ReleaseObjects();
+    Samplers.ReleaseObjects();
+    ShaderResources.ReleaseObjects();
+}
+
+//--------------------------------------------------------------------------------------
+// CStateBlock
+//--------------------------------------------------------------------------------------
+
+CStateBlock::CStateBlock()
+{
+    m_RefCount = 1;
+    ZeroMemory(&m_Mask, sizeof(m_Mask));
+
+    m_PSUnorderedAccessViewStart = 0;
+    m_PSUnorderedAccessViewCount = 0;
+    ZeroMemory(m_pPSUnorderedAccessViews, sizeof(m_pPSUnorderedAccessViews));
+
+    m_pVertexBufferStrides = nullptr;
+    m_pVertexBufferOffsets = nullptr;
+    m_pIndexBuffer = nullptr;
+    m_IndexBufferFormat = DXGI_FORMAT_UNKNOWN;
+    m_IndexBufferOffset = 0;
+    m_pInputLayout = nullptr;
+    m_PrimitiveTopology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+    m_RenderTargetCount = 0;
+    ZeroMemory(m_pRenderTargetViews, sizeof(m_pRenderTargetViews));
+    m_pDepthStencilView = nullptr;
+    m_pDepthStencilState = nullptr;
+    m_StencilRef = 0;
+    m_pBlendState = nullptr;
+    ZeroMemory(m_BlendFactor, sizeof(m_BlendFactor));
+    m_SampleMask = 0xffffffff;
+
+    m_ViewportCount = 0;
+    m_ScissorRectCount = 0;
+    m_pRasterizerState = nullptr;
+
+    ZeroMemory(m_pSOTargets, sizeof(m_pSOTargets));
+
+    m_pPredicate = nullptr;
+    m_PredicateValue = FALSE;
+}
+
+CStateBlock::~CStateBlock()
+{
+    ReleaseAllDeviceObjects();
+    SAFE_DELETE_ARRAY(m_pVertexBufferStrides);
+    SAFE_DELETE_ARRAY(m_pVertexBufferOffsets);
+}
+
+HRESULT CStateBlock::Initialize(_In_ const D3DX11_STATE_BLOCK_MASK *pMask)
+{
+    HRESULT hr = S_OK;
+
+    memcpy(&m_Mask, pMask, sizeof(m_Mask));
+
+    VH( m_Stages[ES_Vertex].Initialize(&g_svtVS, pMask->VS, pMask->VSConstantBuffers, pMask->VSSamplers, pMask->VSShaderResources, pMask->VSInterfaces) );
+    VH( m_Stages[ES_Hull].Initialize(&g_svtHS, pMask->HS, pMask->HSConstantBuffers, pMask->HSSamplers, pMask->HSShaderResources, pMask->HSInterfaces) );
+    VH( m_Stages[ES_Domain].Initialize(&g_svtDS, pMask->DS, pMask->DSConstantBuffers, pMask->DSSamplers, pMask->DSShaderResources, pMask->DSInterfaces) );
+    VH( m_Stages[ES_Geometry].Initialize(&g_svtGS, pMask->GS, pMask->GSConstantBuffers, pMask->GSSamplers, pMask->GSShaderResources, pMask->GSInterfaces) );
+    VH( m_Stages[ES_Pixel].Initialize(&g_svtPS, pMask->PS, pMask->PSConstantBuffers, pMask->PSSamplers, pMask->PSShaderResources, pMask->PSInterfaces) );
+    VH( m_Stages[ES_Compute].Initialize(&g_svtCS, pMask->CS, pMask->CSConstantBuffers, pMask->CSSamplers, pMask->CSShaderResources, pMask->CSInterfaces) );
+
+    // PS UAVs are captured as the span between the lowest and highest masked slot
+    if (pMask->PSUnorderedAccessViews != 0)
+    {
+        uint32_t first = D3D11_PS_CS_UAV_REGISTER_COUNT, last = 0;
+        for (uint32_t i = 0; i < D3D11_PS_CS_UAV_REGISTER_COUNT; ++ i)
+        {
+            if (_IS_BIT_SET((&pMask->PSUnorderedAccessViews), i))
+            {
+                first = std::min(first, i);
+                last = i;
+            }
+        }
+        m_PSUnorderedAccessViewStart = first;
+        m_PSUnorderedAccessViewCount = last - first + 1;
+    }
+
+    VH( m_CSUnorderedAccessViews.Initialize(&pMask->CSUnorderedAccessViews, D3D11_PS_CS_UAV_REGISTER_COUNT) );
+
+    VH( m_VertexBuffers.Initialize(pMask->IAVertexBuffers, D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT) );
+    if (m_VertexBuffers.SlotCount > 0)
+    {
+        VN( m_pVertexBufferStrides = new UINT[m_VertexBuffers.SlotCount] );
+        VN( m_pVertexBufferOffsets = new UINT[m_VertexBuffers.SlotCount] );
+        ZeroMemory(m_pVertexBufferStrides, m_VertexBuffers.SlotCount * sizeof(UINT));
+        ZeroMemory(m_pVertexBufferOffsets, m_VertexBuffers.SlotCount * sizeof(UINT));
+    }
+
+lExit:
+    return hr;
+}
+
+_Use_decl_annotations_
+HRESULT CStateBlock::QueryInterface(REFIID iid, LPVOID *ppv)
+{
+    if (nullptr == ppv)
+    {
+        DPF(0, "ID3DX11StateBlock::QueryInterface: nullptr parameter");
+        return E_INVALIDARG;
+    }
+
+    *ppv = nullptr;
+    if (IsEqualIID(iid, IID_IUnknown))
+    {
+        *ppv = (IUnknown *) this;
+    }
+    else if (IsEqualIID(iid, IID_ID3DX11StateBlock))
+    {
+        *ppv = (ID3DX11StateBlock *) this;
+    }
+    else
+    {
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG CStateBlock::AddRef()
+{
+    return ++ m_RefCount;
+}
+
+ULONG CStateBlock::Release()
+{
+    if (-- m_RefCount > 0)
+    {
+        return m_RefCount;
+    }
+    else
+    {
+        delete this;
+    }
+
+    return 0;
+}
+
+HRESULT CStateBlock::Capture(_In_ ID3D11DeviceContext *pContext)
+{
+    if (nullptr == pContext)
+    {
+        DPF(0, "ID3DX11StateBlock::Capture: pContext must point to a valid device context");
+        return D3DERR_INVALIDCALL;
+    }
+
+    ReleaseAllDeviceObjects();
+
+    for (size_t i = 0; i < ES_Count; ++ i)
+    {
+        m_Stages[i].Capture(pContext);
+    }
+
+    m_CSUnorderedAccessViews.Capture(pContext, &ID3D11DeviceContext::CSGetUnorderedAccessViews);
+
+    // Input assembler
+    if (m_VertexBuffers.SlotCount > 0)
+    {
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < m_VertexBuffers.Ranges.GetSize(); ++ i)
+        {
+            SSlotRange &range = m_VertexBuffers.Ranges[i];
+            pContext->IAGetVertexBuffers(range.StartSlot, range.Count, m_VertexBuffers.ppObjects + offset,
+                                         m_pVertexBufferStrides + offset, m_pVertexBufferOffsets + offset);
+            offset += range.Count;
+        }
+    }
+    if (m_Mask.IAIndexBuffer)
+    {
+        pContext->IAGetIndexBuffer(&m_pIndexBuffer, &m_IndexBufferFormat, &m_IndexBufferOffset);
+    }
+    if (m_Mask.IAInputLayout)
+    {
+        pContext->IAGetInputLayout(&m_pInputLayout);
+    }
+    if (m_Mask.IAPrimitiveTopology)
+    {
+        pContext->IAGetPrimitiveTopology(&m_PrimitiveTopology);
+    }
+
+    // Output merger: render targets and PS UAVs are read back with a single call
+    if (m_Mask.OMRenderTargets || m_PSUnorderedAccessViewCount > 0)
+    {
+        pContext->OMGetRenderTargetsAndUnorderedAccessViews(m_Mask.OMRenderTargets ? D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT : 0,
+                                                            m_Mask.OMRenderTargets ? m_pRenderTargetViews : nullptr,
+                                                            m_Mask.OMRenderTargets ? &m_pDepthStencilView : nullptr,
+                                                            m_PSUnorderedAccessViewStart, m_PSUnorderedAccessViewCount,
+                                                            m_PSUnorderedAccessViewCount > 0 ? m_pPSUnorderedAccessViews : nullptr);
+        m_RenderTargetCount = 0;
+        for (uint32_t i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++ i)
+        {
+            if (nullptr != m_pRenderTargetViews[i])
+            {
+                m_RenderTargetCount = i + 1;
+            }
+        }
+    }
+    if (m_Mask.OMDepthStencilState)
+    {
+        pContext->OMGetDepthStencilState(&m_pDepthStencilState, &m_StencilRef);
+    }
+    if (m_Mask.OMBlendState)
+    {
+        pContext->OMGetBlendState(&m_pBlendState, m_BlendFactor, &m_SampleMask);
+    }
+
+    // Rasterizer
+    if (m_Mask.RSViewports)
+    {
+        m_ViewportCount = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+        pContext->RSGetViewports(&m_ViewportCount, m_Viewports);
+    }
+    if (m_Mask.RSScissorRects)
+    {
+        m_ScissorRectCount = D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+        pContext->RSGetScissorRects(&m_ScissorRectCount, m_ScissorRects);
+    }
+    if (m_Mask.RSRasterizerState)
+    {
+        pContext->RSGetState(&m_pRasterizerState);
+    }
+
+    if (m_Mask.SOBuffers)
+    {
+        pContext->SOGetTargets(D3D11_SO_BUFFER_SLOT_COUNT, m_pSOTargets);
+    }
+
+    if (m_Mask.Predication)
+    {
+        pContext->GetPredication(&m_pPredicate, &m_PredicateValue);
+    }
+
+    return S_OK;
+}
+
+HRESULT CStateBlock::Apply(_In_ ID3D11DeviceContext *pContext)
+{
+    if (nullptr == pContext)
+    {
+        DPF(0, "ID3DX11StateBlock::Apply: pContext must point to a valid device context");
+        return D3DERR_INVALIDCALL;
+    }
+
+    // Input assembler
+    if (m_VertexBuffers.SlotCount > 0)
+    {
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < m_VertexBuffers.Ranges.GetSize(); ++ i)
+        {
+            SSlotRange &range = m_VertexBuffers.Ranges[i];
+            pContext->IASetVertexBuffers(range.StartSlot, range.Count, m_VertexBuffers.ppObjects + offset,
+                                         m_pVertexBufferStrides + offset, m_pVertexBufferOffsets + offset);
+            offset += range.Count;
+        }
+    }
+    if (m_Mask.IAIndexBuffer)
+    {
+        pContext->IASetIndexBuffer(m_pIndexBuffer, m_IndexBufferFormat, m_IndexBufferOffset);
+    }
+    if (m_Mask.IAInputLayout)
+    {
+        pContext->IASetInputLayout(m_pInputLayout);
+    }
+    if (m_Mask.IAPrimitiveTopology)
+    {
+        pContext->IASetPrimitiveTopology(m_PrimitiveTopology);
+    }
+
+    // Output merger first, so that restored shader resources are not unbound by output hazards
+    if (m_Mask.OMRenderTargets || m_PSUnorderedAccessViewCount > 0)
+    {
+        uint32_t UAVStart = m_PSUnorderedAccessViewStart;
+        uint32_t UAVCount = m_PSUnorderedAccessViewCount;
+        ID3D11UnorderedAccessView **ppUAVs = m_pPSUnorderedAccessViews;
+
+        if (m_Mask.OMRenderTargets && UAVCount > 0 && UAVStart < m_RenderTargetCount)
+        {
+            // UAV slots below the last render target were shadowed by render targets at capture time
+            uint32_t skip = std::min(UAVCount, m_RenderTargetCount - UAVStart);
+            UAVStart += skip;
+            UAVCount -= skip;
+            ppUAVs += skip;
+        }
+
+        if (!m_Mask.OMRenderTargets)
+        {
+            pContext->OMSetRenderTargetsAndUnorderedAccessViews(D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL, nullptr, nullptr,
+                                                                UAVStart, UAVCount, ppUAVs, g_pNegativeOnes);
+        }
+        else if (m_PSUnorderedAccessViewCount == 0)
+        {
+            pContext->OMSetRenderTargetsAndUnorderedAccessViews(m_RenderTargetCount, m_pRenderTargetViews, m_pDepthStencilView,
+                                                                0, D3D11_KEEP_UNORDERED_ACCESS_VIEWS, nullptr, nullptr);
+        }
+        else
+        {
+            pContext->OMSetRenderTargetsAndUnorderedAccessViews(m_RenderTargetCount, m_pRenderTargetViews, m_pDepthStencilView,
+                                                                UAVStart, UAVCount, ppUAVs, g_pNegativeOnes);
+        }
+    }
+    if (m_Mask.OMDepthStencilState)
+    {
+        pContext->OMSetDepthStencilState(m_pDepthStencilState, m_StencilRef);
+    }
+    if (m_Mask.OMBlendState)
+    {
+        pContext->OMSetBlendState(m_pBlendState, m_BlendFactor, m_SampleMask);
+    }
+
+    if (m_Mask.SOBuffers)
+    {
+        pContext->SOSetTargets(D3D11_SO_BUFFER_SLOT_COUNT, m_pSOTargets, g_pSOAppendOffsets);
+    }
+
+    for (size_t i = 0; i < ES_Count; ++ i)
+    {
+        m_Stages[i].Apply(pContext);
+    }
+
+    if (m_CSUnorderedAccessViews.SlotCount > 0)
+    {
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < m_CSUnorderedAccessViews.Ranges.GetSize(); ++ i)
+        {
+            SSlotRange &range = m_CSUnorderedAccessViews.Ranges[i];
+            pContext->CSSetUnorderedAccessViews(range.StartSlot, range.Count, m_CSUnorderedAccessViews.ppObjects + offset, g_pNegativeOnes);
+            offset += range.Count;
+        }
+    }
+
+    // Rasterizer
+    if (m_Mask.RSViewports)
+    {
+        pContext->RSSetViewports(m_ViewportCount, m_Viewports);
+    }
+    if (m_Mask.RSScissorRects)
+    {
+        pContext->RSSetScissorRects(m_ScissorRectCount, m_ScissorRects);
+    }
+    if (m_Mask.RSRasterizerState)
+    {
+        pContext->RSSetState(m_pRasterizerState);
+    }
+
+    if (m_Mask.Predication)
+    {
+        pContext->SetPredication(m_pPredicate, m_PredicateValue);
+    }
+
+    return S_OK;
+}
+
+HRESULT CStateBlock::ReleaseAllDeviceObjects()
+{
+    for (size_t i = 0; i < ES_Count; ++ i)
+    {
+        m_Stages[i].ReleaseObjects();
+    }
+
+    for (size_t i = 0; i < D3D11_PS_CS_UAV_REGISTER_COUNT; ++ i)
+    {
+        SAFE_RELEASE(m_pPSUnorderedAccessViews[i]);
+    }
+    m_CSUnorderedAccessViews.ReleaseObjects();
+
+    m_VertexBuffers.ReleaseObjects();
+    SAFE_RELEASE(m_pIndexBuffer);
+    SAFE_RELEASE(m_pInputLayout);
+
+    for (size_t i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++ i)
+    {
+        SAFE_RELEASE(m_pRenderTargetViews[i]);
+    }
+    m_RenderTargetCount = 0;
+    SAFE_RELEASE(m_pDepthStencilView);
+    SAFE_RELEASE(m_pDepthStencilState);
+    SAFE_RELEASE(m_pBlendState);
+
+    SAFE_RELEASE(m_pRasterizerState);
+
+    for (size_t i = 0; i < D3D11_SO_BUFFER_SLOT_COUNT; ++ i)
+    {
+        SAFE_RELEASE(m_pSOTargets[i]);
+    }
+
+    SAFE_RELEASE(m_pPredicate);
+
+    return S_OK;
+}
+
+HRESULT CStateBlock::GetStateBlockMask(_Out_ D3DX11_STATE_BLOCK_MASK *pStateBlockMask)
+{
+    if (nullptr == pStateBlockMask)
+    {
+        DPF(0, "ID3DX11StateBlock::GetStateBlockMask: pStateBlockMask cannot be nullptr");
+        return E_INVALIDARG;
+    }
+
+    memcpy(pStateBlockMask, &m_Mask, sizeof(m_Mask));
+    return S_OK;
+}
+
+}
+
+//--------------------------------------------------------------------------------------
+
+using namespace D3DX11Effects;
+
+_Use_decl_annotations_
+HRESULT WINAPI D3DX11CreateStateBlock(const D3DX11_STATE_BLOCK_MASK *pStateBlockMask, ID3DX11StateBlock **ppStateBlock)
+{
+    HRESULT hr = S_OK;
+    CStateBlock *pStateBlock = nullptr;
+
+    if (!pStateBlockMask || !ppStateBlock)
+        return E_INVALIDARG;
+
+    *ppStateBlock = nullptr;
+
+    VN( pStateBlock = new CStateBlock );
+    VH( pStateBlock->Initialize(pStateBlockMask) );
+
+    *ppStateBlock = pStateBlock;
+    pStateBlock = nullptr;
+
+lExit:
+    SAFE_RELEASE(pStateBlock);
+    return hr;
+}
@@ -0,0 +1,233 @@
+//--------------------------------------------------------------------------------------
+// File: EffectStateBlock.h
+//
+// Direct3D 11 Effects state block (capture and restore of masked context state)
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+namespace D3DX11Effects
+{
+
+#define _IS_BIT_SET(bytes, x) ((bytes[(x) / 8] & (1 << ((x) % 8))) != 0)
+
+// A run of contiguous slots that are set in a state block mask
+struct SSlotRange
+{
+    uint32_t    StartSlot;
+    uint32_t    Count;
+};
+
+// State captured for one slot array of a pipeline stage (constant buffers, samplers, ...).
+// The ranges are computed once from the mask; ppObjects holds one entry per masked slot,
+// packed in range order, so each range is captured and restored with a single call.
+template<class D3DTYPE>
+struct SSlotArrayState
+{
+    typedef void ( __stdcall ID3D11DeviceContext::*PFNGet)(UINT StartSlot, UINT NumSlots, D3DTYPE **ppObjects);
+    typedef void ( __stdcall ID3D11DeviceContext::*PFNSet)(UINT StartSlot, UINT NumSlots, D3DTYPE *const *ppObjects);
+
+    CEffectVector<SSlotRange>   Ranges;
+    uint32_t                    SlotCount;
+    D3DTYPE                     **ppObjects;
+
+    SSlotArrayState() : SlotCount(0), ppObjects(nullptr)
+    {
+    }
+
+    ~SSlotArrayState()
+    {
+        ReleaseObjects();
+        SAFE_DELETE_ARRAY(ppObjects);
+    }
+
+    HRESULT Initialize(_In_ const uint8_t *pMask, _In_ uint32_t MaxSlots)
+    {
+        HRESULT hr = S_OK;
+        uint32_t i = 0;
+
+        while (i < MaxSlots)
+        {
+            if (!_IS_BIT_SET(pMask, i))
+            {
+                ++ i;
+                continue;
+            }
+
+            SSlotRange range;
+            range.StartSlot = i;
+            while (i < MaxSlots && _IS_BIT_SET(pMask, i))
+            {
+                ++ i;
+            }
+            range.Count = i - range.StartSlot;
+
+            VH( Ranges.Add(range) );
+            SlotCount += range.Count;
+        }
+
+        if (SlotCount > 0)
+        {
+            VN( ppObjects = new D3DTYPE*[SlotCount] );
+            ZeroMemory(ppObjects, SlotCount * sizeof(D3DTYPE*));
+        }
+
+lExit:
+        return hr;
+    }
+
+    void Capture(_In_ ID3D11DeviceContext *pContext, _In_ PFNGet pfnGet)
+    {
+        D3DTYPE **ppDest = ppObjects;
+
+        ReleaseObjects();
+        for (uint32_t i = 0; i < Ranges.GetSize(); ++ i)
+        {
+            (pContext->*pfnGet)(Ranges[i].StartSlot, Ranges[i].Count, ppDest);
+            ppDest += Ranges[i].Count;
+        }
+    }
+
+    void Apply(_In_ ID3D11DeviceContext *pContext, _In_ PFNSet pfnSet)
+    {
+        D3DTYPE **ppSource = ppObjects;
+
+        for (uint32_t i = 0; i < Ranges.GetSize(); ++ i)
+        {
+            (pContext->*pfnSet)(Ranges[i].StartSlot, Ranges[i].Count, ppSource);
+            ppSource += Ranges[i].Count;
+        }
+    }
+
+    void ReleaseObjects()
+    {
+        for (uint32_t i = 0; i < SlotCount; ++ i)
+        {
+            SAFE_RELEASE(ppObjects[i]);
+        }
+    }
+};
+
+// Context entry points for one programmable stage; see g_svtVS etc. in EffectStateBlock.cpp
+struct SStageStateVTable
+{
+    void ( __stdcall ID3D11DeviceContext::*pGetShader)(ID3D11DeviceChild **ppShader, ID3D11ClassInstance **ppClassInstances, UINT *pNumClassInstances);
+    void ( __stdcall ID3D11DeviceContext::*pSetShader)(ID3D11DeviceChild *pShader, ID3D11ClassInstance *const *ppClassInstances, UINT NumClassInstances);
+    SSlotArrayState<ID3D11Buffer>::PFNGet               pGetConstantBuffers;
+    SSlotArrayState<ID3D11Buffer>::PFNSet               pSetConstantBuffers;
+    SSlotArrayState<ID3D11SamplerState>::PFNGet         pGetSamplers;
+    SSlotArrayState<ID3D11SamplerState>::PFNSet         pSetSamplers;
+    SSlotArrayState<ID3D11ShaderResourceView>::PFNGet   pGetShaderResources;
+    SSlotArrayState<ID3D11ShaderResourceView>::PFNSet   pSetShaderResources;
+};
+
+// State captured for one programmable stage
+struct SStageState
+{
+    SStageStateVTable                           *pVT;
+
+    bool                                        IsShaderMasked;
+    ID3D11DeviceChild                           *pShader;
+    uint32_t                                    ClassInstanceCapacity;  // highest masked interface slot + 1
+    uint32_t                                    ClassInstanceCount;
+    ID3D11ClassInstance                         **ppClassInstances;
+
+    SSlotArrayState<ID3D11Buffer>               ConstantBuffers;
+    SSlotArrayState<ID3D11SamplerState>         Samplers;
+    SSlotArrayState<ID3D11ShaderResourceView>   ShaderResources;
+
+    SStageState();
+    ~SStageState();
+
+    HRESULT Initialize(_In_ SStageStateVTable *pVirtualTable, _In_ uint8_t ShaderMask, _In_ const uint8_t *pConstantBufferMask,
+                       _In_ const uint8_t *pSamplerMask, _In_ const uint8_t *pShaderResourceMask, _In_ const uint8_t *pInterfaceMask);
+
+    void Capture(_In_ ID3D11DeviceContext *pContext);
+    void Apply(_In_ ID3D11DeviceContext *pContext);
+    void ReleaseObjects();
+};
+
+class CStateBlock : public ID3DX11StateBlock
+{
+protected:
+    enum EStage
+    {
+        ES_Vertex,
+        ES_Hull,
+        ES_Domain,
+        ES_Geometry,
+        ES_Pixel,
+        ES_Compute,
+        ES_Count,
+    };
+
+    uint32_t                                    m_RefCount;
+    D3DX11_STATE_BLOCK_MASK                     m_Mask;
+
+    SStageState                                 m_Stages[ES_Count];
+
+    // PS UAVs share their slots with the render targets and can only be set as one contiguous span
+    uint32_t                                    m_PSUnorderedAccessViewStart;
+    uint32_t                                    m_PSUnorderedAccessViewCount;
+    ID3D11UnorderedAccessView                   *m_pPSUnorderedAccessViews[D3D11_PS_CS_UAV_REGISTER_COUNT];
+    SSlotArrayState<ID3D11UnorderedAccessView>  m_CSUnorderedAccessViews;
+
+    // Input assembler
+    SSlotArrayState<ID3D11Buffer>               m_VertexBuffers;
+    UINT                                        *m_pVertexBufferStrides;
+    UINT                                        *m_pVertexBufferOffsets;
+    ID3D11Buffer                                *m_pIndexBuffer;
+    DXGI_FORMAT                                 m_IndexBufferFormat;
+    UINT                                        m_IndexBufferOffset;
+    ID3D11InputLayout                           *m_pInputLayout;
+    D3D11_PRIMITIVE_TOPOLOGY                    m_PrimitiveTopology;
+
+    // Output merger
+    uint32_t                                    m_RenderTargetCount;
+    ID3D11RenderTargetView                      *m_pRenderTargetViews[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+    ID3D11DepthStencilView                      *m_pDepthStencilView;
+    ID3D11DepthStencilState                     *m_pDepthStencilState;
+    UINT                                        m_StencilRef;
+    ID3D11BlendState                            *m_pBlendState;
+    FLOAT                                       m_BlendFactor[4];
+    UINT                                        m_SampleMask;
+
+    // Rasterizer
+    UINT                                        m_ViewportCount;
+    D3D11_VIEWPORT                              m_Viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+    UINT                                        m_ScissorRectCount;
+    D3D11_RECT                                  m_ScissorRects[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+    ID3D11RasterizerState                       *m_pRasterizerState;
+
+    // Stream output
+    ID3D11Buffer                                *m_pSOTargets[D3D11_SO_BUFFER_SLOT_COUNT];
+
+    // Predication
+    ID3D11Predicate                             *m_pPredicate;
+    BOOL                                        m_PredicateValue;
+
+public:
+    CStateBlock();
+    virtual ~CStateBlock();
+
+    HRESULT Initialize(_In_ const D3DX11_STATE_BLOCK_MASK *pStateBlockMask);
+
+    // IUnknown
+    STDMETHOD(QueryInterface)(REFIID iid, _COM_Outptr_ LPVOID *ppv) override;
+    STDMETHOD_(ULONG, AddRef)() override;
+    STDMETHOD_(ULONG, Release)() override;
+
+    // ID3DX11StateBlock
+    STDMETHOD(Capture)(_In_ ID3D11DeviceContext *pContext) override;
+    STDMETHOD(Apply)(_In_ ID3D11DeviceContext *pContext) override;
+    STDMETHOD(ReleaseAllDeviceObjects)() override;
+    STDMETHOD(GetStateBlockMask)(_Out_ D3DX11_STATE_BLOCK_MASK *pStateBlockMask) override;
+};
+
+}
@@ -1215,7 +1215,7 @@ struct TTopLevelVariable : public SVariable, public IBaseInterface
 //////////////////////////////////////////////////////////////////////////
 
 template<typename IBaseInterface>
-struct TMember : public SVariable, public IBaseInterface
+struct TMember : public SVariable, public IBaseInterface, public CEffectAllocated
 {
     // Indicates that this is a single element of a containing array
     uint32_t                                    IsSingleElement : 1;
@@ -1277,7 +1277,10 @@ struct TMember : public SVariable, public IBaseInterface
             if (!pTopLevelEntity->pType->IsObjectType(EOT_String))
             {
                 // strings are funny; their data is reflection data, so ignore those
-                assert(pTopLevelEntity->pEffect->IsRuntimeData(Data.pGeneric));
+                // shared CBs keep their data in the CB registry
+                assert(pTopLevelEntity->pEffect->IsRuntimeData(Data.pGeneric) ||
+                       (pTopLevelEntity->pType->BelongsInConstantBuffer() &&
+                        nullptr != ((TGlobalVariable<ID3DX11Effect>*)pTopLevelEntity)->pCB->pRuntime->pSharedCB));
             }
             
             pDesc->Annotations = ((TGlobalVariable<ID3DX11Effect>*)pTopLevelEntity)->AnnotationCount;
@@ -1288,10 +1291,10 @@ struct TMember : public SVariable, public IBaseInterface
             {   
                 assert(pCB != 0);
                 _Analysis_assume_(pCB != 0);
-                UINT_PTR offset = Data.pNumeric - pCB->pBackingStore;
+                UINT_PTR offset = Data.pNumeric - pCB->pRuntime->pBackingStore;
                 assert(offset == (uint32_t)offset);
                 pDesc->BufferOffset = (uint32_t)offset;
-                assert(pDesc->BufferOffset >= 0 && pDesc->BufferOffset + GetTotalUnpackedSize() <= pCB->Size);
+                assert(pDesc->BufferOffset >= 0 && pDesc->BufferOffset + GetTotalUnpackedSize() <= pCB->pRuntime->Size);
             }
             else
             {
@@ -1388,7 +1391,7 @@ lExit:
 template<typename IBaseInterface>
 struct TGlobalVariable : public TVariable<TTopLevelVariable<IBaseInterface> >
 {
-    Timer           LastModifiedTime;
+    Timer           *pLastModifiedTime;     // entry in CEffect::m_pVariableTimes
 
     // if numeric, pointer to the constant buffer where this variable lives
     SConstantBuffer *pCB;
@@ -1397,7 +1400,7 @@ struct TGlobalVariable : public TVariable<TTopLevelVariable<IBaseInterface> >
     SAnnotation     *pAnnotations;
 
     TGlobalVariable() :
-        LastModifiedTime(0),
+        pLastModifiedTime(nullptr),
         pCB(nullptr),
         AnnotationCount(0),
         pAnnotations(nullptr)
@@ -1420,10 +1423,10 @@ struct TGlobalVariable : public TVariable<TTopLevelVariable<IBaseInterface> >
         {
             assert(pCB != 0);
             _Analysis_assume_(pCB != 0);
-            UINT_PTR offset = Data.pNumeric - pCB->pBackingStore;
+            UINT_PTR offset = Data.pNumeric - pCB->pRuntime->pBackingStore;
             assert(offset == (uint32_t)offset);
             pDesc->BufferOffset = (uint32_t)offset;
-            assert(pDesc->BufferOffset >= 0 && pDesc->BufferOffset + GetTotalUnpackedSize() <= pCB->Size );
+            assert(pDesc->BufferOffset >= 0 && pDesc->BufferOffset + GetTotalUnpackedSize() <= pCB->pRuntime->Size );
         }
         else
         {
@@ -1474,8 +1477,8 @@ lExit:
     {
         assert(pCB != 0);
         _Analysis_assume_(pCB != 0);
-        pCB->IsDirty = true;
-        LastModifiedTime = pEffect->GetCurrentTime();
+        pCB->pRuntime->SetDirty();
+        *pLastModifiedTime = pEffect->GetCurrentTime();
     }
 
 };
@@ -3585,10 +3588,10 @@ HRESULT TShaderResourceVariable<IBaseInterface>::SetResource(ID3D11ShaderResourc
     VH(ValidateTextureType(pResource, pType->ObjectType, pFuncName));
 #endif
 
-    // Texture variables don't need to be dirtied.
-    SAFE_ADDREF(pResource);
-    SAFE_RELEASE(Data.pShaderResource->pShaderResource);
-    Data.pShaderResource->pShaderResource = pResource;
+    // Texture variables don't need to be dirtied; the timestamp tells ApplyShaderBlock to set them again
+    BindObject(&Data.pShaderResource->pShaderResource, &Data.pShaderResource->IsWeakReference, pResource,
+               GetTopLevelEntity()->pEffect->UsesWeakReferences());
+    Data.pShaderResource->LastModifiedTime = GetTopLevelEntity()->pEffect->GetCurrentTime();
 
 lExit:
     return hr;
@@ -3630,13 +3633,13 @@ HRESULT TShaderResourceVariable<IBaseInterface>::SetResourceArray(ID3D11ShaderRe
     }
 #endif
 
-    // Texture variables don't need to be dirtied.
+    // Texture variables don't need to be dirtied; the timestamp tells ApplyShaderBlock to set them again
     for (size_t i = 0; i < Count; ++ i)
     {
         SShaderResource *pResourceBlock = Data.pShaderResource + Offset + i;
-        SAFE_ADDREF(ppResources[i]);
-        SAFE_RELEASE(pResourceBlock->pShaderResource);
-        pResourceBlock->pShaderResource = ppResources[i];
+        BindObject(&pResourceBlock->pShaderResource, &pResourceBlock->IsWeakReference, ppResources[i],
+                   GetTopLevelEntity()->pEffect->UsesWeakReferences());
+        pResourceBlock->LastModifiedTime = GetTopLevelEntity()->pEffect->GetCurrentTime();
     }
 
 lExit:
@@ -3802,10 +3805,10 @@ HRESULT TUnorderedAccessViewVariable<IBaseInterface>::SetUnorderedAccessView(ID3
     VH(ValidateTextureType(pResource, pType->ObjectType, pFuncName));
 #endif
 
-    // UAV variables don't need to be dirtied.
-    SAFE_ADDREF(pResource);
-    SAFE_RELEASE(Data.pUnorderedAccessView->pUnorderedAccessView);
-    Data.pUnorderedAccessView->pUnorderedAccessView = pResource;
+    // UAV variables don't need to be dirtied; the timestamp tells ApplyShaderBlock to set them again
+    BindObject(&Data.pUnorderedAccessView->pUnorderedAccessView, &Data.pUnorderedAccessView->IsWeakReference, pResource,
+               GetTopLevelEntity()->pEffect->UsesWeakReferences());
+    Data.pUnorderedAccessView->LastModifiedTime = GetTopLevelEntity()->pEffect->GetCurrentTime();
 
 lExit:
     return hr;
@@ -3847,13 +3850,13 @@ HRESULT TUnorderedAccessViewVariable<IBaseInterface>::SetUnorderedAccessViewArra
     }
 #endif
 
-    // Texture variables don't need to be dirtied.
+    // UAV variables don't need to be dirtied; the timestamp tells ApplyShaderBlock to set them again
     for (size_t i = 0; i < Count; ++ i)
     {
         SUnorderedAccessView *pResourceBlock = Data.pUnorderedAccessView + Offset + i;
-        SAFE_ADDREF(ppResources[i]);
-        SAFE_RELEASE(pResourceBlock->pUnorderedAccessView);
-        pResourceBlock->pUnorderedAccessView = ppResources[i];
+        BindObject(&pResourceBlock->pUnorderedAccessView, &pResourceBlock->IsWeakReference, ppResources[i],
+                   GetTopLevelEntity()->pEffect->UsesWeakReferences());
+        pResourceBlock->LastModifiedTime = GetTopLevelEntity()->pEffect->GetCurrentTime();
     }
 
 lExit:
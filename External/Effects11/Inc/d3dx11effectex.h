@@ -0,0 +1,1119 @@
+//--------------------------------------------------------------------------------------
+// File: D3DX11EffectEx.h
+//
+// Direct3D 11 Effect native extensions
+//
+// These types and APIs extend d3dx11effect.h for native callers. They are kept in a
+// separate header so that they are not picked up by the SharpDX code generator, which
+// only parses d3dx11effect.h.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "d3dx11effect.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// File contents:
+//
+// 1) Effect binding flags
+// 2) State block interface
+// 3) Constant buffer registry interface
+// 4) Constant buffer ring interface
+// 5) Parameter table interface
+// 6) Draw queue interface
+// 7) Pass identity
+// 8) Variable handles
+// 9) Staging log interface
+// 10) Snapshot interface
+// 11) Allocator interface
+// 12) Memory usage
+// 13) APIs (state blocks, constant buffer rings, shared constant buffers,
+//     parameter tables, binding flags, draw queues, pass identities,
+//     variable handles, staging logs, snapshots, allocators, memory usage,
+//     shader data)
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// Thread safety:
+//
+// The reflection calls of an effect may be made on several threads at once:
+// ID3DX11Effect::GetDesc, GetVariableBy*, GetConstantBufferBy*,
+// GetGroupBy*, GetTechniqueBy*, GetClassLinkage and IsOptimized; the
+// GetDesc, GetType, GetAnnotationBy*, GetMemberBy*, GetElement, GetPassBy*,
+// GetParentConstantBuffer and As* calls of variables, types, groups and
+// techniques; AddRef and Release; and D3DX11EffectGetVariableHandle.  The
+// member, element and type interfaces these calls create on first use are
+// pooled under a lock.
+//
+// Every other call modifies the effect, or reads what applying passes
+// modifies, and must not overlap any call on it, from any thread: setting
+// values, applying passes, the ID3DX11EffectPass calls that evaluate state
+// assignments (GetDesc, the Get*ShaderDesc calls and
+// ComputeStateBlockMask), D3DX11EffectPassGetIdentity, as well as
+// Optimize, CloneEffect and the APIs of this header that change bindings
+// or cbuffers.
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+// D3DX11_EFFECT_BINDING flags (see D3DX11EffectSetBindingFlags):
+//
+//  D3DX11_EFFECT_BINDING_SKIP_CLEAN_RANGES
+//      When a pass applies the shader that this effect last applied to the
+//      same stage of the same context, ranges of samplers, shader resources
+//      and compute shader UAVs whose objects have not been set since are not
+//      set again.  Only use this flag if nothing else (another effect or the
+//      application) changes those bindings between passes of this effect,
+//      or call D3DX11EffectSetBindingFlags again after doing so.
+//
+//  D3DX11_EFFECT_BINDING_WEAK_REFERENCES
+//      Shader resources, unordered access views, constant buffers and
+//      texture buffers set on the effect's variables while this flag is set
+//      are stored without an AddRef, and are not released when they are
+//      replaced or when the effect is released.  The application must keep
+//      them alive for as long as the effect (or one of its clones) holds
+//      them.  Objects set before the flag was set keep their references.
+//
+//----------------------------------------------------------------------------
+
+#define D3DX11_EFFECT_BINDING_SKIP_CLEAN_RANGES         (1 << 0)
+#define D3DX11_EFFECT_BINDING_WEAK_REFERENCES           (1 << 1)
+
+#define D3DX11_EFFECT_BINDING_VALID_FLAGS               (D3DX11_EFFECT_BINDING_SKIP_CLEAN_RANGES | \
+                                                         D3DX11_EFFECT_BINDING_WEAK_REFERENCES)
+
+//////////////////////////////////////////////////////////////////////////////
+// ID3DX11StateBlock /////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// ID3DX11StateBlock:
+//
+// Captures and restores the subset of device context state selected by a
+// D3DX11_STATE_BLOCK_MASK (see ID3DX11EffectPass::ComputeStateBlockMask and
+// ID3DX11EffectTechnique::ComputeStateBlockMask).
+//
+// Contiguous slots set in the mask are coalesced into ranges when the state
+// block is created, so Capture and Apply issue one Get/Set call per range.
+// PS unordered access views are captured as a single range spanning all
+// masked slots, and are restored together with the render targets in a
+// single OMSetRenderTargetsAndUnorderedAccessViews call when both are masked.
+//
+// Captured objects are AddRef'ed until the next Capture, until
+// ReleaseAllDeviceObjects is called or until the state block is released.
+//----------------------------------------------------------------------------
+
+typedef interface ID3DX11StateBlock ID3DX11StateBlock;
+typedef interface ID3DX11StateBlock *LPD3DX11STATEBLOCK;
+
+// {3E5B7FD1-DE20-4A69-A8C8-D528325368C2}
+DEFINE_GUID(IID_ID3DX11StateBlock,
+            0x3e5b7fd1, 0xde20, 0x4a69, 0xa8, 0xc8, 0xd5, 0x28, 0x32, 0x53, 0x68, 0xc2);
+
+#undef INTERFACE
+#define INTERFACE ID3DX11StateBlock
+
+DECLARE_INTERFACE_(ID3DX11StateBlock, IUnknown)
+{
+    // IUnknown
+
+    // ID3DX11StateBlock
+    STDMETHOD(Capture)(THIS_ _In_ ID3D11DeviceContext *pContext) PURE;
+    STDMETHOD(Apply)(THIS_ _In_ ID3D11DeviceContext *pContext) PURE;
+    STDMETHOD(ReleaseAllDeviceObjects)(THIS) PURE;
+    STDMETHOD(GetStateBlockMask)(THIS_ _Out_ D3DX11_STATE_BLOCK_MASK *pStateBlockMask) PURE;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// ID3DX11ConstantBufferRegistry /////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// ID3DX11ConstantBufferRegistry:
+//
+// Owns one backing store and one ID3D11Buffer per cbuffer name, shared by
+// every effect that binds its cbuffer of that name to the registry with
+// D3DX11EffectShareConstantBuffer.  This replaces the effect pools of
+// Direct3D 10: a value set through any of the sharing effects is seen by
+// all of them, and is uploaded to the device once.
+//
+// Entries live until the registry is released; every effect bound to the
+// registry holds a reference on it.
+//----------------------------------------------------------------------------
+
+typedef interface ID3DX11ConstantBufferRegistry ID3DX11ConstantBufferRegistry;
+typedef interface ID3DX11ConstantBufferRegistry *LPD3DX11CONSTANTBUFFERREGISTRY;
+
+// {8D7C5E0A-4B1F-4C37-9E2D-61A0F3B7C9E4}
+DEFINE_GUID(IID_ID3DX11ConstantBufferRegistry,
+            0x8d7c5e0a, 0x4b1f, 0x4c37, 0x9e, 0x2d, 0x61, 0xa0, 0xf3, 0xb7, 0xc9, 0xe4);
+
+#undef INTERFACE
+#define INTERFACE ID3DX11ConstantBufferRegistry
+
+DECLARE_INTERFACE_(ID3DX11ConstantBufferRegistry, IUnknown)
+{
+    // IUnknown
+
+    // ID3DX11ConstantBufferRegistry
+    STDMETHOD(GetDevice)(THIS_ _Outptr_ ID3D11Device **ppDevice) PURE;
+    STDMETHOD_(uint32_t, GetConstantBufferCount)(THIS) PURE;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// ID3DX11ConstantBufferRing /////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// ID3DX11ConstantBufferRing:
+//
+// A dynamic buffer that the cbuffer contents of every effect attached to it
+// with D3DX11EffectSetConstantBufferRing are appended to.  When a pass is
+// applied, the modified cbuffers it binds are written one after the other
+// at the next free offset of the ring, under a single
+// D3D11_MAP_WRITE_NO_OVERWRITE map (D3D11_MAP_WRITE_DISCARD when the ring
+// wraps around), and bound with *SetConstantBuffers1.  The ring is unmapped
+// before Apply returns, since draws cannot read a mapped buffer.
+//
+// Every effect attached to the ring holds a reference on it.
+//----------------------------------------------------------------------------
+
+typedef interface ID3DX11ConstantBufferRing ID3DX11ConstantBufferRing;
+typedef interface ID3DX11ConstantBufferRing *LPD3DX11CONSTANTBUFFERRING;
+
+// {05FBDFE7-D386-4616-BBB6-E72B44C10059}
+DEFINE_GUID(IID_ID3DX11ConstantBufferRing,
+            0x5fbdfe7, 0xd386, 0x4616, 0xbb, 0xb6, 0xe7, 0x2b, 0x44, 0xc1, 0x0, 0x59);
+
+#undef INTERFACE
+#define INTERFACE ID3DX11ConstantBufferRing
+
+DECLARE_INTERFACE_(ID3DX11ConstantBufferRing, IUnknown)
+{
+    // IUnknown
+
+    // ID3DX11ConstantBufferRing
+    STDMETHOD(GetDevice)(THIS_ _Outptr_ ID3D11Device **ppDevice) PURE;
+    STDMETHOD_(uint32_t, GetSize)(THIS) PURE;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// ID3DX11ParameterTable /////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// ID3DX11ParameterTable:
+//
+// Publishes values by semantic (WORLDVIEWPROJECTION, TIME...) to the global
+// variables of every effect added to the table.  Each effect groups its
+// variables by semantic when it is loaded, so publishing a value does not
+// look up any variable; it sets every bound variable directly, and the
+// owning cbuffers are uploaded when their passes are next applied.
+//
+// Semantics are compared case-insensitively.  Numeric values are written
+// from the start of each variable and truncated to its size; resources are
+// only published to shader resource variables.  An effect added to the
+// table receives the values published so far.  Effects can be added after
+// ID3DX11Effect::Optimize, and the table holds a reference on each of them
+// until it is removed.
+//----------------------------------------------------------------------------
+
+typedef interface ID3DX11ParameterTable ID3DX11ParameterTable;
+typedef interface ID3DX11ParameterTable *LPD3DX11PARAMETERTABLE;
+
+// {5A3B1E92-7C64-4F0D-B1A8-2E9D40C6F57B}
+DEFINE_GUID(IID_ID3DX11ParameterTable,
+            0x5a3b1e92, 0x7c64, 0x4f0d, 0xb1, 0xa8, 0x2e, 0x9d, 0x40, 0xc6, 0xf5, 0x7b);
+
+#undef INTERFACE
+#define INTERFACE ID3DX11ParameterTable
+
+DECLARE_INTERFACE_(ID3DX11ParameterTable, IUnknown)
+{
+    // IUnknown
+
+    // ID3DX11ParameterTable
+    STDMETHOD(AddEffect)(THIS_ _In_ ID3DX11Effect *pEffect) PURE;
+    STDMETHOD(RemoveEffect)(THIS_ _In_ ID3DX11Effect *pEffect) PURE;
+    STDMETHOD(SetRawValue)(THIS_ _In_z_ LPCSTR Semantic, _In_reads_bytes_(ByteCount) const void *pData, _In_ uint32_t ByteCount) PURE;
+    STDMETHOD(SetResource)(THIS_ _In_z_ LPCSTR Semantic, _In_opt_ ID3D11ShaderResourceView *pResource) PURE;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// ID3DX11DrawQueue //////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// D3DX11_EFFECT_DRAW_PARAMETER:
+//
+// A value written with ID3DX11EffectVariable::SetRawValue (at offset 0)
+// before a queued draw.  ByteCount must not be 0; the data is copied when
+// the draw is submitted.
+//----------------------------------------------------------------------------
+
+typedef struct _D3DX11_EFFECT_DRAW_PARAMETER
+{
+    ID3DX11EffectVariable   *pVariable;
+    const void              *pData;
+    uint32_t                ByteCount;
+} D3DX11_EFFECT_DRAW_PARAMETER;
+
+//----------------------------------------------------------------------------
+// LPD3DX11EFFECTDRAWCALLBACK:
+//
+// Issues a queued draw, once its pass has been applied to pContext.  The
+// callback binds the input assembler state it needs and calls Draw*.
+//----------------------------------------------------------------------------
+
+typedef void (CALLBACK *LPD3DX11EFFECTDRAWCALLBACK)(_In_ ID3D11DeviceContext *pContext, _In_opt_ void *pUserData);
+
+//----------------------------------------------------------------------------
+// ID3DX11DrawQueue:
+//
+// Records draws as (pass, per-draw parameters, draw callback) items, and
+// executes them sorted so that draws sharing shaders and render states are
+// submitted together.
+//
+// Each item gets a 64-bit sort key when it is submitted, from the identity
+// hashes of the shaders and states its pass selected when it was last
+// applied (see D3DX11_EFFECT_PASS_IDENTITY).  Each hash is replaced by a
+// small id, in order of first appearance in the queue, and the ids are
+// packed from the most to the least significant bits: the pixel shader (or
+// the compute shader of compute passes) in 16 bits, the vertex shader in
+// 16, the geometry shader in 6, the hull and domain shaders in 5 each, the
+// blend state in 6, and the depth stencil and rasterizer states in 5 each.
+// The ids beyond what a field can hold all alias its last id, so those
+// shaders or states are not grouped with each other.  Items with equal
+// keys keep their submission order.  Queues of 4096 items or more are
+// sorted in chunks on up to 8 threads, started and joined within Sort,
+// and merged on the calling thread; smaller queues are sorted on the
+// calling thread.
+//
+// Execute applies each item's pass with ID3DX11EffectPass::Apply, so passes
+// from several effects can be mixed.  A per-draw parameter is only set when
+// it differs from the value set by a previous item of the same Execute.
+// The queue does not hold references on the effects of its passes; they
+// must stay alive until the queue is cleared.
+//----------------------------------------------------------------------------
+
+typedef interface ID3DX11DrawQueue ID3DX11DrawQueue;
+typedef interface ID3DX11DrawQueue *LPD3DX11DRAWQUEUE;
+
+// {C2F4A7E1-93B6-4D58-8A0E-7B15D36E29F0}
+DEFINE_GUID(IID_ID3DX11DrawQueue,
+            0xc2f4a7e1, 0x93b6, 0x4d58, 0x8a, 0x0e, 0x7b, 0x15, 0xd3, 0x6e, 0x29, 0xf0);
+
+#undef INTERFACE
+#define INTERFACE ID3DX11DrawQueue
+
+DECLARE_INTERFACE_(ID3DX11DrawQueue, IUnknown)
+{
+    // IUnknown
+
+    // ID3DX11DrawQueue
+    STDMETHOD(Submit)(THIS_ _In_ ID3DX11EffectPass *pPass,
+                      _In_reads_opt_(ParameterCount) const D3DX11_EFFECT_DRAW_PARAMETER *pParameters, _In_ uint32_t ParameterCount,
+                      _In_ LPD3DX11EFFECTDRAWCALLBACK pfnDraw, _In_opt_ void *pUserData) PURE;
+    STDMETHOD(Sort)(THIS) PURE;
+    STDMETHOD(Execute)(THIS_ _In_ ID3D11DeviceContext *pContext) PURE;
+    STDMETHOD(Clear)(THIS) PURE;
+    STDMETHOD_(uint32_t, GetCount)(THIS) PURE;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// D3DX11_EFFECT_PASS_IDENTITY ///////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// D3DX11_EFFECT_PASS_IDENTITY:
+//
+// 64-bit identity hashes of a pass and of the shaders and render states it
+// selects (see D3DX11EffectPassGetIdentity).  Shader hashes are derived from
+// the bytecode and stream out declarations, state hashes from the state
+// descs; both are computed when the effect is bound to its device (and
+// again when applying a pass recreates a state because of its
+// assignments), so they are stable across effects, clones and runs.
+// Reading them does not evaluate pass assignments: they describe the
+// shaders and states the pass selected when it was last applied, or when
+// the effect was created if it has not been applied yet.  The pass hash combines all of
+// them with the blend factor, sample mask and stencil reference.  Missing
+// shaders and states hash to 0.  Samplers, resources and render targets
+// are not part of the identity.
+//----------------------------------------------------------------------------
+
+typedef struct _D3DX11_EFFECT_PASS_IDENTITY
+{
+    uint64_t    PassHash;
+
+    uint64_t    VertexShaderHash;
+    uint64_t    HullShaderHash;
+    uint64_t    DomainShaderHash;
+    uint64_t    GeometryShaderHash;
+    uint64_t    PixelShaderHash;
+    uint64_t    ComputeShaderHash;
+    uint64_t    BlendStateHash;
+    uint64_t    DepthStencilStateHash;
+    uint64_t    RasterizerStateHash;
+} D3DX11_EFFECT_PASS_IDENTITY;
+
+//////////////////////////////////////////////////////////////////////////////
+// D3DX11_EFFECT_VARIABLE_HANDLE /////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// D3DX11_EFFECT_VARIABLE_HANDLE:
+//
+// Opaque integer naming a scalar, vector or matrix stored in a cbuffer: a
+// global variable, or a member, element or component range of one (see
+// D3DX11EffectGetVariableHandle).  A handle encodes the cbuffer, the offset
+// of the value in the cbuffer, its dimensions, its register layout and its
+// scalar type, so setting a value through it is a store into the cbuffer's
+// backing store followed by marking the cbuffer dirty; no variable is
+// looked up and no interface is called.
+//
+// Handles remain valid after ID3DX11Effect::Optimize, and can be used with
+// every clone of the effect they were resolved on.  Setting a value checks,
+// in every build, that the handle names a value of the effect's variable it
+// was resolved from and that the caller's scalar type is the variable's.
+// 0 is never a valid handle.
+//----------------------------------------------------------------------------
+
+typedef uint64_t D3DX11_EFFECT_VARIABLE_HANDLE;
+
+//////////////////////////////////////////////////////////////////////////////
+// ID3DX11StagingLog /////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// ID3DX11StagingLog:
+//
+// Records variable updates, as (effect, handle, value) entries, so that
+// threads other than the one applying passes can produce them.  Recording
+// only appends to the log, and AddRefs an effect the first time one of its
+// updates is recorded, so it takes no lock;
+// each thread records into its own log, and a log must not be used
+// by two threads at once.
+//
+// Flush writes the recorded values to their effects, in the order they
+// were recorded, as D3DX11EffectSetVariableByHandle would, and empties the
+// log.  It must be called on the thread that applies the effects' passes,
+// before they are applied (see D3DX11FlushStagingLogs).  An update that
+// fails is skipped; Flush returns the first failure.  The log holds one
+// reference on each effect it has updates for until it is flushed or
+// cleared, so the application may release an effect that still has updates
+// staged.
+//----------------------------------------------------------------------------
+
+typedef interface ID3DX11StagingLog ID3DX11StagingLog;
+typedef interface ID3DX11StagingLog *LPD3DX11STAGINGLOG;
+
+// {6B0E93D4-2F7A-4C1E-B5D8-94A3E07C1F62}
+DEFINE_GUID(IID_ID3DX11StagingLog,
+            0x6b0e93d4, 0x2f7a, 0x4c1e, 0xb5, 0xd8, 0x94, 0xa3, 0xe0, 0x7c, 0x1f, 0x62);
+
+#undef INTERFACE
+#define INTERFACE ID3DX11StagingLog
+
+DECLARE_INTERFACE_(ID3DX11StagingLog, IUnknown)
+{
+    // IUnknown
+
+    // ID3DX11StagingLog
+    STDMETHOD(SetVariable)(THIS_ _In_ ID3DX11Effect *pEffect, _In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle, _In_ D3D_SHADER_VARIABLE_TYPE Type,
+                           _In_reads_bytes_(ByteCount) const void *pData, _In_ uint32_t ByteCount) PURE;
+    STDMETHOD(Flush)(THIS) PURE;
+    STDMETHOD(Clear)(THIS) PURE;
+    STDMETHOD_(uint32_t, GetCount)(THIS) PURE;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// ID3DX11EffectSnapshot /////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// D3DX11_EFFECT_SNAPSHOT flags (see D3DX11EffectCreateSnapshot):
+//
+//  D3DX11_EFFECT_SNAPSHOT_SHADER_RESOURCES
+//      The snapshot also holds the shader resources set on every shader
+//      resource variable of the effect.
+//
+//  D3DX11_EFFECT_SNAPSHOT_UNORDERED_ACCESS_VIEWS
+//      The snapshot also holds the unordered access views set on every
+//      unordered access view variable of the effect.
+//
+//----------------------------------------------------------------------------
+
+#define D3DX11_EFFECT_SNAPSHOT_SHADER_RESOURCES         (1 << 0)
+#define D3DX11_EFFECT_SNAPSHOT_UNORDERED_ACCESS_VIEWS   (1 << 1)
+
+#define D3DX11_EFFECT_SNAPSHOT_VALID_FLAGS              (D3DX11_EFFECT_SNAPSHOT_SHADER_RESOURCES | \
+                                                         D3DX11_EFFECT_SNAPSHOT_UNORDERED_ACCESS_VIEWS)
+
+//----------------------------------------------------------------------------
+// ID3DX11EffectSnapshot:
+//
+// Holds a copy of the contents of a set of cbuffers of an effect and,
+// depending on its flags, of the objects bound to its shader resource and
+// unordered access view variables, such as the values of a material
+// preset.
+//
+// Capture copies the current values of the effect into the snapshot.
+// Restore copies them back into the effect: it compares each cbuffer and
+// object with the snapshot, and only writes what differs, marking changed
+// cbuffers dirty and changed variables and objects modified as the
+// variable setters do.  The next pass applied uploads and rebinds only
+// what the restore changed.  Restoring a snapshot costs a few memcmps and
+// memcpys per cbuffer, whatever the number of variables.
+//
+// A snapshot can be captured from and restored to the effect it was
+// created on and its clones.  It holds references on the objects it
+// captured, and none on the effect.
+//----------------------------------------------------------------------------
+
+typedef interface ID3DX11EffectSnapshot ID3DX11EffectSnapshot;
+typedef interface ID3DX11EffectSnapshot *LPD3DX11EFFECTSNAPSHOT;
+
+// {E47A1C35-58D2-4B9F-A6E3-0D8B27F514C9}
+DEFINE_GUID(IID_ID3DX11EffectSnapshot,
+            0xe47a1c35, 0x58d2, 0x4b9f, 0xa6, 0xe3, 0x0d, 0x8b, 0x27, 0xf5, 0x14, 0xc9);
+
+#undef INTERFACE
+#define INTERFACE ID3DX11EffectSnapshot
+
+DECLARE_INTERFACE_(ID3DX11EffectSnapshot, IUnknown)
+{
+    // IUnknown
+
+    // ID3DX11EffectSnapshot
+    STDMETHOD(Capture)(THIS_ _In_ ID3DX11Effect *pEffect) PURE;
+    STDMETHOD(Restore)(THIS_ _In_ ID3DX11Effect *pEffect) PURE;
+    STDMETHOD_(uint32_t, GetDataSize)(THIS) PURE;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// ID3DX11EffectAllocator ////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// ID3DX11EffectAllocator:
+//
+// Implemented by the application to provide the memory of an effect (see
+// D3DX11CreateEffectFromMemoryWithAllocator).  Everything the effect
+// allocates while it is loaded and bound to its device, cloned, optimized
+// or reflected, and when it recreates state objects, comes from Allocate:
+// the effect object itself, its heaps, arrays and hash tables, and its
+// member and type interfaces.  Clones use the allocator of the effect they
+// were cloned from.
+//
+// Allocate returns nullptr on failure, or memory aligned to
+// MEMORY_ALLOCATION_ALIGNMENT.  Each allocation carries a small header, which
+// Size includes.  Free is called once for every allocation, with the same
+// Size, possibly on another thread.  The allocator is not reference counted:
+// it must outlive the effect and all of its clones.
+//----------------------------------------------------------------------------
+
+#undef INTERFACE
+#define INTERFACE ID3DX11EffectAllocator
+
+DECLARE_INTERFACE(ID3DX11EffectAllocator)
+{
+    STDMETHOD_(void*, Allocate)(THIS_ _In_ SIZE_T Size) PURE;
+    STDMETHOD_(void, Free)(THIS_ _In_ void *pData, _In_ SIZE_T Size) PURE;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// D3DX11_EFFECT_MEMORY_USAGE ////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+//----------------------------------------------------------------------------
+// D3DX11_EFFECT_MEMORY_USAGE:
+//
+// Memory held by an effect, by category (see D3DX11EffectGetMemoryUsage).
+// Sizes are in bytes.
+//
+//  RuntimeHeapSize
+//      Variables, cbuffer contents, shaders, states, techniques and passes
+//  ReflectionHeapSize
+//      Names, annotations, stream out declarations and other reflection
+//      data.  0 once the effect is optimized
+//  TypePoolSize
+//      Pooled types and type names; 0 once the effect is optimized
+//  OptimizedTypeHeapSize
+//      Types kept by ID3DX11Effect::Optimize
+//  InterfacePoolSize
+//      Member, element and type interfaces created on demand
+//  TableSize
+//      Tables used to clone the effect and to publish parameters by semantic
+//  ShaderBytecodeSize
+//      Shader bytecode kept after the shaders were created.  0 once the
+//      effect is optimized or its shader data is discarded (see
+//      D3DX11EffectDiscardShaderData)
+//  ShaderSignatureSize
+//      Vertex shader input signatures kept for input layout creation
+//  ShaderReflectionCount
+//      ID3D11ShaderReflection objects kept alive
+//  ShaderCount, StateObjectCount
+//      Shaders and render state objects the effect holds
+//  ConstantBufferCount, ConstantBufferSize
+//      Buffers the effect created for its cbuffers and tbuffers, and the
+//      sum of their widths.  This estimates their GPU-side size, which the
+//      driver may pad.  Buffers shared through a registry or with the
+//      effect a clone was made from are not included
+//  ConstantBufferRingSize
+//      Size of the constant buffer ring, if there is one
+//
+// Device objects shared with clones, and constant buffer rings, are counted
+// by every effect holding them.
+//----------------------------------------------------------------------------
+
+typedef struct _D3DX11_EFFECT_MEMORY_USAGE
+{
+    uint32_t    RuntimeHeapSize;
+    uint32_t    ReflectionHeapSize;
+    uint32_t    TypePoolSize;
+    uint32_t    OptimizedTypeHeapSize;
+    uint32_t    InterfacePoolSize;
+    uint32_t    TableSize;
+
+    uint32_t    ShaderBytecodeSize;
+    uint32_t    ShaderSignatureSize;
+    uint32_t    ShaderReflectionCount;
+
+    uint32_t    ShaderCount;
+    uint32_t    StateObjectCount;
+    uint32_t    ConstantBufferCount;
+    uint32_t    ConstantBufferSize;
+    uint32_t    ConstantBufferRingSize;
+} D3DX11_EFFECT_MEMORY_USAGE;
+
+//////////////////////////////////////////////////////////////////////////////
+// APIs //////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+//----------------------------------------------------------------------------
+// D3DX11CreateStateBlock
+//
+// Creates a state block which captures and restores the state selected
+// by a state block mask
+//
+// Parameters:
+//
+// [in]
+//
+//  pStateBlockMask
+//      Mask of the state to capture and restore
+//
+// [out]
+//
+//  ppStateBlock
+//      Address of the newly created state block interface
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11CreateStateBlock( _In_ const D3DX11_STATE_BLOCK_MASK *pStateBlockMask,
+                                       _Outptr_ ID3DX11StateBlock **ppStateBlock );
+
+//----------------------------------------------------------------------------
+// D3DX11CreateConstantBufferRing
+//
+// Creates a constant buffer ring, to be shared by any number of effects
+//
+// Parameters:
+//
+// [in]
+//
+//  pDevice
+//      Device the ring is created on; it is written through the device's
+//      immediate context
+//  RingSize
+//      Size of the ring in bytes (rounded up to 256)
+//
+// [out]
+//
+//  ppRing
+//      Address of the newly created ring interface, or nullptr if the
+//      device does not support constant buffer offsetting
+//
+// Returns S_FALSE, and no ring, if the device does not support constant
+// buffer offsetting (Direct3D 11.1); effects then keep using one buffer per
+// cbuffer.
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11CreateConstantBufferRing( _In_ ID3D11Device *pDevice, _In_ UINT RingSize,
+                                               _Outptr_result_maybenull_ ID3DX11ConstantBufferRing **ppRing );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectSetConstantBufferRing
+//
+// Sub-allocates the contents of the effect's cbuffers from a constant
+// buffer ring (see ID3DX11ConstantBufferRing), instead of updating one
+// buffer per cbuffer with UpdateSubresource.
+//
+// The ring is only used when passes are applied to the device's immediate
+// context; other contexts, texture buffers and cbuffers set with
+// ID3DX11EffectConstantBuffer::SetConstantBuffer keep the per-cbuffer
+// buffers, as do passes whose cbuffers do not fit in the ring.  While the
+// ring is in use, the buffers returned by
+// ID3DX11EffectConstantBuffer::GetConstantBuffer may hold stale contents.
+// Cloned effects do not inherit the ring.
+//
+// Parameters:
+//
+// [in]
+//
+//  pEffect
+//      The effect
+//  pRing
+//      Ring created on the effect's device, or nullptr to stop using a ring
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectSetConstantBufferRing( _In_ ID3DX11Effect *pEffect, _In_opt_ ID3DX11ConstantBufferRing *pRing );
+
+//----------------------------------------------------------------------------
+// D3DX11CreateConstantBufferRegistry
+//
+// Creates an empty registry of cbuffers shared across effects
+//
+// Parameters:
+//
+// [in]
+//
+//  pDevice
+//      Device the shared buffers are created on
+//
+// [out]
+//
+//  ppRegistry
+//      Address of the newly created registry interface
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11CreateConstantBufferRegistry( _In_ ID3D11Device *pDevice,
+                                                   _Outptr_ ID3DX11ConstantBufferRegistry **ppRegistry );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectShareConstantBuffer
+//
+// Binds the effect's cbuffer named Name to the registry entry of the same
+// name.  The first effect to share a cbuffer name creates the entry and
+// provides its initial contents; later effects must declare the cbuffer
+// with an identical layout (same size, and same variable names, offsets
+// and types) and take on the shared contents.
+//
+// Must be called before ID3DX11Effect::Optimize.  Texture buffers,
+// cbuffers set with ID3DX11EffectConstantBuffer::SetConstantBuffer and
+// cbuffers read by state or pass assignments cannot be shared, since those
+// assignments are only re-evaluated when values are set through their own
+// effect.  Clones of the effect keep sharing its cbuffers.
+//
+// Parameters:
+//
+// [in]
+//
+//  pEffect
+//      The effect
+//  Name
+//      Name of the cbuffer to share
+//  pRegistry
+//      Registry created on the effect's device
+//
+// Returns E_FAIL if the layout does not match the registered one.
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectShareConstantBuffer( _In_ ID3DX11Effect *pEffect, _In_z_ LPCSTR Name,
+                                                _In_ ID3DX11ConstantBufferRegistry *pRegistry );
+
+//----------------------------------------------------------------------------
+// D3DX11CreateParameterTable
+//
+// Creates an empty table of global parameters published by semantic
+//
+// Parameters:
+//
+// [out]
+//
+//  ppTable
+//      Address of the newly created parameter table interface
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11CreateParameterTable( _Outptr_ ID3DX11ParameterTable **ppTable );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectSetBindingFlags
+//
+// Sets how the effect binds objects when its passes are applied, and
+// forgets which shaders were last applied to each stage
+//
+// Parameters:
+//
+// [in]
+//
+//  pEffect
+//      The effect
+//  Flags
+//      Combination of D3DX11_EFFECT_BINDING flags
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectSetBindingFlags( _In_ ID3DX11Effect *pEffect, _In_ UINT Flags );
+
+//----------------------------------------------------------------------------
+// D3DX11CreateDrawQueue
+//
+// Creates an empty draw queue
+//
+// Parameters:
+//
+// [out]
+//
+//  ppQueue
+//      Address of the newly created draw queue interface
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11CreateDrawQueue( _Outptr_ ID3DX11DrawQueue **ppQueue );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectPassGetIdentity
+//
+// Returns the identity hashes of a pass, as stored when it was last
+// applied; its pass assignments are not evaluated
+//
+// Parameters:
+//
+// [in]
+//
+//  pPass
+//      The pass
+//
+// [out]
+//
+//  pIdentity
+//      The identity hashes of the pass, its shaders and its render states
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectPassGetIdentity( _In_ ID3DX11EffectPass *pPass,
+                                            _Out_ D3DX11_EFFECT_PASS_IDENTITY *pIdentity );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectGetVariableHandle
+//
+// Resolves the path of a scalar, vector or matrix to a handle.  A path is
+// the name of a global variable in a cbuffer, followed by any number of
+// element ("[3]") and member (".Color") selections, and optionally by a
+// selection of consecutive components of a vector (".x", ".yz", ".rgb"),
+// for example "Lights[3].Color.rgb".  The path is parsed against the type
+// of the variable, without creating any variable interface.  Paths must
+// be resolved before ID3DX11Effect::Optimize, which discards names.
+//
+// Parameters:
+//
+// [in]
+//
+//  pEffect
+//      The effect
+//  Path
+//      Path of the value
+//
+// [out]
+//
+//  pHandle
+//      The handle of the value, or 0 on failure
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectGetVariableHandle( _In_ ID3DX11Effect *pEffect, _In_z_ LPCSTR Path,
+                                              _Out_ D3DX11_EFFECT_VARIABLE_HANDLE *pHandle );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectSetVariableByHandle
+//
+// Sets the variable of a handle.  Scalars and vectors are read as one 32-bit
+// value per component, in the variable's scalar type (bools as BOOLs); no
+// conversion is made.  Matrices are read as 4x4 row-major float matrices,
+// like ID3DX11EffectMatrixVariable::SetMatrix.  Returns E_INVALIDARG if
+// Type is not the variable's scalar type, or if the handle was not
+// resolved on the effect or one of its clones.
+//
+// Parameters:
+//
+// [in]
+//
+//  pEffect
+//      The effect the handle was resolved on, or one of its clones
+//  Handle
+//      Handle of the variable
+//  Type
+//      Scalar type of the value: D3D_SVT_FLOAT, D3D_SVT_INT, D3D_SVT_UINT
+//      or D3D_SVT_BOOL
+//  pData
+//      The value
+//  ByteCount
+//      Size of the value; it must be at least the size read
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectSetVariableByHandle( _In_ ID3DX11Effect *pEffect, _In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle,
+                                                _In_ D3D_SHADER_VARIABLE_TYPE Type,
+                                                _In_reads_bytes_(ByteCount) const void *pData, _In_ UINT ByteCount );
+
+//----------------------------------------------------------------------------
+// D3DX11CreateStagingLog
+//
+// Creates an empty staging log
+//
+// Parameters:
+//
+// [out]
+//
+//  ppLog
+//      Address of the newly created staging log interface
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11CreateStagingLog( _Outptr_ ID3DX11StagingLog **ppLog );
+
+//----------------------------------------------------------------------------
+// D3DX11FlushStagingLogs
+//
+// Flushes staging logs one after the other, so that when several logs
+// update the same variable, the value of the last log wins.  Null entries
+// are skipped.
+//
+// Parameters:
+//
+// [in]
+//
+//  ppLogs
+//      The logs, in the order they are flushed
+//  LogCount
+//      Number of logs
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11FlushStagingLogs( _In_reads_opt_(LogCount) ID3DX11StagingLog **ppLogs, _In_ UINT LogCount );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectCreateSnapshot
+//
+// Creates a snapshot of a set of cbuffers of an effect, and captures their
+// current contents
+//
+// Parameters:
+//
+// [in]
+//
+//  pEffect
+//      The effect
+//  ppConstantBuffers
+//      The cbuffers of the effect to include, or nullptr for all of them
+//  ConstantBufferCount
+//      Number of cbuffers in ppConstantBuffers
+//  Flags
+//      Combination of D3DX11_EFFECT_SNAPSHOT flags
+//
+// [out]
+//
+//  ppSnapshot
+//      Address of the newly created snapshot interface
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectCreateSnapshot( _In_ ID3DX11Effect *pEffect,
+                                           _In_reads_opt_(ConstantBufferCount) ID3DX11EffectConstantBuffer *const *ppConstantBuffers,
+                                           _In_ UINT ConstantBufferCount, _In_ UINT Flags,
+                                           _Outptr_ ID3DX11EffectSnapshot **ppSnapshot );
+
+//----------------------------------------------------------------------------
+// D3DX11CreateEffectFromMemoryWithAllocator
+//
+// Creates an effect instance from a compiled effect in memory, as
+// D3DX11CreateEffectFromMemory does, with all of its memory provided by an
+// application allocator
+//
+// Parameters:
+//
+// [in]
+//
+//  pData
+//      Blob of compiled effect data
+//  DataLength
+//      Length of the data blob
+//  FXFlags
+//      Flags pertaining to Effect creation
+//  pDevice
+//      Pointer to the D3D11 device on which to create Effect resources
+//  pAllocator [optional]
+//      Allocator of the effect and its clones; nullptr uses the CRT heap
+//  srcName [optional]
+//      ASCII string to use for debug object naming
+//
+// [out]
+//
+//  ppEffect
+//      Address of the newly created Effect interface
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11CreateEffectFromMemoryWithAllocator( _In_reads_bytes_(DataLength) LPCVOID pData,
+                                                          _In_ SIZE_T DataLength,
+                                                          _In_ UINT FXFlags,
+                                                          _In_ ID3D11Device *pDevice,
+                                                          _In_opt_ ID3DX11EffectAllocator *pAllocator,
+                                                          _Outptr_ ID3DX11Effect **ppEffect,
+                                                          _In_opt_z_ LPCSTR srcName = nullptr );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectGetMemoryUsage
+//
+// Returns how much memory the effect holds, by category
+//
+// Parameters:
+//
+// [in]
+//
+//  pEffect
+//      The effect
+//
+// [out]
+//
+//  pUsage
+//      The memory held by the effect
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectGetMemoryUsage( _In_ ID3DX11Effect *pEffect, _Out_ D3DX11_EFFECT_MEMORY_USAGE *pUsage );
+
+//----------------------------------------------------------------------------
+// D3DX11EffectDiscardShaderData
+//
+// Frees the shader bytecode of the effect and its shader reflection
+// objects, which are no longer needed once the shaders are created, while
+// keeping the rest of its reflection data.  Vertex shader input signatures
+// (for input layout creation) and stream out declarations are kept, and
+// are still returned by the GetShaderDesc calls of shader variables and
+// passes; pBytecode is nullptr and the signature entry counts are 0.  The
+// Get*SignatureElementDesc calls fail with D3DERR_INVALIDCALL, as they do
+// after ID3DX11Effect::Optimize.
+//
+// The data cannot be restored.  Clones made afterwards do not have it
+// either; clones made before keep their own copy.
+//
+// Parameters:
+//
+// [in]
+//
+//  pEffect
+//      The effect
+//
+//----------------------------------------------------------------------------
+
+HRESULT WINAPI D3DX11EffectDiscardShaderData( _In_ ID3DX11Effect *pEffect );
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#ifdef __cplusplus
+
+//----------------------------------------------------------------------------
+// D3DX11EffectValueType
+//
+// Scalar type of the components of a value type, for D3DX11EffectSetVariable
+// and D3DX11StageVariable.  It is defined for float, int32_t, uint32_t,
+// arrays of them and, when DirectXMath is included first, the XMFLOATn,
+// XMINTn, XMUINTn and XMFLOAT4X4 types; specialize it for other types.
+// BOOL is an int, so bool vectors must be set with
+// D3DX11EffectSetVariableByHandle and D3D_SVT_BOOL.
+//----------------------------------------------------------------------------
+
+template<class T>
+struct D3DX11EffectValueType
+{
+    static_assert( sizeof(T) == 0, "Specialize D3DX11EffectValueType for this type" );
+};
+
+#define D3DX11_EFFECT_VALUE_TYPE( T, SVT ) \
+    template<> struct D3DX11EffectValueType<T> { static const D3D_SHADER_VARIABLE_TYPE Type = SVT; };
+
+D3DX11_EFFECT_VALUE_TYPE( float, D3D_SVT_FLOAT )
+D3DX11_EFFECT_VALUE_TYPE( int32_t, D3D_SVT_INT )
+D3DX11_EFFECT_VALUE_TYPE( uint32_t, D3D_SVT_UINT )
+
+template<class T, size_t N>
+struct D3DX11EffectValueType<T[N]> : D3DX11EffectValueType<T> {};
+
+#ifdef DIRECTX_MATH_VERSION
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMFLOAT2, D3D_SVT_FLOAT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMFLOAT3, D3D_SVT_FLOAT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMFLOAT4, D3D_SVT_FLOAT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMFLOAT4X4, D3D_SVT_FLOAT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMINT2, D3D_SVT_INT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMINT3, D3D_SVT_INT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMINT4, D3D_SVT_INT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMUINT2, D3D_SVT_UINT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMUINT3, D3D_SVT_UINT )
+D3DX11_EFFECT_VALUE_TYPE( DirectX::XMUINT4, D3D_SVT_UINT )
+#endif
+
+#undef D3DX11_EFFECT_VALUE_TYPE
+
+//----------------------------------------------------------------------------
+// D3DX11EffectSetVariable
+//
+// Sets the variable of a handle from a value laid out as the variable
+// expects (float, XMFLOAT3, XMINT4, XMFLOAT4X4...), with the scalar type
+// given by D3DX11EffectValueType, see D3DX11EffectSetVariableByHandle.
+// bool values are converted to BOOL.
+//----------------------------------------------------------------------------
+
+template<class T>
+inline HRESULT D3DX11EffectSetVariable( _In_ ID3DX11Effect *pEffect, _In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle, _In_ const T &Value )
+{
+    static_assert( sizeof(T) % sizeof(uint32_t) == 0, "Effect variables are made of 32-bit components" );
+    return D3DX11EffectSetVariableByHandle( pEffect, Handle, D3DX11EffectValueType<T>::Type, &Value, sizeof(T) );
+}
+
+template<>
+inline HRESULT D3DX11EffectSetVariable<bool>( _In_ ID3DX11Effect *pEffect, _In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle, _In_ const bool &Value )
+{
+    BOOL value = Value ? TRUE : FALSE;
+    return D3DX11EffectSetVariableByHandle( pEffect, Handle, D3D_SVT_BOOL, &value, sizeof(value) );
+}
+
+//----------------------------------------------------------------------------
+// D3DX11StageVariable
+//
+// Records the update of the variable of a handle into a staging log, from
+// a value laid out as the variable expects, see D3DX11EffectSetVariable.
+//----------------------------------------------------------------------------
+
+template<class T>
+inline HRESULT D3DX11StageVariable( _In_ ID3DX11StagingLog *pLog, _In_ ID3DX11Effect *pEffect, _In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle, _In_ const T &Value )
+{
+    static_assert( sizeof(T) % sizeof(uint32_t) == 0, "Effect variables are made of 32-bit components" );
+    return pLog->SetVariable( pEffect, Handle, D3DX11EffectValueType<T>::Type, &Value, sizeof(T) );
+}
+
+template<>
+inline HRESULT D3DX11StageVariable<bool>( _In_ ID3DX11StagingLog *pLog, _In_ ID3DX11Effect *pEffect, _In_ D3DX11_EFFECT_VARIABLE_HANDLE Handle, _In_ const bool &Value )
+{
+    BOOL value = Value ? TRUE : FALSE;
+    return pLog->SetVariable( pEffect, Handle, D3D_SVT_BOOL, &value, sizeof(value) );
+}
+
+#endif //__cplusplus
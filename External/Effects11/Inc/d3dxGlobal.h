@@ -17,6 +17,8 @@
 
 #include <assert.h>
 #include <string.h>
+#include <type_traits>
+#include <utility>
 
 namespace D3DX11Debug
 {
@@ -139,8 +141,45 @@ _declspec(selectany) unsigned int g_TimerRolloverCount = 0x80000000;
 #endif // _DEBUG && !_M_X64
 
 
+//////////////////////////////////////////////////////////////////////////
+// Effect memory - allocations made on behalf of an effect
+//////////////////////////////////////////////////////////////////////////
+
+// Allocations are made from the allocator of the innermost CEffectAllocatorScope of the
+// calling thread, or from the CRT heap outside of any scope. Each allocation records the
+// allocator it came from, so it can be freed on any thread, in or out of a scope.
+void* AllocateEffectMemory(_In_ size_t Size);
+void FreeEffectMemory(_In_opt_ void *pData);
+
+// Routes the allocations made on this thread to pAllocator (nullptr: the CRT heap) until
+// the scope ends. Effects open one in every call that loads, clones, optimizes or reflects.
+class CEffectAllocatorScope
+{
+    ID3DX11EffectAllocator  *m_pPrevious;
+
+public:
+    explicit CEffectAllocatorScope(_In_opt_ ID3DX11EffectAllocator *pAllocator);
+    ~CEffectAllocatorScope();
+};
+
+// Base of the classes created with new on behalf of an effect. Not for classes that are
+// also constructed with placement new, since these operators would hide it.
+class CEffectAllocated
+{
+public:
+    static void* __cdecl operator new(size_t Size) throw() { return AllocateEffectMemory(Size); }
+    static void* __cdecl operator new[](size_t Size) throw() { return AllocateEffectMemory(Size); }
+    static void __cdecl operator delete(void *pData) { FreeEffectMemory(pData); }
+    static void __cdecl operator delete[](void *pData) { FreeEffectMemory(pData); }
+};
+
+
 //////////////////////////////////////////////////////////////////////////
 // CEffectVector - A vector implementation
+//
+// Elements are moved rather than copied when the storage grows. Trivially copyable
+// elements are moved with memcpy; other elements through their move constructor,
+// so they may own memory or hold inline vectors of their own.
 //////////////////////////////////////////////////////////////////////////
 
 template<class T> class CEffectVector
@@ -151,8 +190,62 @@ protected:
 #endif // _DEBUG
 
     uint8_t    *m_pData;
+    uint8_t    *m_pInlineData;  // storage of CEffectInlineVector, nullptr otherwise
     uint32_t    m_MaxSize;
     uint32_t    m_CurSize;
+    uint32_t    m_InlineSize;
+
+    // Constructor of CEffectInlineVector; pInlineData is not initialized yet
+    CEffectVector<T>(_In_ uint8_t *pInlineData, _In_ uint32_t InlineSize) : m_hLastError(S_OK), m_pData(pInlineData), m_pInlineData(pInlineData),
+                                                                             m_CurSize(0), m_MaxSize(InlineSize), m_InlineSize(InlineSize)
+    {
+#if _DEBUG
+        m_pCastData = (T*) m_pData;
+#endif // _DEBUG
+    }
+
+    // Moves Count elements to uninitialized memory, leaving the source uninitialized
+    static void RelocateElements(_Out_writes_(Count) T *pDest, _Inout_updates_(Count) T *pSource, _In_ uint32_t Count, _In_ std::true_type)
+    {
+        memcpy(pDest, pSource, Count * sizeof(T));
+    }
+
+    static void RelocateElements(_Out_writes_(Count) T *pDest, _Inout_updates_(Count) T *pSource, _In_ uint32_t Count, _In_ std::false_type)
+    {
+        for (size_t i = 0; i < Count; ++ i)
+        {
+            new(pDest + i) T(std::move(pSource[i]));
+            pSource[i].~T();
+        }
+    }
+
+    // Copies Count elements to uninitialized memory
+    static void CopyElements(_Out_writes_(Count) T *pDest, _In_reads_(Count) const T *pSource, _In_ uint32_t Count, _In_ std::true_type)
+    {
+        memcpy(pDest, pSource, Count * sizeof(T));
+    }
+
+    static void CopyElements(_Out_writes_(Count) T *pDest, _In_reads_(Count) const T *pSource, _In_ uint32_t Count, _In_ std::false_type)
+    {
+        for (size_t i = 0; i < Count; ++ i)
+        {
+            new(pDest + i) T(pSource[i]);
+        }
+    }
+
+    // Releases heap storage, going back to the inline storage if there is one
+    void FreeData()
+    {
+        if (m_pData != m_pInlineData)
+        {
+            FreeEffectMemory(m_pData);
+        }
+        m_pData = m_pInlineData;
+        m_MaxSize = m_InlineSize;
+#if _DEBUG
+        m_pCastData = (T*) m_pData;
+#endif // _DEBUG
+    }
 
     HRESULT Grow()
     {
@@ -175,7 +268,7 @@ protected:
                 return m_hLastError;
             }
 
-            pNewData = new uint8_t[newSize * sizeof(T)];
+            pNewData = (uint8_t*) AllocateEffectMemory(newSize * sizeof(T));
             if (pNewData == nullptr)
             {
                 m_hLastError = E_OUTOFMEMORY;
@@ -184,8 +277,11 @@ protected:
 
             if (m_pData)
             {
-                memcpy(pNewData, m_pData, m_CurSize * sizeof(T));
-                delete []m_pData;
+                RelocateElements((T*)pNewData, (T*)m_pData, m_CurSize, typename std::is_trivially_copyable<T>::type());
+                if (m_pData != m_pInlineData)
+                {
+                    FreeEffectMemory(m_pData);
+                }
             }
 
             m_pData = pNewData;
@@ -197,14 +293,27 @@ protected:
         return S_OK;
     }
 
+private:
+    // Not implemented: vectors are moved with MoveFrom or std::move, and copied with CopyFrom
+    CEffectVector<T>(const CEffectVector<T> &vOther);
+    CEffectVector<T>& operator=(const CEffectVector<T> &vOther);
+
 public:
     HRESULT m_hLastError;
 
-    CEffectVector<T>() : m_hLastError(S_OK), m_pData(nullptr), m_CurSize(0), m_MaxSize(0)
+    CEffectVector<T>() : m_hLastError(S_OK), m_pData(nullptr), m_pInlineData(nullptr), m_CurSize(0), m_MaxSize(0), m_InlineSize(0)
+    {
+#if _DEBUG
+        m_pCastData = nullptr;
+#endif // _DEBUG
+    }
+
+    CEffectVector<T>(_Inout_ CEffectVector<T> &&vOther) : m_hLastError(S_OK), m_pData(nullptr), m_pInlineData(nullptr), m_CurSize(0), m_MaxSize(0), m_InlineSize(0)
     {
 #if _DEBUG
         m_pCastData = nullptr;
 #endif // _DEBUG
+        MoveFrom(vOther);
     }
 
     ~CEffectVector<T>()
@@ -212,61 +321,94 @@ public:
         Clear();
     }
 
-    // cleanly swaps two vectors -- useful for when you want
-    // to reallocate a vector and copy data over, then swap them back
-    void SwapVector(_Out_ CEffectVector<T> &vOther)
+    CEffectVector<T>& operator=(_Inout_ CEffectVector<T> &&vOther)
     {
-        uint8_t tempData[sizeof(*this)];
-
-        memcpy(tempData, this, sizeof(*this));
-        memcpy(this, &vOther, sizeof(*this));
-        memcpy(&vOther, tempData, sizeof(*this));
+        MoveFrom(vOther);
+        return *this;
     }
 
-    HRESULT CopyFrom(_In_ const CEffectVector<T> &vOther)
+    // Takes the elements of vOther and leaves it empty. Heap storage changes hands without
+    // touching the elements; elements in inline storage have to be moved one by one, which
+    // is the only case that can fail.
+    HRESULT MoveFrom(_Inout_ CEffectVector<T> &vOther)
     {
         HRESULT hr = S_OK;
+
+        if (this == &vOther)
+            goto lExit;
+
         Clear();
-        VN( m_pData = new uint8_t[vOther.m_MaxSize * sizeof(T)] );
-        
-        m_CurSize = vOther.m_CurSize;
-        m_MaxSize = vOther.m_MaxSize;
-        m_hLastError = vOther.m_hLastError;
 
-        for (size_t i = 0; i < m_CurSize; ++ i)
+        if (vOther.m_pData != vOther.m_pInlineData)
         {
-            ((T*)m_pData)[i] = ((T*)vOther.m_pData)[i];
+            m_pData = vOther.m_pData;
+            m_MaxSize = vOther.m_MaxSize;
+            m_CurSize = vOther.m_CurSize;
+
+            vOther.m_pData = vOther.m_pInlineData;
+            vOther.m_MaxSize = vOther.m_InlineSize;
         }
+        else
+        {
+            VH( Reserve(vOther.m_CurSize) );
+            RelocateElements((T*)m_pData, (T*)vOther.m_pData, vOther.m_CurSize, typename std::is_trivially_copyable<T>::type());
+            m_CurSize = vOther.m_CurSize;
+        }
+
+        m_hLastError = vOther.m_hLastError;
+        vOther.m_CurSize = 0;
+        vOther.m_hLastError = S_OK;
 
 lExit:
 
 #if _DEBUG
         m_pCastData = (T*) m_pData;
+        vOther.m_pCastData = (T*) vOther.m_pData;
 #endif // _DEBUG
 
         return hr;
     }
 
+    // cleanly swaps two vectors -- useful for when you want
+    // to reallocate a vector and copy data over, then swap them back
+    HRESULT SwapVector(_Inout_ CEffectVector<T> &vOther)
+    {
+        HRESULT hr = S_OK;
+        CEffectVector<T> vTemp;
+
+        VH( vTemp.MoveFrom(vOther) );
+        VH( vOther.MoveFrom(*this) );
+        VH( MoveFrom(vTemp) );
+
+lExit:
+        return hr;
+    }
+
+    HRESULT CopyFrom(_In_ const CEffectVector<T> &vOther)
+    {
+        HRESULT hr = S_OK;
+        Clear();
+        VH( Reserve(vOther.m_CurSize) );
+
+        CopyElements((T*)m_pData, (const T*)vOther.m_pData, vOther.m_CurSize, typename std::is_trivially_copyable<T>::type());
+        m_CurSize = vOther.m_CurSize;
+        m_hLastError = vOther.m_hLastError;
+
+lExit:
+        return hr;
+    }
+
     void Clear()
     {
         Empty();
-        SAFE_DELETE_ARRAY(m_pData);
-        m_MaxSize = 0;
-#if _DEBUG
-        m_pCastData = nullptr;
-#endif // _DEBUG
+        FreeData();
     }
 
     void ClearWithoutDestructor()
     {
         m_CurSize = 0;
         m_hLastError = S_OK;
-        SAFE_DELETE_ARRAY(m_pData);
-        m_MaxSize = 0;
-
-#if _DEBUG
-        m_pCastData = nullptr;
-#endif // _DEBUG
+        FreeData();
     }
 
     void Empty()
@@ -436,14 +578,13 @@ public:
         for (size_t i=0; i<m_CurSize; i++)
             SAFE_DELETE(((T**)m_pData)[i]);
 
-        SAFE_DELETE_ARRAY(m_pData);
+        FreeData();
     }
 
     void Clear()
     {
         Empty();
-        SAFE_DELETE_ARRAY(m_pData);
-        m_MaxSize = 0;
+        FreeData();
     }
 
     void Empty()
@@ -467,6 +608,33 @@ public:
     }
 };
 
+//////////////////////////////////////////////////////////////////////////
+// CEffectInlineVector - A vector with room for InlineSize elements in the object itself,
+// for temporaries that usually stay small. It only goes to the heap when it outgrows them.
+//////////////////////////////////////////////////////////////////////////
+template<class T, uint32_t InlineSize> class CEffectInlineVector : public CEffectVector<T>
+{
+    static_assert(InlineSize > 0, "CEffectInlineVector needs room for at least one element");
+
+    typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type m_InlineStorage[InlineSize];
+
+public:
+    CEffectInlineVector<T, InlineSize>() : CEffectVector<T>((uint8_t*) m_InlineStorage, InlineSize)
+    {
+    }
+
+    CEffectInlineVector<T, InlineSize>(_Inout_ CEffectInlineVector<T, InlineSize> &&vOther) : CEffectVector<T>((uint8_t*) m_InlineStorage, InlineSize)
+    {
+        this->MoveFrom(vOther);
+    }
+
+    CEffectInlineVector<T, InlineSize>& operator=(_Inout_ CEffectInlineVector<T, InlineSize> &&vOther)
+    {
+        this->MoveFrom(vOther);
+        return *this;
+    }
+};
+
 //////////////////////////////////////////////////////////////////////////
 // Checked uint32_t, uint64_t
 // Use CheckedNumber only with uint32_t and uint64_t
@@ -557,10 +725,10 @@ typedef CheckedNumber<uint64_t, _UI64_MAX> CCheckedDword64;
 
 
 //////////////////////////////////////////////////////////////////////////
-// Data Block Store - A linked list of allocations
+// Data Block Store - An arena of geometrically growing blocks
 //////////////////////////////////////////////////////////////////////////
 
-class CDataBlock
+class CDataBlock : public CEffectAllocated
 {
 protected:
     uint32_t    m_size;
@@ -568,16 +736,15 @@ protected:
     uint8_t     *m_pData;
     CDataBlock  *m_pNext;
 
-    bool        m_IsAligned;        // Whether or not to align the data to c_DataAlignment
-
 public:
-    // AddData appends an existing use buffer to the data block
-    HRESULT AddData(_In_reads_bytes_(bufferSize) const void *pNewData, _In_ uint32_t bufferSize, _Outptr_ CDataBlock **ppBlock);
+    // Initialize reserves maxSize bytes (a multiple of c_DataAlignment); call it once, before the block is used
+    HRESULT Initialize(_In_ uint32_t maxSize);
 
-    // Allocate reserves bufferSize bytes of contiguous memory and returns a pointer to the user
-    void*   Allocate(_In_ uint32_t bufferSize, _Outptr_ CDataBlock **ppBlock);
+    // Allocate returns bufferSize bytes from the tail of the block, or nullptr if they do not fit
+    void*   Allocate(_In_ uint32_t bufferSize, _In_ bool IsAligned);
 
-    void    EnableAlignment();
+    // Reset makes the whole block available again
+    void    Reset();
 
     CDataBlock();
     ~CDataBlock();
@@ -585,20 +752,26 @@ public:
     friend class CDataBlockStore;
 };
 
+struct SDataBlockStoreStats
+{
+    uint32_t    BlockCount;
+    uint32_t    ReservedSize;       // bytes of all blocks
+    uint32_t    UsedSize;           // bytes allocated from them, alignment padding included
+    uint32_t    AllocationCount;    // since the store was created or last reset
+};
 
-class CDataBlockStore
+class CDataBlockStore : public CEffectAllocated
 {
 protected:
     CDataBlock  *m_pFirst;
-    CDataBlock  *m_pLast;
+    CDataBlock  *m_pLast;           // Allocations are made from this block; the blocks after it are empty (see Reset)
     uint32_t    m_Size;
     uint32_t    m_Offset;           // m_Offset gets added to offsets returned from AddData & AddString. Use this to set a global for the entire string block
+    uint32_t    m_cAllocations;
     bool        m_IsAligned;        // Whether or not to align the data to c_DataAlignment
 
-public:
-#if _DEBUG
-    uint32_t    m_cAllocations;
-#endif
+    // Makes m_pLast a block with at least bufferSize free bytes
+    HRESULT AdvanceBlock(_In_ uint32_t bufferSize);
 
 public:
     HRESULT AddString(_In_z_ LPCSTR pString, _Inout_ uint32_t *pOffset);
@@ -612,13 +785,17 @@ public:
     uint32_t GetSize();
     void    EnableAlignment();
 
+    // Reset discards all allocations but keeps the blocks, so the store can be filled again without allocating
+    void    Reset();
+    void    GetStats(_Out_ SDataBlockStoreStats *pStats);
+
     CDataBlockStore();
     ~CDataBlockStore();
 };
 
 // Custom allocator that uses CDataBlockStore
 // The trick is that we never free, so we don't have to keep as much state around
-// Use PRIVATENEW in CEffectLoader
+// Used for the type and string pools of an effect
 
 static void* __cdecl operator new(_In_ size_t s, _In_ CDataBlockStore &pAllocator)
 {
@@ -756,6 +933,21 @@ static uint32_t ComputeHash(_In_z_ LPCSTR pString)
     return ComputeHash(reinterpret_cast<const uint8_t*>(pString), (uint32_t)strlen(pString));
 }
 
+// 64-bit FNV-1a, for identities that must not collide in practice (see SBaseBlock::IdentityHash).
+// Pass the result of a previous call as Hash to hash several blocks of data as one.
+static const uint64_t c_Hash64Basis = 14695981039346656037ULL;
+
+static uint64_t ComputeHash64(_In_reads_bytes_(cbToHash) const uint8_t *pb, _In_ uint32_t cbToHash, _In_ uint64_t Hash = c_Hash64Basis)
+{
+    for (uint32_t i = 0; i < cbToHash; ++ i)
+    {
+        Hash ^= pb[i];
+        Hash *= 1099511628211ULL;
+    }
+
+    return Hash;
+}
+
 
 // 1) these numbers are prime
 // 2) each is slightly less than double the last
@@ -795,7 +987,7 @@ static const uint32_t c_PrimeSizes[] =
 };
 
 template<typename T, bool (*pfnIsEqual)(const T &Data1, const T &Data2)>
-class CEffectHashTable
+class CEffectHashTable : public CEffectAllocated
 {
 protected:
 
@@ -851,7 +1043,7 @@ public:
         Cleanup();
 
         actualSize = pOther->m_NumHashSlots;
-        VN( rgpNewHashEntries = new SHashEntry*[actualSize] );
+        VN( rgpNewHashEntries = (SHashEntry**) AllocateEffectMemory(sizeof(SHashEntry*) * actualSize) );
 
         ZeroMemory(rgpNewHashEntries, sizeof(SHashEntry*) * actualSize);
 
@@ -870,7 +1062,7 @@ public:
 
             // seize this hash entry, migrate it to the new table
             SHashEntry *pNewEntry;
-            VN( pNewEntry = new SHashEntry );
+            VN( pNewEntry = (SHashEntry*) AllocateEffectMemory(sizeof(SHashEntry)) );
             
             pNewEntry->pNext = rgpNewHashEntries[index];
             pNewEntry->Data = iter.pHashEntry->Data;
@@ -890,7 +1082,7 @@ public:
         rgpNewHashEntries = nullptr;
 
 lExit:
-        SAFE_DELETE_ARRAY( rgpNewHashEntries );
+        FreeEffectMemory( rgpNewHashEntries );
         return hr;
     }
 
@@ -899,7 +1091,8 @@ protected:
     {
         if (m_bOwnHashEntryArray)
         {
-            SAFE_DELETE_ARRAY(m_rgpHashEntries);
+            FreeEffectMemory(m_rgpHashEntries);
+            m_rgpHashEntries = nullptr;
             m_bOwnHashEntryArray = false;
         }
     }
@@ -914,7 +1107,7 @@ public:
             while (nullptr != pCurrentEntry)
             {
                 pTempEntry = pCurrentEntry->pNext;
-                SAFE_DELETE(pCurrentEntry);
+                FreeEffectMemory(pCurrentEntry);
                 pCurrentEntry = pTempEntry;
                 -- m_NumEntries;
             }
@@ -946,6 +1139,7 @@ public:
     // O(n) function
     // Grows to the next suitable size (based off of the prime number table)
     // DesiredSize is merely a suggestion
+    // An owned ProvidedArray must have been allocated with AllocateEffectMemory
     HRESULT Grow(_In_ uint32_t DesiredSize,
                  _In_ uint32_t ProvidedArraySize = 0,
                  _In_reads_opt_(ProvidedArraySize) void** ProvidedArray = nullptr,
@@ -969,7 +1163,7 @@ public:
         {
             OwnProvidedArray = true;
             
-            VN( rgpNewHashEntries = new SHashEntry*[actualSize] );
+            VN( rgpNewHashEntries = (SHashEntry**) AllocateEffectMemory(sizeof(SHashEntry*) * actualSize) );
         }
         
         ZeroMemory(rgpNewHashEntries, sizeof(SHashEntry*) * actualSize);
@@ -1129,7 +1323,7 @@ lExit:
         SHashEntry *pHashEntry;
         uint32_t index = Hash % m_NumHashSlots;
 
-        VN( pHashEntry = new SHashEntry );
+        VN( pHashEntry = (SHashEntry*) AllocateEffectMemory(sizeof(SHashEntry)) );
         pHashEntry->pNext = m_rgpHashEntries[index];
         pHashEntry->Data = Data;
         pHashEntry->Hash = Hash;
@@ -1209,7 +1403,7 @@ lExit:
             {
                 *ppPrev = pTemp->pNext;
                 pIterator->ppHashSlot = ppEnd;
-                delete pTemp;
+                FreeEffectMemory(pTemp);
                 return;
             }
             ppPrev = &pTemp->pNext;
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <new>
 
 namespace D3DX11Core
 {
@@ -127,134 +128,156 @@ HRESULT CMemoryStream::Seek(_In_ size_t offset)
 
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Effect memory
+//////////////////////////////////////////////////////////////////////////
+
+// Precedes every allocation, so that it can be returned to its allocator
+struct SEffectAllocationHeader
+{
+    ID3DX11EffectAllocator  *pAllocator;
+    SIZE_T                  Size;           // as passed to Allocate, header included
+};
+
+static_assert( sizeof(SEffectAllocationHeader) % MEMORY_ALLOCATION_ALIGNMENT == 0, "Effect allocations must stay aligned" );
+
+// Used outside of any scope, and by effects created without an allocator
+class CDefaultEffectAllocator : public ID3DX11EffectAllocator
+{
+public:
+    STDMETHOD_(void*, Allocate)(_In_ SIZE_T Size) override
+    {
+        return new (std::nothrow) uint8_t[Size];
+    }
+
+    STDMETHOD_(void, Free)(_In_ void *pData, _In_ SIZE_T Size) override
+    {
+        UNREFERENCED_PARAMETER(Size);
+        delete [] (uint8_t*) pData;
+    }
+};
+
+static CDefaultEffectAllocator s_DefaultAllocator;
+static __declspec(thread) ID3DX11EffectAllocator *s_pScopeAllocator = nullptr;
+
+void* AllocateEffectMemory(_In_ size_t Size)
+{
+    ID3DX11EffectAllocator *pAllocator = (nullptr != s_pScopeAllocator) ? s_pScopeAllocator : &s_DefaultAllocator;
+    SEffectAllocationHeader *pHeader;
+
+    if (Size > SIZE_MAX - sizeof(SEffectAllocationHeader))
+        return nullptr;
+
+    Size += sizeof(SEffectAllocationHeader);
+    pHeader = (SEffectAllocationHeader*) pAllocator->Allocate(Size);
+    if (nullptr == pHeader)
+        return nullptr;
+
+    assert(pHeader == AlignToPowerOf2(pHeader, MEMORY_ALLOCATION_ALIGNMENT));
+
+    pHeader->pAllocator = pAllocator;
+    pHeader->Size = Size;
+    return pHeader + 1;
+}
+
+void FreeEffectMemory(_In_opt_ void *pData)
+{
+    if (nullptr == pData)
+        return;
+
+    SEffectAllocationHeader *pHeader = (SEffectAllocationHeader*) pData - 1;
+    pHeader->pAllocator->Free(pHeader, pHeader->Size);
+}
+
+CEffectAllocatorScope::CEffectAllocatorScope(_In_opt_ ID3DX11EffectAllocator *pAllocator)
+{
+    m_pPrevious = s_pScopeAllocator;
+    s_pScopeAllocator = pAllocator;
+}
+
+CEffectAllocatorScope::~CEffectAllocatorScope()
+{
+    s_pScopeAllocator = m_pPrevious;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // CDataBlock - used to dynamically build up the effect file in memory
 //////////////////////////////////////////////////////////////////////////
 
+// Blocks double in size from c_DataBlockInitialSize up to c_DataBlockMaxSize; an allocation
+// larger than that gets a block of its own size
+static const uint32_t c_DataBlockInitialSize = 8192;
+static const uint32_t c_DataBlockMaxSize = 1024 * 1024;
+
+#ifdef _DEBUG
+// Unallocated bytes of the blocks are filled with this, to catch reads of uninitialized data
+static const int c_DataBlockFill = 0xDD;
+#endif
+
 CDataBlock::CDataBlock() :
     m_size(0),
     m_maxSize(0),
     m_pData(nullptr),
-    m_pNext(nullptr),
-    m_IsAligned(false)
+    m_pNext(nullptr)
 {
 }
 
 CDataBlock::~CDataBlock()
 {
-    SAFE_DELETE_ARRAY(m_pData);
+    FreeEffectMemory(m_pData);
     SAFE_DELETE(m_pNext);
 }
 
-void CDataBlock::EnableAlignment()
-{
-    m_IsAligned = true;
-}
-
-_Use_decl_annotations_
-HRESULT CDataBlock::AddData(const void *pvNewData, uint32_t bufferSize, CDataBlock **ppBlock)
+HRESULT CDataBlock::Initialize(_In_ uint32_t maxSize)
 {
     HRESULT hr = S_OK;
-    uint32_t bytesToCopy;
-    const uint8_t *pNewData = (const uint8_t*) pvNewData;
 
-    if (m_maxSize == 0)
-    {
-        // This is a brand new DataBlock, fill it up
-        m_maxSize = std::max<uint32_t>(8192, bufferSize);
-
-        VN( m_pData = new uint8_t[m_maxSize] );
-    }
+    assert(nullptr == m_pData);
+    assert(maxSize == AlignToPowerOf2(maxSize, c_DataAlignment));
 
-    assert(m_pData == AlignToPowerOf2(m_pData, c_DataAlignment));
+    VN( m_pData = (uint8_t*) AllocateEffectMemory(maxSize) );
+    m_maxSize = maxSize;
 
-    bytesToCopy = std::min(m_maxSize - m_size, bufferSize);
-    memcpy(m_pData + m_size, pNewData, bytesToCopy);
-    pNewData += bytesToCopy;
-    
-    if (m_IsAligned)
-    {
-        assert(m_size == AlignToPowerOf2(m_size, c_DataAlignment));
-        m_size += AlignToPowerOf2(bytesToCopy, c_DataAlignment);
-    }
-    else
-    {
-        m_size += bytesToCopy;
-    }
-    
-    bufferSize -= bytesToCopy;
-    *ppBlock = this;
-
-    if (bufferSize != 0)
-    {
-        assert(nullptr == m_pNext); // make sure we're not overwriting anything
-
-        // Couldn't fit all data into this block, spill over into next
-        VN( m_pNext = new CDataBlock() );
-        if (m_IsAligned)
-        {
-            m_pNext->EnableAlignment();
-        }
-        VH( m_pNext->AddData(pNewData, bufferSize, ppBlock) );
-    }
+#ifdef _DEBUG
+    memset(m_pData, c_DataBlockFill, m_maxSize);
+#endif
 
 lExit:
     return hr;
 }
 
-_Use_decl_annotations_
-void* CDataBlock::Allocate(uint32_t bufferSize, CDataBlock **ppBlock)
+void* CDataBlock::Allocate(_In_ uint32_t bufferSize, _In_ bool IsAligned)
 {
     void *pRetValue;
-    uint32_t temp = m_size + bufferSize;
 
-    if (temp < m_size)
+    if (bufferSize > m_maxSize - m_size)
         return nullptr;
 
-    *ppBlock = this;
-
-    if (m_maxSize == 0)
-    {
-        // This is a brand new DataBlock, fill it up
-        m_maxSize = std::max<uint32_t>(8192, bufferSize);
-
-        m_pData = new uint8_t[m_maxSize];
-        if (!m_pData)
-            return nullptr;
-        memset(m_pData, 0xDD, m_maxSize);
-    }
-    else if (temp > m_maxSize)
-    {
-        assert(nullptr == m_pNext); // make sure we're not overwriting anything
-
-        // Couldn't fit data into this block, spill over into next
-        m_pNext = new CDataBlock();
-        if (!m_pNext)
-            return nullptr;
-        if (m_IsAligned)
-        {
-            m_pNext->EnableAlignment();
-        }
-
-        return m_pNext->Allocate(bufferSize, ppBlock);
-    }
-
     assert(m_pData == AlignToPowerOf2(m_pData, c_DataAlignment));
 
     pRetValue = m_pData + m_size;
-    if (m_IsAligned)
+    if (IsAligned)
     {
+        // m_maxSize is aligned, so the padding always fits
         assert(m_size == AlignToPowerOf2(m_size, c_DataAlignment));
-        m_size = AlignToPowerOf2(temp, c_DataAlignment);
+        m_size = AlignToPowerOf2(m_size + bufferSize, c_DataAlignment);
     }
     else
     {
-        m_size = temp;
+        m_size += bufferSize;
     }
 
     return pRetValue;
 }
 
+void CDataBlock::Reset()
+{
+#ifdef _DEBUG
+    memset(m_pData, c_DataBlockFill, m_size);
+#endif
+    m_size = 0;
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -263,11 +286,9 @@ CDataBlockStore::CDataBlockStore() :
     m_pLast(nullptr),
     m_Size(0),
     m_Offset(0),
+    m_cAllocations(0),
     m_IsAligned(false)
 {
-#if _DEBUG
-    m_cAllocations = 0;
-#endif
 }
 
 CDataBlockStore::~CDataBlockStore()
@@ -290,6 +311,48 @@ void CDataBlockStore::EnableAlignment()
     m_IsAligned = true;
 }
 
+_Use_decl_annotations_
+HRESULT CDataBlockStore::AdvanceBlock(uint32_t bufferSize)
+{
+    HRESULT hr = S_OK;
+    CDataBlock *pBlock = nullptr;
+    uint32_t blockSize;
+
+    // Blocks emptied by Reset are reused when the allocation fits
+    if (nullptr != m_pLast && nullptr != m_pLast->m_pNext && bufferSize <= m_pLast->m_pNext->m_maxSize)
+    {
+        m_pLast = m_pLast->m_pNext;
+        goto lExit;
+    }
+
+    blockSize = c_DataBlockInitialSize;
+    if (nullptr != m_pLast)
+    {
+        blockSize = std::min(m_pLast->m_maxSize, c_DataBlockMaxSize / 2) * 2;
+    }
+    blockSize = std::max(blockSize, AlignToPowerOf2(bufferSize, c_DataAlignment));
+
+    VN( pBlock = new CDataBlock() );
+    VH( pBlock->Initialize(blockSize) );
+
+    // The new block goes right after m_pLast, ahead of any empty block too small for this allocation
+    if (nullptr == m_pLast)
+    {
+        m_pFirst = pBlock;
+    }
+    else
+    {
+        pBlock->m_pNext = m_pLast->m_pNext;
+        m_pLast->m_pNext = pBlock;
+    }
+    m_pLast = pBlock;
+    pBlock = nullptr;
+
+lExit:
+    SAFE_DELETE(pBlock);
+    return hr;
+}
+
 _Use_decl_annotations_
 HRESULT CDataBlockStore::AddString(LPCSTR pString, uint32_t *pOffset)
 {
@@ -302,6 +365,7 @@ _Use_decl_annotations_
 HRESULT CDataBlockStore::AddData(const void *pNewData, uint32_t bufferSize, uint32_t *pCurOffset)
 {
     HRESULT hr = S_OK;
+    void *pData;
 
     if (bufferSize == 0)
     {        
@@ -312,57 +376,73 @@ HRESULT CDataBlockStore::AddData(const void *pNewData, uint32_t bufferSize, uint
         goto lExit;
     }
 
-    if (!m_pFirst)
-    {
-        VN( m_pFirst = new CDataBlock() );
-        if (m_IsAligned)
-        {
-            m_pFirst->EnableAlignment();
-        }
-        m_pLast = m_pFirst;
-    }
-
     if (pCurOffset)
         *pCurOffset = m_Size + m_Offset;
 
-    VH( m_pLast->AddData(pNewData, bufferSize, &m_pLast) );
-    m_Size += bufferSize;
+    VN( pData = Allocate(bufferSize) );
+    memcpy(pData, pNewData, bufferSize);
 
 lExit:
     return hr;
 }
 
+// O(1): allocations are made from the tail of the last block, and only when it is full
+// does the store move on to a new block
 void* CDataBlockStore::Allocate(_In_ uint32_t bufferSize)
 {
     void *pRetValue = nullptr;
+    uint32_t newSize;
 
-#if _DEBUG
-    m_cAllocations++;
-#endif
+    if (bufferSize > UINT_MAX - c_DataAlignment || FAILED(UIntAdd(m_Size, bufferSize, &newSize)))
+        return nullptr;
+
+    if (nullptr != m_pLast)
+    {
+        pRetValue = m_pLast->Allocate(bufferSize, m_IsAligned);
+    }
 
-    if (!m_pFirst)
+    if (nullptr == pRetValue)
     {
-        m_pFirst = new CDataBlock();
-        if (!m_pFirst)
+        if (FAILED(AdvanceBlock(bufferSize)))
             return nullptr;
 
-        if (m_IsAligned)
-        {
-            m_pFirst->EnableAlignment();
-        }
-        m_pLast = m_pFirst;
+        pRetValue = m_pLast->Allocate(bufferSize, m_IsAligned);
+        assert(nullptr != pRetValue);
     }
 
-    if (FAILED(UIntAdd(m_Size, bufferSize, &m_Size)))
-        return nullptr;
-
-    pRetValue = m_pLast->Allocate(bufferSize, &m_pLast);
-    if (!pRetValue)
-        return nullptr;
+    m_Size = newSize;
+    ++ m_cAllocations;
 
     return pRetValue;
 }
 
+void CDataBlockStore::Reset()
+{
+    for (CDataBlock *pBlock = m_pFirst; nullptr != pBlock; pBlock = pBlock->m_pNext)
+    {
+        pBlock->Reset();
+    }
+
+    m_pLast = m_pFirst;
+    m_Size = 0;
+    m_cAllocations = 0;
+}
+
+_Use_decl_annotations_
+void CDataBlockStore::GetStats(SDataBlockStoreStats *pStats)
+{
+    ZeroMemory(pStats, sizeof(*pStats));
+
+    for (CDataBlock *pBlock = m_pFirst; nullptr != pBlock; pBlock = pBlock->m_pNext)
+    {
+        ++ pStats->BlockCount;
+        pStats->ReservedSize += pBlock->m_maxSize;
+        pStats->UsedSize += pBlock->m_size;
+    }
+
+    pStats->AllocationCount = m_cAllocations;
+}
+
 uint32_t CDataBlockStore::GetSize()
 {
     return m_Size;
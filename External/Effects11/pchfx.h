@@ -22,12 +22,13 @@
 #endif
 
 #include <algorithm>
-#include <d3d11.h>
+#include <d3d11_1.h>
 
 #undef DEFINE_GUID
 #include "INITGUID.h"
 
 #include "d3dx11effect.h"
+#include "d3dx11effectex.h"
 
 #define UNUSED -1
 
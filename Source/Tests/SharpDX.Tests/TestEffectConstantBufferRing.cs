@@ -0,0 +1,128 @@
+﻿// Copyright (c) 2010-2014 SharpDX - Alexandre Mutel
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+using System;
+using System.Runtime.InteropServices;
+
+using NUnit.Framework;
+
+using SharpDX.D3DCompiler;
+using SharpDX.Direct3D;
+using SharpDX.Direct3D11;
+
+using Buffer = SharpDX.Direct3D11.Buffer;
+
+namespace SharpDX.Tests
+{
+    /// <summary>
+    /// Tests the constant buffer ring of Effects11 (D3DX11EffectSetConstantBufferRing)
+    /// </summary>
+    [TestFixture]
+    [Description("Tests the Effects11 constant buffer ring")]
+    public class TestEffectConstantBufferRing
+    {
+        // Both cbuffers are bound by the same dependency, one from the ring and one from the
+        // application's buffer, which is smaller than the 16 constants a ring range spans
+        private const string EffectSource = @"
+cbuffer RingConstants : register(b0) { float4 RingValue; };
+cbuffer UserConstants : register(b1) { float4 UserValue; };
+RWStructuredBuffer<float4> Output : register(u0);
+
+[numthreads(1, 1, 1)]
+void CS()
+{
+    Output[0] = RingValue;
+    Output[1] = UserValue;
+}
+
+technique11 T { pass P { SetComputeShader(CompileShader(cs_5_0, CS())); } }";
+
+        [Test]
+        public void TestRingAndUserBufferInSameDependency()
+        {
+            var ringValue = new Vector4(1, 2, 3, 4);
+            var userValue = new Vector4(5, 6, 7, 8);
+
+            using (var device = new Device(DriverType.Warp))
+            using (var bytecode = ShaderBytecode.Compile(EffectSource, "fx_5_0").Bytecode)
+            using (var effect = new Effect(device, bytecode))
+            using (var userBuffer = Buffer.Create(device, BindFlags.ConstantBuffer, ref userValue))
+            using (var output = new Buffer(device, new BufferDescription(32, ResourceUsage.Default, BindFlags.UnorderedAccess, CpuAccessFlags.None, ResourceOptionFlags.BufferStructured, 16)))
+            using (var staging = new Buffer(device, new BufferDescription(32, ResourceUsage.Staging, BindFlags.None, CpuAccessFlags.Read, ResourceOptionFlags.BufferStructured, 16)))
+            using (var outputView = new UnorderedAccessView(device, output))
+            {
+                IntPtr ring;
+                var result = CreateConstantBufferRing(device.NativePointer, 64 * 1024, out ring);
+                result.CheckError();
+                if (ring == IntPtr.Zero)
+                {
+                    Assert.Ignore("The device does not support constant buffer offsetting");
+                }
+
+                // The effect holds its own reference on the ring
+                result = SetConstantBufferRing(effect.NativePointer, ring);
+                Marshal.Release(ring);
+                result.CheckError();
+
+                effect.GetVariableByName("RingValue").AsVector().Set(ringValue);
+                effect.GetConstantBufferByName("UserConstants").ConstantBuffer = userBuffer;
+                effect.GetVariableByName("Output").AsUnorderedAccessView().Set(outputView);
+
+                var context = device.ImmediateContext;
+                effect.GetTechniqueByIndex(0).GetPassByIndex(0).Apply(context);
+                context.Dispatch(1, 1, 1);
+                context.CopyResource(output, staging);
+
+                var box = context.MapSubresource(staging, 0, MapMode.Read, MapFlags.None);
+                try
+                {
+                    Assert.AreEqual(ringValue, Utilities.Read<Vector4>(box.DataPointer));
+                    Assert.AreEqual(userValue, Utilities.Read<Vector4>(box.DataPointer + 16));
+                }
+                finally
+                {
+                    context.UnmapSubresource(staging, 0);
+                }
+            }
+        }
+
+        private static Result CreateConstantBufferRing(IntPtr device, int ringSize, out IntPtr ring)
+        {
+            return IntPtr.Size == 4 ? D3DX11CreateConstantBufferRing_x86(device, ringSize, out ring) : D3DX11CreateConstantBufferRing_x64(device, ringSize, out ring);
+        }
+
+        private static Result SetConstantBufferRing(IntPtr effect, IntPtr ring)
+        {
+            return IntPtr.Size == 4 ? D3DX11EffectSetConstantBufferRing_x86(effect, ring) : D3DX11EffectSetConstantBufferRing_x64(effect, ring);
+        }
+
+        [DllImport("sharpdx_direct3d11_1_effects_x86.dll", EntryPoint = "D3DX11CreateConstantBufferRing")]
+        private static extern Result D3DX11CreateConstantBufferRing_x86(IntPtr device, int ringSize, out IntPtr ring);
+
+        [DllImport("sharpdx_direct3d11_1_effects_x64.dll", EntryPoint = "D3DX11CreateConstantBufferRing")]
+        private static extern Result D3DX11CreateConstantBufferRing_x64(IntPtr device, int ringSize, out IntPtr ring);
+
+        [DllImport("sharpdx_direct3d11_1_effects_x86.dll", EntryPoint = "D3DX11EffectSetConstantBufferRing")]
+        private static extern Result D3DX11EffectSetConstantBufferRing_x86(IntPtr effect, IntPtr ring);
+
+        [DllImport("sharpdx_direct3d11_1_effects_x64.dll", EntryPoint = "D3DX11EffectSetConstantBufferRing")]
+        private static extern Result D3DX11EffectSetConstantBufferRing_x64(IntPtr effect, IntPtr ring);
+    }
+}